@@ -0,0 +1,74 @@
+# Copyright (c) Facebook, Inc. and its affiliates.
+#
+# This source code is licensed under the MIT license found in the
+# LICENSE file in the root directory of this source tree.
+
+"""
+Compares the speed of the PQ4 fast-scan search with the AVX2 and the AVX-512
+versions of the kernels. Faiss should be compiled with
+-DFAISS_OPT_LEVEL=avx512, so that both the AVX2 and the AVX-512 libraries
+are available. Each measurement is done in a subprocess where the AVX-512
+library is disabled or not (see loader.py).
+"""
+
+import os
+import subprocess
+import sys
+import time
+
+
+def run_bench():
+    import faiss
+
+    try:
+        from faiss.contrib.datasets_fb import DatasetSIFT1M
+    except ImportError:
+        from faiss.contrib.datasets import DatasetSIFT1M
+
+    ds = DatasetSIFT1M()
+    xq = ds.get_queries()
+    xb = ds.get_database()
+    xt = ds.get_train()
+    gt = ds.get_groundtruth()
+    nq, d = xq.shape
+    k = 10
+
+    simd = "AVX512" if faiss.loader.has_AVX512 else (
+        "AVX2" if faiss.loader.has_AVX2 else "generic")
+    print(f"======== loaded faiss with {simd}")
+
+    for key in "IVF1024,PQ32x4fs", "IVF1024,PQ64x4fs", "PQ32x4fs":
+        index_path = f"/tmp/{key}.faissindex"
+        if os.path.exists(index_path):
+            index = faiss.read_index(index_path)
+        else:
+            index = faiss.index_factory(d, key)
+            index.train(xt)
+            index.add(xb)
+            faiss.write_index(index, index_path)
+
+        nprobes = [1, 4, 16, 64] if key.startswith("IVF") else [0]
+        for nprobe in nprobes:
+            if nprobe > 0:
+                index.nprobe = nprobe
+            for nt in 1, faiss.omp_get_max_threads():
+                faiss.omp_set_num_threads(nt)
+                # warmup
+                index.search(xq[:100], k)
+                t0 = time.time()
+                D, I = index.search(xq, k)
+                t = time.time() - t0
+                recall = (I[:, :1] == gt[:, :1]).sum() / nq
+                print(
+                    f"{simd}\t{key}\tnprobe={nprobe:3d}\tnt={nt:2d}\t"
+                    f"R@1={recall:.4f}\t{t * 1000 / nq:.4f} ms/query"
+                )
+
+
+if len(sys.argv) > 1 and sys.argv[1] == "run":
+    run_bench()
+else:
+    for disabled in "AVX512_SKX", "":
+        env = dict(os.environ)
+        env["FAISS_DISABLE_CPU_FEATURES"] = disabled
+        subprocess.run([sys.executable, __file__, "run"], env=env, check=True)
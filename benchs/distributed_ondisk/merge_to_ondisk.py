@@ -81,7 +81,14 @@ if __name__ == '__main__':
 
     print("perform merge")
 
-    ntotal = il.merge_from(ils.data(), ils.size(), True)
+    # merge_from_files reads the inputs from their files, it needs
+    # OnDiskInvertedLists
+    if all(isinstance(faiss.downcast_InvertedLists(ils.at(i)),
+                      faiss.OnDiskInvertedLists)
+           for i in range(ils.size())):
+        ntotal = il.merge_from_files(ils.data(), ils.size(), 1 << 26, True)
+    else:
+        ntotal = il.merge_from(ils.data(), ils.size(), True)
 
     print("swap into index0")
 
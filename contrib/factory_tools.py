@@ -54,7 +54,7 @@ def get_code_size(d, indexkey):
         return (d + 1) // 2
     elif indexkey == 'SQ6':
         return (d * 6 + 7) // 8
-    elif indexkey == 'SQfp16':
+    elif indexkey == 'SQfp16' or indexkey == 'SQbf16':
         return d * 2
 
     mo = re.match('PCAR?(\\d+),(.*)$', indexkey)
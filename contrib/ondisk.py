@@ -51,7 +51,17 @@ def merge_ondisk(
         ivf_vector.push_back(ivf)
 
     LOG.info("merge %d inverted lists " % ivf_vector.size())
-    ntotal = invlists.merge_from(ivf_vector.data(), ivf_vector.size())
+    # the shards are read from their files with large sequential reads if
+    # they are all on-disk inverted lists
+    if all(
+        isinstance(faiss.downcast_InvertedLists(ivf), faiss.OnDiskInvertedLists)
+        for ivf in ivfs
+    ):
+        ntotal = invlists.merge_from_files(
+            ivf_vector.data(), ivf_vector.size()
+        )
+    else:
+        ntotal = invlists.merge_from(ivf_vector.data(), ivf_vector.size())
 
     # now replace the inverted lists in the output index
     index.ntotal = index_ivf.ntotal = ntotal
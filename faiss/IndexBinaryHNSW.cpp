@@ -205,6 +205,7 @@ void IndexBinaryHNSW::search(
     {
         VisitedTable vt(ntotal);
         std::unique_ptr<DistanceComputer> dis(get_distance_computer());
+        HNSWStats thread_stats;
 
 #pragma omp for
         for (idx_t i = 0; i < n; i++) {
@@ -214,7 +215,7 @@ void IndexBinaryHNSW::search(
             dis->set_query((float*)(x + i * code_size));
 
             maxheap_heapify(k, simi, idxi);
-            hnsw.search(*dis, k, idxi, simi, vt);
+            hnsw.search(*dis, k, idxi, simi, vt, thread_stats);
             maxheap_reorder(k, simi, idxi);
         }
     }
@@ -60,6 +60,17 @@ size_t IndexFlatCodes::remove_ids(const IDSelector& sel) {
     return nremove;
 }
 
+void IndexFlatCodes::permute_entries(const idx_t* perm) {
+    std::vector<uint8_t> new_codes(codes.size());
+    for (idx_t i = 0; i < ntotal; i++) {
+        FAISS_THROW_IF_NOT(perm[i] >= 0 && perm[i] < ntotal);
+        memcpy(new_codes.data() + i * code_size,
+               codes.data() + perm[i] * code_size,
+               code_size);
+    }
+    codes = std::move(new_codes);
+}
+
 void IndexFlatCodes::reconstruct_n(idx_t i0, idx_t ni, float* recons) const {
     FAISS_THROW_IF_NOT(ni == 0 || (i0 >= 0 && i0 + ni <= ntotal));
     sa_decode(ni, codes.data() + i0 * code_size, recons);
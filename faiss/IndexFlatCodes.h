@@ -11,6 +11,7 @@
 
 #include <faiss/Index.h>
 #include <faiss/impl/DistanceComputer.h>
+#include <faiss/impl/maybe_owned_vector.h>
 #include <vector>
 
 namespace faiss {
@@ -21,7 +22,7 @@ struct IndexFlatCodes : Index {
     size_t code_size;
 
     /// encoded dataset, size ntotal * code_size
-    std::vector<uint8_t> codes;
+    MaybeOwnedVector<uint8_t> codes;
 
     IndexFlatCodes();
 
@@ -53,6 +54,10 @@ struct IndexFlatCodes : Index {
 
     void check_compatible_for_merge(const Index& otherIndex) const override;
 
+    /** permute the stored codes: the new code i is the former code perm[i].
+     * perm should be a permutation of [0, ntotal) */
+    void permute_entries(const idx_t* perm);
+
     virtual void merge_from(Index& otherIndex, idx_t add_id = 0) override;
 };
 
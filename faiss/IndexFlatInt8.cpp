@@ -0,0 +1,147 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/IndexFlatInt8.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/distances.h>
+
+namespace faiss {
+
+IndexFlatInt8::IndexFlatInt8(idx_t d, MetricType metric, bool is_signed)
+        : IndexFlatCodes(d, d, metric), is_signed(is_signed) {
+    FAISS_THROW_IF_NOT_MSG(
+            metric == METRIC_L2 || metric == METRIC_INNER_PRODUCT,
+            "IndexFlatInt8 supports only L2 and inner product");
+    // the int32 accumulators of the kernels overflow above
+    FAISS_THROW_IF_NOT_MSG(d < 32768, "IndexFlatInt8 requires d < 32768");
+}
+
+IndexFlatInt8::IndexFlatInt8() : is_signed(true) {}
+
+void IndexFlatInt8::add_int8(idx_t n, const uint8_t* x) {
+    if (n == 0) {
+        return;
+    }
+    codes.resize((ntotal + n) * code_size);
+    memcpy(codes.data() + ntotal * code_size, x, n * code_size);
+    ntotal += n;
+}
+
+void IndexFlatInt8::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    std::vector<uint8_t> xq(n * code_size);
+    sa_encode(n, x, xq.data());
+    search_int8(n, xq.data(), k, distances, labels, params);
+}
+
+void IndexFlatInt8::search_int8(
+        idx_t n,
+        const uint8_t* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    IDSelector* sel = params ? params->sel : nullptr;
+    FAISS_THROW_IF_NOT(k > 0);
+    knn_int8(
+            x,
+            codes.data(),
+            d,
+            n,
+            ntotal,
+            is_signed,
+            metric_type == METRIC_INNER_PRODUCT,
+            k,
+            distances,
+            labels,
+            sel);
+}
+
+namespace {
+
+struct FlatInt8Dis : FlatCodesDistanceComputer {
+    const IndexFlatInt8& storage;
+    size_t d;
+    bool is_inner_product;
+    std::vector<uint8_t> q;
+
+    explicit FlatInt8Dis(const IndexFlatInt8& storage)
+            : FlatCodesDistanceComputer(
+                      storage.codes.data(),
+                      storage.code_size),
+              storage(storage),
+              d(storage.d),
+              is_inner_product(storage.metric_type == METRIC_INNER_PRODUCT),
+              q(storage.d) {}
+
+    float distance(const uint8_t* x, const uint8_t* y) const {
+        int32_t dis;
+        if (storage.is_signed) {
+            int8_distances_block(
+                    (const int8_t*)x,
+                    (const int8_t*)y,
+                    d,
+                    1,
+                    1,
+                    is_inner_product,
+                    &dis);
+        } else {
+            uint8_distances_block(x, y, d, 1, 1, is_inner_product, &dis);
+        }
+        return dis;
+    }
+
+    float distance_to_code(const uint8_t* code) final {
+        return distance(q.data(), code);
+    }
+
+    float symmetric_dis(idx_t i, idx_t j) override {
+        return distance(codes + i * code_size, codes + j * code_size);
+    }
+
+    void set_query(const float* x) override {
+        storage.sa_encode(1, x, q.data());
+    }
+};
+
+} // namespace
+
+FlatCodesDistanceComputer* IndexFlatInt8::get_FlatCodesDistanceComputer()
+        const {
+    return new FlatInt8Dis(*this);
+}
+
+void IndexFlatInt8::sa_encode(idx_t n, const float* x, uint8_t* bytes)
+        const {
+    float vmin = is_signed ? -128 : 0, vmax = is_signed ? 127 : 255;
+    for (size_t i = 0; i < n * d; i++) {
+        float v = std::min(std::max(std::nearbyint(x[i]), vmin), vmax);
+        bytes[i] = is_signed ? uint8_t(int8_t(v)) : uint8_t(v);
+    }
+}
+
+void IndexFlatInt8::sa_decode(idx_t n, const uint8_t* bytes, float* x)
+        const {
+    for (size_t i = 0; i < n * d; i++) {
+        x[i] = is_signed ? float(int8_t(bytes[i])) : float(bytes[i]);
+    }
+}
+
+} // namespace faiss
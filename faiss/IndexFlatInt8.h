@@ -0,0 +1,69 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#pragma once
+
+#include <faiss/IndexFlatCodes.h>
+
+namespace faiss {
+
+/** Index that stores int8 (or uint8) vectors, one byte per component, and
+ * performs exhaustive search with integer distance computations.
+ *
+ * The float interface (add, search, reconstruct) rounds and clamps the
+ * components to the int8 range, so the vectors should already be integers
+ * for the search to be exact. The *_int8 functions take the bytes
+ * directly. The distances are exact as long as they fit in the mantissa of
+ * the float output. d must be below 32768, so that they fit in an int32.
+ */
+struct IndexFlatInt8 : IndexFlatCodes {
+    /// the components are int8 in [-128, 127], otherwise uint8 in [0, 255]
+    bool is_signed;
+
+    explicit IndexFlatInt8(
+            idx_t d,
+            MetricType metric = METRIC_L2,
+            bool is_signed = true);
+
+    IndexFlatInt8();
+
+    /// add n vectors of d bytes
+    void add_int8(idx_t n, const uint8_t* x);
+
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    /** search with n query vectors of d bytes
+     *
+     * @param x          query vectors, size n * d bytes
+     * @param distances  output distances, size n * k
+     * @param labels     output labels, size n * k
+     */
+    void search_int8(
+            idx_t n,
+            const uint8_t* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const;
+
+    FlatCodesDistanceComputer* get_FlatCodesDistanceComputer() const override;
+
+    /// rounds and clamps the components
+    void sa_encode(idx_t n, const float* x, uint8_t* bytes) const override;
+
+    void sa_decode(idx_t n, const uint8_t* bytes, float* x) const override;
+};
+
+} // namespace faiss
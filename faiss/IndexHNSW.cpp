@@ -17,6 +17,7 @@
 #include <cstdlib>
 #include <cstring>
 
+#include <algorithm>
 #include <queue>
 #include <unordered_set>
 
@@ -29,6 +30,7 @@
 #include <faiss/IndexIVFPQ.h>
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/IDSelector.h>
 #include <faiss/utils/Heap.h>
 #include <faiss/utils/distances.h>
 #include <faiss/utils/random.h>
@@ -87,6 +89,23 @@ struct NegativeDistanceComputer : DistanceComputer {
         return -(*basedis)(i);
     }
 
+    void distances_batch_4(
+            const idx_t idx0,
+            const idx_t idx1,
+            const idx_t idx2,
+            const idx_t idx3,
+            float& dis0,
+            float& dis1,
+            float& dis2,
+            float& dis3) override {
+        basedis->distances_batch_4(
+                idx0, idx1, idx2, idx3, dis0, dis1, dis2, dis3);
+        dis0 = -dis0;
+        dis1 = -dis1;
+        dis2 = -dis2;
+        dis3 = -dis3;
+    }
+
     /// compute distance between two stored vectors
     float symmetric_dis(idx_t i, idx_t j) override {
         return -basedis->symmetric_dis(i, j);
@@ -243,6 +262,175 @@ void hnsw_add_vertices(
     }
 }
 
+/** Search where the queries are sorted by level 0 entry point before the
+ * level 0 search, see HNSW::search_group_queries */
+void hnsw_search_grouped(
+        const IndexHNSW& index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParametersHNSW* params,
+        idx_t vt_size) {
+    const HNSW& hnsw = index.hnsw;
+    size_t d = index.d;
+    std::vector<storage_idx_t> nearest(n);
+    std::vector<float> d_nearest(n);
+    std::vector<idx_t> order(n);
+
+#pragma omp parallel
+    {
+        VisitedTable vt(vt_size);
+        HNSWStats search_stats;
+        DistanceComputer* dis = storage_distance_computer(index.storage);
+        ScopeDeleter1<DistanceComputer> del(dis);
+
+#pragma omp for
+        for (idx_t i = 0; i < n; i++) {
+            dis->set_query(x + i * d);
+            nearest[i] = hnsw.search_upper_levels(*dis, vt, &d_nearest[i]);
+        }
+
+#pragma omp single
+        {
+            for (idx_t i = 0; i < n; i++) {
+                order[i] = i;
+            }
+            std::sort(order.begin(), order.end(), [&](idx_t a, idx_t b) {
+                return nearest[a] < nearest[b] ||
+                        (nearest[a] == nearest[b] && a < b);
+            });
+        }
+
+        // static schedule: each thread gets a contiguous range of queries
+#pragma omp for schedule(static)
+        for (idx_t ii = 0; ii < n; ii++) {
+            idx_t i = order[ii];
+            idx_t* idxi = labels + i * k;
+            float* simi = distances + i * k;
+            dis->set_query(x + i * d);
+
+            maxheap_heapify(k, simi, idxi);
+            if (nearest[i] >= 0) {
+                hnsw.search_level_0(
+                        *dis,
+                        k,
+                        idxi,
+                        simi,
+                        1,
+                        &nearest[i],
+                        &d_nearest[i],
+                        1,
+                        search_stats,
+                        vt,
+                        params);
+            }
+            vt.advance();
+            maxheap_reorder(k, simi, idxi);
+        }
+
+#pragma omp critical
+        { hnsw_stats.combine(search_stats); }
+    }
+
+    if (index.metric_type == METRIC_INNER_PRODUCT) {
+        // we need to revert the negated distances
+        for (size_t i = 0; i < k * n; i++) {
+            distances[i] = -distances[i];
+        }
+    }
+}
+
+/// fraction of the vertices that pass the selector, estimated on a sample
+float estimate_selectivity(const IDSelector& sel, idx_t ntotal) {
+    if (ntotal == 0) {
+        return 1;
+    }
+    idx_t nsample = std::min(ntotal, idx_t(1024));
+    RandomGenerator rng(1234);
+    idx_t nmember = 0;
+    for (idx_t i = 0; i < nsample; i++) {
+        idx_t id = nsample == ntotal ? i : rng.rand_int64() % ntotal;
+        if (sel.is_member(id)) {
+            nmember++;
+        }
+    }
+    return nmember / float(nsample);
+}
+
+/// exhaustive search over the vertices that pass the selector
+void hnsw_search_brute_force(
+        const IndexHNSW& index,
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const IDSelector& sel) {
+    const HNSW& hnsw = index.hnsw;
+    idx_t nvisible = hnsw.concurrent
+            ? hnsw.concurrent->ntotal_visible.load(std::memory_order_acquire)
+            : index.ntotal;
+    std::vector<storage_idx_t> allowed;
+    for (idx_t i = 0; i < nvisible; i++) {
+        if (sel.is_member(i) && !hnsw.is_deleted(i)) {
+            allowed.push_back(i);
+        }
+    }
+    size_t na = allowed.size();
+
+#pragma omp parallel if (n > 1)
+    {
+        DistanceComputer* dis = storage_distance_computer(index.storage);
+        ScopeDeleter1<DistanceComputer> del(dis);
+
+#pragma omp for
+        for (idx_t i = 0; i < n; i++) {
+            idx_t* idxi = labels + i * k;
+            float* simi = distances + i * k;
+            dis->set_query(x + i * index.d);
+            maxheap_heapify(k, simi, idxi);
+
+            auto add_to_heap = [&](storage_idx_t v, float d) {
+                if (d < simi[0]) {
+                    maxheap_replace_top(k, simi, idxi, d, v);
+                }
+            };
+            size_t j = 0;
+            for (; j + 4 <= na; j += 4) {
+                float d[4];
+                dis->distances_batch_4(
+                        allowed[j],
+                        allowed[j + 1],
+                        allowed[j + 2],
+                        allowed[j + 3],
+                        d[0],
+                        d[1],
+                        d[2],
+                        d[3]);
+                for (int j4 = 0; j4 < 4; j4++) {
+                    add_to_heap(allowed[j + j4], d[j4]);
+                }
+            }
+            for (; j < na; j++) {
+                add_to_heap(allowed[j], (*dis)(allowed[j]));
+            }
+            maxheap_reorder(k, simi, idxi);
+        }
+    }
+
+    if (index.metric_type == METRIC_INNER_PRODUCT) {
+        // we need to revert the negated distances
+        for (size_t i = 0; i < k * n; i++) {
+            distances[i] = -distances[i];
+        }
+    }
+    HNSWStats stats(n, 0, n * na, n * na, 0);
+    stats.add_query_ndis(na, n);
+    hnsw_stats.combine(stats);
+}
+
 } // namespace
 
 /**************************************************************
@@ -289,6 +477,9 @@ void IndexHNSW::search(
     FAISS_THROW_IF_NOT_MSG(
             storage,
             "Please use IndexHNSWFlat (or variants) instead of IndexHNSW directly");
+    FAISS_THROW_IF_NOT_MSG(
+            !reconstruct_from_neighbors || !hnsw.is_level0_compressed(),
+            "cannot reconstruct from the neighbors of a compressed level 0");
     const SearchParametersHNSW* params = nullptr;
 
     int efSearch = hnsw.efSearch;
@@ -297,7 +488,40 @@ void IndexHNSW::search(
         FAISS_THROW_IF_NOT_MSG(params, "params type invalid");
         efSearch = params->efSearch;
     }
-    size_t n1 = 0, n2 = 0, n3 = 0, ndis = 0, nreorder = 0;
+
+    // choose the filtered search strategy from the selectivity
+    SearchParametersHNSW filter_params;
+    if (params && params->sel &&
+        (params->filter_brute_force_threshold > 0 ||
+         params->filter_two_hop_threshold > 0 ||
+         params->filter_max_efSearch_factor > 1)) {
+        float selectivity = estimate_selectivity(*params->sel, ntotal);
+        if (selectivity < params->filter_brute_force_threshold) {
+            hnsw_search_brute_force(
+                    *this, n, x, k, distances, labels, *params->sel);
+            return;
+        }
+        filter_params = *params;
+        if (selectivity < params->filter_two_hop_threshold) {
+            filter_params.filter_two_hop = true;
+        } else if (!params->filter_two_hop) {
+            float factor = std::min(
+                    1 / selectivity, params->filter_max_efSearch_factor);
+            filter_params.efSearch = int(ceil(efSearch * factor));
+        }
+        params = &filter_params;
+        efSearch = params->efSearch;
+    }
+    // with concurrent adds, the visited table must cover the vertices that
+    // become visible during the search
+    idx_t vt_size = hnsw.concurrent ? hnsw.concurrent->capacity : ntotal;
+
+    if (hnsw.search_group_queries && hnsw.upper_beam == 1 &&
+        hnsw.search_bounded_queue && !reconstruct_from_neighbors) {
+        hnsw_search_grouped(
+                *this, n, x, k, distances, labels, params, vt_size);
+        return;
+    }
 
     idx_t check_period =
             InterruptCallback::get_period_hint(hnsw.max_level * d * efSearch);
@@ -307,24 +531,20 @@ void IndexHNSW::search(
 
 #pragma omp parallel
         {
-            VisitedTable vt(ntotal);
+            VisitedTable vt(vt_size);
+            HNSWStats thread_stats;
 
             DistanceComputer* dis = storage_distance_computer(storage);
             ScopeDeleter1<DistanceComputer> del(dis);
 
-#pragma omp for reduction(+ : n1, n2, n3, ndis, nreorder)
+#pragma omp for
             for (idx_t i = i0; i < i1; i++) {
                 idx_t* idxi = labels + i * k;
                 float* simi = distances + i * k;
                 dis->set_query(x + i * d);
 
                 maxheap_heapify(k, simi, idxi);
-                HNSWStats stats = hnsw.search(*dis, k, idxi, simi, vt, params);
-                n1 += stats.n1;
-                n2 += stats.n2;
-                n3 += stats.n3;
-                ndis += stats.ndis;
-                nreorder += stats.nreorder;
+                hnsw.search(*dis, k, idxi, simi, vt, thread_stats, params);
                 maxheap_reorder(k, simi, idxi);
 
                 if (reconstruct_from_neighbors &&
@@ -333,8 +553,9 @@ void IndexHNSW::search(
                     if (k_reorder == -1 || k_reorder > k)
                         k_reorder = k;
 
-                    nreorder += reconstruct_from_neighbors->compute_distances(
-                            k_reorder, idxi, x + i * d, simi);
+                    thread_stats.nreorder +=
+                            reconstruct_from_neighbors->compute_distances(
+                                    k_reorder, idxi, x + i * d, simi);
 
                     // sort top k_reorder
                     maxheap_heapify(
@@ -342,6 +563,8 @@ void IndexHNSW::search(
                     maxheap_reorder(k_reorder, simi, idxi);
                 }
             }
+#pragma omp critical
+            { hnsw_stats.combine(thread_stats); }
         }
         InterruptCallback::check();
     }
@@ -352,20 +575,93 @@ void IndexHNSW::search(
             distances[i] = -distances[i];
         }
     }
+}
+
+namespace {
+
+/** Draw the levels of the n vectors to add in advance, so that the
+ * preallocated memory can be checked before the index is modified */
+void hnsw_prepare_concurrent_add(IndexHNSW& index, idx_t n) {
+    HNSW& hnsw = index.hnsw;
+    idx_t n0 = index.ntotal;
+    if (hnsw.levels.size() == n0) {
+        for (idx_t i = 0; i < n; i++) {
+            hnsw.levels.push_back(hnsw.random_level() + 1);
+        }
+    }
+    FAISS_THROW_IF_NOT(hnsw.levels.size() == n0 + n);
 
-    hnsw_stats.combine({n1, n2, n3, ndis, nreorder});
+    size_t nslots = hnsw.neighbors.size();
+    for (idx_t i = n0; i < n0 + n; i++) {
+        nslots += hnsw.cum_nb_neighbors(hnsw.levels[i]);
+    }
+    const IndexFlatCodes* storage =
+            dynamic_cast<const IndexFlatCodes*>(index.storage);
+    FAISS_ASSERT(storage);
+
+    if (n0 + n > hnsw.concurrent->capacity ||
+        nslots > hnsw.neighbors.capacity() ||
+        (n0 + n) * storage->code_size > storage->codes.capacity()) {
+        hnsw.levels.resize(n0);
+        FAISS_THROW_FMT(
+                "adding %" PRId64 " vectors exceeds the memory reserved "
+                "for concurrent adds (capacity %zd)",
+                n,
+                hnsw.concurrent->capacity);
+    }
 }
 
+} // namespace
+
 void IndexHNSW::add(idx_t n, const float* x) {
     FAISS_THROW_IF_NOT_MSG(
             storage,
             "Please use IndexHNSWFlat (or variants) instead of IndexHNSW directly");
     FAISS_THROW_IF_NOT(is_trained);
+    FAISS_THROW_IF_NOT_MSG(
+            !hnsw.is_level0_compressed(),
+            "cannot add to a graph with compressed level 0, "
+            "call hnsw.decompress_level_0()");
+    HNSWConcurrentState* cs = hnsw.concurrent.get();
+    std::unique_lock<std::mutex> lock;
+    if (cs) {
+        lock = std::unique_lock<std::mutex>(cs->add_mutex);
+        hnsw_prepare_concurrent_add(*this, n);
+    }
     int n0 = ntotal;
     storage->add(n, x);
     ntotal = storage->ntotal;
 
     hnsw_add_vertices(*this, n0, n, x, verbose, hnsw.levels.size() == ntotal);
+
+    if (cs) {
+        // publish the new vertices, then the entry point that may be one
+        // of them
+        cs->ntotal_visible.store(ntotal, std::memory_order_release);
+        cs->entry_point.store(hnsw.entry_point, std::memory_order_release);
+    }
+}
+
+void IndexHNSW::reserve(idx_t n) {
+    FAISS_THROW_IF_NOT(n >= ntotal);
+    IndexFlatCodes* codes_storage = dynamic_cast<IndexFlatCodes*>(storage);
+    FAISS_THROW_IF_NOT_MSG(
+            codes_storage,
+            "concurrent adds require a storage derived from IndexFlatCodes");
+    codes_storage->codes.reserve(n * codes_storage->code_size);
+
+    // expected nb of link slots per vertex, the margin accounts for the
+    // variance of the random levels
+    double slots_per_vertex = 0;
+    for (int level = 0; level < hnsw.assign_probas.size(); level++) {
+        slots_per_vertex +=
+                hnsw.assign_probas[level] * hnsw.cum_nb_neighbors(level + 1);
+    }
+    size_t nslots = hnsw.neighbors.size() +
+            size_t((n - ntotal) * slots_per_vertex * 1.1) +
+            hnsw.cum_nb_neighbors(hnsw.assign_probas.size());
+
+    hnsw.enable_concurrent_add(n, nslots);
 }
 
 void IndexHNSW::reset() {
@@ -374,11 +670,86 @@ void IndexHNSW::reset() {
     ntotal = 0;
 }
 
+namespace {
+
+/// selects the tombstoned vertices of an HNSW graph
+struct IDSelectorHNSWDeleted : IDSelector {
+    const HNSW& hnsw;
+
+    explicit IDSelectorHNSWDeleted(const HNSW& hnsw) : hnsw(hnsw) {}
+
+    bool is_member(idx_t id) const final {
+        return hnsw.is_deleted(id);
+    }
+};
+
+} // namespace
+
+size_t IndexHNSW::remove_ids(const IDSelector& sel) {
+    FAISS_THROW_IF_NOT_MSG(
+            !reconstruct_from_neighbors,
+            "cannot remove ids when reconstructing from neighbors");
+    FAISS_THROW_IF_NOT_MSG(
+            !hnsw.concurrent, "cannot remove ids with concurrent adds");
+    size_t nremove = 0;
+    for (idx_t i = 0; i < ntotal; i++) {
+        if (sel.is_member(i) && hnsw.mark_deleted(i)) {
+            nremove++;
+        }
+    }
+    return nremove;
+}
+
+size_t IndexHNSW::compact_deleted(int max_hops) {
+    if (hnsw.ndeleted == 0) {
+        return 0;
+    }
+    FAISS_THROW_IF_NOT_MSG(
+            !hnsw.concurrent, "cannot compact a graph with concurrent adds");
+    FAISS_THROW_IF_NOT_MSG(
+            !hnsw.is_level0_compressed(), "level 0 of the graph is compressed");
+    FAISS_THROW_IF_NOT(max_hops >= 0);
+
+#pragma omp parallel
+    {
+        DistanceComputer* dis = storage_distance_computer(storage);
+        ScopeDeleter1<DistanceComputer> del(dis);
+
+#pragma omp for schedule(dynamic, 1024)
+        for (idx_t i = 0; i < ntotal; i++) {
+            if (!hnsw.is_deleted(i)) {
+                hnsw.repair_neighbors(*dis, i, max_hops);
+            }
+        }
+    }
+
+    size_t nremove = storage->remove_ids(IDSelectorHNSWDeleted(hnsw));
+    FAISS_THROW_IF_NOT(nremove == hnsw.ndeleted);
+    hnsw.compact_deleted();
+    ntotal = storage->ntotal;
+    FAISS_ASSERT(hnsw.levels.size() == ntotal);
+    return nremove;
+}
+
+void IndexHNSW::permute_entries(const idx_t* perm) {
+    IndexFlatCodes* codes_storage = dynamic_cast<IndexFlatCodes*>(storage);
+    FAISS_THROW_IF_NOT_MSG(
+            codes_storage,
+            "permute_entries requires a storage derived from IndexFlatCodes");
+    FAISS_THROW_IF_NOT_MSG(
+            !reconstruct_from_neighbors,
+            "cannot renumber when reconstructing from neighbors");
+    hnsw.permute_entries(perm);
+    codes_storage->permute_entries(perm);
+}
+
 void IndexHNSW::reconstruct(idx_t key, float* recons) const {
     storage->reconstruct(key, recons);
 }
 
 void IndexHNSW::shrink_level_0_neighbors(int new_size) {
+    FAISS_THROW_IF_NOT_MSG(
+            !hnsw.is_level0_compressed(), "level 0 of the graph is compressed");
 #pragma omp parallel
     {
         DistanceComputer* dis = storage_distance_computer(storage);
@@ -469,6 +840,8 @@ void IndexHNSW::init_level_0_from_knngraph(
         const float* D,
         const idx_t* I) {
     int dest_size = hnsw.nb_neighbors(0);
+    FAISS_THROW_IF_NOT_MSG(
+            !hnsw.is_level0_compressed(), "level 0 of the graph is compressed");
 
 #pragma omp parallel for
     for (idx_t i = 0; i < ntotal; i++) {
@@ -507,6 +880,8 @@ void IndexHNSW::init_level_0_from_entry_points(
         int n,
         const storage_idx_t* points,
         const storage_idx_t* nearests) {
+    FAISS_THROW_IF_NOT_MSG(
+            !hnsw.is_level0_compressed(), "level 0 of the graph is compressed");
     std::vector<omp_lock_t> locks(ntotal);
     for (int i = 0; i < ntotal; i++)
         omp_init_lock(&locks[i]);
@@ -544,6 +919,8 @@ void IndexHNSW::init_level_0_from_entry_points(
 }
 
 void IndexHNSW::reorder_links() {
+    FAISS_THROW_IF_NOT_MSG(
+            !hnsw.is_level0_compressed(), "level 0 of the graph is compressed");
     int M = hnsw.nb_neighbors(0);
 
 #pragma omp parallel
@@ -578,6 +955,8 @@ void IndexHNSW::reorder_links() {
 }
 
 void IndexHNSW::link_singletons() {
+    FAISS_THROW_IF_NOT_MSG(
+            !hnsw.is_level0_compressed(), "level 0 of the graph is compressed");
     printf("search for singletons\n");
 
     std::vector<bool> seen(ntotal);
@@ -963,7 +1342,7 @@ int search_from_candidates_2(
                 candidates.push(v1, d);
 
                 // never seen before --> add to heap
-                if (vt.visited[v1] < vt.visno) {
+                if (vt.visited[v1] < vt.visno && !hnsw.is_deleted(v1)) {
                     if (nres < k) {
                         faiss::maxheap_push(++nres, D, I, d, v1);
                     } else if (d < D[0]) {
@@ -1004,7 +1383,9 @@ void IndexHNSW2Level::search(
         IndexHNSW::search(n, x, k, distances, labels);
 
     } else { // "mixed" search
-        size_t n1 = 0, n2 = 0, n3 = 0, ndis = 0, nreorder = 0;
+        FAISS_THROW_IF_NOT_MSG(
+                !hnsw.is_level0_compressed(),
+                "level 0 of the graph is compressed");
 
         const IndexIVFPQ* index_ivfpq =
                 dynamic_cast<const IndexIVFPQ*>(storage);
@@ -1030,13 +1411,14 @@ void IndexHNSW2Level::search(
 #pragma omp parallel
         {
             VisitedTable vt(ntotal);
+            HNSWStats thread_stats;
             DistanceComputer* dis = storage_distance_computer(storage);
             ScopeDeleter1<DistanceComputer> del(dis);
 
             int candidates_size = hnsw.upper_beam;
             MinimaxHeap candidates(candidates_size);
 
-#pragma omp for reduction(+ : n1, n2, n3, ndis, nreorder)
+#pragma omp for
             for (idx_t i = 0; i < n; i++) {
                 idx_t* idxi = labels + i * k;
                 float* simi = distances + i * k;
@@ -1067,7 +1449,7 @@ void IndexHNSW2Level::search(
                 // reorder from sorted to heap
                 maxheap_heapify(k, simi, idxi, simi, idxi, k);
 
-                HNSWStats search_stats;
+                size_t n3_before = thread_stats.n3;
                 search_from_candidates_2(
                         hnsw,
                         *dis,
@@ -1076,23 +1458,19 @@ void IndexHNSW2Level::search(
                         simi,
                         candidates,
                         vt,
-                        search_stats,
+                        thread_stats,
                         0,
                         k);
-                n1 += search_stats.n1;
-                n2 += search_stats.n2;
-                n3 += search_stats.n3;
-                ndis += search_stats.ndis;
-                nreorder += search_stats.nreorder;
+                thread_stats.add_query_ndis(thread_stats.n3 - n3_before);
 
                 vt.advance();
                 vt.advance();
 
                 maxheap_reorder(k, simi, idxi);
             }
+#pragma omp critical
+            { hnsw_stats.combine(thread_stats); }
         }
-
-        hnsw_stats.combine({n1, n2, n3, ndis, nreorder});
     }
 }
 
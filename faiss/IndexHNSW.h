@@ -84,8 +84,20 @@ struct IndexHNSW : Index {
 
     ~IndexHNSW() override;
 
+    /** Add n vectors. If reserve was called before, add can run while
+     * other threads are searching: the new vectors become visible to the
+     * searches once they are fully linked. Concurrent calls to add are
+     * serialized.
+     */
     void add(idx_t n, const float* x) override;
 
+    /** Preallocate the graph and the storage for n vectors in total and
+     * allow adds to run concurrently with searches from then on. The storage
+     * must be derived from IndexFlatCodes. Adding more than n vectors
+     * throws an exception.
+     */
+    void reserve(idx_t n);
+
     /// Trains the storage if needed
     void train(idx_t n, const float* x) override;
 
@@ -102,6 +114,35 @@ struct IndexHNSW : Index {
 
     void reset() override;
 
+    /** Tombstone the selected vectors. They stay in the graph for routing
+     * but are not returned by search anymore. Ids are not changed until
+     * compact_deleted is called. Needs exclusive access to the index: it
+     * must not run alongside searches or adds, and throws after reserve.
+     *
+     * @return number of newly deleted vectors
+     */
+    size_t remove_ids(const IDSelector& sel) override;
+
+    /** Repair the links around the deleted vectors and reclaim their slots
+     * in the graph and the storage. The remaining vectors are renumbered
+     * sequentially, like in IndexFlat::remove_ids. Needs exclusive access
+     * to the index, like remove_ids.
+     *
+     * @param max_hops   nb of consecutive deleted vertices to traverse
+     *                   when looking for replacement neighbors
+     * @return number of removed vectors
+     */
+    size_t compact_deleted(int max_hops = 2);
+
+    /** Renumber the vectors in the graph and the storage: the new vector i
+     * is the former vector perm[i], so perm is the id map to use to get
+     * back the former labels (eg. as the id_map of an IndexIDMap).
+     * Typically, perm is computed with hnsw.bfs_order to improve the
+     * memory locality of searches. The storage must be derived from
+     * IndexFlatCodes.
+     */
+    void permute_entries(const idx_t* perm);
+
     void shrink_level_0_neighbors(int size);
 
     /** Perform search only on level 0, given the starting points for
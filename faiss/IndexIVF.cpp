@@ -15,8 +15,10 @@
 #include <algorithm>
 #include <cinttypes>
 #include <cstdio>
+#include <cstring>
 #include <memory>
 
+#include <faiss/utils/distances.h>
 #include <faiss/utils/hamming.h>
 #include <faiss/utils/utils.h>
 
@@ -24,6 +26,7 @@
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/IDSelector.h>
+#include <faiss/invlists/CompressedIdsInvertedLists.h>
 
 namespace faiss {
 
@@ -202,6 +205,7 @@ void IndexIVF::add_sa_codes(idx_t n, const uint8_t* codes, const idx_t* xids) {
     size_t coarse_size = coarse_code_size();
     DirectMapAdd dm_adder(direct_map, n, xids);
 
+    invlists->begin_add_batch();
     for (idx_t i = 0; i < n; i++) {
         const uint8_t* code = codes + (code_size + coarse_size) * i;
         idx_t list_no = decode_listno(code);
@@ -209,6 +213,7 @@ void IndexIVF::add_sa_codes(idx_t n, const uint8_t* codes, const idx_t* xids) {
         size_t ofs = invlists->add_entry(list_no, id, code + coarse_size);
         dm_adder.add(i, list_no, ofs);
     }
+    invlists->end_add_batch();
     ntotal += n;
 }
 
@@ -251,6 +256,7 @@ void IndexIVF::add_core(
 
     DirectMapAdd dm_adder(direct_map, n, xids);
 
+    invlists->begin_add_batch();
 #pragma omp parallel reduction(+ : nadd)
     {
         int nt = omp_get_num_threads();
@@ -272,6 +278,7 @@ void IndexIVF::add_core(
             }
         }
     }
+    invlists->end_add_batch();
 
     if (verbose) {
         printf("    added %zd / %" PRId64 " vectors (%zd -1s)\n",
@@ -427,7 +434,27 @@ void IndexIVF::search_preassigned(
             !(sel && store_pairs),
             "selector and store_pairs cannot be combined");
 
-    size_t nlistv = 0, ndis = 0, nheap = 0;
+    int pmode = this->parallel_mode & ~PARALLEL_MODE_NO_HEAP_INIT;
+    bool do_heap_init = !(this->parallel_mode & PARALLEL_MODE_NO_HEAP_INIT);
+
+    // compressed ids are decoded only for the results: the lists are
+    // scanned as with store_pairs and the labels are converted at the end
+    bool lazy_ids = !store_pairs && !sel && !selr && do_heap_init &&
+            dynamic_cast<const CompressedIdsInvertedLists*>(invlists);
+    bool scan_store_pairs = store_pairs || lazy_ids;
+
+    bool adaptive = params && params->adaptive_nprobe;
+    if (adaptive) {
+        FAISS_THROW_IF_NOT_MSG(
+                metric_type == METRIC_L2,
+                "adaptive nprobe is supported only for METRIC_L2");
+        FAISS_THROW_IF_NOT_FMT(
+                pmode == 0 || pmode == 3,
+                "adaptive nprobe is not supported with parallel_mode %d",
+                pmode);
+    }
+
+    size_t nlistv = 0, ndis = 0, nheap = 0, nskip = 0;
 
     using HeapForIP = CMin<float, idx_t>;
     using HeapForL2 = CMax<float, idx_t>;
@@ -436,19 +463,100 @@ void IndexIVF::search_preassigned(
     std::mutex exception_mutex;
     std::string exception_string;
 
-    int pmode = this->parallel_mode & ~PARALLEL_MODE_NO_HEAP_INIT;
-    bool do_heap_init = !(this->parallel_mode & PARALLEL_MODE_NO_HEAP_INIT);
+    // parallel_mode 1 with chunks: query i scans the list ranges
+    // chunks[chunk_begins[i]:chunk_begins[i + 1]]
+    struct ListChunk {
+        idx_t ik;
+        size_t j0, j1;
+    };
+    std::vector<ListChunk> chunks;
+    std::vector<idx_t> chunk_begins;
+    bool chunk_lists = pmode == 1 && parallel_chunk_size > 0 &&
+            !scan_store_pairs && omp_get_max_threads() >= 2;
+    if (chunk_lists) {
+        for (idx_t i = 0; i < n; i++) {
+            chunk_begins.push_back(chunks.size());
+            for (idx_t ik = 0; ik < nprobe; ik++) {
+                idx_t key = keys[i * nprobe + ik];
+                if (key < 0) {
+                    continue;
+                }
+                FAISS_THROW_IF_NOT_FMT(
+                        key < (idx_t)nlist,
+                        "Invalid key=%" PRId64 " nlist=%zd\n",
+                        key,
+                        nlist);
+                size_t list_size = invlists->list_size(key);
+                for (size_t j0 = 0; j0 < list_size;
+                     j0 += parallel_chunk_size) {
+                    size_t j1 = std::min(j0 + parallel_chunk_size, list_size);
+                    chunks.push_back({ik, j0, j1});
+                }
+            }
+        }
+        chunk_begins.push_back(chunks.size());
+    }
 
     bool do_parallel = omp_get_max_threads() >= 2 &&
             (pmode == 0           ? false
                      : pmode == 3 ? n > 1
-                     : pmode == 1 ? nprobe > 1
+                     : pmode == 1 ? nprobe > 1 || chunk_lists
                                   : nprobe * n > 1);
 
-#pragma omp parallel if (do_parallel) reduction(+ : nlistv, ndis, nheap)
+    // list-major order: the (query, probe) pairs grouped by inverted list,
+    // group g is lm_order[lm_begins[g]:lm_begins[g + 1]] and scans list
+    // lm_keys[g]. The groups are processed by chunks
+    // lm_chunks[c]:lm_chunks[c + 1], within a chunk the pairs are sorted by
+    // query so that the scanner is set to each query once per chunk
+    std::vector<idx_t> lm_order, lm_begins, lm_keys, lm_chunks;
+    std::vector<const float*> lm_local_dis;
+    std::vector<const idx_t*> lm_local_idx;
+    if (pmode == 4) {
+        for (idx_t ij = 0; ij < n * nprobe; ij++) {
+            FAISS_THROW_IF_NOT_FMT(
+                    keys[ij] < (idx_t)nlist,
+                    "Invalid key=%" PRId64 " nlist=%zd\n",
+                    keys[ij],
+                    nlist);
+            if (keys[ij] >= 0) {
+                lm_order.push_back(ij);
+            }
+        }
+        std::stable_sort(
+                lm_order.begin(), lm_order.end(), [&](idx_t a, idx_t b) {
+                    return keys[a] < keys[b];
+                });
+        for (size_t o = 0; o < lm_order.size(); o++) {
+            if (o == 0 || keys[lm_order[o]] != keys[lm_order[o - 1]]) {
+                lm_begins.push_back(o);
+            }
+        }
+        lm_begins.push_back(lm_order.size());
+        size_t ngroups = lm_begins.size() - 1;
+        for (size_t g = 0; g < ngroups; g++) {
+            lm_keys.push_back(keys[lm_order[lm_begins[g]]]);
+        }
+        // small enough chunks to balance the load over the threads
+        size_t chunk_size = std::max(
+                size_t(1),
+                std::min(size_t(16), ngroups / (4 * omp_get_max_threads())));
+        for (size_t g = 0; g < ngroups; g += chunk_size) {
+            lm_chunks.push_back(g);
+        }
+        lm_chunks.push_back(ngroups);
+        for (size_t c = 0; c + 1 < lm_chunks.size(); c++) {
+            std::sort(
+                    lm_order.begin() + lm_begins[lm_chunks[c]],
+                    lm_order.begin() + lm_begins[lm_chunks[c + 1]]);
+        }
+        lm_local_dis.resize(omp_get_max_threads());
+        lm_local_idx.resize(omp_get_max_threads());
+    }
+
+#pragma omp parallel if (do_parallel) reduction(+ : nlistv, ndis, nheap, nskip)
     {
         InvertedListScanner* scanner =
-                get_InvertedListScanner(store_pairs, sel);
+                get_InvertedListScanner(scan_store_pairs, sel);
         ScopeDeleter1<InvertedListScanner> del(scanner);
 
         /*****************************************************
@@ -490,12 +598,14 @@ void IndexIVF::search_preassigned(
             }
         };
 
-        // single list scan using the current scanner (with query
-        // set porperly) and storing results in simi and idxi
-        auto scan_one_list = [&](idx_t key,
-                                 float coarse_dis_i,
-                                 float* simi,
-                                 idx_t* idxi) {
+        // scan of the entries j0:j1 of a list using the current scanner
+        // (with query set porperly) and storing results in simi and idxi
+        auto scan_list_range = [&](idx_t key,
+                                   float coarse_dis_i,
+                                   size_t j0,
+                                   size_t j1,
+                                   float* simi,
+                                   idx_t* idxi) {
             if (key < 0) {
                 // not enough centroids for multiprobe
                 return (size_t)0;
@@ -507,15 +617,18 @@ void IndexIVF::search_preassigned(
                     nlist);
 
             size_t list_size = invlists->list_size(key);
+            j1 = std::min(j1, list_size);
 
             // don't waste time on empty lists
-            if (list_size == 0) {
+            if (j0 >= j1) {
                 return (size_t)0;
             }
 
             scanner->set_list(key, coarse_dis_i);
 
-            nlistv++;
+            if (j0 == 0) {
+                nlistv++;
+            }
 
             try {
                 InvertedLists::ScopedCodes scodes(invlists, key);
@@ -524,7 +637,7 @@ void IndexIVF::search_preassigned(
                 std::unique_ptr<InvertedLists::ScopedIds> sids;
                 const idx_t* ids = nullptr;
 
-                if (!store_pairs) {
+                if (!scan_store_pairs) {
                     sids.reset(new InvertedLists::ScopedIds(invlists, key));
                     ids = sids->get();
                 }
@@ -533,12 +646,16 @@ void IndexIVF::search_preassigned(
                     // restrict search to a section of the inverted list
                     size_t jmin, jmax;
                     selr->find_sorted_ids_bounds(list_size, ids, &jmin, &jmax);
-                    list_size = jmax - jmin;
-                    if (list_size == 0) {
+                    j0 = std::max(j0, jmin);
+                    j1 = std::min(j1, jmax);
+                    if (j0 >= j1) {
                         return (size_t)0;
                     }
-                    codes += jmin * code_size;
-                    ids += jmin;
+                }
+                list_size = j1 - j0;
+                codes += j0 * code_size;
+                if (ids) {
+                    ids += j0;
                 }
 
                 nheap += scanner->scan_codes(
@@ -555,11 +672,47 @@ void IndexIVF::search_preassigned(
             return list_size;
         };
 
+        auto scan_one_list = [&](idx_t key,
+                                 float coarse_dis_i,
+                                 float* simi,
+                                 idx_t* idxi) {
+            return scan_list_range(
+                    key, coarse_dis_i, 0, size_t(-1), simi, idxi);
+        };
+
         /****************************************************
          * Actual loops, depending on parallel_mode
          ****************************************************/
 
         if (pmode == 0 || pmode == 3) {
+            // nearest and current centroids for the adaptive nprobe
+            std::vector<float> c0(adaptive ? d : 0), cj(adaptive ? d : 0);
+
+            // can list ik of query i contain a result better than simi[0]?
+            auto adaptive_stop = [&](idx_t i, size_t ik, const float* simi) {
+                const idx_t* keysi = keys + i * nprobe;
+                const float* coarse_disi = coarse_dis + i * nprobe;
+                if (keysi[0] < 0 || keysi[ik] < 0) {
+                    return false;
+                }
+                float d0 = coarse_disi[0], dj = coarse_disi[ik];
+                if (params->adaptive_gap_ratio > 0 &&
+                    dj > params->adaptive_gap_ratio * d0) {
+                    return true;
+                }
+                if (ik == 1) {
+                    quantizer->reconstruct(keysi[0], c0.data());
+                }
+                quantizer->reconstruct(keysi[ik], cj.data());
+                float cc = fvec_L2sqr(c0.data(), cj.data(), d);
+                if (cc == 0) {
+                    return false;
+                }
+                // squared distance to the bisector hyperplane
+                float lb = (dj - d0) * (dj - d0) / (4 * cc);
+                return lb * params->adaptive_lb_factor >= simi[0];
+            };
+
 #pragma omp for
             for (idx_t i = 0; i < n; i++) {
                 if (interrupt) {
@@ -577,6 +730,10 @@ void IndexIVF::search_preassigned(
 
                 // loop over probes
                 for (size_t ik = 0; ik < nprobe; ik++) {
+                    if (adaptive && ik > 0 && adaptive_stop(i, ik, simi)) {
+                        nskip += nprobe - ik;
+                        break;
+                    }
                     nscan += scan_one_list(
                             keys[i * nprobe + ik],
                             coarse_dis[i * nprobe + ik],
@@ -604,15 +761,30 @@ void IndexIVF::search_preassigned(
                 scanner->set_query(x + i * d);
                 init_result(local_dis.data(), local_idx.data());
 
+                if (chunk_lists) {
 #pragma omp for schedule(dynamic)
-                for (idx_t ik = 0; ik < nprobe; ik++) {
-                    ndis += scan_one_list(
-                            keys[i * nprobe + ik],
-                            coarse_dis[i * nprobe + ik],
-                            local_dis.data(),
-                            local_idx.data());
-
-                    // can't do the test on max_codes
+                    for (idx_t c = chunk_begins[i]; c < chunk_begins[i + 1];
+                         c++) {
+                        const ListChunk& chunk = chunks[c];
+                        ndis += scan_list_range(
+                                keys[i * nprobe + chunk.ik],
+                                coarse_dis[i * nprobe + chunk.ik],
+                                chunk.j0,
+                                chunk.j1,
+                                local_dis.data(),
+                                local_idx.data());
+                    }
+                } else {
+#pragma omp for schedule(dynamic)
+                    for (idx_t ik = 0; ik < nprobe; ik++) {
+                        ndis += scan_one_list(
+                                keys[i * nprobe + ik],
+                                coarse_dis[i * nprobe + ik],
+                                local_dis.data(),
+                                local_idx.data());
+
+                        // can't do the test on max_codes
+                    }
                 }
                 // merge thread-local results
 
@@ -665,6 +837,127 @@ void IndexIVF::search_preassigned(
             for (int64_t i = 0; i < n; i++) {
                 reorder_result(distances + i * k, labels + i * k);
             }
+        } else if (pmode == 4) {
+            // each thread accumulates the results of all queries
+            std::vector<float> local_dis(n * k);
+            std::vector<idx_t> local_idx(n * k);
+            for (idx_t i = 0; i < n; i++) {
+                float* simi = local_dis.data() + i * k;
+                idx_t* idxi = local_idx.data() + i * k;
+                if (metric_type == METRIC_INNER_PRODUCT) {
+                    heap_heapify<HeapForIP>(k, simi, idxi);
+                } else {
+                    heap_heapify<HeapForL2>(k, simi, idxi);
+                }
+            }
+
+            // a list fetched for a chunk
+            struct ChunkList {
+                size_t list_size = 0;
+                const uint8_t* codes = nullptr;
+                const idx_t* ids = nullptr;
+                std::unique_ptr<InvertedLists::ScopedCodes> scodes;
+                std::unique_ptr<InvertedLists::ScopedIds> sids;
+            };
+
+            // each list is fetched once and scanned for all the queries
+            // that probe it
+#pragma omp for schedule(dynamic)
+            for (idx_t c = 0; c < (idx_t)lm_chunks.size() - 1; c++) {
+                if (interrupt) {
+                    continue;
+                }
+                idx_t g0 = lm_chunks[c], g1 = lm_chunks[c + 1];
+
+                try {
+                    std::vector<ChunkList> lists(g1 - g0);
+                    for (idx_t g = g0; g < g1; g++) {
+                        ChunkList& l = lists[g - g0];
+                        idx_t key = lm_keys[g];
+                        l.list_size = invlists->list_size(key);
+                        if (l.list_size == 0) {
+                            continue;
+                        }
+                        l.scodes.reset(
+                                new InvertedLists::ScopedCodes(invlists, key));
+                        l.codes = l.scodes->get();
+                        if (!scan_store_pairs) {
+                            l.sids.reset(new InvertedLists::ScopedIds(
+                                    invlists, key));
+                            l.ids = l.sids->get();
+                        }
+                        if (selr) { // IDSelectorRange
+                            size_t jmin, jmax;
+                            selr->find_sorted_ids_bounds(
+                                    l.list_size, l.ids, &jmin, &jmax);
+                            l.list_size = jmax - jmin;
+                            l.codes += jmin * code_size;
+                            l.ids += jmin;
+                        }
+                    }
+
+                    idx_t prev_i = -1;
+                    for (idx_t o = lm_begins[g0]; o < lm_begins[g1]; o++) {
+                        idx_t ij = lm_order[o];
+                        idx_t i = ij / nprobe;
+                        idx_t key = keys[ij];
+                        const ChunkList& l = lists
+                                [std::lower_bound(
+                                         lm_keys.begin() + g0,
+                                         lm_keys.begin() + g1,
+                                         key) -
+                                 lm_keys.begin() - g0];
+                        if (l.list_size == 0) {
+                            continue;
+                        }
+                        if (i != prev_i) {
+                            scanner->set_query(x + i * d);
+                            prev_i = i;
+                        }
+                        scanner->set_list(key, coarse_dis[ij]);
+                        nlistv++;
+                        nheap += scanner->scan_codes(
+                                l.list_size,
+                                l.codes,
+                                l.ids,
+                                local_dis.data() + i * k,
+                                local_idx.data() + i * k,
+                                k);
+                        ndis += l.list_size;
+                    }
+                } catch (const std::exception& e) {
+                    std::lock_guard<std::mutex> lock(exception_mutex);
+                    exception_string = demangle_cpp_symbol(typeid(e).name()) +
+                            "  " + e.what();
+                    interrupt = true;
+                }
+
+                if (InterruptCallback::is_interrupted()) {
+                    interrupt = true;
+                }
+            }
+
+            // merge the per-thread results
+            int rank = omp_get_thread_num();
+            int nt = omp_get_num_threads();
+            lm_local_dis[rank] = local_dis.data();
+            lm_local_idx[rank] = local_idx.data();
+#pragma omp barrier
+
+#pragma omp for
+            for (idx_t i = 0; i < n; i++) {
+                float* simi = distances + i * k;
+                idx_t* idxi = labels + i * k;
+                init_result(simi, idxi);
+                for (int t = 0; t < nt; t++) {
+                    add_local_results(
+                            lm_local_dis[t] + i * k,
+                            lm_local_idx[t] + i * k,
+                            simi,
+                            idxi);
+                }
+                reorder_result(simi, idxi);
+            }
         } else {
             FAISS_THROW_FMT("parallel_mode %d not supported\n", pmode);
         }
@@ -679,11 +972,22 @@ void IndexIVF::search_preassigned(
         }
     }
 
+    if (lazy_ids) {
+#pragma omp parallel for if (n * k > 1000)
+        for (idx_t i = 0; i < n * k; i++) {
+            if (labels[i] >= 0) {
+                labels[i] = invlists->get_single_id(
+                        lo_listno(labels[i]), lo_offset(labels[i]));
+            }
+        }
+    }
+
     if (ivf_stats) {
         ivf_stats->nq += n;
         ivf_stats->nlist += nlistv;
         ivf_stats->ndis += ndis;
         ivf_stats->nheap_updates += nheap;
+        ivf_stats->nprobe_skipped += nskip;
     }
 }
 
@@ -753,6 +1057,10 @@ void IndexIVF::range_search_preassigned(
     std::vector<RangeSearchPartialResult*> all_pres(omp_get_max_threads());
 
     int pmode = this->parallel_mode & ~PARALLEL_MODE_NO_HEAP_INIT;
+    if (pmode == 4) {
+        // the list-major mode is implemented only for search
+        pmode = 0;
+    }
     // don't start parallel section if single query
     bool do_parallel = omp_get_max_threads() >= 2 &&
             (pmode == 3           ? false
@@ -803,7 +1111,7 @@ void IndexIVF::range_search_preassigned(
             }
         };
 
-        if (parallel_mode == 0) {
+        if (pmode == 0) {
 #pragma omp for
             for (idx_t i = 0; i < nx; i++) {
                 scanner->set_query(x + i * d);
@@ -815,7 +1123,7 @@ void IndexIVF::range_search_preassigned(
                 }
             }
 
-        } else if (parallel_mode == 1) {
+        } else if (pmode == 1) {
             for (size_t i = 0; i < nx; i++) {
                 scanner->set_query(x + i * d);
 
@@ -826,7 +1134,7 @@ void IndexIVF::range_search_preassigned(
                     scan_list_func(i, ik, qres);
                 }
             }
-        } else if (parallel_mode == 2) {
+        } else if (pmode == 2) {
             RangeQueryResult* qres = nullptr;
 
 #pragma omp for schedule(dynamic)
@@ -840,9 +1148,9 @@ void IndexIVF::range_search_preassigned(
                 scan_list_func(i, ik, *qres);
             }
         } else {
-            FAISS_THROW_FMT("parallel_mode %d not supported\n", parallel_mode);
+            FAISS_THROW_FMT("parallel_mode %d not supported\n", pmode);
         }
-        if (parallel_mode == 0) {
+        if (pmode == 0) {
             pres.finalize();
         } else {
 #pragma omp barrier
@@ -1111,6 +1419,206 @@ void IndexIVF::copy_subset_to(
             invlists->copy_subset_to(*other.invlists, subset_type, a1, a2);
 }
 
+namespace {
+
+/// change the nb of lists, the lists that are removed should be empty
+void resize_nlist(ArrayInvertedLists* ails, size_t nlist) {
+    ails->codes.resize(nlist);
+    ails->ids.resize(nlist);
+    ails->nlist = nlist;
+}
+
+/// reconstruct the entries of a list and append them to x and ids
+void extract_list(
+        const IndexIVF& index,
+        idx_t list_no,
+        std::vector<float>& x,
+        std::vector<idx_t>& ids) {
+    size_t ls = index.invlists->list_size(list_no);
+    size_t n0 = ids.size(), d = index.d;
+    x.resize((n0 + ls) * d);
+    ids.resize(n0 + ls);
+    InvertedLists::ScopedIds sids(index.invlists, list_no);
+    memcpy(ids.data() + n0, sids.get(), ls * sizeof(idx_t));
+#pragma omp parallel for if (ls > 1000)
+    for (idx_t j = 0; j < (idx_t)ls; j++) {
+        index.reconstruct_from_offset(list_no, j, x.data() + (n0 + j) * d);
+    }
+}
+
+/// encode and add entries to the given lists, update the direct map
+void add_to_lists(
+        IndexIVF& index,
+        size_t n,
+        const float* x,
+        const idx_t* ids,
+        const idx_t* list_nos) {
+    std::vector<uint8_t> codes(n * index.code_size);
+    index.encode_vectors(n, x, list_nos, codes.data());
+    for (size_t i = 0; i < n; i++) {
+        size_t offset = index.invlists->add_entry(
+                list_nos[i], ids[i], codes.data() + i * index.code_size);
+        index.direct_map.update_single_id(ids[i], list_nos[i], offset);
+    }
+}
+
+} // namespace
+
+size_t IndexIVF::split_lists(size_t max_list_size, int niter) {
+    ArrayInvertedLists* ails = dynamic_cast<ArrayInvertedLists*>(invlists);
+    FAISS_THROW_IF_NOT_MSG(ails, "split_lists requires ArrayInvertedLists");
+    FAISS_THROW_IF_NOT(quantizer->ntotal == nlist);
+
+    std::vector<float> centroids(nlist * d);
+    quantizer->reconstruct_n(0, nlist, centroids.data());
+
+    // entries of the lists that are split
+    std::vector<idx_t> split_list_nos;
+    std::vector<float> x;
+    std::vector<idx_t> ids, list_nos;
+
+    for (size_t list_no = 0; list_no < nlist; list_no++) {
+        size_t ls = invlists->list_size(list_no);
+        if (ls <= max_list_size || ls < 2) {
+            continue;
+        }
+        std::vector<float> xl;
+        std::vector<idx_t> idsl;
+        extract_list(*this, list_no, xl, idsl);
+
+        // 2-means on the residuals
+        const float* c = centroids.data() + list_no * d;
+        std::vector<float> residuals(ls * d);
+        for (size_t j = 0; j < ls * d; j++) {
+            residuals[j] = xl[j] - c[j % d];
+        }
+        ClusteringParameters cp2;
+        cp2.niter = niter;
+        cp2.min_points_per_centroid = 1;
+        cp2.seed = 1234 + list_no;
+        Clustering clus(d, 2, cp2);
+        IndexFlatL2 assign_index(d);
+        clus.train(ls, residuals.data(), assign_index);
+
+        IndexFlat new_centroids(d, quantizer->metric_type);
+        for (size_t j = 0; j < 2 * d; j++) {
+            clus.centroids[j] += c[j % d];
+        }
+        new_centroids.add(2, clus.centroids.data());
+
+        std::vector<idx_t> assign(ls);
+        std::vector<float> dis(ls);
+        new_centroids.search(ls, xl.data(), 1, dis.data(), assign.data());
+        size_t n1 = std::count(assign.begin(), assign.end(), 1);
+        if (n1 == 0 || n1 == ls) {
+            continue; // degenerate split
+        }
+
+        idx_t new_list_no = nlist + split_list_nos.size();
+        split_list_nos.push_back(list_no);
+        memcpy(centroids.data() + list_no * d,
+               clus.centroids.data(),
+               d * sizeof(float));
+        centroids.insert(
+                centroids.end(),
+                clus.centroids.begin() + d,
+                clus.centroids.begin() + 2 * d);
+        for (size_t j = 0; j < ls; j++) {
+            list_nos.push_back(assign[j] == 0 ? list_no : new_list_no);
+        }
+        x.insert(x.end(), xl.begin(), xl.end());
+        ids.insert(ids.end(), idsl.begin(), idsl.end());
+    }
+
+    size_t nsplit = split_list_nos.size();
+    if (nsplit == 0) {
+        return 0;
+    }
+
+    // the residuals of the entries are re-encoded w.r.t. the new centroids
+    nlist += nsplit;
+    quantizer->reset();
+    quantizer->add(nlist, centroids.data());
+    resize_nlist(ails, nlist);
+    for (idx_t list_no : split_list_nos) {
+        ails->resize(list_no, 0);
+    }
+    add_to_lists(*this, ids.size(), x.data(), ids.data(), list_nos.data());
+    update_centroid_tables();
+    return nsplit;
+}
+
+size_t IndexIVF::merge_lists(size_t min_list_size) {
+    ArrayInvertedLists* ails = dynamic_cast<ArrayInvertedLists*>(invlists);
+    FAISS_THROW_IF_NOT_MSG(ails, "merge_lists requires ArrayInvertedLists");
+    FAISS_THROW_IF_NOT(quantizer->ntotal == nlist);
+
+    std::vector<bool> removed(nlist);
+    size_t nremove = 0, largest = 0;
+    for (size_t i = 0; i < nlist; i++) {
+        if (invlists->list_size(i) < min_list_size) {
+            removed[i] = true;
+            nremove++;
+        }
+        if (invlists->list_size(i) > invlists->list_size(largest)) {
+            largest = i;
+        }
+    }
+    if (nremove == nlist) {
+        // keep at least one list
+        removed[largest] = false;
+        nremove--;
+    }
+    if (nremove == 0) {
+        return 0;
+    }
+
+    std::vector<float> centroids(nlist * d);
+    quantizer->reconstruct_n(0, nlist, centroids.data());
+
+    std::vector<float> x;
+    std::vector<idx_t> ids;
+    for (size_t i = 0; i < nlist; i++) {
+        if (removed[i]) {
+            extract_list(*this, i, x, ids);
+            ails->resize(i, 0);
+        }
+    }
+
+    // move the last lists to the gaps
+    size_t new_nlist = nlist - nremove;
+    size_t src = nlist;
+    for (size_t i = 0; i < new_nlist; i++) {
+        if (!removed[i]) {
+            continue;
+        }
+        do {
+            src--;
+        } while (removed[src]);
+        std::swap(ails->codes[i], ails->codes[src]);
+        std::swap(ails->ids[i], ails->ids[src]);
+        memcpy(centroids.data() + i * d,
+               centroids.data() + src * d,
+               d * sizeof(float));
+        for (size_t j = 0; j < ails->ids[i].size(); j++) {
+            direct_map.update_single_id(ails->ids[i][j], i, j);
+        }
+    }
+
+    nlist = new_nlist;
+    centroids.resize(nlist * d);
+    quantizer->reset();
+    quantizer->add(nlist, centroids.data());
+    resize_nlist(ails, nlist);
+
+    size_t n = ids.size();
+    std::vector<idx_t> list_nos(n);
+    quantizer->assign(n, x.data(), list_nos.data());
+    add_to_lists(*this, n, x.data(), ids.data(), list_nos.data());
+    update_centroid_tables();
+    return nremove;
+}
+
 IndexIVF::~IndexIVF() {
     if (own_invlists) {
         delete invlists;
@@ -1132,6 +1640,7 @@ void IndexIVFStats::add(const IndexIVFStats& other) {
     nheap_updates += other.nheap_updates;
     quantization_time += other.quantization_time;
     search_time += other.search_time;
+    nprobe_skipped += other.nprobe_skipped;
 }
 
 IndexIVFStats indexIVF_stats;
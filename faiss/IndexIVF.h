@@ -69,6 +69,22 @@ struct SearchParametersIVF : SearchParameters {
     size_t max_codes; ///< max nb of codes to visit to do a query
     SearchParameters* quantizer_params = nullptr;
 
+    /** adaptive nprobe (METRIC_L2, parallel_mode 0 and 3): the lists of a
+     * query are visited by increasing coarse distance, and the search
+     * stops when the next list cannot contain a vector closer than the
+     * current k-th result. The bound is the distance from the query to
+     * the bisector hyperplane between the nearest centroid and the list
+     * centroid, valid when the vectors are assigned to their nearest
+     * centroid. nprobe is the max nb of lists visited. The search throws
+     * with the other metrics and parallel modes.
+     */
+    bool adaptive_nprobe = false;
+    /// the lower bound is multiplied by this factor, > 1 stops earlier
+    float adaptive_lb_factor = 1.0;
+    /// also stop at the lists whose coarse distance is above this ratio
+    /// times the distance of the nearest centroid (0 = disabled)
+    float adaptive_gap_ratio = 0;
+
     SearchParametersIVF() : nprobe(1), max_codes(0) {}
     virtual ~SearchParametersIVF() {}
 };
@@ -112,9 +128,17 @@ struct IndexIVF : Index, Level1Quantizer {
     /** Parallel mode determines how queries are parallelized with OpenMP
      *
      * 0 (default): split over queries
-     * 1: parallelize over inverted lists
+     * 1: parallelize over inverted lists (or chunks of inverted lists,
+     *    see parallel_chunk_size)
      * 2: parallelize over both
      * 3: split over queries with a finer granularity
+     * 4: list-major: the (query, list) pairs of the batch are grouped by
+     *    inverted list, each list is scanned once for all the queries that
+     *    probe it (each thread keeps heaps for all the queries, merged at
+     *    the end). The lists are scanned by chunks, the scanner is set to
+     *    each query once per chunk. Efficient for large batches where many
+     *    queries visit the same lists. max_codes is ignored; range_search
+     *    uses mode 0
      *
      * PARALLEL_MODE_NO_HEAP_INIT: binary or with the previous to
      * prevent the heap to be initialized and finalized
@@ -122,6 +146,13 @@ struct IndexIVF : Index, Level1Quantizer {
     int parallel_mode;
     const int PARALLEL_MODE_NO_HEAP_INIT = 1024;
 
+    /** in parallel_mode 1, the inverted lists longer than this are split in
+     * chunks of parallel_chunk_size entries that are scanned by different
+     * threads, so that a single long list does not serialize the search of
+     * a query (0 = no split). Not used with store_pairs.
+     */
+    size_t parallel_chunk_size = 0;
+
     /** optional map that maps back ids to invlist entries. This
      *  enables reconstruct() */
     DirectMap direct_map;
@@ -326,6 +357,38 @@ struct IndexIVF : Index, Level1Quantizer {
             idx_t a1,
             idx_t a2) const;
 
+    /** Split the inverted lists that have more than max_list_size entries.
+     *
+     * The entries of a list are clustered with a 2-means on their residuals
+     * w.r.t. the list centroid. The first centroid replaces the centroid of
+     * the list, the second one is added to the quantizer for a new list
+     * (numbered from nlist on). The entries of the list are re-encoded
+     * w.r.t. their new centroid from their reconstruction, which adds
+     * some error for lossy codes. The other lists are not modified.
+     *
+     * Requires ArrayInvertedLists, reconstruct_from_offset and a quantizer
+     * that supports reconstruct. The direct map is kept up-to-date. There
+     * is no synchronization: the index must not be searched or modified
+     * during the call.
+     *
+     * @param niter  nb of 2-means iterations
+     * @return       nb of lists that were split
+     */
+    size_t split_lists(size_t max_list_size, int niter = 10);
+
+    /** Remove the inverted lists that have less than min_list_size
+     * entries. Their entries are re-assigned to the nearest remaining
+     * centroids and the last lists are renumbered to fill the gaps.
+     * Same requirements as split_lists, and no concurrent search either.
+     *
+     * @return nb of lists that were removed
+     */
+    size_t merge_lists(size_t min_list_size);
+
+    /// called when the quantizer centroids were updated by split_lists or
+    /// merge_lists, to recompute the tables that depend on them
+    virtual void update_centroid_tables() {}
+
     ~IndexIVF() override;
 
     size_t get_list_size(size_t list_no) const {
@@ -431,6 +494,7 @@ struct IndexIVFStats {
     size_t nheap_updates;     // nb of times the heap was updated
     double quantization_time; // time spent quantizing vectors (in ms)
     double search_time;       // time spent searching lists (in ms)
+    size_t nprobe_skipped;    // nb of lists skipped by the adaptive nprobe
 
     IndexIVFStats() {
         reset();
@@ -518,6 +518,12 @@ void IndexIVFPQ::precompute_table() {
             use_precomputed_table, quantizer, pq, precomputed_table, verbose);
 }
 
+void IndexIVFPQ::update_centroid_tables() {
+    if (by_residual) {
+        precompute_table();
+    }
+}
+
 namespace {
 
 #define TIC t0 = get_cycles()
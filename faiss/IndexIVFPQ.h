@@ -140,6 +140,8 @@ struct IndexIVFPQ : IndexIVF {
     /// build precomputed table
     void precompute_table();
 
+    void update_centroid_tables() override;
+
     IndexIVFPQ();
 };
 
@@ -0,0 +1,302 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/IndexMultiVector.h>
+
+#include <algorithm>
+
+#include <faiss/IVFlib.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/Heap.h>
+#include <faiss/utils/distances.h>
+
+namespace faiss {
+
+/***************************************************
+ * IndexMultiVector
+ ***************************************************/
+
+IndexMultiVector::IndexMultiVector(Index* token_index)
+        : Index(token_index->d, token_index->metric_type),
+          token_index(token_index),
+          own_fields(false) {
+    FAISS_THROW_IF_NOT_MSG(
+            token_index->ntotal == 0, "the token index should be empty");
+    FAISS_THROW_IF_NOT_MSG(
+            metric_type == METRIC_INNER_PRODUCT || metric_type == METRIC_L2,
+            "MaxSim is supported for METRIC_INNER_PRODUCT and METRIC_L2");
+    is_trained = token_index->is_trained;
+    doc_offsets.push_back(0);
+
+    // the vectors of the candidate documents are reconstructed by id
+    IndexIVF* ivf = ivflib::try_extract_index_ivf(token_index);
+    if (ivf && ivf->direct_map.no()) {
+        ivf->set_direct_map_type(DirectMap::Array);
+    }
+}
+
+IndexMultiVector::IndexMultiVector()
+        : token_index(nullptr), own_fields(false) {
+    doc_offsets.push_back(0);
+}
+
+void IndexMultiVector::train(idx_t n, const float* x) {
+    token_index->train(n, x);
+    is_trained = true;
+}
+
+void IndexMultiVector::add(idx_t n, const float* x) {
+    std::vector<idx_t> doc_lengths(n, 1);
+    add_documents(n, doc_lengths.data(), x);
+}
+
+void IndexMultiVector::add_documents(
+        idx_t ndoc,
+        const idx_t* doc_lengths,
+        const float* x) {
+    FAISS_THROW_IF_NOT(is_trained);
+    FAISS_THROW_IF_NOT_MSG(
+            token_index->ntotal == doc_offsets.back(),
+            "the token index was modified outside of IndexMultiVector");
+    idx_t ntok = 0;
+    for (idx_t i = 0; i < ndoc; i++) {
+        FAISS_THROW_IF_NOT(doc_lengths[i] >= 0);
+        ntok += doc_lengths[i];
+    }
+    token_index->add(ntok, x);
+    for (idx_t i = 0; i < ndoc; i++) {
+        doc_offsets.push_back(doc_offsets.back() + doc_lengths[i]);
+    }
+    ntotal += ndoc;
+}
+
+idx_t IndexMultiVector::token_to_doc(idx_t token_no) const {
+    return std::upper_bound(doc_offsets.begin(), doc_offsets.end(), token_no) -
+            doc_offsets.begin() - 1;
+}
+
+void IndexMultiVector::search(
+        idx_t n,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    std::vector<idx_t> query_lengths(n, 1);
+    search_documents(
+            n, query_lengths.data(), x, k, distances, labels, params);
+}
+
+namespace {
+
+/* C is the comparator of the result heap: CMin for similarities, CMax for
+ * distances. A score a is better than b if C::cmp(b, a). */
+template <class C>
+void maxsim_search(
+        const IndexMultiVector& index,
+        idx_t nq,
+        const idx_t* q_offsets,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        idx_t kt,
+        const float* tok_dis,
+        const idx_t* tok_ids) {
+    size_t d = index.d;
+
+#pragma omp parallel if (nq > 1)
+    {
+        std::vector<idx_t> docs;
+        std::vector<idx_t> keys;
+        std::vector<float> recons;
+        std::vector<float> sims;
+        std::vector<float> best;
+
+#pragma omp for schedule(dynamic)
+        for (idx_t q = 0; q < nq; q++) {
+            idx_t m = q_offsets[q + 1] - q_offsets[q];
+            const float* xq = x + q_offsets[q] * d;
+            const float* qdis = tok_dis + q_offsets[q] * kt;
+            const idx_t* qids = tok_ids + q_offsets[q] * kt;
+            float* simi = distances + q * k;
+            idx_t* idxi = labels + q * k;
+
+            // candidate documents
+            docs.clear();
+            for (idx_t j = 0; j < m * kt; j++) {
+                if (qids[j] >= 0) {
+                    docs.push_back(index.token_to_doc(qids[j]));
+                }
+            }
+            std::sort(docs.begin(), docs.end());
+            docs.erase(std::unique(docs.begin(), docs.end()), docs.end());
+            size_t ndocs = docs.size();
+
+            heap_heapify<C>(k, simi, idxi);
+
+            if (index.exact_maxsim) {
+                for (idx_t doc : docs) {
+                    idx_t len = index.doc_length(doc);
+                    keys.resize(len);
+                    for (idx_t t = 0; t < len; t++) {
+                        keys[t] = index.doc_offsets[doc] + t;
+                    }
+                    recons.resize(len * d);
+                    index.token_index->reconstruct_batch(
+                            len, keys.data(), recons.data());
+                    sims.resize(len);
+
+                    float score = 0;
+                    for (idx_t i = 0; i < m; i++) {
+                        if (index.metric_type == METRIC_INNER_PRODUCT) {
+                            fvec_inner_products_ny(
+                                    sims.data(),
+                                    xq + i * d,
+                                    recons.data(),
+                                    d,
+                                    len);
+                        } else {
+                            fvec_L2sqr_ny(
+                                    sims.data(),
+                                    xq + i * d,
+                                    recons.data(),
+                                    d,
+                                    len);
+                        }
+                        float s = sims[0];
+                        for (idx_t t = 1; t < len; t++) {
+                            if (C::cmp(s, sims[t])) {
+                                s = sims[t];
+                            }
+                        }
+                        score += s;
+                    }
+                    if (C::cmp(simi[0], score)) {
+                        heap_replace_top<C>(k, simi, idxi, score, doc);
+                    }
+                }
+            } else {
+                // the score of a query vector for a document that was not
+                // retrieved is replaced with the worst retrieved score
+                best.resize(ndocs * m);
+                for (idx_t i = 0; i < m; i++) {
+                    float worst = 0;
+                    for (idx_t j = 0; j < kt; j++) {
+                        if (qids[i * kt + j] >= 0) {
+                            worst = qdis[i * kt + j];
+                        }
+                    }
+                    for (size_t di = 0; di < ndocs; di++) {
+                        best[di * m + i] = worst;
+                    }
+                }
+                for (idx_t i = 0; i < m; i++) {
+                    for (idx_t j = 0; j < kt; j++) {
+                        idx_t id = qids[i * kt + j];
+                        if (id < 0) {
+                            continue;
+                        }
+                        size_t di = std::lower_bound(
+                                            docs.begin(),
+                                            docs.end(),
+                                            index.token_to_doc(id)) -
+                                docs.begin();
+                        float& b = best[di * m + i];
+                        if (C::cmp(b, qdis[i * kt + j])) {
+                            b = qdis[i * kt + j];
+                        }
+                    }
+                }
+                for (size_t di = 0; di < ndocs; di++) {
+                    float score = 0;
+                    for (idx_t i = 0; i < m; i++) {
+                        score += best[di * m + i];
+                    }
+                    if (C::cmp(simi[0], score)) {
+                        heap_replace_top<C>(k, simi, idxi, score, docs[di]);
+                    }
+                }
+            }
+
+            heap_reorder<C>(k, simi, idxi);
+        }
+    }
+}
+
+} // namespace
+
+void IndexMultiVector::search_documents(
+        idx_t nq,
+        const idx_t* query_lengths,
+        const float* x,
+        idx_t k,
+        float* distances,
+        idx_t* labels,
+        const SearchParameters* params) const {
+    FAISS_THROW_IF_NOT(k > 0);
+    FAISS_THROW_IF_NOT(is_trained);
+
+    std::vector<idx_t> q_offsets(nq + 1, 0);
+    for (idx_t q = 0; q < nq; q++) {
+        FAISS_THROW_IF_NOT(query_lengths[q] >= 0);
+        q_offsets[q + 1] = q_offsets[q] + query_lengths[q];
+    }
+    idx_t ntok = q_offsets[nq];
+
+    // candidate generation
+    idx_t kt = std::max(idx_t(1), std::min(k_token, token_index->ntotal));
+    std::vector<float> tok_dis(ntok * kt);
+    std::vector<idx_t> tok_ids(ntok * kt, -1);
+    if (token_index->ntotal > 0) {
+        token_index->search(
+                ntok, x, kt, tok_dis.data(), tok_ids.data(), params);
+    }
+
+    if (metric_type == METRIC_INNER_PRODUCT) {
+        maxsim_search<CMin<float, idx_t>>(
+                *this,
+                nq,
+                q_offsets.data(),
+                x,
+                k,
+                distances,
+                labels,
+                kt,
+                tok_dis.data(),
+                tok_ids.data());
+    } else {
+        maxsim_search<CMax<float, idx_t>>(
+                *this,
+                nq,
+                q_offsets.data(),
+                x,
+                k,
+                distances,
+                labels,
+                kt,
+                tok_dis.data(),
+                tok_ids.data());
+    }
+}
+
+void IndexMultiVector::reset() {
+    token_index->reset();
+    doc_offsets.resize(1);
+    ntotal = 0;
+}
+
+IndexMultiVector::~IndexMultiVector() {
+    if (own_fields) {
+        delete token_index;
+    }
+}
+
+} // namespace faiss
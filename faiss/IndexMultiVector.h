@@ -0,0 +1,107 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#pragma once
+
+#include <vector>
+
+#include <faiss/Index.h>
+
+namespace faiss {
+
+/** Index for documents represented by several vectors (late interaction,
+ * as in ColBERT).
+ *
+ * The score of a document for a query made of several vectors is the
+ * MaxSim aggregation: the sum over the query vectors of the best
+ * similarity (or smallest distance for METRIC_L2) with the vectors of the
+ * document.
+ *
+ * The vectors of all the documents are stored in token_index, where the
+ * vectors of a document are contiguous. The search is done in two steps:
+ * - candidate generation: each query vector is searched in token_index,
+ *   the documents of the k_token results are the candidates;
+ * - aggregation: the MaxSim scores of the candidates are computed on the
+ *   vectors reconstructed from token_index (exact_maxsim = true, exact
+ *   for a flat token_index), or from the token-level results only, where
+ *   the missing similarities are replaced with the k_token-th one.
+ *
+ * The token_index can be any index that supports reconstruct, typically an
+ * IndexIVFPQ or an IndexIVFPQFastScan. A direct map is added to IVF
+ * indexes.
+ *
+ * ntotal is the number of documents and labels are document numbers.
+ */
+struct IndexMultiVector : Index {
+    /// index of all the document vectors
+    Index* token_index;
+    bool own_fields;
+
+    /// the vectors of document i are the vectors doc_offsets[i] to
+    /// doc_offsets[i + 1] - 1 of token_index (size ntotal + 1)
+    std::vector<idx_t> doc_offsets;
+
+    /// nb of results per query vector for the candidate generation
+    idx_t k_token = 64;
+
+    /// compute the MaxSim scores on the reconstructed vectors
+    bool exact_maxsim = true;
+
+    explicit IndexMultiVector(Index* token_index);
+
+    IndexMultiVector();
+
+    void train(idx_t n, const float* x) override;
+
+    /// add n documents of one vector each
+    void add(idx_t n, const float* x) override;
+
+    /** add ndoc documents, document i has doc_lengths[i] vectors, the
+     * vectors of all documents are concatenated in x */
+    void add_documents(idx_t ndoc, const idx_t* doc_lengths, const float* x);
+
+    /// search n queries of one vector each
+    void search(
+            idx_t n,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const override;
+
+    /** search nq queries, query i has query_lengths[i] vectors, the vectors
+     * of all queries are concatenated in x.
+     *
+     * @param distances  output MaxSim scores, size nq * k
+     * @param labels     output document numbers, size nq * k
+     * @param params     passed to the token_index search
+     */
+    void search_documents(
+            idx_t nq,
+            const idx_t* query_lengths,
+            const float* x,
+            idx_t k,
+            float* distances,
+            idx_t* labels,
+            const SearchParameters* params = nullptr) const;
+
+    /// nb of vectors of document i
+    idx_t doc_length(idx_t i) const {
+        return doc_offsets[i + 1] - doc_offsets[i];
+    }
+
+    /// document that contains vector number token_no of token_index
+    idx_t token_to_doc(idx_t token_no) const;
+
+    void reset() override;
+
+    ~IndexMultiVector() override;
+};
+
+} // namespace faiss
@@ -149,11 +149,15 @@ void IndexNSG::add(idx_t n, const float* x) {
             !is_built && ntotal == 0,
             "NSG does not support incremental addition");
 
-    std::vector<idx_t> knng;
     if (verbose) {
         printf("IndexNSG::add %zd vectors\n", size_t(n));
     }
 
+    // the kNN graph is stored with 32-bit ids, like the NSG graph
+    std::unique_ptr<nsg::Graph<int>> knn_graph;
+    // keeps the NNDescent graph alive when knn_graph is a view of it
+    std::unique_ptr<IndexNNDescent> nndescent_index;
+
     if (build_type == 0) { // build with brute force search
 
         if (verbose) {
@@ -164,37 +168,57 @@ void IndexNSG::add(idx_t n, const float* x) {
         ntotal = storage->ntotal;
         FAISS_THROW_IF_NOT(ntotal == n);
 
-        knng.resize(ntotal * (GK + 1));
-        storage->assign(ntotal, x, knng.data(), GK + 1);
+        knn_graph.reset(new nsg::Graph<int>(n, GK));
 
-        // Remove itself
-        // - For metric distance, we just need to remove the first neighbor
-        // - But for non-metric, e.g. inner product, we need to check
-        // - each neighbor
-        if (storage->metric_type == METRIC_INNER_PRODUCT) {
-            for (idx_t i = 0; i < ntotal; i++) {
+        // the queries are processed by blocks so that the temporary
+        // search results do not scale with n
+        size_t bs = 16384;
+        if (nsg.build_memory_budget > 0) {
+            size_t per_query = (GK + 1) * (sizeof(idx_t) + sizeof(float));
+            bs = std::max(size_t(1), nsg.build_memory_budget / per_query);
+        }
+        std::vector<idx_t> labels;
+
+        for (idx_t i0 = 0; i0 < n; i0 += bs) {
+            idx_t i1 = std::min(i0 + idx_t(bs), n);
+            labels.resize((i1 - i0) * (GK + 1));
+            storage->assign(i1 - i0, x + i0 * d, labels.data(), GK + 1);
+
+            // Remove itself
+            // - For metric distance, we just need to remove the first
+            //   neighbor
+            // - But for non-metric, e.g. inner product, we need to check
+            //   each neighbor
+            bool check_all = storage->metric_type == METRIC_INNER_PRODUCT;
+#pragma omp parallel for
+            for (idx_t i = i0; i < i1; i++) {
+                const idx_t* li = labels.data() + (i - i0) * (GK + 1);
                 int count = 0;
-                for (int j = 0; j < GK + 1; j++) {
-                    idx_t id = knng[i * (GK + 1) + j];
-                    if (id != i) {
-                        knng[i * GK + count] = id;
-                        count += 1;
-                    }
-                    if (count == GK) {
-                        break;
+                for (int j = check_all ? 0 : 1; j < GK + 1 && count < GK;
+                     j++) {
+                    if (li[j] != i) {
+                        knn_graph->at(i, count++) = li[j];
                     }
                 }
+                for (; count < GK; count++) {
+                    knn_graph->at(i, count) = -1;
+                }
             }
-        } else {
-            for (idx_t i = 0; i < ntotal; i++) {
-                memmove(knng.data() + i * GK,
-                        knng.data() + i * (GK + 1) + 1,
-                        GK * sizeof(idx_t));
+
+            if (verbose) {
+                printf("  kNN graph: %" PRId64 "/%" PRId64 " nodes\r",
+                       i1,
+                       n);
+                fflush(stdout);
             }
         }
+        if (verbose) {
+            printf("\n");
+        }
 
     } else if (build_type == 1) { // build with NNDescent
-        IndexNNDescent index(storage, GK);
+        nndescent_index.reset(new IndexNNDescent(storage, GK));
+        IndexNNDescent& index = *nndescent_index;
         index.nndescent.S = nndescent_S;
         index.nndescent.R = nndescent_R;
         index.nndescent.L = std::max(nndescent_L, GK + 50);
@@ -218,14 +242,9 @@ void IndexNSG::add(idx_t n, const float* x) {
         ntotal = storage->ntotal;
         FAISS_THROW_IF_NOT(ntotal == n);
 
-        knng.resize(ntotal * GK);
-
-        // cast from idx_t to int
-        const int* knn_graph = index.nndescent.final_graph.data();
-#pragma omp parallel for
-        for (idx_t i = 0; i < ntotal * GK; i++) {
-            knng[i] = knn_graph[i];
-        }
+        // use the NNDescent graph in place, without conversion
+        knn_graph.reset(new nsg::Graph<int>(
+                index.nndescent.final_graph.data(), n, GK));
     } else {
         FAISS_THROW_MSG("build_type should be 0 or 1");
     }
@@ -235,14 +254,13 @@ void IndexNSG::add(idx_t n, const float* x) {
     }
 
     // check the knn graph
-    check_knn_graph(knng.data(), n, GK);
+    check_knn_graph(knn_graph->data, n, GK);
 
     if (verbose) {
         printf("  nsg building\n");
     }
 
-    const nsg::Graph<idx_t> knn_graph(knng.data(), n, GK);
-    nsg.build(storage, n, knn_graph, verbose);
+    nsg.build(storage, n, *knn_graph, verbose);
     is_built = true;
 }
 
@@ -257,7 +275,19 @@ void IndexNSG::reconstruct(idx_t key, float* recons) const {
     storage->reconstruct(key, recons);
 }
 
-void IndexNSG::check_knn_graph(const idx_t* knn_graph, idx_t n, int K) const {
+void IndexNSG::permute_entries(const idx_t* perm) {
+    IndexFlatCodes* codes_storage = dynamic_cast<IndexFlatCodes*>(storage);
+    FAISS_THROW_IF_NOT_MSG(
+            codes_storage,
+            "permute_entries requires a storage derived from IndexFlatCodes");
+    nsg.permute_entries(perm);
+    codes_storage->permute_entries(perm);
+}
+
+namespace {
+
+template <class index_t>
+void check_knn_graph_ids(const index_t* knn_graph, idx_t n, int K) {
     idx_t total_count = 0;
 
 #pragma omp parallel for reduction(+ : total_count)
@@ -284,6 +314,16 @@ void IndexNSG::check_knn_graph(const idx_t* knn_graph, idx_t n, int K) const {
             "It may be an invalid knn graph.");
 }
 
+} // namespace
+
+void IndexNSG::check_knn_graph(const idx_t* knn_graph, idx_t n, int K) const {
+    check_knn_graph_ids(knn_graph, n, K);
+}
+
+void IndexNSG::check_knn_graph(const int* knn_graph, idx_t n, int K) const {
+    check_knn_graph_ids(knn_graph, n, K);
+}
+
 /**************************************************************
  * IndexNSGFlat implementation
  **************************************************************/
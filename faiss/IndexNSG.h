@@ -74,6 +74,12 @@ struct IndexNSG : Index {
     void reset() override;
 
     void check_knn_graph(const idx_t* knn_graph, idx_t n, int K) const;
+    void check_knn_graph(const int* knn_graph, idx_t n, int K) const;
+
+    /** Renumber the vectors in the graph and the storage, see
+     * IndexHNSW::permute_entries. perm can be computed with nsg.bfs_order.
+     */
+    void permute_entries(const idx_t* perm);
 };
 
 /** Flat index topped with with a NSG structure to access elements
@@ -32,6 +32,7 @@ IndexScalarQuantizer::IndexScalarQuantizer(
         MetricType metric)
         : IndexFlatCodes(0, d, metric), sq(d, qtype) {
     is_trained = qtype == ScalarQuantizer::QT_fp16 ||
+            qtype == ScalarQuantizer::QT_bf16 ||
             qtype == ScalarQuantizer::QT_8bit_direct;
     code_size = sq.code_size;
 }
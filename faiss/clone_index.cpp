@@ -18,6 +18,7 @@
 #include <faiss/IndexAdditiveQuantizer.h>
 #include <faiss/IndexAdditiveQuantizerFastScan.h>
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexFlatInt8.h>
 #include <faiss/IndexHNSW.h>
 #include <faiss/IndexIVF.h>
 #include <faiss/IndexIVFAdditiveQuantizerFastScan.h>
@@ -251,6 +252,7 @@ Index* Cloner::clone_Index(const Index* index) {
     TRYCLONE(IndexFlatL2, index)
     TRYCLONE(IndexFlatIP, index)
     TRYCLONE(IndexFlat, index)
+    TRYCLONE(IndexFlatInt8, index)
 
     TRYCLONE(IndexLattice, index)
     TRYCLONE(IndexRandom, index)
@@ -9,6 +9,8 @@
 
 #include <faiss/impl/HNSW.h>
 
+#include <algorithm>
+#include <cmath>
 #include <string>
 
 #include <faiss/impl/AuxIndexStructures.h>
@@ -41,10 +43,94 @@ int HNSW::cum_nb_neighbors(int layer_no) const {
 void HNSW::neighbor_range(idx_t no, int layer_no, size_t* begin, size_t* end)
         const {
     size_t o = offsets[no];
+    if (is_level0_compressed()) {
+        // only the levels > 0 are stored in the neighbors array
+        FAISS_ASSERT(layer_no > 0);
+        o -= cum_nb_neighbors(1);
+    }
     *begin = o + cum_nb_neighbors(layer_no);
     *end = o + cum_nb_neighbors(layer_no + 1);
 }
 
+HNSWConcurrentState::HNSWConcurrentState(size_t capacity)
+        : capacity(capacity),
+          seqlocks(new std::atomic<uint32_t>[capacity]),
+          ntotal_visible(0),
+          entry_point(-1) {
+    for (size_t i = 0; i < capacity; i++) {
+        seqlocks[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void HNSW::enable_concurrent_add(size_t capacity, size_t nslots) {
+    FAISS_THROW_IF_NOT_MSG(
+            !is_level0_compressed(), "level 0 of the graph is compressed");
+    FAISS_THROW_IF_NOT(capacity >= levels.size());
+    FAISS_THROW_IF_NOT(nslots >= neighbors.size());
+    levels.reserve(capacity);
+    offsets.reserve(capacity + 1);
+    neighbors.reserve(nslots);
+    concurrent.reset(new HNSWConcurrentState(capacity));
+    concurrent->ntotal_visible.store(levels.size());
+    concurrent->entry_point.store(entry_point);
+}
+
+size_t HNSW::get_neighbors(
+        storage_idx_t no,
+        int layer_no,
+        storage_idx_t nvisible,
+        storage_idx_t* out) const {
+    if (layer_no == 0 && is_level0_compressed()) {
+        // ids are sorted, so decoding stops at the first invisible one
+        const uint8_t* p = level0_codes.data() + level0_offsets[no];
+        const uint8_t* p_end = level0_codes.data() + level0_offsets[no + 1];
+        size_t n = 0;
+        storage_idx_t v = 0;
+        while (p < p_end) {
+            uint8_t b = *p++;
+            uint32_t delta = b & 127;
+            for (int shift = 7; b & 128; shift += 7) {
+                b = *p++;
+                delta |= uint32_t(b & 127) << shift;
+            }
+            v += delta;
+            if (v >= nvisible)
+                break;
+            out[n++] = v;
+        }
+        return n;
+    }
+    size_t begin, end;
+    neighbor_range(no, layer_no, &begin, &end);
+    const HNSWConcurrentState* cs = concurrent.get();
+
+    for (;;) {
+        uint32_t seq = 0;
+        if (cs) {
+            seq = cs->seqlocks[no].load(std::memory_order_acquire);
+            if (seq & 1) {
+                // a writer is updating the list
+                continue;
+            }
+        }
+        size_t n = 0;
+        for (size_t j = begin; j < end; j++) {
+            storage_idx_t v = neighbors[j];
+            if (v < 0)
+                break;
+            if (v < nvisible)
+                out[n++] = v;
+        }
+        if (!cs) {
+            return n;
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (cs->seqlocks[no].load(std::memory_order_relaxed) == seq) {
+            return n;
+        }
+    }
+}
+
 HNSW::HNSW(int M) : rng(12345) {
     set_default_probas(M, 1.0 / log(M));
     max_level = -1;
@@ -98,6 +184,342 @@ void HNSW::reset() {
     offsets.push_back(0);
     levels.clear();
     neighbors.clear();
+    level0_offsets.clear();
+    level0_codes.clear();
+    deleted.clear();
+    ndeleted = 0;
+    concurrent.reset();
+}
+
+/**************************************************************
+ * Level 0 compression
+ **************************************************************/
+
+void HNSW::compress_level_0() {
+    if (is_level0_compressed()) {
+        return;
+    }
+    FAISS_THROW_IF_NOT_MSG(
+            !concurrent, "cannot compress a graph with concurrent adds");
+    size_t n = levels.size();
+    int nb0 = nb_neighbors(0);
+
+    std::vector<size_t> new_offsets(n + 1);
+    std::vector<storage_idx_t> new_neighbors(neighbors.size() - n * nb0);
+    std::vector<size_t> codes_offsets(n + 1);
+    std::vector<uint8_t> codes;
+    std::vector<storage_idx_t> list;
+
+    codes_offsets[0] = new_offsets[0] = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t begin, end;
+        neighbor_range(i, 0, &begin, &end);
+        list.clear();
+        for (size_t j = begin; j < end && neighbors[j] >= 0; j++) {
+            list.push_back(neighbors[j]);
+        }
+        std::sort(list.begin(), list.end());
+        storage_idx_t prev = 0;
+        for (storage_idx_t v : list) {
+            uint32_t delta = v - prev;
+            while (delta >= 128) {
+                codes.push_back((delta & 127) | 128);
+                delta >>= 7;
+            }
+            codes.push_back(delta);
+            prev = v;
+        }
+        codes_offsets[i + 1] = codes.size();
+
+        // upper levels are copied as is
+        std::copy(
+                neighbors.begin() + end,
+                neighbors.begin() + offsets[i + 1],
+                new_neighbors.begin() + new_offsets[i]);
+        new_offsets[i + 1] = new_offsets[i] + offsets[i + 1] - end;
+    }
+    codes.shrink_to_fit();
+
+    offsets = std::move(new_offsets);
+    neighbors = std::move(new_neighbors);
+    level0_offsets = std::move(codes_offsets);
+    level0_codes = std::move(codes);
+}
+
+void HNSW::decompress_level_0() {
+    if (!is_level0_compressed()) {
+        return;
+    }
+    size_t n = levels.size();
+    int nb0 = nb_neighbors(0);
+
+    std::vector<size_t> new_offsets(n + 1);
+    std::vector<storage_idx_t> new_neighbors(neighbors.size() + n * nb0, -1);
+
+    new_offsets[0] = 0;
+    for (size_t i = 0; i < n; i++) {
+        size_t o = new_offsets[i];
+        get_neighbors(i, 0, n, new_neighbors.data() + o);
+        std::copy(
+                neighbors.begin() + offsets[i],
+                neighbors.begin() + offsets[i + 1],
+                new_neighbors.begin() + o + nb0);
+        new_offsets[i + 1] = o + nb0 + offsets[i + 1] - offsets[i];
+    }
+
+    offsets = std::move(new_offsets);
+    neighbors = std::move(new_neighbors);
+    level0_offsets.clear();
+    level0_codes.clear();
+}
+
+/**************************************************************
+ * Renumbering
+ **************************************************************/
+
+void HNSW::permute_entries(const idx_t* perm) {
+    FAISS_THROW_IF_NOT_MSG(
+            !concurrent && ndeleted == 0,
+            "cannot renumber a graph with concurrent adds or deletions");
+    FAISS_THROW_IF_NOT_MSG(
+            !is_level0_compressed(), "level 0 of the graph is compressed");
+    storage_idx_t n = levels.size();
+
+    // old id -> new id
+    std::vector<storage_idx_t> map(n, -1);
+    for (storage_idx_t i = 0; i < n; i++) {
+        FAISS_THROW_IF_NOT(perm[i] >= 0 && perm[i] < n);
+        FAISS_THROW_IF_NOT_MSG(map[perm[i]] == -1, "invalid permutation");
+        map[perm[i]] = i;
+    }
+
+    std::vector<int> new_levels(n);
+    std::vector<size_t> new_offsets(n + 1);
+    std::vector<storage_idx_t> new_neighbors(neighbors.size());
+
+    new_offsets[0] = 0;
+    for (storage_idx_t i = 0; i < n; i++) {
+        storage_idx_t i0 = perm[i];
+        new_levels[i] = levels[i0];
+        size_t o = new_offsets[i];
+        for (size_t j = offsets[i0]; j < offsets[i0 + 1]; j++) {
+            storage_idx_t v = neighbors[j];
+            new_neighbors[o++] = v < 0 ? v : map[v];
+        }
+        new_offsets[i + 1] = o;
+    }
+
+    levels = std::move(new_levels);
+    offsets = std::move(new_offsets);
+    neighbors = std::move(new_neighbors);
+    if (entry_point >= 0) {
+        entry_point = map[entry_point];
+    }
+}
+
+void HNSW::bfs_order(idx_t* perm) const {
+    FAISS_THROW_IF_NOT_MSG(
+            !is_level0_compressed(), "level 0 of the graph is compressed");
+    storage_idx_t n = levels.size();
+    std::vector<bool> seen(n);
+    // perm doubles as the BFS queue
+    idx_t nperm = 0, head = 0;
+    storage_idx_t next_root = 0;
+
+    if (entry_point >= 0) {
+        seen[entry_point] = true;
+        perm[nperm++] = entry_point;
+    }
+
+    for (;;) {
+        while (head < nperm) {
+            storage_idx_t v = perm[head++];
+            size_t begin, end;
+            neighbor_range(v, 0, &begin, &end);
+            for (size_t j = begin; j < end; j++) {
+                storage_idx_t u = neighbors[j];
+                if (u < 0)
+                    break;
+                if (!seen[u]) {
+                    seen[u] = true;
+                    perm[nperm++] = u;
+                }
+            }
+        }
+        // unreachable vertices start a new traversal
+        while (next_root < n && seen[next_root]) {
+            next_root++;
+        }
+        if (next_root == n) {
+            break;
+        }
+        seen[next_root] = true;
+        perm[nperm++] = next_root;
+    }
+    FAISS_ASSERT(nperm == n);
+}
+
+/**************************************************************
+ * Deletion
+ **************************************************************/
+
+bool HNSW::mark_deleted(storage_idx_t i) {
+    FAISS_THROW_IF_NOT(i >= 0 && i < levels.size());
+    if (deleted.size() < levels.size()) {
+        deleted.resize(levels.size(), 0);
+    }
+    if (deleted[i]) {
+        return false;
+    }
+    deleted[i] = 1;
+    ndeleted++;
+    return true;
+}
+
+int HNSW::repair_neighbors(
+        DistanceComputer& qdis,
+        storage_idx_t i,
+        int max_hops) {
+    int nchanged = 0;
+    std::unordered_set<storage_idx_t> seen;
+    std::vector<storage_idx_t> frontier, next;
+
+    for (int level = 0; level < levels[i]; level++) {
+        size_t begin, end;
+        neighbor_range(i, level, &begin, &end);
+
+        bool has_deleted = false;
+        for (size_t j = begin; j < end; j++) {
+            storage_idx_t v = neighbors[j];
+            if (v < 0)
+                break;
+            if (is_deleted(v)) {
+                has_deleted = true;
+                break;
+            }
+        }
+        if (!has_deleted) {
+            continue;
+        }
+
+        // collect the live vertices reachable from i through deleted ones.
+        // Only the lists of i and of deleted vertices are read, so vertices
+        // can be repaired in parallel
+        std::priority_queue<NodeDistFarther> candidates;
+        seen.clear();
+        seen.insert(i);
+        frontier.assign(1, i);
+        for (int hop = 0; hop <= max_hops && !frontier.empty(); hop++) {
+            next.clear();
+            for (storage_idx_t u : frontier) {
+                size_t begin1, end1;
+                neighbor_range(u, level, &begin1, &end1);
+                for (size_t j = begin1; j < end1; j++) {
+                    storage_idx_t v = neighbors[j];
+                    if (v < 0)
+                        break;
+                    if (!seen.insert(v).second)
+                        continue;
+                    if (is_deleted(v)) {
+                        next.push_back(v);
+                    } else {
+                        candidates.emplace(qdis.symmetric_dis(i, v), v);
+                    }
+                }
+            }
+            std::swap(frontier, next);
+        }
+
+        std::vector<NodeDistFarther> shrunk_list;
+        if (candidates.size() <= end - begin) {
+            while (!candidates.empty()) {
+                shrunk_list.push_back(candidates.top());
+                candidates.pop();
+            }
+        } else {
+            shrink_neighbor_list(qdis, candidates, shrunk_list, end - begin);
+        }
+
+        for (size_t j = begin; j < end; j++) {
+            if (j - begin < shrunk_list.size())
+                neighbors[j] = shrunk_list[j - begin].id;
+            else
+                neighbors[j] = -1;
+        }
+        nchanged++;
+    }
+    return nchanged;
+}
+
+size_t HNSW::compact_deleted() {
+    if (ndeleted == 0) {
+        return 0;
+    }
+    FAISS_THROW_IF_NOT_MSG(
+            !concurrent, "cannot compact a graph with concurrent adds");
+    FAISS_THROW_IF_NOT_MSG(
+            !is_level0_compressed(), "level 0 of the graph is compressed");
+    storage_idx_t n = levels.size();
+
+    // old id -> new id, -1 for deleted vertices
+    std::vector<storage_idx_t> new_ids(n, -1);
+    storage_idx_t n2 = 0;
+    for (storage_idx_t i = 0; i < n; i++) {
+        if (!is_deleted(i)) {
+            new_ids[i] = n2++;
+        }
+    }
+
+    std::vector<int> new_levels;
+    new_levels.reserve(n2);
+    std::vector<size_t> new_offsets(1, 0);
+    new_offsets.reserve(n2 + 1);
+    std::vector<storage_idx_t> new_neighbors;
+
+    for (storage_idx_t i = 0; i < n; i++) {
+        if (new_ids[i] < 0) {
+            continue;
+        }
+        new_levels.push_back(levels[i]);
+        for (int level = 0; level < levels[i]; level++) {
+            size_t begin, end;
+            neighbor_range(i, level, &begin, &end);
+            size_t o = new_neighbors.size();
+            for (size_t j = begin; j < end; j++) {
+                storage_idx_t v = neighbors[j];
+                if (v < 0)
+                    break;
+                if (new_ids[v] >= 0) {
+                    new_neighbors.push_back(new_ids[v]);
+                }
+            }
+            new_neighbors.resize(o + end - begin, -1);
+        }
+        new_offsets.push_back(new_neighbors.size());
+    }
+
+    // the entry point must be a remaining vertex of maximum level
+    storage_idx_t new_entry_point = -1;
+    if (entry_point >= 0 && new_ids[entry_point] >= 0) {
+        new_entry_point = new_ids[entry_point];
+    } else {
+        for (storage_idx_t i = 0; i < n2; i++) {
+            if (new_entry_point < 0 ||
+                new_levels[i] > new_levels[new_entry_point]) {
+                new_entry_point = i;
+            }
+        }
+    }
+
+    levels = std::move(new_levels);
+    offsets = std::move(new_offsets);
+    neighbors = std::move(new_neighbors);
+    entry_point = new_entry_point;
+    max_level = entry_point >= 0 ? levels[entry_point] - 1 : -1;
+    deleted.clear();
+    ndeleted = 0;
+
+    return n - n2;
 }
 
 void HNSW::print_neighbor_stats(int level) const {
@@ -193,6 +615,10 @@ void HNSW::fill_with_random_links(size_t n) {
 }
 
 int HNSW::prepare_level_tab(size_t n, bool preset_levels) {
+    FAISS_THROW_IF_NOT_MSG(
+            !is_level0_compressed(),
+            "cannot add to a graph with compressed level 0, "
+            "call decompress_level_0()");
     size_t n0 = offsets.size() - 1;
 
     if (preset_levels) {
@@ -283,6 +709,25 @@ void shrink_neighbor_list(
     }
 }
 
+/// makes the updates to the lists of a vertex atomic for concurrent searches
+struct SeqLockWriteGuard {
+    HNSWConcurrentState* cs;
+    storage_idx_t i;
+
+    SeqLockWriteGuard(HNSWConcurrentState* cs, storage_idx_t i)
+            : cs(cs), i(i) {
+        if (cs) {
+            cs->write_begin(i);
+        }
+    }
+
+    ~SeqLockWriteGuard() {
+        if (cs) {
+            cs->write_end(i);
+        }
+    }
+};
+
 /// add a link between two elements, possibly shrinking the list
 /// of links to make room for it.
 void add_link(
@@ -291,6 +736,7 @@ void add_link(
         storage_idx_t src,
         storage_idx_t dest,
         int level) {
+    SeqLockWriteGuard guard(hnsw.concurrent.get(), src);
     size_t begin, end;
     hnsw.neighbor_range(src, level, &begin, &end);
     if (hnsw.neighbors[end - 1] == -1) {
@@ -386,20 +832,82 @@ void search_neighbors_to_add(
  * Searching subroutines
  **************************************************************/
 
+/// size of the buffer needed by neighbor_list
+size_t neighbor_buffer_size(const HNSW& hnsw) {
+    if (!hnsw.concurrent && !hnsw.is_level0_compressed()) {
+        return 0;
+    }
+    int nmax = 0;
+    for (int level = 0; level < hnsw.assign_probas.size(); level++) {
+        nmax = std::max(nmax, hnsw.nb_neighbors(level));
+    }
+    return nmax;
+}
+
+/** Neighbors of vertex no at a level, as an array of size *n that may be
+ * terminated early by -1 entries. When vertices are added concurrently or
+ * the list is compressed, a consistent copy of the list is made to buf. */
+const storage_idx_t* neighbor_list(
+        const HNSW& hnsw,
+        storage_idx_t no,
+        int level,
+        storage_idx_t nvisible,
+        storage_idx_t* buf,
+        size_t* n) {
+    if (!hnsw.concurrent && (level > 0 || !hnsw.is_level0_compressed())) {
+        size_t begin, end;
+        hnsw.neighbor_range(no, level, &begin, &end);
+        *n = end - begin;
+        return hnsw.neighbors.data() + begin;
+    }
+    *n = hnsw.get_neighbors(no, level, nvisible, buf);
+    return buf;
+}
+
+/// number of vertices that a search using this visited table can access
+storage_idx_t visible_vertices(const HNSW& hnsw, const VisitedTable& vt) {
+    if (!hnsw.concurrent) {
+        return hnsw.levels.size();
+    }
+    return std::min(
+            hnsw.concurrent->ntotal_visible.load(std::memory_order_acquire),
+            storage_idx_t(vt.visited.size()));
+}
+
+/// entry point and top level to use for a search
+void get_search_entry_point(
+        const HNSW& hnsw,
+        storage_idx_t* entry_point,
+        int* max_level) {
+    *entry_point = hnsw.entry_point;
+    *max_level = hnsw.max_level;
+    if (hnsw.concurrent) {
+        // the entry point is published after the vertex is visible
+        *entry_point =
+                hnsw.concurrent->entry_point.load(std::memory_order_acquire);
+        if (*entry_point >= 0) {
+            *max_level = hnsw.levels[*entry_point] - 1;
+        }
+    }
+}
+
 /// greedily update a nearest vector at a given level
 void greedy_update_nearest(
         const HNSW& hnsw,
         DistanceComputer& qdis,
         int level,
         storage_idx_t& nearest,
-        float& d_nearest) {
+        float& d_nearest,
+        storage_idx_t nvisible) {
+    std::vector<storage_idx_t> buf(neighbor_buffer_size(hnsw));
     for (;;) {
         storage_idx_t prev_nearest = nearest;
 
-        size_t begin, end;
-        hnsw.neighbor_range(nearest, level, &begin, &end);
-        for (size_t i = begin; i < end; i++) {
-            storage_idx_t v = hnsw.neighbors[i];
+        size_t nneigh;
+        const storage_idx_t* neigh = neighbor_list(
+                hnsw, nearest, level, nvisible, buf.data(), &nneigh);
+        for (size_t i = 0; i < nneigh; i++) {
+            storage_idx_t v = neigh[i];
             if (v < 0)
                 break;
             float dis = qdis(v);
@@ -487,7 +995,8 @@ void HNSW::add_with_locks(
     float d_nearest = ptdis(nearest);
 
     for (; level > pt_level; level--) {
-        greedy_update_nearest(*this, ptdis, level, nearest, d_nearest);
+        greedy_update_nearest(
+                *this, ptdis, level, nearest, d_nearest, levels.size());
     }
 
     for (; level >= 0; level--) {
@@ -534,17 +1043,41 @@ int search_from_candidates(
     int efSearch = params ? params->efSearch : hnsw.efSearch;
     const IDSelector* sel = params ? params->sel : nullptr;
 
-    for (int i = 0; i < candidates.size(); i++) {
-        idx_t v1 = candidates.ids[i];
-        float d = candidates.dis[i];
-        FAISS_ASSERT(v1 >= 0);
-        if (!sel || sel->is_member(v1)) {
+    // deleted vertices are only used for routing
+    bool skip_deleted = level == 0 && hnsw.ndeleted > 0;
+
+    // go through the rejected vertices to their neighbors
+    bool two_hop = level == 0 && sel && params->filter_two_hop;
+
+    // adaptive early termination, only for the final results
+    int patience = level == 0 && params ? params->early_stop_patience : 0;
+    size_t max_ndis = level == 0 && params ? params->max_ndis : 0;
+    int nstep_no_improve = 0;
+    bool improved = false;
+
+    storage_idx_t nvisible = visible_vertices(hnsw, vt);
+    std::vector<storage_idx_t> buf(neighbor_buffer_size(hnsw));
+    std::vector<storage_idx_t> buf2(two_hop ? buf.size() : 0);
+
+    auto add_to_heap = [&](idx_t v1, float d) {
+        if (skip_deleted && hnsw.is_deleted(v1)) {
+            // not a valid result
+        } else if (!sel || sel->is_member(v1)) {
             if (nres < k) {
                 faiss::maxheap_push(++nres, D, I, d, v1);
+                improved = true;
             } else if (d < D[0]) {
                 faiss::maxheap_replace_top(nres, D, I, d, v1);
+                improved = true;
             }
         }
+    };
+
+    for (int i = 0; i < candidates.size(); i++) {
+        idx_t v1 = candidates.ids[i];
+        float d = candidates.dis[i];
+        FAISS_ASSERT(v1 >= 0);
+        add_to_heap(v1, d);
         vt.set(v1);
     }
 
@@ -565,33 +1098,96 @@ int search_from_candidates(
             }
         }
 
-        size_t begin, end;
-        hnsw.neighbor_range(v0, level, &begin, &end);
+        size_t nneigh;
+        const storage_idx_t* neigh =
+                neighbor_list(hnsw, v0, level, nvisible, buf.data(), &nneigh);
+
+        // the distances to the unvisited neighbors are computed by
+        // batches of 4
+        int saved_j[4];
+        int counter = 0;
+
+        auto add_candidate = [&](int v1) {
+            saved_j[counter++] = v1;
+            if (counter == 4) {
+                float dis[4];
+                qdis.distances_batch_4(
+                        saved_j[0],
+                        saved_j[1],
+                        saved_j[2],
+                        saved_j[3],
+                        dis[0],
+                        dis[1],
+                        dis[2],
+                        dis[3]);
+                for (int id4 = 0; id4 < 4; id4++) {
+                    add_to_heap(saved_j[id4], dis[id4]);
+                    candidates.push(saved_j[id4], dis[id4]);
+                }
+                ndis += 4;
+                counter = 0;
+            }
+        };
 
-        for (size_t j = begin; j < end; j++) {
-            int v1 = hnsw.neighbors[j];
+        auto is_allowed = [&](storage_idx_t v) {
+            return sel->is_member(v) && !(skip_deleted && hnsw.is_deleted(v));
+        };
+
+        // the second hop adds at most as many vertices as a neighbor list
+        size_t n_two_hop = 0;
+        size_t max_two_hop = nneigh;
+
+        for (size_t j = 0; j < nneigh; j++) {
+            int v1 = neigh[j];
             if (v1 < 0)
                 break;
             if (vt.get(v1)) {
                 continue;
             }
             vt.set(v1);
-            ndis++;
-            float d = qdis(v1);
-            if (!sel || sel->is_member(v1)) {
-                if (nres < k) {
-                    faiss::maxheap_push(++nres, D, I, d, v1);
-                } else if (d < D[0]) {
-                    faiss::maxheap_replace_top(nres, D, I, d, v1);
+            if (!two_hop || is_allowed(v1)) {
+                add_candidate(v1);
+                continue;
+            }
+            size_t nneigh2;
+            const storage_idx_t* neigh2 = neighbor_list(
+                    hnsw, v1, level, nvisible, buf2.data(), &nneigh2);
+            for (size_t j2 = 0; j2 < nneigh2 && n_two_hop < max_two_hop;
+                 j2++) {
+                int v2 = neigh2[j2];
+                if (v2 < 0)
+                    break;
+                if (vt.get(v2) || !is_allowed(v2)) {
+                    continue;
                 }
+                vt.set(v2);
+                add_candidate(v2);
+                n_two_hop++;
             }
-            candidates.push(v1, d);
+        }
+
+        for (int icnt = 0; icnt < counter; icnt++) {
+            float d = qdis(saved_j[icnt]);
+            add_to_heap(saved_j[icnt], d);
+            candidates.push(saved_j[icnt], d);
+            ndis++;
         }
 
         nstep++;
         if (!do_dis_check && nstep > efSearch) {
             break;
         }
+
+        if (patience > 0 && nres == k) {
+            nstep_no_improve = improved ? 0 : nstep_no_improve + 1;
+            if (nstep_no_improve >= patience) {
+                break;
+            }
+        }
+        improved = false;
+        if (max_ndis > 0 && ndis >= max_ndis) {
+            break;
+        }
     }
 
     if (level == 0) {
@@ -621,6 +1217,9 @@ std::priority_queue<HNSW::Node> search_from_candidate_unbounded(
 
     vt->set(node.second);
 
+    storage_idx_t nvisible = visible_vertices(hnsw, *vt);
+    std::vector<storage_idx_t> buf(neighbor_buffer_size(hnsw));
+
     while (!candidates.empty()) {
         float d0;
         storage_idx_t v0;
@@ -632,11 +1231,12 @@ std::priority_queue<HNSW::Node> search_from_candidate_unbounded(
 
         candidates.pop();
 
-        size_t begin, end;
-        hnsw.neighbor_range(v0, 0, &begin, &end);
+        size_t nneigh;
+        const storage_idx_t* neigh =
+                neighbor_list(hnsw, v0, 0, nvisible, buf.data(), &nneigh);
 
-        for (size_t j = begin; j < end; ++j) {
-            int v1 = hnsw.neighbors[j];
+        for (size_t j = 0; j < nneigh; ++j) {
+            int v1 = neigh[j];
 
             if (v1 < 0) {
                 break;
@@ -672,6 +1272,27 @@ std::priority_queue<HNSW::Node> search_from_candidate_unbounded(
 
 } // anonymous namespace
 
+storage_idx_t HNSW::search_upper_levels(
+        DistanceComputer& qdis,
+        const VisitedTable& vt,
+        float* d_nearest) const {
+    storage_idx_t nearest;
+    int max_level;
+    get_search_entry_point(*this, &nearest, &max_level);
+    if (nearest == -1) {
+        return -1;
+    }
+    storage_idx_t nvisible = visible_vertices(*this, vt);
+    FAISS_THROW_IF_NOT(nearest < nvisible);
+
+    float d = qdis(nearest);
+    for (int level = max_level; level >= 1; level--) {
+        greedy_update_nearest(*this, qdis, level, nearest, d, nvisible);
+    }
+    *d_nearest = d;
+    return nearest;
+}
+
 HNSWStats HNSW::search(
         DistanceComputer& qdis,
         int k,
@@ -680,19 +1301,32 @@ HNSWStats HNSW::search(
         VisitedTable& vt,
         const SearchParametersHNSW* params) const {
     HNSWStats stats;
+    search(qdis, k, I, D, vt, stats, params);
+    return stats;
+}
+
+void HNSW::search(
+        DistanceComputer& qdis,
+        int k,
+        idx_t* I,
+        float* D,
+        VisitedTable& vt,
+        HNSWStats& stats,
+        const SearchParametersHNSW* params) const {
+    storage_idx_t entry_point;
+    int max_level;
+    get_search_entry_point(*this, &entry_point, &max_level);
     if (entry_point == -1) {
-        return stats;
+        return;
     }
+    size_t n3_before = stats.n3;
+
     if (upper_beam == 1) {
         //  greedy search on upper levels
-        storage_idx_t nearest = entry_point;
-        float d_nearest = qdis(nearest);
-
-        for (int level = max_level; level >= 1; level--) {
-            greedy_update_nearest(*this, qdis, level, nearest, d_nearest);
-        }
+        float d_nearest;
+        storage_idx_t nearest = search_upper_levels(qdis, vt, &d_nearest);
 
-        int ef = std::max(efSearch, k);
+        int ef = std::max(params ? params->efSearch : efSearch, k);
         if (search_bounded_queue) { // this is the most common branch
             MinimaxHeap candidates(ef);
 
@@ -710,17 +1344,20 @@ HNSWStats HNSW::search(
                             &vt,
                             stats);
 
-            while (top_candidates.size() > k) {
-                top_candidates.pop();
-            }
-
             int nres = 0;
             while (!top_candidates.empty()) {
                 float d;
                 storage_idx_t label;
                 std::tie(d, label) = top_candidates.top();
-                faiss::maxheap_push(++nres, D, I, d, label);
                 top_candidates.pop();
+                if (is_deleted(label)) {
+                    continue;
+                }
+                if (nres < k) {
+                    faiss::maxheap_push(++nres, D, I, d, label);
+                } else if (d < D[0]) {
+                    faiss::maxheap_replace_top(nres, D, I, d, label);
+                }
             }
         }
 
@@ -765,7 +1402,7 @@ HNSWStats HNSW::search(
         }
     }
 
-    return stats;
+    stats.add_query_ndis(stats.n3 - n3_before);
 }
 
 void HNSW::search_level_0(
@@ -778,8 +1415,11 @@ void HNSW::search_level_0(
         const float* nearest_d,
         int search_type,
         HNSWStats& search_stats,
-        VisitedTable& vt) const {
+        VisitedTable& vt,
+        const SearchParametersHNSW* params) const {
     const HNSW& hnsw = *this;
+    int efSearch = params ? params->efSearch : hnsw.efSearch;
+    size_t n3_before = search_stats.n3;
 
     if (search_type == 1) {
         int nres = 0;
@@ -793,7 +1433,7 @@ void HNSW::search_level_0(
             if (vt.get(cj))
                 continue;
 
-            int candidates_size = std::max(hnsw.efSearch, int(k));
+            int candidates_size = std::max(efSearch, int(k));
             MinimaxHeap candidates(candidates_size);
 
             candidates.push(cj, nearest_d[j]);
@@ -808,10 +1448,11 @@ void HNSW::search_level_0(
                     vt,
                     search_stats,
                     0,
-                    nres);
+                    nres,
+                    params);
         }
     } else if (search_type == 2) {
-        int candidates_size = std::max(hnsw.efSearch, int(k));
+        int candidates_size = std::max(efSearch, int(k));
         candidates_size = std::max(candidates_size, int(nprobe));
 
         MinimaxHeap candidates(candidates_size);
@@ -824,8 +1465,57 @@ void HNSW::search_level_0(
         }
 
         search_from_candidates(
-                hnsw, qdis, k, idxi, simi, candidates, vt, search_stats, 0);
+                hnsw,
+                qdis,
+                k,
+                idxi,
+                simi,
+                candidates,
+                vt,
+                search_stats,
+                0,
+                0,
+                params);
+    }
+
+    search_stats.add_query_ndis(search_stats.n3 - n3_before);
+}
+
+/**************************************************************
+ * HNSWStats
+ **************************************************************/
+
+constexpr int HNSWStats::ndis_hist_size;
+
+void HNSWStats::add_query_ndis(size_t ndis, size_t nq) {
+    int b = int(4 * std::log2(double(ndis) + 1));
+    ndis_hist[std::min(b, ndis_hist_size - 1)] += nq;
+}
+
+size_t HNSWStats::nquery() const {
+    size_t nq = 0;
+    for (int b = 0; b < ndis_hist_size; b++) {
+        nq += ndis_hist[b];
+    }
+    return nq;
+}
+
+size_t HNSWStats::ndis_quantile(double q) const {
+    size_t nq = nquery();
+    if (nq == 0) {
+        return 0;
+    }
+    size_t rank = std::min(size_t(q * nq), nq - 1);
+    size_t cum = 0;
+    int b = 0;
+    for (; b < ndis_hist_size - 1; b++) {
+        cum += ndis_hist[b];
+        if (cum > rank) {
+            break;
+        }
     }
+    // largest ndis that falls in bucket b
+    return size_t(std::ceil(std::exp2((b + 1) / 4.0))) - 2;
 }
 
 /**************************************************************
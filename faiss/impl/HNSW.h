@@ -9,6 +9,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
 #include <queue>
 #include <unordered_set>
 #include <vector>
@@ -17,6 +21,7 @@
 
 #include <faiss/Index.h>
 #include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/maybe_owned_vector.h>
 #include <faiss/impl/platform_macros.h>
 #include <faiss/utils/Heap.h>
 #include <faiss/utils/random.h>
@@ -47,9 +52,79 @@ struct SearchParametersHNSW : SearchParameters {
     int efSearch = 16;
     bool check_relative_distance = true;
 
+    /** Filtered search (sel != nullptr). IndexHNSW::search estimates the
+     * fraction of the ids that pass the selector, then:
+     * - below filter_brute_force_threshold, the ids that pass the selector
+     *   are scanned exhaustively;
+     * - below filter_two_hop_threshold, the traversal is done with
+     *   filter_two_hop;
+     * - otherwise efSearch is divided by the fraction, with a factor of at
+     *   most filter_max_efSearch_factor, to make up for the rejected
+     *   vertices in the candidate list.
+     * The defaults disable the three strategies (eg. 0.01, 0.5 and 4 enable
+     * them).
+     */
+    float filter_brute_force_threshold = 0;
+    float filter_two_hop_threshold = 0;
+    float filter_max_efSearch_factor = 1;
+
+    /** At level 0, compute the distances only to the vertices that pass the
+     * selector and reach the neighbors of the rejected vertices through
+     * them, so that the graph stays connected when few vertices pass.
+     */
+    bool filter_two_hop = false;
+
+    /** Adaptive early termination of the level 0 search: stop when the k
+     * results have not changed during early_stop_patience consecutive
+     * expansions of the candidate list. Easy queries then stop well before
+     * efSearch is exhausted, while hard queries still use it. 0 = disabled.
+     */
+    int early_stop_patience = 0;
+
+    /// max nb of level 0 distances computed per query, 0 = no limit
+    size_t max_ndis = 0;
+
     ~SearchParametersHNSW() {}
 };
 
+/** Synchronization state to add vertices to a HNSW graph while it is being
+ * searched, see IndexHNSW::reserve.
+ *
+ * The neighbor lists of each vertex are protected by a sequence lock:
+ * writers make the sequence number odd while they modify the lists of the
+ * vertex, readers copy a list and retry if the sequence number changed in
+ * the meantime, so they never block. Vertices become visible to searches
+ * once they are fully linked, by increasing ntotal_visible. The arrays of
+ * the graph are preallocated so that they are never moved in memory.
+ */
+struct HNSWConcurrentState {
+    /// max number of vertices in the graph
+    size_t capacity;
+
+    /// one sequence number per vertex, size capacity
+    std::unique_ptr<std::atomic<uint32_t>[]> seqlocks;
+
+    /// vertices < ntotal_visible can be accessed by searches
+    std::atomic<int32_t> ntotal_visible;
+
+    /// entry point to use for searches
+    std::atomic<int32_t> entry_point;
+
+    /// serializes the calls to IndexHNSW::add
+    std::mutex add_mutex;
+
+    explicit HNSWConcurrentState(size_t capacity);
+
+    void write_begin(int32_t i) {
+        seqlocks[i].fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void write_end(int32_t i) {
+        seqlocks[i].fetch_add(1, std::memory_order_release);
+    }
+};
+
 struct HNSW {
     /// internal storage of vectors (32 bits: this is expensive)
     using storage_idx_t = int32_t;
@@ -109,15 +184,15 @@ struct HNSW {
     std::vector<int> cum_nneighbor_per_level;
 
     /// level of each vector (base level = 1), size = ntotal
-    std::vector<int> levels;
+    MaybeOwnedVector<int> levels;
 
     /// offsets[i] is the offset in the neighbors array where vector i is stored
     /// size ntotal + 1
-    std::vector<size_t> offsets;
+    MaybeOwnedVector<size_t> offsets;
 
     /// neighbors[offsets[i]:offsets[i+1]] is the list of neighbors of vector i
     /// for all levels. this is where all storage goes.
-    std::vector<storage_idx_t> neighbors;
+    MaybeOwnedVector<storage_idx_t> neighbors;
 
     /// entry point in the search structure (one of the points with maximum
     /// level
@@ -144,6 +219,44 @@ struct HNSW {
     /// use bounded queue during exploration
     bool search_bounded_queue = true;
 
+    /** Batched search in IndexHNSW::search: all queries of a batch first
+     * descend the upper levels, then the level 0 searches are run with the
+     * queries sorted by entry point, so that queries exploring the same
+     * region of the graph are processed back-to-back by the same thread and
+     * find the vectors and links in cache. Used only with upper_beam = 1
+     * and the bounded queue. */
+    bool search_group_queries = false;
+
+    /// tombstones: deleted[i] != 0 if vector i was removed but its slot was
+    /// not reclaimed yet. Deleted vertices are still used for routing but are
+    /// never returned as search results. May be shorter than ntotal.
+    std::vector<uint8_t> deleted;
+
+    /// number of non-zero entries in deleted
+    size_t ndeleted = 0;
+
+    /// unique_ptr that is not transferred when the graph is copied
+    struct ConcurrentStatePtr : std::unique_ptr<HNSWConcurrentState> {
+        ConcurrentStatePtr() {}
+        ConcurrentStatePtr(const ConcurrentStatePtr&) {}
+        ConcurrentStatePtr& operator=(const ConcurrentStatePtr&) {
+            reset();
+            return *this;
+        }
+    };
+
+    /// non-null if vertices can be added during searches, see
+    /// enable_concurrent_add. Copies of the graph do not inherit it.
+    ConcurrentStatePtr concurrent;
+
+    /// compressed level 0 neighbor lists, see compress_level_0. The list of
+    /// vertex i is level0_codes[level0_offsets[i]:level0_offsets[i + 1]].
+    /// Empty if level 0 is stored in the neighbors array.
+    MaybeOwnedVector<size_t> level0_offsets;
+
+    /// sorted neighbor ids, delta-encoded as varints
+    MaybeOwnedVector<uint8_t> level0_codes;
+
     // methods that initialize the tree sizes
 
     /// initialize the assign_probas and cum_nneighbor_per_level to
@@ -201,6 +314,29 @@ struct HNSW {
             VisitedTable& vt,
             const SearchParametersHNSW* params = nullptr) const;
 
+    /// same, the statistics are added to stats (eg. per thread)
+    void search(
+            DistanceComputer& qdis,
+            int k,
+            idx_t* I,
+            float* D,
+            VisitedTable& vt,
+            HNSWStats& stats,
+            const SearchParametersHNSW* params = nullptr) const;
+
+    /** Greedy search on the levels above 0 for 1 point
+     *
+     * @param vt         visited table of the level 0 search that follows,
+     *                   used only to bound the vertices that are accessed
+     * @param d_nearest  distance from the query to the returned vertex
+     * @return           the entry point for the search at level 0, -1 if
+     *                   the graph is empty
+     */
+    storage_idx_t search_upper_levels(
+            DistanceComputer& qdis,
+            const VisitedTable& vt,
+            float* d_nearest) const;
+
     /// search only in level 0 from a given vertex
     void search_level_0(
             DistanceComputer& qdis,
@@ -212,7 +348,85 @@ struct HNSW {
             const float* nearest_d,
             int search_type,
             HNSWStats& search_stats,
-            VisitedTable& vt) const;
+            VisitedTable& vt,
+            const SearchParametersHNSW* params = nullptr) const;
+
+    /// is vertex i tombstoned
+    bool is_deleted(storage_idx_t i) const {
+        return ndeleted > 0 && i < deleted.size() && deleted[i];
+    }
+
+    /** Preallocate the graph for capacity vertices in total, of which
+     * nslots link slots, and allow add_with_locks to run concurrently with
+     * searches from then on.
+     */
+    void enable_concurrent_add(size_t capacity, size_t nslots);
+
+    /** Copy the neighbor list of vertex no at layer_no to out, skipping
+     * the vertices >= nvisible. When adds run concurrently, the copy is
+     * consistent. out should have room for nb_neighbors(layer_no)
+     * elements.
+     *
+     * @return  number of neighbors copied
+     */
+    size_t get_neighbors(
+            storage_idx_t no,
+            int layer_no,
+            storage_idx_t nvisible,
+            storage_idx_t* out) const;
+
+    /// are the level 0 neighbor lists compressed
+    bool is_level0_compressed() const {
+        return !level0_offsets.empty();
+    }
+
+    /** Store the level 0 neighbor lists in compressed form: the ids of each
+     * list are sorted and the differences between consecutive ids are
+     * encoded as varints, without the -1 padding. The neighbors array then
+     * contains only the levels > 0. Searching decodes the lists on the fly;
+     * the graph cannot be modified until decompress_level_0 is called.
+     */
+    void compress_level_0();
+
+    /// store level 0 in the neighbors array again
+    void decompress_level_0();
+
+    /** Renumber the vertices: the new vertex i is the former vertex perm[i].
+     * perm should be a permutation of [0, ntotal) */
+    void permute_entries(const idx_t* perm);
+
+    /** Compute a vertex order where the vertices close in the level 0 graph
+     * get close ids: breadth-first traversal from the entry point, the
+     * vertices that are not reachable start new traversals. The result can
+     * be passed to permute_entries to improve the memory locality of the
+     * searches.
+     *
+     * @param perm   output permutation, size ntotal
+     */
+    void bfs_order(idx_t* perm) const;
+
+    /// tombstone vertex i, returns false if it was already deleted
+    bool mark_deleted(storage_idx_t i);
+
+    /** Replace the links to deleted vertices in the neighbor lists of the
+     * remaining vertices. The candidate neighbors of a vertex are its
+     * non-deleted neighbors plus the vertices reachable through at most
+     * max_hops deleted vertices, pruned with shrink_neighbor_list.
+     *
+     * @param qdis   distance computer for vertex pairs, only symmetric_dis
+     *               is used
+     * @param i      vertex to repair
+     * @return       number of levels where the neighbor list changed
+     */
+    int repair_neighbors(DistanceComputer& qdis, storage_idx_t i, int max_hops);
+
+    /** Remove the deleted vertices from the link structure and renumber the
+     * remaining ones, keeping their relative order. Links towards deleted
+     * vertices are dropped, so repair_neighbors should be called before.
+     *
+     * @return the number of removed vertices
+     */
+    size_t compact_deleted();
 
     void reset();
 
@@ -233,18 +447,27 @@ struct HNSWStats {
     size_t ndis;
     size_t nreorder;
 
+    /// histogram of the nb of level 0 distances computed per query, with 4
+    /// buckets per power of 2: bucket b counts the queries for which
+    /// floor(4 * log2(ndis + 1)) == b
+    static constexpr int ndis_hist_size = 128;
+    size_t ndis_hist[ndis_hist_size];
+
     HNSWStats(
             size_t n1 = 0,
             size_t n2 = 0,
             size_t n3 = 0,
             size_t ndis = 0,
             size_t nreorder = 0)
-            : n1(n1), n2(n2), n3(n3), ndis(ndis), nreorder(nreorder) {}
+            : n1(n1), n2(n2), n3(n3), ndis(ndis), nreorder(nreorder) {
+        std::fill_n(ndis_hist, ndis_hist_size, 0);
+    }
 
     void reset() {
         n1 = n2 = n3 = 0;
         ndis = 0;
         nreorder = 0;
+        std::fill_n(ndis_hist, ndis_hist_size, 0);
     }
 
     void combine(const HNSWStats& other) {
@@ -253,7 +476,20 @@ struct HNSWStats {
         n3 += other.n3;
         ndis += other.ndis;
         nreorder += other.nreorder;
+        for (int b = 0; b < ndis_hist_size; b++) {
+            ndis_hist[b] += other.ndis_hist[b];
+        }
     }
+
+    /// record nq queries that computed ndis level 0 distances each
+    void add_query_ndis(size_t ndis, size_t nq = 1);
+
+    /// nb of queries recorded in the histogram
+    size_t nquery() const;
+
+    /// approximate q-quantile (0 <= q <= 1) of the nb of level 0 distances
+    /// per query, ie. the upper bound of the corresponding bucket
+    size_t ndis_quantile(double q) const;
 };
 
 // global var that collects them all
@@ -165,10 +165,72 @@ void NSG::search(
     }
 }
 
+void NSG::permute_entries(const idx_t* perm) {
+    FAISS_THROW_IF_NOT(is_built && final_graph);
+    int N = final_graph->N;
+    int K = final_graph->K;
+
+    // old id -> new id
+    std::vector<int> map(N, EMPTY_ID);
+    for (int i = 0; i < N; i++) {
+        FAISS_THROW_IF_NOT(perm[i] >= 0 && perm[i] < N);
+        FAISS_THROW_IF_NOT_MSG(map[perm[i]] == EMPTY_ID, "invalid permutation");
+        map[perm[i]] = i;
+    }
+
+    auto new_graph = std::make_shared<nsg::Graph<int>>(N, K);
+    for (int i = 0; i < N; i++) {
+        for (int j = 0; j < K; j++) {
+            int id = final_graph->at(perm[i], j);
+            new_graph->at(i, j) = id == EMPTY_ID ? EMPTY_ID : map[id];
+        }
+    }
+    final_graph = new_graph;
+    enterpoint = map[enterpoint];
+}
+
+void NSG::bfs_order(idx_t* perm) const {
+    FAISS_THROW_IF_NOT(is_built && final_graph);
+    int N = final_graph->N;
+    std::vector<bool> seen(N);
+    // perm doubles as the BFS queue
+    idx_t nperm = 0, head = 0;
+    int next_root = 0;
+
+    seen[enterpoint] = true;
+    perm[nperm++] = enterpoint;
+
+    for (;;) {
+        while (head < nperm) {
+            int v = perm[head++];
+            for (int j = 0; j < final_graph->K; j++) {
+                int u = final_graph->at(v, j);
+                if (u == EMPTY_ID)
+                    break;
+                if (!seen[u]) {
+                    seen[u] = true;
+                    perm[nperm++] = u;
+                }
+            }
+        }
+        // unreachable nodes start a new traversal
+        while (next_root < N && seen[next_root]) {
+            next_root++;
+        }
+        if (next_root == N) {
+            break;
+        }
+        seen[next_root] = true;
+        perm[nperm++] = next_root;
+    }
+    FAISS_ASSERT(nperm == N);
+}
+
+template <class index_t>
 void NSG::build(
         Index* storage,
         idx_t n,
-        const nsg::Graph<idx_t>& knn_graph,
+        const nsg::Graph<index_t>& knn_graph,
         bool verbose) {
     FAISS_THROW_IF_NOT(!is_built && ntotal == 0);
 
@@ -235,23 +297,40 @@ void NSG::reset() {
     is_built = false;
 }
 
-void NSG::init_graph(Index* storage, const nsg::Graph<idx_t>& knn_graph) {
+template <class index_t>
+void NSG::init_graph(Index* storage, const nsg::Graph<index_t>& knn_graph) {
     int d = storage->d;
     int n = storage->ntotal;
 
     std::unique_ptr<float[]> center(new float[d]);
-    std::unique_ptr<float[]> tmp(new float[d]);
-    std::fill_n(center.get(), d, 0.0f);
+    std::vector<double> sum(d, 0.0);
 
-    for (int i = 0; i < n; i++) {
-        storage->reconstruct(i, tmp.get());
-        for (int j = 0; j < d; j++) {
-            center[j] += tmp[j];
+    // accumulate the vectors by blocks, in parallel
+    const int bs = 1024;
+#pragma omp parallel
+    {
+        std::vector<float> block(size_t(bs) * d);
+        std::vector<double> local_sum(d, 0.0);
+
+#pragma omp for schedule(dynamic)
+        for (int i0 = 0; i0 < n; i0 += bs) {
+            int i1 = std::min(i0 + bs, n);
+            storage->reconstruct_n(i0, i1 - i0, block.data());
+            for (size_t i = 0; i < size_t(i1 - i0) * d; i++) {
+                local_sum[i % d] += block[i];
+            }
+        }
+
+#pragma omp critical
+        {
+            for (int j = 0; j < d; j++) {
+                sum[j] += local_sum[j];
+            }
         }
     }
 
     for (int i = 0; i < d; i++) {
-        center[i] /= n;
+        center[i] = sum[i] / n;
     }
 
     std::vector<Neighbor> retset;
@@ -355,12 +434,29 @@ void NSG::search_on_graph(
     }
 }
 
+int NSG::link_nthreads(int knn_K) const {
+    int nt = omp_get_max_threads();
+    if (build_memory_budget == 0) {
+        return nt;
+    }
+    // visited table + pool of visited nodes collected by search_on_graph
+    size_t per_thread = size_t(ntotal) + size_t(L) * knn_K * sizeof(Node);
+    size_t max_nt = build_memory_budget / per_thread;
+    return std::max(1, (int)std::min(size_t(nt), max_nt));
+}
+
+template <class index_t>
 void NSG::link(
         Index* storage,
-        const nsg::Graph<idx_t>& knn_graph,
+        const nsg::Graph<index_t>& knn_graph,
         nsg::Graph<Node>& graph,
-        bool /* verbose */) {
-#pragma omp parallel
+        bool verbose) {
+    int nt = link_nthreads(knn_graph.K);
+    if (verbose) {
+        printf("  link with %d threads\n", nt);
+    }
+
+#pragma omp parallel num_threads(nt)
     {
         std::unique_ptr<float[]> vec(new float[storage->d]);
 
@@ -388,7 +484,8 @@ void NSG::link(
         }
     } // omp parallel
 
-    std::vector<std::mutex> locks(ntotal);
+    // striped locks: one mutex per node would take tens of bytes per node
+    std::vector<std::mutex> locks(std::min(ntotal, 1 << 16));
 #pragma omp parallel
     {
         std::unique_ptr<DistanceComputer> dis(
@@ -401,12 +498,13 @@ void NSG::link(
     } // omp parallel
 }
 
+template <class index_t>
 void NSG::sync_prune(
         int q,
         std::vector<Node>& pool,
         DistanceComputer& dis,
         VisitedTable& vt,
-        const nsg::Graph<idx_t>& knn_graph,
+        const nsg::Graph<index_t>& knn_graph,
         nsg::Graph<Node>& graph) {
     for (int i = 0; i < knn_graph.K; i++) {
         int id = knn_graph.at(q, i);
@@ -473,7 +571,7 @@ void NSG::add_reverse_links(
         std::vector<Node> tmp_pool;
         int dup = 0;
         {
-            LockGuard guard(locks[des]);
+            LockGuard guard(locks[des % locks.size()]);
             for (int j = 0; j < R; j++) {
                 if (graph.at(des, j).id == EMPTY_ID) {
                     break;
@@ -519,14 +617,14 @@ void NSG::add_reverse_links(
             }
 
             {
-                LockGuard guard(locks[des]);
+                LockGuard guard(locks[des % locks.size()]);
                 for (int t = 0; t < result.size(); t++) {
                     graph.at(des, t) = result[t];
                 }
             }
 
         } else {
-            LockGuard guard(locks[des]);
+            LockGuard guard(locks[des % locks.size()]);
             for (int t = 0; t < R; t++) {
                 if (graph.at(des, t).id == EMPTY_ID) {
                     graph.at(des, t) = sn;
@@ -537,6 +635,18 @@ void NSG::add_reverse_links(
     }
 }
 
+template void NSG::build<int>(
+        Index* storage,
+        idx_t n,
+        const nsg::Graph<int>& knn_graph,
+        bool verbose);
+
+template void NSG::build<idx_t>(
+        Index* storage,
+        idx_t n,
+        const nsg::Graph<idx_t>& knn_graph,
+        bool verbose);
+
 int NSG::tree_grow(Index* storage, std::vector<int>& degrees) {
     int root = enterpoint;
     VisitedTable vt(ntotal);
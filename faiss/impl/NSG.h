@@ -66,12 +66,12 @@ struct Graph {
     // construct an empty graph
     // NOTE: the newly allocated data needs to be destroyed at destruction time
     Graph(int N, int K) : K(K), N(N), own_fields(true) {
-        data = new node_t[N * K];
+        data = new node_t[size_t(N) * K];
     }
 
     // copy constructor
     Graph(const Graph& g) : Graph(g.N, g.K) {
-        memcpy(data, g.data, N * K * sizeof(node_t));
+        memcpy(data, g.data, size_t(N) * K * sizeof(node_t));
     }
 
     // release the allocated memory if needed
@@ -83,12 +83,12 @@ struct Graph {
 
     // access the j-th neighbor of node i
     inline node_t at(int i, int j) const {
-        return data[i * K + j];
+        return data[size_t(i) * K + j];
     }
 
     // access the j-th neighbor of node i by reference
     inline node_t& at(int i, int j) {
-        return data[i * K + j];
+        return data[size_t(i) * K + j];
     }
 };
 
@@ -110,6 +110,13 @@ struct NSG {
     // search-time parameters
     int search_L; ///< length of the search path
 
+    /// max nb of bytes of the temporary buffers allocated by the build, on
+    /// top of the kNN graph and the NSG graph. It bounds the size of the
+    /// query blocks of the brute-force kNN search (see IndexNSG::add) and
+    /// the nb of threads that link the graph, each of which needs a visited
+    /// table of ntotal bytes. 0 = no bound.
+    size_t build_memory_budget = 0;
+
     int enterpoint; ///< enterpoint
 
     std::shared_ptr<nsg::Graph<int>> final_graph; ///< NSG graph structure
@@ -120,11 +127,13 @@ struct NSG {
 
     explicit NSG(int R = 32);
 
-    // build NSG from a KNN graph
+    // build NSG from a KNN graph. The graph ids can be idx_t or int, the
+    // latter halves the memory used by large kNN graphs
+    template <class index_t>
     void build(
             Index* storage,
             idx_t n,
-            const nsg::Graph<idx_t>& knn_graph,
+            const nsg::Graph<index_t>& knn_graph,
             bool verbose);
 
     // reset the graph
@@ -139,7 +148,8 @@ struct NSG {
             VisitedTable& vt) const;
 
     // Compute the center point
-    void init_graph(Index* storage, const nsg::Graph<idx_t>& knn_graph);
+    template <class index_t>
+    void init_graph(Index* storage, const nsg::Graph<index_t>& knn_graph);
 
     // Search on a built graph.
     // If collect_fullset is true, the visited nodes will be
@@ -154,27 +164,33 @@ struct NSG {
             std::vector<Neighbor>& retset,
             std::vector<Node>& fullset) const;
 
-    // Add reverse links
+    // Add reverse links. The locks are striped: node i is protected by
+    // locks[i % locks.size()]
     void add_reverse_links(
             int q,
             std::vector<std::mutex>& locks,
             DistanceComputer& dis,
             nsg::Graph<Node>& graph);
 
+    template <class index_t>
     void sync_prune(
             int q,
             std::vector<Node>& pool,
             DistanceComputer& dis,
             VisitedTable& vt,
-            const nsg::Graph<idx_t>& knn_graph,
+            const nsg::Graph<index_t>& knn_graph,
             nsg::Graph<Node>& graph);
 
+    template <class index_t>
     void link(
             Index* storage,
-            const nsg::Graph<idx_t>& knn_graph,
+            const nsg::Graph<index_t>& knn_graph,
             nsg::Graph<Node>& graph,
             bool verbose);
 
+    /// nb of threads used to link the graph given build_memory_budget
+    int link_nthreads(int knn_K) const;
+
     // make NSG be fully connected
     int tree_grow(Index* storage, std::vector<int>& degrees);
 
@@ -191,6 +207,13 @@ struct NSG {
 
     // check the integrity of the NSG built
     void check_graph() const;
+
+    /// Renumber the nodes: the new node i is the former node perm[i]
+    void permute_entries(const idx_t* perm);
+
+    /// breadth-first order of the nodes from the enterpoint, see
+    /// HNSW::bfs_order
+    void bfs_order(idx_t* perm) const;
 };
 
 } // namespace faiss
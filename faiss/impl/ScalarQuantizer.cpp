@@ -10,6 +10,7 @@
 #include <faiss/impl/ScalarQuantizer.h>
 
 #include <algorithm>
+#include <cmath>
 #include <cstdio>
 
 #include <faiss/impl/platform_macros.h>
@@ -23,7 +24,9 @@
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/IDSelector.h>
+#include <faiss/utils/bf16.h>
 #include <faiss/utils/fp16.h>
+#include <faiss/utils/simd_levels.h>
 #include <faiss/utils/utils.h>
 
 namespace faiss {
@@ -37,7 +40,7 @@ namespace faiss {
  * - 4 / 8 bits per code component
  * - uniform / non-uniform
  * - IP / L2 distance search
- * - scalar / AVX distance computation
+ * - scalar / AVX2 / AVX-512 distance computation
  *
  * The appropriate Quantizer object is returned via select_quantizer
  * that hides the template mess.
@@ -52,12 +55,202 @@ namespace faiss {
 #endif
 #endif
 
+// 16-component kernels, used when d % 16 == 0
+#if defined(USE_F16C) && defined(__AVX512F__) && defined(__AVX512BW__) && \
+        defined(__AVX512VL__)
+#define USE_AVX512
+#endif
+
 namespace {
 
 typedef ScalarQuantizer::QuantizerType QuantizerType;
 typedef ScalarQuantizer::RangeStat RangeStat;
 using SQDistanceComputer = ScalarQuantizer::SQDistanceComputer;
 
+} // namespace
+
+#ifdef FAISS_SIMD_MAIN
+
+namespace {
+
+/*******************************************************************
+ * Quantizer range training
+ */
+
+static float sqr(float x) {
+    return x * x;
+}
+
+void train_Uniform(
+        RangeStat rs,
+        float rs_arg,
+        idx_t n,
+        int k,
+        const float* x,
+        std::vector<float>& trained) {
+    trained.resize(2);
+    float& vmin = trained[0];
+    float& vmax = trained[1];
+
+    if (rs == ScalarQuantizer::RS_minmax) {
+        vmin = HUGE_VAL;
+        vmax = -HUGE_VAL;
+        for (size_t i = 0; i < n; i++) {
+            if (x[i] < vmin)
+                vmin = x[i];
+            if (x[i] > vmax)
+                vmax = x[i];
+        }
+        float vexp = (vmax - vmin) * rs_arg;
+        vmin -= vexp;
+        vmax += vexp;
+    } else if (rs == ScalarQuantizer::RS_meanstd) {
+        double sum = 0, sum2 = 0;
+        for (size_t i = 0; i < n; i++) {
+            sum += x[i];
+            sum2 += x[i] * x[i];
+        }
+        float mean = sum / n;
+        float var = sum2 / n - mean * mean;
+        float std = var <= 0 ? 1.0 : sqrt(var);
+
+        vmin = mean - std * rs_arg;
+        vmax = mean + std * rs_arg;
+    } else if (rs == ScalarQuantizer::RS_quantiles) {
+        std::vector<float> x_copy(n);
+        memcpy(x_copy.data(), x, n * sizeof(*x));
+        // TODO just do a qucikselect
+        std::sort(x_copy.begin(), x_copy.end());
+        int o = int(rs_arg * n);
+        if (o < 0)
+            o = 0;
+        if (o > n - o)
+            o = n / 2;
+        vmin = x_copy[o];
+        vmax = x_copy[n - 1 - o];
+
+    } else if (rs == ScalarQuantizer::RS_optim) {
+        float a, b;
+        float sx = 0;
+        {
+            vmin = HUGE_VAL, vmax = -HUGE_VAL;
+            for (size_t i = 0; i < n; i++) {
+                if (x[i] < vmin)
+                    vmin = x[i];
+                if (x[i] > vmax)
+                    vmax = x[i];
+                sx += x[i];
+            }
+            b = vmin;
+            a = (vmax - vmin) / (k - 1);
+        }
+        int verbose = false;
+        int niter = 2000;
+        float last_err = -1;
+        int iter_last_err = 0;
+        for (int it = 0; it < niter; it++) {
+            float sn = 0, sn2 = 0, sxn = 0, err1 = 0;
+
+            for (idx_t i = 0; i < n; i++) {
+                float xi = x[i];
+                float ni = floor((xi - b) / a + 0.5);
+                if (ni < 0)
+                    ni = 0;
+                if (ni >= k)
+                    ni = k - 1;
+                err1 += sqr(xi - (ni * a + b));
+                sn += ni;
+                sn2 += ni * ni;
+                sxn += ni * xi;
+            }
+
+            if (err1 == last_err) {
+                iter_last_err++;
+                if (iter_last_err == 16)
+                    break;
+            } else {
+                last_err = err1;
+                iter_last_err = 0;
+            }
+
+            float det = sqr(sn) - sn2 * n;
+
+            b = (sn * sxn - sn2 * sx) / det;
+            a = (sn * sx - n * sxn) / det;
+            if (verbose) {
+                printf("it %d, err1=%g            \r", it, err1);
+                fflush(stdout);
+            }
+        }
+        if (verbose)
+            printf("\n");
+
+        vmin = b;
+        vmax = b + a * (k - 1);
+
+    } else {
+        FAISS_THROW_MSG("Invalid qtype");
+    }
+    vmax -= vmin;
+}
+
+void train_NonUniform(
+        RangeStat rs,
+        float rs_arg,
+        idx_t n,
+        int d,
+        int k,
+        const float* x,
+        std::vector<float>& trained) {
+    trained.resize(2 * d);
+    float* vmin = trained.data();
+    float* vmax = trained.data() + d;
+    if (rs == ScalarQuantizer::RS_minmax) {
+        memcpy(vmin, x, sizeof(*x) * d);
+        memcpy(vmax, x, sizeof(*x) * d);
+        for (size_t i = 1; i < n; i++) {
+            const float* xi = x + i * d;
+            for (size_t j = 0; j < d; j++) {
+                if (xi[j] < vmin[j])
+                    vmin[j] = xi[j];
+                if (xi[j] > vmax[j])
+                    vmax[j] = xi[j];
+            }
+        }
+        float* vdiff = vmax;
+        for (size_t j = 0; j < d; j++) {
+            float vexp = (vmax[j] - vmin[j]) * rs_arg;
+            vmin[j] -= vexp;
+            vmax[j] += vexp;
+            vdiff[j] = vmax[j] - vmin[j];
+        }
+    } else {
+        // transpose
+        std::vector<float> xt(n * d);
+        for (size_t i = 1; i < n; i++) {
+            const float* xi = x + i * d;
+            for (size_t j = 0; j < d; j++) {
+                xt[j * n + i] = xi[j];
+            }
+        }
+        std::vector<float> trained_d(2);
+#pragma omp parallel for
+        for (int j = 0; j < d; j++) {
+            train_Uniform(rs, rs_arg, n, k, xt.data() + j * n, trained_d);
+            vmin[j] = trained_d[0];
+            vmax[j] = trained_d[1];
+        }
+    }
+}
+
+} // namespace
+
+#endif
+
+FAISS_SIMD_NS_BEGIN
+
+namespace {
+
 /*******************************************************************
  * Codec: converts between values in [0, 1] and an index in a code
  * array. The "i" parameter is the vector component index (not byte
@@ -88,6 +281,15 @@ struct Codec8bit {
         return _mm256_mul_ps(f8, one_255);
     }
 #endif
+
+#ifdef USE_AVX512
+    static __m512 decode_16_components(const uint8_t* code, int i) {
+        __m128i c16 = _mm_loadu_si128((const __m128i*)(code + i));
+        __m512 f16 = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(c16));
+        f16 = _mm512_add_ps(f16, _mm512_set1_ps(0.5f));
+        return _mm512_mul_ps(f16, _mm512_set1_ps(1.f / 255.f));
+    }
+#endif
 };
 
 struct Codec4bit {
@@ -120,6 +322,19 @@ struct Codec4bit {
         return _mm256_mul_ps(f8, one_255);
     }
 #endif
+
+#ifdef USE_AVX512
+    static __m512 decode_16_components(const uint8_t* code, int i) {
+        uint64_t c8 = *(uint64_t*)(code + (i >> 1));
+        uint64_t mask = 0x0f0f0f0f0f0f0f0f;
+        // interleave the low and high nibbles of the 8 bytes
+        __m128i c16 = _mm_unpacklo_epi8(
+                _mm_set1_epi64x(c8 & mask), _mm_set1_epi64x((c8 >> 4) & mask));
+        __m512 f16 = _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(c16));
+        f16 = _mm512_add_ps(f16, _mm512_set1_ps(0.5f));
+        return _mm512_mul_ps(f16, _mm512_set1_ps(1.f / 15.f));
+    }
+#endif
 };
 
 struct Codec6bit {
@@ -201,6 +416,18 @@ struct Codec6bit {
     }
 
 #endif
+
+#ifdef USE_AVX512
+    // 16 components = 12 bytes, decoded as 2 * 8 components
+    static __m512 decode_16_components(const uint8_t* code, int i) {
+        const uint16_t* code16 = (const uint16_t*)(code + (i >> 2) * 3);
+        __m512i i16 = _mm512_inserti64x4(
+                _mm512_castsi256_si512(load6(code16)), load6(code16 + 3), 1);
+        __m512 f16 = _mm512_cvtepi32_ps(i16);
+        f16 = _mm512_add_ps(f16, _mm512_set1_ps(0.5f));
+        return _mm512_mul_ps(f16, _mm512_set1_ps(1.f / 63.f));
+    }
+#endif
 };
 
 /*******************************************************************
@@ -265,6 +492,23 @@ struct QuantizerTemplate<Codec, true, 8> : QuantizerTemplate<Codec, true, 1> {
 
 #endif
 
+#ifdef USE_AVX512
+
+template <class Codec>
+struct QuantizerTemplate<Codec, true, 16> : QuantizerTemplate<Codec, true, 8> {
+    QuantizerTemplate(size_t d, const std::vector<float>& trained)
+            : QuantizerTemplate<Codec, true, 8>(d, trained) {}
+
+    __m512 reconstruct_16_components(const uint8_t* code, int i) const {
+        __m512 xi = Codec::decode_16_components(code, i);
+        return _mm512_add_ps(
+                _mm512_set1_ps(this->vmin),
+                _mm512_mul_ps(xi, _mm512_set1_ps(this->vdiff)));
+    }
+};
+
+#endif
+
 template <class Codec>
 struct QuantizerTemplate<Codec, false, 1> : ScalarQuantizer::SQuantizer {
     const size_t d;
@@ -319,6 +563,24 @@ struct QuantizerTemplate<Codec, false, 8> : QuantizerTemplate<Codec, false, 1> {
 
 #endif
 
+#ifdef USE_AVX512
+
+template <class Codec>
+struct QuantizerTemplate<Codec, false, 16>
+        : QuantizerTemplate<Codec, false, 8> {
+    QuantizerTemplate(size_t d, const std::vector<float>& trained)
+            : QuantizerTemplate<Codec, false, 8>(d, trained) {}
+
+    __m512 reconstruct_16_components(const uint8_t* code, int i) const {
+        __m512 xi = Codec::decode_16_components(code, i);
+        return _mm512_add_ps(
+                _mm512_loadu_ps(this->vmin + i),
+                _mm512_mul_ps(xi, _mm512_loadu_ps(this->vdiff + i)));
+    }
+};
+
+#endif
+
 /*******************************************************************
  * FP16 quantizer
  *******************************************************************/
@@ -364,250 +626,176 @@ struct QuantizerFP16<8> : QuantizerFP16<1> {
 
 #endif
 
+#ifdef USE_AVX512
+
+template <>
+struct QuantizerFP16<16> : QuantizerFP16<8> {
+    QuantizerFP16(size_t d, const std::vector<float>& trained)
+            : QuantizerFP16<8>(d, trained) {}
+
+    __m512 reconstruct_16_components(const uint8_t* code, int i) const {
+        __m256i codei = _mm256_loadu_si256((const __m256i*)(code + 2 * i));
+        return _mm512_cvtph_ps(codei);
+    }
+};
+
+#endif
+
 /*******************************************************************
- * 8bit_direct quantizer
+ * BF16 quantizer
  *******************************************************************/
 
 template <int SIMDWIDTH>
-struct Quantizer8bitDirect {};
+struct QuantizerBF16 {};
 
 template <>
-struct Quantizer8bitDirect<1> : ScalarQuantizer::SQuantizer {
+struct QuantizerBF16<1> : ScalarQuantizer::SQuantizer {
     const size_t d;
 
-    Quantizer8bitDirect(size_t d, const std::vector<float>& /* unused */)
-            : d(d) {}
+    QuantizerBF16(size_t d, const std::vector<float>& /* unused */) : d(d) {}
 
+    // the conversions are branch-free integer operations, so these loops
+    // get vectorized by the compiler
     void encode_vector(const float* x, uint8_t* code) const final {
         for (size_t i = 0; i < d; i++) {
-            code[i] = (uint8_t)x[i];
+            ((uint16_t*)code)[i] = encode_bf16(x[i]);
         }
     }
 
     void decode_vector(const uint8_t* code, float* x) const final {
         for (size_t i = 0; i < d; i++) {
-            x[i] = code[i];
+            x[i] = decode_bf16(((uint16_t*)code)[i]);
         }
     }
 
     float reconstruct_component(const uint8_t* code, int i) const {
-        return code[i];
+        return decode_bf16(((uint16_t*)code)[i]);
     }
 };
 
 #ifdef __AVX2__
 
 template <>
-struct Quantizer8bitDirect<8> : Quantizer8bitDirect<1> {
-    Quantizer8bitDirect(size_t d, const std::vector<float>& trained)
-            : Quantizer8bitDirect<1>(d, trained) {}
+struct QuantizerBF16<8> : QuantizerBF16<1> {
+    QuantizerBF16(size_t d, const std::vector<float>& trained)
+            : QuantizerBF16<1>(d, trained) {}
 
     __m256 reconstruct_8_components(const uint8_t* code, int i) const {
-        __m128i x8 = _mm_loadl_epi64((__m128i*)(code + i)); // 8 * int8
-        __m256i y8 = _mm256_cvtepu8_epi32(x8);              // 8 * int32
-        return _mm256_cvtepi32_ps(y8);                      // 8 * float32
+        __m128i codei = _mm_loadu_si128((const __m128i*)(code + 2 * i));
+        __m256i x32 = _mm256_slli_epi32(_mm256_cvtepu16_epi32(codei), 16);
+        return _mm256_castsi256_ps(x32);
+    }
+};
+
+#endif
+
+#ifdef USE_AVX512
+
+template <>
+struct QuantizerBF16<16> : QuantizerBF16<8> {
+    QuantizerBF16(size_t d, const std::vector<float>& trained)
+            : QuantizerBF16<8>(d, trained) {}
+
+    __m512 reconstruct_16_components(const uint8_t* code, int i) const {
+        __m256i codei = _mm256_loadu_si256((const __m256i*)(code + 2 * i));
+        __m512i x32 = _mm512_slli_epi32(_mm512_cvtepu16_epi32(codei), 16);
+        return _mm512_castsi512_ps(x32);
     }
 };
 
 #endif
 
+/*******************************************************************
+ * 8bit_direct quantizer
+ *******************************************************************/
+
 template <int SIMDWIDTH>
-ScalarQuantizer::SQuantizer* select_quantizer_1(
-        QuantizerType qtype,
-        size_t d,
-        const std::vector<float>& trained) {
-    switch (qtype) {
-        case ScalarQuantizer::QT_8bit:
-            return new QuantizerTemplate<Codec8bit, false, SIMDWIDTH>(
-                    d, trained);
-        case ScalarQuantizer::QT_6bit:
-            return new QuantizerTemplate<Codec6bit, false, SIMDWIDTH>(
-                    d, trained);
-        case ScalarQuantizer::QT_4bit:
-            return new QuantizerTemplate<Codec4bit, false, SIMDWIDTH>(
-                    d, trained);
-        case ScalarQuantizer::QT_8bit_uniform:
-            return new QuantizerTemplate<Codec8bit, true, SIMDWIDTH>(
-                    d, trained);
-        case ScalarQuantizer::QT_4bit_uniform:
-            return new QuantizerTemplate<Codec4bit, true, SIMDWIDTH>(
-                    d, trained);
-        case ScalarQuantizer::QT_fp16:
-            return new QuantizerFP16<SIMDWIDTH>(d, trained);
-        case ScalarQuantizer::QT_8bit_direct:
-            return new Quantizer8bitDirect<SIMDWIDTH>(d, trained);
-    }
-    FAISS_THROW_MSG("unknown qtype");
-}
-
-/*******************************************************************
- * Quantizer range training
- */
+struct Quantizer8bitDirect {};
 
-static float sqr(float x) {
-    return x * x;
-}
+template <>
+struct Quantizer8bitDirect<1> : ScalarQuantizer::SQuantizer {
+    const size_t d;
 
-void train_Uniform(
-        RangeStat rs,
-        float rs_arg,
-        idx_t n,
-        int k,
-        const float* x,
-        std::vector<float>& trained) {
-    trained.resize(2);
-    float& vmin = trained[0];
-    float& vmax = trained[1];
+    Quantizer8bitDirect(size_t d, const std::vector<float>& /* unused */)
+            : d(d) {}
 
-    if (rs == ScalarQuantizer::RS_minmax) {
-        vmin = HUGE_VAL;
-        vmax = -HUGE_VAL;
-        for (size_t i = 0; i < n; i++) {
-            if (x[i] < vmin)
-                vmin = x[i];
-            if (x[i] > vmax)
-                vmax = x[i];
+    void encode_vector(const float* x, uint8_t* code) const final {
+        for (size_t i = 0; i < d; i++) {
+            code[i] = (uint8_t)x[i];
         }
-        float vexp = (vmax - vmin) * rs_arg;
-        vmin -= vexp;
-        vmax += vexp;
-    } else if (rs == ScalarQuantizer::RS_meanstd) {
-        double sum = 0, sum2 = 0;
-        for (size_t i = 0; i < n; i++) {
-            sum += x[i];
-            sum2 += x[i] * x[i];
+    }
+
+    void decode_vector(const uint8_t* code, float* x) const final {
+        for (size_t i = 0; i < d; i++) {
+            x[i] = code[i];
         }
-        float mean = sum / n;
-        float var = sum2 / n - mean * mean;
-        float std = var <= 0 ? 1.0 : sqrt(var);
+    }
 
-        vmin = mean - std * rs_arg;
-        vmax = mean + std * rs_arg;
-    } else if (rs == ScalarQuantizer::RS_quantiles) {
-        std::vector<float> x_copy(n);
-        memcpy(x_copy.data(), x, n * sizeof(*x));
-        // TODO just do a qucikselect
-        std::sort(x_copy.begin(), x_copy.end());
-        int o = int(rs_arg * n);
-        if (o < 0)
-            o = 0;
-        if (o > n - o)
-            o = n / 2;
-        vmin = x_copy[o];
-        vmax = x_copy[n - 1 - o];
+    float reconstruct_component(const uint8_t* code, int i) const {
+        return code[i];
+    }
+};
 
-    } else if (rs == ScalarQuantizer::RS_optim) {
-        float a, b;
-        float sx = 0;
-        {
-            vmin = HUGE_VAL, vmax = -HUGE_VAL;
-            for (size_t i = 0; i < n; i++) {
-                if (x[i] < vmin)
-                    vmin = x[i];
-                if (x[i] > vmax)
-                    vmax = x[i];
-                sx += x[i];
-            }
-            b = vmin;
-            a = (vmax - vmin) / (k - 1);
-        }
-        int verbose = false;
-        int niter = 2000;
-        float last_err = -1;
-        int iter_last_err = 0;
-        for (int it = 0; it < niter; it++) {
-            float sn = 0, sn2 = 0, sxn = 0, err1 = 0;
+#ifdef __AVX2__
 
-            for (idx_t i = 0; i < n; i++) {
-                float xi = x[i];
-                float ni = floor((xi - b) / a + 0.5);
-                if (ni < 0)
-                    ni = 0;
-                if (ni >= k)
-                    ni = k - 1;
-                err1 += sqr(xi - (ni * a + b));
-                sn += ni;
-                sn2 += ni * ni;
-                sxn += ni * xi;
-            }
+template <>
+struct Quantizer8bitDirect<8> : Quantizer8bitDirect<1> {
+    Quantizer8bitDirect(size_t d, const std::vector<float>& trained)
+            : Quantizer8bitDirect<1>(d, trained) {}
 
-            if (err1 == last_err) {
-                iter_last_err++;
-                if (iter_last_err == 16)
-                    break;
-            } else {
-                last_err = err1;
-                iter_last_err = 0;
-            }
+    __m256 reconstruct_8_components(const uint8_t* code, int i) const {
+        __m128i x8 = _mm_loadl_epi64((__m128i*)(code + i)); // 8 * int8
+        __m256i y8 = _mm256_cvtepu8_epi32(x8);              // 8 * int32
+        return _mm256_cvtepi32_ps(y8);                      // 8 * float32
+    }
+};
 
-            float det = sqr(sn) - sn2 * n;
+#endif
 
-            b = (sn * sxn - sn2 * sx) / det;
-            a = (sn * sx - n * sxn) / det;
-            if (verbose) {
-                printf("it %d, err1=%g            \r", it, err1);
-                fflush(stdout);
-            }
-        }
-        if (verbose)
-            printf("\n");
+#ifdef USE_AVX512
 
-        vmin = b;
-        vmax = b + a * (k - 1);
+template <>
+struct Quantizer8bitDirect<16> : Quantizer8bitDirect<8> {
+    Quantizer8bitDirect(size_t d, const std::vector<float>& trained)
+            : Quantizer8bitDirect<8>(d, trained) {}
 
-    } else {
-        FAISS_THROW_MSG("Invalid qtype");
+    __m512 reconstruct_16_components(const uint8_t* code, int i) const {
+        __m128i x16 = _mm_loadu_si128((const __m128i*)(code + i));
+        return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(x16));
     }
-    vmax -= vmin;
-}
+};
 
-void train_NonUniform(
-        RangeStat rs,
-        float rs_arg,
-        idx_t n,
-        int d,
-        int k,
-        const float* x,
-        std::vector<float>& trained) {
-    trained.resize(2 * d);
-    float* vmin = trained.data();
-    float* vmax = trained.data() + d;
-    if (rs == ScalarQuantizer::RS_minmax) {
-        memcpy(vmin, x, sizeof(*x) * d);
-        memcpy(vmax, x, sizeof(*x) * d);
-        for (size_t i = 1; i < n; i++) {
-            const float* xi = x + i * d;
-            for (size_t j = 0; j < d; j++) {
-                if (xi[j] < vmin[j])
-                    vmin[j] = xi[j];
-                if (xi[j] > vmax[j])
-                    vmax[j] = xi[j];
-            }
-        }
-        float* vdiff = vmax;
-        for (size_t j = 0; j < d; j++) {
-            float vexp = (vmax[j] - vmin[j]) * rs_arg;
-            vmin[j] -= vexp;
-            vmax[j] += vexp;
-            vdiff[j] = vmax[j] - vmin[j];
-        }
-    } else {
-        // transpose
-        std::vector<float> xt(n * d);
-        for (size_t i = 1; i < n; i++) {
-            const float* xi = x + i * d;
-            for (size_t j = 0; j < d; j++) {
-                xt[j * n + i] = xi[j];
-            }
-        }
-        std::vector<float> trained_d(2);
-#pragma omp parallel for
-        for (int j = 0; j < d; j++) {
-            train_Uniform(rs, rs_arg, n, k, xt.data() + j * n, trained_d);
-            vmin[j] = trained_d[0];
-            vmax[j] = trained_d[1];
-        }
+#endif
+
+template <int SIMDWIDTH>
+ScalarQuantizer::SQuantizer* select_quantizer_1(
+        QuantizerType qtype,
+        size_t d,
+        const std::vector<float>& trained) {
+    switch (qtype) {
+        case ScalarQuantizer::QT_8bit:
+            return new QuantizerTemplate<Codec8bit, false, SIMDWIDTH>(
+                    d, trained);
+        case ScalarQuantizer::QT_6bit:
+            return new QuantizerTemplate<Codec6bit, false, SIMDWIDTH>(
+                    d, trained);
+        case ScalarQuantizer::QT_4bit:
+            return new QuantizerTemplate<Codec4bit, false, SIMDWIDTH>(
+                    d, trained);
+        case ScalarQuantizer::QT_8bit_uniform:
+            return new QuantizerTemplate<Codec8bit, true, SIMDWIDTH>(
+                    d, trained);
+        case ScalarQuantizer::QT_4bit_uniform:
+            return new QuantizerTemplate<Codec4bit, true, SIMDWIDTH>(
+                    d, trained);
+        case ScalarQuantizer::QT_fp16:
+            return new QuantizerFP16<SIMDWIDTH>(d, trained);
+        case ScalarQuantizer::QT_bf16:
+            return new QuantizerBF16<SIMDWIDTH>(d, trained);
+        case ScalarQuantizer::QT_8bit_direct:
+            return new Quantizer8bitDirect<SIMDWIDTH>(d, trained);
     }
+    FAISS_THROW_MSG("unknown qtype");
 }
 
 /*******************************************************************
@@ -691,6 +879,41 @@ struct SimilarityL2<8> {
 
 #endif
 
+#ifdef USE_AVX512
+template <>
+struct SimilarityL2<16> {
+    static constexpr int simdwidth = 16;
+    static constexpr MetricType metric_type = METRIC_L2;
+
+    const float *y, *yi;
+
+    explicit SimilarityL2(const float* y) : y(y) {}
+    __m512 accu16;
+
+    void begin_16() {
+        accu16 = _mm512_setzero_ps();
+        yi = y;
+    }
+
+    void add_16_components(__m512 x) {
+        __m512 yiv = _mm512_loadu_ps(yi);
+        yi += 16;
+        __m512 tmp = _mm512_sub_ps(yiv, x);
+        accu16 = _mm512_fmadd_ps(tmp, tmp, accu16);
+    }
+
+    void add_16_components_2(__m512 x, __m512 y) {
+        __m512 tmp = _mm512_sub_ps(y, x);
+        accu16 = _mm512_fmadd_ps(tmp, tmp, accu16);
+    }
+
+    float result_16() {
+        return _mm512_reduce_add_ps(accu16);
+    }
+};
+
+#endif
+
 template <int SIMDWIDTH>
 struct SimilarityIP {};
 
@@ -762,13 +985,47 @@ struct SimilarityIP<8> {
 };
 #endif
 
-/*******************************************************************
- * DistanceComputer: combines a similarity and a quantizer to do
- * code-to-vector or code-to-code comparisons
- *******************************************************************/
+#ifdef USE_AVX512
 
-template <class Quantizer, class Similarity, int SIMDWIDTH>
-struct DCTemplate : SQDistanceComputer {};
+template <>
+struct SimilarityIP<16> {
+    static constexpr int simdwidth = 16;
+    static constexpr MetricType metric_type = METRIC_INNER_PRODUCT;
+
+    const float *y, *yi;
+
+    explicit SimilarityIP(const float* y) : y(y) {}
+
+    __m512 accu16;
+
+    void begin_16() {
+        accu16 = _mm512_setzero_ps();
+        yi = y;
+    }
+
+    void add_16_components(__m512 x) {
+        __m512 yiv = _mm512_loadu_ps(yi);
+        yi += 16;
+        accu16 = _mm512_fmadd_ps(yiv, x, accu16);
+    }
+
+    void add_16_components_2(__m512 x1, __m512 x2) {
+        accu16 = _mm512_fmadd_ps(x1, x2, accu16);
+    }
+
+    float result_16() {
+        return _mm512_reduce_add_ps(accu16);
+    }
+};
+#endif
+
+/*******************************************************************
+ * DistanceComputer: combines a similarity and a quantizer to do
+ * code-to-vector or code-to-code comparisons
+ *******************************************************************/
+
+template <class Quantizer, class Similarity, int SIMDWIDTH>
+struct DCTemplate : SQDistanceComputer {};
 
 template <class Quantizer, class Similarity>
 struct DCTemplate<Quantizer, Similarity, 1> : SQDistanceComputer {
@@ -864,6 +1121,55 @@ struct DCTemplate<Quantizer, Similarity, 8> : SQDistanceComputer {
 
 #endif
 
+#ifdef USE_AVX512
+
+template <class Quantizer, class Similarity>
+struct DCTemplate<Quantizer, Similarity, 16> : SQDistanceComputer {
+    using Sim = Similarity;
+
+    Quantizer quant;
+
+    DCTemplate(size_t d, const std::vector<float>& trained)
+            : quant(d, trained) {}
+
+    float compute_distance(const float* x, const uint8_t* code) const {
+        Similarity sim(x);
+        sim.begin_16();
+        for (size_t i = 0; i < quant.d; i += 16) {
+            __m512 xi = quant.reconstruct_16_components(code, i);
+            sim.add_16_components(xi);
+        }
+        return sim.result_16();
+    }
+
+    float compute_code_distance(const uint8_t* code1, const uint8_t* code2)
+            const {
+        Similarity sim(nullptr);
+        sim.begin_16();
+        for (size_t i = 0; i < quant.d; i += 16) {
+            __m512 x1 = quant.reconstruct_16_components(code1, i);
+            __m512 x2 = quant.reconstruct_16_components(code2, i);
+            sim.add_16_components_2(x1, x2);
+        }
+        return sim.result_16();
+    }
+
+    void set_query(const float* x) final {
+        q = x;
+    }
+
+    float symmetric_dis(idx_t i, idx_t j) override {
+        return compute_code_distance(
+                codes + i * code_size, codes + j * code_size);
+    }
+
+    float query_to_code(const uint8_t* code) const final {
+        return compute_distance(q, code);
+    }
+};
+
+#endif
+
 /*******************************************************************
  * DistanceComputerByte: computes distances in the integer domain
  *******************************************************************/
@@ -980,216 +1286,366 @@ struct DistanceComputerByte<Similarity, 8> : SQDistanceComputer {
 
 #endif
 
-/*******************************************************************
- * select_distance_computer: runtime selection of template
- * specialization
- *******************************************************************/
+#ifdef USE_AVX512
+
+/* The VNNI instructions (vpdpwssd, vpdpbusd) are not enabled by the
+ * AVX-512 flags of the build. Unless they are compiled in, the kernels
+ * that use them get a target attribute and are selected at runtime. */
+#if defined(__AVX512VNNI__)
+#define SQ_USE_VNNI
+#define SQ_VNNI_KERNEL
+#elif defined(__GNUC__) || defined(__clang__)
+#define SQ_USE_VNNI
+// flatten inlines the generic loop and the VNNI dot products together
+#define SQ_VNNI_KERNEL __attribute__((target("avx512vnni"), flatten))
+#endif
 
-template <class Sim>
-SQDistanceComputer* select_distance_computer(
-        QuantizerType qtype,
-        size_t d,
-        const std::vector<float>& trained) {
-    constexpr int SIMDWIDTH = Sim::simdwidth;
-    switch (qtype) {
-        case ScalarQuantizer::QT_8bit_uniform:
-            return new DCTemplate<
-                    QuantizerTemplate<Codec8bit, true, SIMDWIDTH>,
-                    Sim,
-                    SIMDWIDTH>(d, trained);
+bool cpu_has_vnni() {
+#if defined(__AVX512VNNI__)
+    return true;
+#elif defined(SQ_USE_VNNI)
+    static const bool has_vnni = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx512vnni") != 0;
+    }();
+    return has_vnni;
+#else
+    return false;
+#endif
+}
 
-        case ScalarQuantizer::QT_4bit_uniform:
-            return new DCTemplate<
-                    QuantizerTemplate<Codec4bit, true, SIMDWIDTH>,
-                    Sim,
-                    SIMDWIDTH>(d, trained);
+// integer dot products with AVX512-BW
+struct DotAVX512 {
+    // accu + the dot products of the pairs of int16 of x and y
+    static __m512i epi16(__m512i accu, __m512i x, __m512i y) {
+        return _mm512_add_epi32(accu, _mm512_madd_epi16(x, y));
+    }
 
-        case ScalarQuantizer::QT_8bit:
-            return new DCTemplate<
-                    QuantizerTemplate<Codec8bit, false, SIMDWIDTH>,
-                    Sim,
-                    SIMDWIDTH>(d, trained);
+    // accu + the dot products of the groups of 4 uint8 of u and int8 of s
+    static __m512i u8i8(__m512i accu, __m512i u, __m512i s) {
+        __m512i u0 = _mm512_cvtepu8_epi16(_mm512_castsi512_si256(u));
+        __m512i s0 = _mm512_cvtepi8_epi16(_mm512_castsi512_si256(s));
+        __m512i u1 = _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(u, 1));
+        __m512i s1 = _mm512_cvtepi8_epi16(_mm512_extracti64x4_epi64(s, 1));
+        accu = _mm512_add_epi32(accu, _mm512_madd_epi16(u0, s0));
+        return _mm512_add_epi32(accu, _mm512_madd_epi16(u1, s1));
+    }
+};
 
-        case ScalarQuantizer::QT_6bit:
-            return new DCTemplate<
-                    QuantizerTemplate<Codec6bit, false, SIMDWIDTH>,
-                    Sim,
-                    SIMDWIDTH>(d, trained);
+#ifdef SQ_USE_VNNI
 
-        case ScalarQuantizer::QT_4bit:
-            return new DCTemplate<
-                    QuantizerTemplate<Codec4bit, false, SIMDWIDTH>,
-                    Sim,
-                    SIMDWIDTH>(d, trained);
+// same with AVX512-VNNI
+struct DotVNNI {
+    SQ_VNNI_KERNEL static __m512i epi16(__m512i accu, __m512i x, __m512i y) {
+        return _mm512_dpwssd_epi32(accu, x, y);
+    }
 
-        case ScalarQuantizer::QT_fp16:
-            return new DCTemplate<QuantizerFP16<SIMDWIDTH>, Sim, SIMDWIDTH>(
-                    d, trained);
+    SQ_VNNI_KERNEL static __m512i u8i8(__m512i accu, __m512i u, __m512i s) {
+        return _mm512_dpbusd_epi32(accu, u, s);
+    }
+};
 
-        case ScalarQuantizer::QT_8bit_direct:
-            if (d % 16 == 0) {
-                return new DistanceComputerByte<Sim, SIMDWIDTH>(d, trained);
-            } else {
-                return new DCTemplate<
-                        Quantizer8bitDirect<SIMDWIDTH>,
-                        Sim,
-                        SIMDWIDTH>(d, trained);
-            }
+#endif
+
+template <class Dot, class Sim>
+int byte_code_distance(int d, const uint8_t* code1, const uint8_t* code2) {
+    __m512i accu = _mm512_setzero_si512();
+    for (int i = 0; i < d; i += 32) {
+        // load 32 bytes (16 for the last block if d % 32 == 16),
+        // convert to 32 uint16_t
+        __mmask32 mask = d - i >= 32 ? 0xffffffff : 0xffff;
+        __m512i c1 =
+                _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(mask, code1 + i));
+        __m512i c2 =
+                _mm512_cvtepu8_epi16(_mm256_maskz_loadu_epi8(mask, code2 + i));
+        if (Sim::metric_type == METRIC_INNER_PRODUCT) {
+            accu = Dot::epi16(accu, c1, c2);
+        } else {
+            __m512i diff = _mm512_sub_epi16(c1, c2);
+            accu = Dot::epi16(accu, diff, diff);
+        }
     }
-    FAISS_THROW_MSG("unknown qtype");
-    return nullptr;
+    return _mm512_reduce_add_epi32(accu);
 }
 
-} // anonymous namespace
+#ifdef SQ_USE_VNNI
+
+template <class Sim>
+SQ_VNNI_KERNEL int byte_code_distance_vnni(
+        int d,
+        const uint8_t* code1,
+        const uint8_t* code2) {
+    return byte_code_distance<DotVNNI, Sim>(d, code1, code2);
+}
+
+#endif
+
+template <class Similarity>
+struct DistanceComputerByte<Similarity, 16> : SQDistanceComputer {
+    using Sim = Similarity;
+
+    int d;
+    std::vector<uint8_t> tmp;
+    bool vnni;
+
+    DistanceComputerByte(int d, const std::vector<float>&)
+            : d(d), tmp(d), vnni(cpu_has_vnni()) {}
+
+    int compute_code_distance(const uint8_t* code1, const uint8_t* code2)
+            const {
+#ifdef SQ_USE_VNNI
+        if (vnni) {
+            return byte_code_distance_vnni<Sim>(d, code1, code2);
+        }
+#endif
+        return byte_code_distance<DotAVX512, Sim>(d, code1, code2);
+    }
+
+    void set_query(const float* x) final {
+        for (int i = 0; i < d; i++) {
+            tmp[i] = int(x[i]);
+        }
+    }
+
+    int compute_distance(const float* x, const uint8_t* code) {
+        set_query(x);
+        return compute_code_distance(tmp.data(), code);
+    }
+
+    float symmetric_dis(idx_t i, idx_t j) override {
+        return compute_code_distance(
+                codes + i * code_size, codes + j * code_size);
+    }
+
+    float query_to_code(const uint8_t* code) const final {
+        return compute_code_distance(tmp.data(), code);
+    }
+};
+
+#endif
 
 /*******************************************************************
- * ScalarQuantizer implementation
- ********************************************************************/
+ * DistanceComputerInt8Query: QT_8bit_uniform distances with the query
+ * quantized to int8 (ScalarQuantizer::int8_query)
+ *
+ * The components are reconstructed as x_i = a + b * c_i with
+ * b = vdiff / 255 and a = vmin + b / 2. The query term r = y - a (L2) or
+ * r = y (IP) is approximated as scale * t where t is in int8, so that
+ *
+ *   <y, x>        = a * sum(y) + b * scale * <t, c>
+ *   ||y - x||^2   = ||r||^2 - 2 * b * scale * <t, c> + b^2 * ||c||^2
+ *
+ * <t, c> and ||c||^2 = <c, c - 128> + 128 * sum(c) are uint8 * int8 dot
+ * products, computed without conversion to float.
+ *******************************************************************/
 
-ScalarQuantizer::ScalarQuantizer(size_t d, QuantizerType qtype)
-        : Quantizer(d), qtype(qtype), rangestat(RS_minmax), rangestat_arg(0) {
-    set_derived_sizes();
-}
+// the dot products <t, c>, <c, c - 128> and sum(c)
+struct U8I8Dots {
+    int32_t tc = 0, cc = 0, csum = 0;
+};
 
-ScalarQuantizer::ScalarQuantizer()
-        : qtype(QT_8bit), rangestat(RS_minmax), rangestat_arg(0), bits(0) {}
+template <bool l2>
+U8I8Dots u8i8_dots_ref(int d, const uint8_t* code, const int8_t* t) {
+    U8I8Dots r;
+    for (int i = 0; i < d; i++) {
+        r.tc += code[i] * t[i];
+        if (l2) {
+            r.cc += code[i] * (code[i] - 128);
+            r.csum += code[i];
+        }
+    }
+    return r;
+}
 
-void ScalarQuantizer::set_derived_sizes() {
-    switch (qtype) {
-        case QT_8bit:
-        case QT_8bit_uniform:
-        case QT_8bit_direct:
-            code_size = d;
-            bits = 8;
-            break;
-        case QT_4bit:
-        case QT_4bit_uniform:
-            code_size = (d + 1) / 2;
-            bits = 4;
-            break;
-        case QT_6bit:
-            code_size = (d * 6 + 7) / 8;
-            bits = 6;
-            break;
-        case QT_fp16:
-            code_size = d * 2;
-            bits = 16;
-            break;
+#ifdef USE_AVX512
+
+template <class Dot, bool l2>
+U8I8Dots u8i8_dots(int d, const uint8_t* code, const int8_t* t) {
+    __m512i tc = _mm512_setzero_si512();
+    __m512i cc = _mm512_setzero_si512();
+    __m512i csum = _mm512_setzero_si512();
+    const __m512i ones = _mm512_set1_epi8(1);
+    const __m512i m128 = _mm512_set1_epi8(-128);
+    for (int i = 0; i < d; i += 64) {
+        __mmask64 mask =
+                d - i >= 64 ? ~__mmask64(0) : (__mmask64(1) << (d - i)) - 1;
+        __m512i c = _mm512_maskz_loadu_epi8(mask, code + i);
+        __m512i ti = _mm512_maskz_loadu_epi8(mask, t + i);
+        tc = Dot::u8i8(tc, c, ti);
+        if (l2) {
+            // c ^ 0x80 is c - 128 as an int8
+            cc = Dot::u8i8(cc, c, _mm512_xor_si512(c, m128));
+            csum = Dot::u8i8(csum, c, ones);
+        }
+    }
+    U8I8Dots r;
+    r.tc = _mm512_reduce_add_epi32(tc);
+    if (l2) {
+        r.cc = _mm512_reduce_add_epi32(cc);
+        r.csum = _mm512_reduce_add_epi32(csum);
     }
+    return r;
 }
 
-void ScalarQuantizer::train(size_t n, const float* x) {
-    int bit_per_dim = qtype == QT_4bit_uniform ? 4
-            : qtype == QT_4bit                 ? 4
-            : qtype == QT_6bit                 ? 6
-            : qtype == QT_8bit_uniform         ? 8
-            : qtype == QT_8bit                 ? 8
-                                               : -1;
+#ifdef SQ_USE_VNNI
 
-    switch (qtype) {
-        case QT_4bit_uniform:
-        case QT_8bit_uniform:
-            train_Uniform(
-                    rangestat,
-                    rangestat_arg,
-                    n * d,
-                    1 << bit_per_dim,
-                    x,
-                    trained);
-            break;
-        case QT_4bit:
-        case QT_8bit:
-        case QT_6bit:
-            train_NonUniform(
-                    rangestat,
-                    rangestat_arg,
-                    n,
-                    d,
-                    1 << bit_per_dim,
-                    x,
-                    trained);
-            break;
-        case QT_fp16:
-        case QT_8bit_direct:
-            // no training necessary
-            break;
-    }
+template <bool l2>
+SQ_VNNI_KERNEL U8I8Dots
+u8i8_dots_vnni(int d, const uint8_t* code, const int8_t* t) {
+    return u8i8_dots<DotVNNI, l2>(d, code, t);
 }
 
-void ScalarQuantizer::train_residual(
-        size_t n,
-        const float* x,
-        Index* quantizer,
-        bool by_residual,
-        bool verbose) {
-    const float* x_in = x;
+#endif
 
-    // 100k points more than enough
-    x = fvecs_maybe_subsample(d, (size_t*)&n, 100000, x, verbose, 1234);
+#endif
 
-    ScopeDeleter<float> del_x(x_in == x ? nullptr : x);
+template <class Similarity>
+struct DistanceComputerInt8Query : SQDistanceComputer {
+    using Sim = Similarity;
+    static constexpr int SIMDWIDTH = Sim::simdwidth;
+    static constexpr bool l2 = Sim::metric_type == METRIC_L2;
 
-    if (by_residual) {
-        std::vector<idx_t> idx(n);
-        quantizer->assign(n, x, idx.data());
+    // for the code-to-code distances
+    DCTemplate<
+            QuantizerTemplate<Codec8bit, true, SIMDWIDTH>,
+            Similarity,
+            SIMDWIDTH>
+            dcf;
 
-        std::vector<float> residuals(n * d);
-        quantizer->compute_residual_n(n, x, residuals.data(), idx.data());
+    int d;
+    float a, b;
+    std::vector<int8_t> tmp;
+    float scale, bias;
+    bool vnni;
+
+    DistanceComputerInt8Query(int d, const std::vector<float>& trained)
+            : dcf(d, trained),
+              d(d),
+              tmp(d),
+              scale(1),
+              bias(0),
+              vnni(false) {
+        b = dcf.quant.vdiff / 255;
+        a = dcf.quant.vmin + b / 2;
+#ifdef USE_AVX512
+        vnni = cpu_has_vnni();
+#endif
+    }
 
-        train(n, residuals.data());
-    } else {
-        train(n, x);
+    float query_component(const float* x, int i) const {
+        return l2 ? x[i] - a : x[i];
     }
-}
 
-ScalarQuantizer::SQuantizer* ScalarQuantizer::select_quantizer() const {
-#ifdef USE_F16C
-    if (d % 8 == 0) {
-        return select_quantizer_1<8>(qtype, d, trained);
-    } else
-#endif
-    {
-        return select_quantizer_1<1>(qtype, d, trained);
-    }
-}
+    void set_query(const float* x) final {
+        q = x;
+        float amax = 0;
+        bias = 0;
+        for (int i = 0; i < d; i++) {
+            float r = query_component(x, i);
+            amax = std::max(amax, std::abs(r));
+            bias += l2 ? r * r : a * r;
+        }
+        scale = amax > 0 ? amax / 127 : 1;
+        for (int i = 0; i < d; i++) {
+            tmp[i] = (int8_t)std::lrint(query_component(x, i) / scale);
+        }
+    }
+
+    U8I8Dots dots(const uint8_t* code) const {
+#ifdef USE_AVX512
+#ifdef SQ_USE_VNNI
+        if (vnni) {
+            return u8i8_dots_vnni<l2>(d, code, tmp.data());
+        }
+#endif
+        return u8i8_dots<DotAVX512, l2>(d, code, tmp.data());
+#else
+        return u8i8_dots_ref<l2>(d, code, tmp.data());
+#endif
+    }
+
+    float query_to_code(const uint8_t* code) const final {
+        U8I8Dots r = dots(code);
+        float dot = b * scale * r.tc;
+        if (!l2) {
+            return bias + dot;
+        }
+        float norm = r.cc + 128.f * r.csum;
+        return bias - 2 * dot + b * b * norm;
+    }
+
+    float symmetric_dis(idx_t i, idx_t j) override {
+        return dcf.compute_code_distance(
+                codes + i * code_size, codes + j * code_size);
+    }
+};
+
+/*******************************************************************
+ * select_distance_computer: runtime selection of template
+ * specialization
+ *******************************************************************/
+
+template <class Sim>
+SQDistanceComputer* select_distance_computer(
+        QuantizerType qtype,
+        size_t d,
+        const std::vector<float>& trained,
+        bool int8_query) {
+    constexpr int SIMDWIDTH = Sim::simdwidth;
+    switch (qtype) {
+        case ScalarQuantizer::QT_8bit_uniform:
+            if (int8_query) {
+                return new DistanceComputerInt8Query<Sim>(d, trained);
+            }
+            return new DCTemplate<
+                    QuantizerTemplate<Codec8bit, true, SIMDWIDTH>,
+                    Sim,
+                    SIMDWIDTH>(d, trained);
+
+        case ScalarQuantizer::QT_4bit_uniform:
+            return new DCTemplate<
+                    QuantizerTemplate<Codec4bit, true, SIMDWIDTH>,
+                    Sim,
+                    SIMDWIDTH>(d, trained);
+
+        case ScalarQuantizer::QT_8bit:
+            return new DCTemplate<
+                    QuantizerTemplate<Codec8bit, false, SIMDWIDTH>,
+                    Sim,
+                    SIMDWIDTH>(d, trained);
 
-void ScalarQuantizer::compute_codes(const float* x, uint8_t* codes, size_t n)
-        const {
-    std::unique_ptr<SQuantizer> squant(select_quantizer());
+        case ScalarQuantizer::QT_6bit:
+            return new DCTemplate<
+                    QuantizerTemplate<Codec6bit, false, SIMDWIDTH>,
+                    Sim,
+                    SIMDWIDTH>(d, trained);
 
-    memset(codes, 0, code_size * n);
-#pragma omp parallel for
-    for (int64_t i = 0; i < n; i++)
-        squant->encode_vector(x + i * d, codes + i * code_size);
-}
+        case ScalarQuantizer::QT_4bit:
+            return new DCTemplate<
+                    QuantizerTemplate<Codec4bit, false, SIMDWIDTH>,
+                    Sim,
+                    SIMDWIDTH>(d, trained);
 
-void ScalarQuantizer::decode(const uint8_t* codes, float* x, size_t n) const {
-    std::unique_ptr<SQuantizer> squant(select_quantizer());
+        case ScalarQuantizer::QT_fp16:
+            return new DCTemplate<QuantizerFP16<SIMDWIDTH>, Sim, SIMDWIDTH>(
+                    d, trained);
 
-#pragma omp parallel for
-    for (int64_t i = 0; i < n; i++)
-        squant->decode_vector(codes + i * code_size, x + i * d);
-}
+        case ScalarQuantizer::QT_bf16:
+            return new DCTemplate<QuantizerBF16<SIMDWIDTH>, Sim, SIMDWIDTH>(
+                    d, trained);
 
-SQDistanceComputer* ScalarQuantizer::get_distance_computer(
-        MetricType metric) const {
-    FAISS_THROW_IF_NOT(metric == METRIC_L2 || metric == METRIC_INNER_PRODUCT);
-#ifdef USE_F16C
-    if (d % 8 == 0) {
-        if (metric == METRIC_L2) {
-            return select_distance_computer<SimilarityL2<8>>(qtype, d, trained);
-        } else {
-            return select_distance_computer<SimilarityIP<8>>(qtype, d, trained);
-        }
-    } else
-#endif
-    {
-        if (metric == METRIC_L2) {
-            return select_distance_computer<SimilarityL2<1>>(qtype, d, trained);
-        } else {
-            return select_distance_computer<SimilarityIP<1>>(qtype, d, trained);
-        }
+        case ScalarQuantizer::QT_8bit_direct:
+            if (d % 16 == 0) {
+                return new DistanceComputerByte<Sim, SIMDWIDTH>(d, trained);
+            } else {
+                return new DCTemplate<
+                        Quantizer8bitDirect<SIMDWIDTH>,
+                        Sim,
+                        SIMDWIDTH>(d, trained);
+            }
     }
+    FAISS_THROW_MSG("unknown qtype");
+    return nullptr;
 }
 
 /*******************************************************************
@@ -1199,8 +1655,6 @@ SQDistanceComputer* ScalarQuantizer::get_distance_computer(
  * IndexScalarQuantizer as well.
  ********************************************************************/
 
-namespace {
-
 template <class DCClass, int use_sel>
 struct IVFSQScannerIP : InvertedListScanner {
     DCClass dc;
@@ -1447,6 +1901,11 @@ InvertedListScanner* sel1_InvertedListScanner(
     constexpr int SIMDWIDTH = Similarity::simdwidth;
     switch (sq->qtype) {
         case ScalarQuantizer::QT_8bit_uniform:
+            if (sq->int8_query) {
+                return sel2_InvertedListScanner<
+                        DistanceComputerInt8Query<Similarity>>(
+                        sq, quantizer, store_pairs, sel, r);
+            }
             return sel12_InvertedListScanner<Similarity, Codec8bit, true>(
                     sq, quantizer, store_pairs, sel, r);
         case ScalarQuantizer::QT_4bit_uniform:
@@ -1466,6 +1925,11 @@ InvertedListScanner* sel1_InvertedListScanner(
                     QuantizerFP16<SIMDWIDTH>,
                     Similarity,
                     SIMDWIDTH>>(sq, quantizer, store_pairs, sel, r);
+        case ScalarQuantizer::QT_bf16:
+            return sel2_InvertedListScanner<DCTemplate<
+                    QuantizerBF16<SIMDWIDTH>,
+                    Similarity,
+                    SIMDWIDTH>>(sq, quantizer, store_pairs, sel, r);
         case ScalarQuantizer::QT_8bit_direct:
             if (sq->d % 16 == 0) {
                 return sel2_InvertedListScanner<
@@ -1504,22 +1968,270 @@ InvertedListScanner* sel0_InvertedListScanner(
 
 } // anonymous namespace
 
-InvertedListScanner* ScalarQuantizer::select_InvertedListScanner(
+/*******************************************************************
+ * Entry points of the kernels, the ScalarQuantizer methods call them
+ * for the SIMD level in use.
+ ********************************************************************/
+
+ScalarQuantizer::SQuantizer* sq_select_quantizer(const ScalarQuantizer& sq) {
+#ifdef USE_AVX512
+    if (sq.d % 16 == 0) {
+        return select_quantizer_1<16>(sq.qtype, sq.d, sq.trained);
+    } else
+#endif
+#ifdef USE_F16C
+    if (sq.d % 8 == 0) {
+        return select_quantizer_1<8>(sq.qtype, sq.d, sq.trained);
+    } else
+#endif
+    {
+        return select_quantizer_1<1>(sq.qtype, sq.d, sq.trained);
+    }
+}
+
+SQDistanceComputer* sq_get_distance_computer(
+        const ScalarQuantizer& sq,
+        MetricType metric) {
+    QuantizerType qtype = sq.qtype;
+    size_t d = sq.d;
+    const std::vector<float>& trained = sq.trained;
+    bool i8 = sq.int8_query;
+#ifdef USE_AVX512
+    if (d % 16 == 0) {
+        if (metric == METRIC_L2) {
+            return select_distance_computer<SimilarityL2<16>>(
+                    qtype, d, trained, i8);
+        } else {
+            return select_distance_computer<SimilarityIP<16>>(
+                    qtype, d, trained, i8);
+        }
+    } else
+#endif
+#ifdef USE_F16C
+    if (d % 8 == 0) {
+        if (metric == METRIC_L2) {
+            return select_distance_computer<SimilarityL2<8>>(
+                    qtype, d, trained, i8);
+        } else {
+            return select_distance_computer<SimilarityIP<8>>(
+                    qtype, d, trained, i8);
+        }
+    } else
+#endif
+    {
+        if (metric == METRIC_L2) {
+            return select_distance_computer<SimilarityL2<1>>(
+                    qtype, d, trained, i8);
+        } else {
+            return select_distance_computer<SimilarityIP<1>>(
+                    qtype, d, trained, i8);
+        }
+    }
+}
+
+InvertedListScanner* sq_select_InvertedListScanner(
+        const ScalarQuantizer& sq,
         MetricType mt,
         const Index* quantizer,
         bool store_pairs,
         const IDSelector* sel,
-        bool by_residual) const {
+        bool by_residual) {
+#ifdef USE_AVX512
+    if (sq.d % 16 == 0) {
+        return sel0_InvertedListScanner<16>(
+                mt, &sq, quantizer, store_pairs, sel, by_residual);
+    } else
+#endif
 #ifdef USE_F16C
-    if (d % 8 == 0) {
+    if (sq.d % 8 == 0) {
         return sel0_InvertedListScanner<8>(
-                mt, this, quantizer, store_pairs, sel, by_residual);
+                mt, &sq, quantizer, store_pairs, sel, by_residual);
     } else
 #endif
     {
         return sel0_InvertedListScanner<1>(
-                mt, this, quantizer, store_pairs, sel, by_residual);
+                mt, &sq, quantizer, store_pairs, sel, by_residual);
+    }
+}
+
+FAISS_SIMD_NS_END
+
+#ifdef FAISS_SIMD_DISPATCH
+
+#define FAISS_SQ_KERNELS(K)                           \
+    K(ScalarQuantizer::SQuantizer*,                   \
+      sq_select_quantizer,                            \
+      sq_select_quantizer,                            \
+      (const ScalarQuantizer& sq),                    \
+      (sq))                                           \
+    K(SQDistanceComputer*,                            \
+      sq_get_distance_computer,                       \
+      sq_get_distance_computer,                       \
+      (const ScalarQuantizer& sq, MetricType metric), \
+      (sq, metric))                                   \
+    K(InvertedListScanner*,                           \
+      sq_select_InvertedListScanner,                  \
+      sq_select_InvertedListScanner,                  \
+      (const ScalarQuantizer& sq,                     \
+       MetricType mt,                                 \
+       const Index* quantizer,                        \
+       bool store_pairs,                              \
+       const IDSelector* sel,                         \
+       bool by_residual),                             \
+      (sq, mt, quantizer, store_pairs, sel, by_residual))
+
+FAISS_SIMD_DISPATCH_TABLE(FAISS_SQ_KERNELS)
+
+#endif
+
+#ifdef FAISS_SIMD_MAIN
+
+/*******************************************************************
+ * ScalarQuantizer implementation
+ ********************************************************************/
+
+ScalarQuantizer::ScalarQuantizer(size_t d, QuantizerType qtype)
+        : Quantizer(d), qtype(qtype), rangestat(RS_minmax), rangestat_arg(0) {
+    set_derived_sizes();
+}
+
+ScalarQuantizer::ScalarQuantizer()
+        : qtype(QT_8bit), rangestat(RS_minmax), rangestat_arg(0), bits(0) {}
+
+void ScalarQuantizer::set_derived_sizes() {
+    switch (qtype) {
+        case QT_8bit:
+        case QT_8bit_uniform:
+        case QT_8bit_direct:
+            code_size = d;
+            bits = 8;
+            break;
+        case QT_4bit:
+        case QT_4bit_uniform:
+            code_size = (d + 1) / 2;
+            bits = 4;
+            break;
+        case QT_6bit:
+            code_size = (d * 6 + 7) / 8;
+            bits = 6;
+            break;
+        case QT_fp16:
+        case QT_bf16:
+            code_size = d * 2;
+            bits = 16;
+            break;
+    }
+}
+
+void ScalarQuantizer::train(size_t n, const float* x) {
+    int bit_per_dim = qtype == QT_4bit_uniform ? 4
+            : qtype == QT_4bit                 ? 4
+            : qtype == QT_6bit                 ? 6
+            : qtype == QT_8bit_uniform         ? 8
+            : qtype == QT_8bit                 ? 8
+                                               : -1;
+
+    switch (qtype) {
+        case QT_4bit_uniform:
+        case QT_8bit_uniform:
+            train_Uniform(
+                    rangestat,
+                    rangestat_arg,
+                    n * d,
+                    1 << bit_per_dim,
+                    x,
+                    trained);
+            break;
+        case QT_4bit:
+        case QT_8bit:
+        case QT_6bit:
+            train_NonUniform(
+                    rangestat,
+                    rangestat_arg,
+                    n,
+                    d,
+                    1 << bit_per_dim,
+                    x,
+                    trained);
+            break;
+        case QT_fp16:
+        case QT_bf16:
+        case QT_8bit_direct:
+            // no training necessary
+            break;
+    }
+}
+
+void ScalarQuantizer::train_residual(
+        size_t n,
+        const float* x,
+        Index* quantizer,
+        bool by_residual,
+        bool verbose) {
+    const float* x_in = x;
+
+    // 100k points more than enough
+    x = fvecs_maybe_subsample(d, (size_t*)&n, 100000, x, verbose, 1234);
+
+    ScopeDeleter<float> del_x(x_in == x ? nullptr : x);
+
+    if (by_residual) {
+        std::vector<idx_t> idx(n);
+        quantizer->assign(n, x, idx.data());
+
+        std::vector<float> residuals(n * d);
+        quantizer->compute_residual_n(n, x, residuals.data(), idx.data());
+
+        train(n, residuals.data());
+    } else {
+        train(n, x);
     }
 }
 
+ScalarQuantizer::SQuantizer* ScalarQuantizer::select_quantizer() const {
+    return sq_select_quantizer(*this);
+}
+
+void ScalarQuantizer::compute_codes(const float* x, uint8_t* codes, size_t n)
+        const {
+    std::unique_ptr<SQuantizer> squant(select_quantizer());
+
+    memset(codes, 0, code_size * n);
+#pragma omp parallel for
+    for (int64_t i = 0; i < n; i++)
+        squant->encode_vector(x + i * d, codes + i * code_size);
+}
+
+void ScalarQuantizer::decode(const uint8_t* codes, float* x, size_t n) const {
+    std::unique_ptr<SQuantizer> squant(select_quantizer());
+
+#pragma omp parallel for
+    for (int64_t i = 0; i < n; i++)
+        squant->decode_vector(codes + i * code_size, x + i * d);
+}
+
+SQDistanceComputer* ScalarQuantizer::get_distance_computer(
+        MetricType metric) const {
+    FAISS_THROW_IF_NOT(metric == METRIC_L2 || metric == METRIC_INNER_PRODUCT);
+    FAISS_THROW_IF_NOT_MSG(
+            !int8_query || qtype == QT_8bit_uniform,
+            "int8_query requires QT_8bit_uniform");
+    return sq_get_distance_computer(*this, metric);
+}
+
+InvertedListScanner* ScalarQuantizer::select_InvertedListScanner(
+        MetricType mt,
+        const Index* quantizer,
+        bool store_pairs,
+        const IDSelector* sel,
+        bool by_residual) const {
+    FAISS_THROW_IF_NOT_MSG(
+            !int8_query || qtype == QT_8bit_uniform,
+            "int8_query requires QT_8bit_uniform");
+    return sq_select_InvertedListScanner(
+            *this, mt, quantizer, store_pairs, sel, by_residual);
+}
+
+#endif
+
 } // namespace faiss
@@ -32,6 +32,7 @@ struct ScalarQuantizer : Quantizer {
         QT_fp16,
         QT_8bit_direct, ///< fast indexing of uint8s
         QT_6bit,        ///< 6 bits per component
+        QT_bf16,        ///< bfloat16, same range as float32
     };
 
     QuantizerType qtype;
@@ -57,6 +58,14 @@ struct ScalarQuantizer : Quantizer {
     /// trained values (including the range)
     std::vector<float> trained;
 
+    /** For QT_8bit_uniform, quantize the queries to int8 and compute the
+     * distances with integer dot products. Faster but approximate. The
+     * AVX-512 kernels use AVX512-VNNI when the CPU supports it, the other
+     * SIMD levels a scalar loop. The distance computers and scanners
+     * throw for the other qtypes. Not stored in the index files.
+     */
+    bool int8_query = false;
+
     ScalarQuantizer(size_t d, QuantizerType qtype);
     ScalarQuantizer();
 
@@ -20,6 +20,7 @@
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/io.h>
 #include <faiss/impl/io_macros.h>
+#include <faiss/impl/mapped_io.h>
 #include <faiss/utils/hamming.h>
 
 #include <faiss/invlists/InvertedListsIOHook.h>
@@ -28,6 +29,7 @@
 #include <faiss/IndexAdditiveQuantizer.h>
 #include <faiss/IndexAdditiveQuantizerFastScan.h>
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexFlatInt8.h>
 #include <faiss/IndexHNSW.h>
 #include <faiss/IndexIVF.h>
 #include <faiss/IndexIVFAdditiveQuantizer.h>
@@ -44,6 +46,7 @@
 #include <faiss/IndexPQ.h>
 #include <faiss/IndexPQFastScan.h>
 #include <faiss/IndexPreTransform.h>
+#include <faiss/IndexMultiVector.h>
 #include <faiss/IndexRefine.h>
 #include <faiss/IndexRowwiseMinMax.h>
 #include <faiss/IndexScalarQuantizer.h>
@@ -62,6 +65,27 @@ namespace faiss {
  * Read
  **************************************************************/
 
+/** Read a vector of (size_mult * stored size) elements. When f is a
+ * MappedFileIOReader, the vector is a view of the mapped file. */
+template <typename T>
+static void read_mmappable_vector(
+        MaybeOwnedVector<T>& vec,
+        IOReader* f,
+        size_t size_mult = 1) {
+    size_t size;
+    READ1(size);
+    FAISS_THROW_IF_NOT(size < (uint64_t{1} << 40));
+    size *= size_mult;
+    MappedFileIOReader* mf = dynamic_cast<MappedFileIOReader*>(f);
+    if (mf) {
+        T* ptr = (T*)mf->map(sizeof(T), size);
+        vec = MaybeOwnedVector<T>::create_view(ptr, size, mf->mmap_owner);
+    } else {
+        vec.resize(size);
+        READANDCHECK(vec.data(), size);
+    }
+}
+
 static void read_index_header(Index* idx, IOReader* f) {
     READ1(idx->d);
     READ1(idx->ntotal);
@@ -354,21 +378,34 @@ static void read_ScalarQuantizer(ScalarQuantizer* ivsc, IOReader* f) {
     ivsc->set_derived_sizes();
 }
 
-static void read_HNSW(HNSW* hnsw, IOReader* f) {
+static void read_HNSW(
+        HNSW* hnsw,
+        IOReader* f,
+        bool level0_compressed = false) {
     READVECTOR(hnsw->assign_probas);
     READVECTOR(hnsw->cum_nneighbor_per_level);
-    READVECTOR(hnsw->levels);
-    READVECTOR(hnsw->offsets);
-    READVECTOR(hnsw->neighbors);
+    read_mmappable_vector(hnsw->levels, f);
+    read_mmappable_vector(hnsw->offsets, f);
+    read_mmappable_vector(hnsw->neighbors, f);
 
     READ1(hnsw->entry_point);
     READ1(hnsw->max_level);
     READ1(hnsw->efConstruction);
     READ1(hnsw->efSearch);
     READ1(hnsw->upper_beam);
+
+    if (level0_compressed) {
+        read_mmappable_vector(hnsw->level0_offsets, f);
+        read_mmappable_vector(hnsw->level0_codes, f);
+        FAISS_THROW_IF_NOT(
+                hnsw->level0_offsets.size() == hnsw->levels.size() + 1 &&
+                hnsw->level0_offsets.back() == hnsw->level0_codes.size());
+    }
 }
 
-static void read_NSG(NSG* nsg, IOReader* f) {
+/// dense_graph: graph stored as a N * R matrix (INGx fourccs) instead of
+/// -1 terminated lists (INSx)
+static void read_NSG(NSG* nsg, IOReader* f, bool dense_graph) {
     READ1(nsg->ntotal);
     READ1(nsg->R);
     READ1(nsg->L);
@@ -385,6 +422,23 @@ static void read_NSG(NSG* nsg, IOReader* f) {
     int N = nsg->ntotal;
     int R = nsg->R;
     auto& graph = nsg->final_graph;
+
+    if (dense_graph) {
+        MappedFileIOReader* mf = dynamic_cast<MappedFileIOReader*>(f);
+        if (mf) {
+            // the graph is a view of the mapping, that it keeps alive
+            int* data = (int*)mf->map(sizeof(int), size_t(N) * R);
+            std::shared_ptr<MmappedFileMappingOwner> owner = mf->mmap_owner;
+            graph.reset(
+                    new nsg::Graph<int>(data, N, R),
+                    [owner](nsg::Graph<int>* g) { delete g; });
+        } else {
+            graph = std::make_shared<nsg::Graph<int>>(N, R);
+            READANDCHECK(graph->data, size_t(N) * R);
+        }
+        return;
+    }
+
     graph = std::make_shared<nsg::Graph<int>>(N, R);
     std::fill_n(graph->data, N * R, EMPTY_ID);
 
@@ -535,7 +589,8 @@ Index* read_index(IOReader* f, int io_flags) {
         }
         read_index_header(idxf, f);
         idxf->code_size = idxf->d * sizeof(float);
-        READXBVECTOR(idxf->codes);
+        // the stored size is in floats
+        read_mmappable_vector(idxf->codes, f, sizeof(float));
         FAISS_THROW_IF_NOT(
                 idxf->codes.size() == idxf->ntotal * idxf->code_size);
         // leak!
@@ -566,7 +621,7 @@ Index* read_index(IOReader* f, int io_flags) {
             idxl->rrot = *rrot;
             delete rrot;
         }
-        READVECTOR(idxl->codes);
+        read_mmappable_vector(idxl->codes, f);
         FAISS_THROW_IF_NOT(
                 idxl->rrot.d_in == idxl->d && idxl->rrot.d_out == idxl->nbits);
         FAISS_THROW_IF_NOT(
@@ -579,7 +634,7 @@ Index* read_index(IOReader* f, int io_flags) {
         read_index_header(idxp, f);
         read_ProductQuantizer(&idxp->pq, f);
         idxp->code_size = idxp->pq.code_size;
-        READVECTOR(idxp->codes);
+        read_mmappable_vector(idxp->codes, f);
         if (h == fourcc("IxPo") || h == fourcc("IxPq")) {
             READ1(idxp->search_type);
             READ1(idxp->encode_signs);
@@ -601,28 +656,28 @@ Index* read_index(IOReader* f, int io_flags) {
             read_ResidualQuantizer(&idxr->rq, f);
         }
         READ1(idxr->code_size);
-        READVECTOR(idxr->codes);
+        read_mmappable_vector(idxr->codes, f);
         idx = idxr;
     } else if (h == fourcc("IxLS")) {
         auto idxr = new IndexLocalSearchQuantizer();
         read_index_header(idxr, f);
         read_LocalSearchQuantizer(&idxr->lsq, f);
         READ1(idxr->code_size);
-        READVECTOR(idxr->codes);
+        read_mmappable_vector(idxr->codes, f);
         idx = idxr;
     } else if (h == fourcc("IxPR")) {
         auto idxpr = new IndexProductResidualQuantizer();
         read_index_header(idxpr, f);
         read_ProductResidualQuantizer(&idxpr->prq, f);
         READ1(idxpr->code_size);
-        READVECTOR(idxpr->codes);
+        read_mmappable_vector(idxpr->codes, f);
         idx = idxpr;
     } else if (h == fourcc("IxPL")) {
         auto idxpl = new IndexProductLocalSearchQuantizer();
         read_index_header(idxpl, f);
         read_ProductLocalSearchQuantizer(&idxpl->plsq, f);
         READ1(idxpl->code_size);
-        READVECTOR(idxpl->codes);
+        read_mmappable_vector(idxpl->codes, f);
         idx = idxpl;
     } else if (h == fourcc("ImRQ")) {
         ResidualCoarseQuantizer* idxr = new ResidualCoarseQuantizer();
@@ -768,11 +823,18 @@ Index* read_index(IOReader* f, int io_flags) {
         ivfl->code_size = ivfl->d * sizeof(float);
         read_InvertedLists(ivfl, f, io_flags);
         idx = ivfl;
+    } else if (h == fourcc("IxI8")) {
+        IndexFlatInt8* idxi = new IndexFlatInt8();
+        read_index_header(idxi, f);
+        READ1(idxi->is_signed);
+        read_mmappable_vector(idxi->codes, f);
+        idxi->code_size = idxi->d;
+        idx = idxi;
     } else if (h == fourcc("IxSQ")) {
         IndexScalarQuantizer* idxs = new IndexScalarQuantizer();
         read_index_header(idxs, f);
         read_ScalarQuantizer(&idxs->sq, f);
-        READVECTOR(idxs->codes);
+        read_mmappable_vector(idxs->codes, f);
         idxs->code_size = idxs->sq.code_size;
         idx = idxs;
     } else if (h == fourcc("IxLa")) {
@@ -894,6 +956,18 @@ Index* read_index(IOReader* f, int io_flags) {
         idxrf->own_fields = true;
         idxrf->own_refine_index = true;
         idx = idxrf;
+    } else if (h == fourcc("IxMV")) {
+        IndexMultiVector* idxmv = new IndexMultiVector();
+        read_index_header(idxmv, f);
+        idxmv->token_index = read_index(f, io_flags);
+        idxmv->own_fields = true;
+        READVECTOR(idxmv->doc_offsets);
+        READ1(idxmv->k_token);
+        READ1(idxmv->exact_maxsim);
+        FAISS_THROW_IF_NOT(
+                idxmv->doc_offsets.size() == idxmv->ntotal + 1 &&
+                idxmv->doc_offsets.back() == idxmv->token_index->ntotal);
+        idx = idxmv;
     } else if (h == fourcc("IxMp") || h == fourcc("IxM2")) {
         bool is_map2 = h == fourcc("IxM2");
         IndexIDMap* idxmap = is_map2 ? new IndexIDMap2() : new IndexIDMap();
@@ -915,36 +989,43 @@ Index* read_index(IOReader* f, int io_flags) {
         READ1(idxp->code_size_1);
         READ1(idxp->code_size_2);
         READ1(idxp->code_size);
-        READVECTOR(idxp->codes);
+        read_mmappable_vector(idxp->codes, f);
         idx = idxp;
     } else if (
             h == fourcc("IHNf") || h == fourcc("IHNp") || h == fourcc("IHNs") ||
-            h == fourcc("IHN2")) {
+            h == fourcc("IHN2") || h == fourcc("IHCf") || h == fourcc("IHCp") ||
+            h == fourcc("IHCs") || h == fourcc("IHC2")) {
+        // IHCx: same as IHNx with a compressed level 0
+        bool level0_compressed = h == fourcc("IHCf") || h == fourcc("IHCp") ||
+                h == fourcc("IHCs") || h == fourcc("IHC2");
         IndexHNSW* idxhnsw = nullptr;
-        if (h == fourcc("IHNf"))
+        if (h == fourcc("IHNf") || h == fourcc("IHCf"))
             idxhnsw = new IndexHNSWFlat();
-        if (h == fourcc("IHNp"))
+        if (h == fourcc("IHNp") || h == fourcc("IHCp"))
             idxhnsw = new IndexHNSWPQ();
-        if (h == fourcc("IHNs"))
+        if (h == fourcc("IHNs") || h == fourcc("IHCs"))
             idxhnsw = new IndexHNSWSQ();
-        if (h == fourcc("IHN2"))
+        if (h == fourcc("IHN2") || h == fourcc("IHC2"))
             idxhnsw = new IndexHNSW2Level();
         read_index_header(idxhnsw, f);
-        read_HNSW(&idxhnsw->hnsw, f);
+        read_HNSW(&idxhnsw->hnsw, f, level0_compressed);
         idxhnsw->storage = read_index(f, io_flags);
         idxhnsw->own_fields = true;
-        if (h == fourcc("IHNp")) {
+        if (h == fourcc("IHNp") || h == fourcc("IHCp")) {
             dynamic_cast<IndexPQ*>(idxhnsw->storage)->pq.compute_sdc_table();
         }
         idx = idxhnsw;
     } else if (
-            h == fourcc("INSf") || h == fourcc("INSp") || h == fourcc("INSs")) {
+            h == fourcc("INSf") || h == fourcc("INSp") || h == fourcc("INSs") ||
+            h == fourcc("INGf") || h == fourcc("INGp") || h == fourcc("INGs")) {
+        bool dense_graph = h == fourcc("INGf") || h == fourcc("INGp") ||
+                h == fourcc("INGs");
         IndexNSG* idxnsg;
-        if (h == fourcc("INSf"))
+        if (h == fourcc("INSf") || h == fourcc("INGf"))
             idxnsg = new IndexNSGFlat();
-        if (h == fourcc("INSp"))
+        if (h == fourcc("INSp") || h == fourcc("INGp"))
             idxnsg = new IndexNSGPQ();
-        if (h == fourcc("INSs"))
+        if (h == fourcc("INSs") || h == fourcc("INGs"))
             idxnsg = new IndexNSGSQ();
         read_index_header(idxnsg, f);
         READ1(idxnsg->GK);
@@ -953,7 +1034,7 @@ Index* read_index(IOReader* f, int io_flags) {
         READ1(idxnsg->nndescent_R);
         READ1(idxnsg->nndescent_L);
         READ1(idxnsg->nndescent_iter);
-        read_NSG(&idxnsg->nsg, f);
+        read_NSG(&idxnsg->nsg, f, dense_graph);
         idxnsg->storage = read_index(f, io_flags);
         idxnsg->own_fields = true;
         idx = idxnsg;
@@ -1035,6 +1116,10 @@ Index* read_index(FILE* f, int io_flags) {
 }
 
 Index* read_index(const char* fname, int io_flags) {
+    if (io_flags & IO_FLAG_MMAP_IFC) {
+        MappedFileIOReader reader(fname);
+        return read_index(&reader, io_flags);
+    }
     FileIOReader reader(fname);
     Index* idx = read_index(&reader, io_flags);
     return idx;
@@ -1155,10 +1240,10 @@ IndexBinary* read_index_binary(IOReader* f, int io_flags) {
         idxff->own_fields = true;
         idxff->index = read_index(f, io_flags);
         idx = idxff;
-    } else if (h == fourcc("IBHf")) {
+    } else if (h == fourcc("IBHf") || h == fourcc("IBHc")) {
         IndexBinaryHNSW* idxhnsw = new IndexBinaryHNSW();
         read_index_binary_header(idxhnsw, f);
-        read_HNSW(&idxhnsw->hnsw, f);
+        read_HNSW(&idxhnsw->hnsw, f, h == fourcc("IBHc"));
         idxhnsw->storage = read_index_binary(f, io_flags);
         idxhnsw->own_fields = true;
         idx = idxhnsw;
@@ -29,6 +29,7 @@
 #include <faiss/IndexAdditiveQuantizer.h>
 #include <faiss/IndexAdditiveQuantizerFastScan.h>
 #include <faiss/IndexFlat.h>
+#include <faiss/IndexFlatInt8.h>
 #include <faiss/IndexHNSW.h>
 #include <faiss/IndexIVF.h>
 #include <faiss/IndexIVFAdditiveQuantizer.h>
@@ -45,6 +46,7 @@
 #include <faiss/IndexPQ.h>
 #include <faiss/IndexPQFastScan.h>
 #include <faiss/IndexPreTransform.h>
+#include <faiss/IndexMultiVector.h>
 #include <faiss/IndexRefine.h>
 #include <faiss/IndexRowwiseMinMax.h>
 #include <faiss/IndexScalarQuantizer.h>
@@ -303,6 +305,9 @@ void write_ProductQuantizer(const ProductQuantizer* pq, const char* fname) {
 }
 
 static void write_HNSW(const HNSW* hnsw, IOWriter* f) {
+    FAISS_THROW_IF_NOT_MSG(
+            hnsw->ndeleted == 0,
+            "cannot write HNSW with deleted vertices, call compact_deleted()");
     WRITEVECTOR(hnsw->assign_probas);
     WRITEVECTOR(hnsw->cum_nneighbor_per_level);
     WRITEVECTOR(hnsw->levels);
@@ -314,9 +319,16 @@ static void write_HNSW(const HNSW* hnsw, IOWriter* f) {
     WRITE1(hnsw->efConstruction);
     WRITE1(hnsw->efSearch);
     WRITE1(hnsw->upper_beam);
+
+    if (hnsw->is_level0_compressed()) {
+        WRITEVECTOR(hnsw->level0_offsets);
+        WRITEVECTOR(hnsw->level0_codes);
+    }
 }
 
-static void write_NSG(const NSG* nsg, IOWriter* f) {
+/// dense_graph: store the graph as a N * R matrix (INGx fourccs) instead of
+/// -1 terminated lists (INSx)
+static void write_NSG(const NSG* nsg, IOWriter* f, bool dense_graph) {
     WRITE1(nsg->ntotal);
     WRITE1(nsg->R);
     WRITE1(nsg->L);
@@ -329,21 +341,25 @@ static void write_NSG(const NSG* nsg, IOWriter* f) {
         return;
     }
 
-    constexpr int EMPTY_ID = -1;
     auto& graph = nsg->final_graph;
     int K = graph->K;
     int N = graph->N;
     FAISS_THROW_IF_NOT(N == nsg->ntotal);
     FAISS_THROW_IF_NOT(K == nsg->R);
-    FAISS_THROW_IF_NOT(true == graph->own_fields);
 
-    int size = 0;
+    if (dense_graph) {
+        // the N * K adjacency matrix is stored as is, so that it can be
+        // memory-mapped
+        WRITEANDCHECK(graph->data, size_t(N) * K);
+        return;
+    }
+
+    constexpr int EMPTY_ID = -1;
     for (int i = 0; i < N; i++) {
         for (int j = 0; j < K; j++) {
             int id = graph->at(i, j);
             if (id != EMPTY_ID) {
                 WRITE1(id);
-                size += 1;
             } else {
                 break;
             }
@@ -389,7 +405,7 @@ static void write_ivf_header(const IndexIVF* ivf, IOWriter* f) {
     write_direct_map(&ivf->direct_map, f);
 }
 
-void write_index(const Index* idx, IOWriter* f) {
+void write_index(const Index* idx, IOWriter* f, int io_flags) {
     if (const IndexFlat* idxf = dynamic_cast<const IndexFlat*>(idx)) {
         uint32_t h =
                 fourcc(idxf->metric_type == METRIC_INNER_PRODUCT ? "IxFI"
@@ -581,7 +597,7 @@ void write_index(const Index* idx, IOWriter* f) {
         uint32_t h = fourcc("Ix2L");
         WRITE1(h);
         write_index_header(idx, f);
-        write_index(idxp->q1.quantizer, f);
+        write_index(idxp->q1.quantizer, f, io_flags);
         WRITE1(idxp->q1.nlist);
         WRITE1(idxp->q1.quantizer_trains_alone);
         write_ProductQuantizer(&idxp->pq, f);
@@ -589,6 +605,14 @@ void write_index(const Index* idx, IOWriter* f) {
         WRITE1(idxp->code_size_2);
         WRITE1(idxp->code_size);
         WRITEVECTOR(idxp->codes);
+    } else if (
+            const IndexFlatInt8* idxi =
+                    dynamic_cast<const IndexFlatInt8*>(idx)) {
+        uint32_t h = fourcc("IxI8");
+        WRITE1(h);
+        write_index_header(idx, f);
+        WRITE1(idxi->is_signed);
+        WRITEVECTOR(idxi->codes);
     } else if (
             const IndexScalarQuantizer* idxs =
                     dynamic_cast<const IndexScalarQuantizer*>(idx)) {
@@ -711,7 +735,7 @@ void write_index(const Index* idx, IOWriter* f) {
         WRITE1(nt);
         for (int i = 0; i < nt; i++)
             write_VectorTransform(ixpt->chain[i], f);
-        write_index(ixpt->index, f);
+        write_index(ixpt->index, f, io_flags);
     } else if (
             const MultiIndexQuantizer* imiq =
                     dynamic_cast<const MultiIndexQuantizer*>(idx)) {
@@ -724,9 +748,19 @@ void write_index(const Index* idx, IOWriter* f) {
         uint32_t h = fourcc("IxRF");
         WRITE1(h);
         write_index_header(idxrf, f);
-        write_index(idxrf->base_index, f);
-        write_index(idxrf->refine_index, f);
+        write_index(idxrf->base_index, f, io_flags);
+        write_index(idxrf->refine_index, f, io_flags);
         WRITE1(idxrf->k_factor);
+    } else if (
+            const IndexMultiVector* idxmv =
+                    dynamic_cast<const IndexMultiVector*>(idx)) {
+        uint32_t h = fourcc("IxMV");
+        WRITE1(h);
+        write_index_header(idxmv, f);
+        write_index(idxmv->token_index, f, io_flags);
+        WRITEVECTOR(idxmv->doc_offsets);
+        WRITE1(idxmv->k_token);
+        WRITE1(idxmv->exact_maxsim);
     } else if (
             const IndexIDMap* idxmap = dynamic_cast<const IndexIDMap*>(idx)) {
         uint32_t h = dynamic_cast<const IndexIDMap2*>(idx) ? fourcc("IxM2")
@@ -734,24 +768,34 @@ void write_index(const Index* idx, IOWriter* f) {
         // no need to store additional info for IndexIDMap2
         WRITE1(h);
         write_index_header(idxmap, f);
-        write_index(idxmap->index, f);
+        write_index(idxmap->index, f, io_flags);
         WRITEVECTOR(idxmap->id_map);
     } else if (const IndexHNSW* idxhnsw = dynamic_cast<const IndexHNSW*>(idx)) {
-        uint32_t h = dynamic_cast<const IndexHNSWFlat*>(idx) ? fourcc("IHNf")
-                : dynamic_cast<const IndexHNSWPQ*>(idx)      ? fourcc("IHNp")
-                : dynamic_cast<const IndexHNSWSQ*>(idx)      ? fourcc("IHNs")
-                : dynamic_cast<const IndexHNSW2Level*>(idx)  ? fourcc("IHN2")
-                                                             : 0;
+        // IHCx when level 0 is compressed
+        bool c = idxhnsw->hnsw.is_level0_compressed();
+        uint32_t h = dynamic_cast<const IndexHNSWFlat*>(idx)
+                ? fourcc(c ? "IHCf" : "IHNf")
+                : dynamic_cast<const IndexHNSWPQ*>(idx)
+                ? fourcc(c ? "IHCp" : "IHNp")
+                : dynamic_cast<const IndexHNSWSQ*>(idx)
+                ? fourcc(c ? "IHCs" : "IHNs")
+                : dynamic_cast<const IndexHNSW2Level*>(idx)
+                ? fourcc(c ? "IHC2" : "IHN2")
+                : 0;
         FAISS_THROW_IF_NOT(h != 0);
         WRITE1(h);
         write_index_header(idxhnsw, f);
         write_HNSW(&idxhnsw->hnsw, f);
-        write_index(idxhnsw->storage, f);
+        write_index(idxhnsw->storage, f, io_flags);
     } else if (const IndexNSG* idxnsg = dynamic_cast<const IndexNSG*>(idx)) {
-        uint32_t h = dynamic_cast<const IndexNSGFlat*>(idx) ? fourcc("INSf")
-                : dynamic_cast<const IndexNSGPQ*>(idx)      ? fourcc("INSp")
-                : dynamic_cast<const IndexNSGSQ*>(idx)      ? fourcc("INSs")
-                                                            : 0;
+        bool dense_graph = io_flags & IO_FLAG_WRITE_DENSE_NSG;
+        uint32_t h = dynamic_cast<const IndexNSGFlat*>(idx)
+                ? fourcc(dense_graph ? "INGf" : "INSf")
+                : dynamic_cast<const IndexNSGPQ*>(idx)
+                ? fourcc(dense_graph ? "INGp" : "INSp")
+                : dynamic_cast<const IndexNSGSQ*>(idx)
+                ? fourcc(dense_graph ? "INGs" : "INSs")
+                : 0;
         FAISS_THROW_IF_NOT(h != 0);
         WRITE1(h);
         write_index_header(idxnsg, f);
@@ -761,8 +805,8 @@ void write_index(const Index* idx, IOWriter* f) {
         WRITE1(idxnsg->nndescent_R);
         WRITE1(idxnsg->nndescent_L);
         WRITE1(idxnsg->nndescent_iter);
-        write_NSG(&idxnsg->nsg, f);
-        write_index(idxnsg->storage, f);
+        write_NSG(&idxnsg->nsg, f, dense_graph);
+        write_index(idxnsg->storage, f, io_flags);
     } else if (
             const IndexNNDescent* idxnnd =
                     dynamic_cast<const IndexNNDescent*>(idx)) {
@@ -773,7 +817,7 @@ void write_index(const Index* idx, IOWriter* f) {
         WRITE1(h);
         write_index_header(idxnnd, f);
         write_NNDescent(&idxnnd->nndescent, f);
-        write_index(idxnnd->storage, f);
+        write_index(idxnnd->storage, f, io_flags);
     } else if (
             const IndexPQFastScan* idxpqfs =
                     dynamic_cast<const IndexPQFastScan*>(idx)) {
@@ -808,7 +852,7 @@ void write_index(const Index* idx, IOWriter* f) {
         uint32_t h = fourcc("IRMf");
         WRITE1(h);
         write_index_header(imm, f);
-        write_index(imm->index, f);
+        write_index(imm->index, f, io_flags);
     } else if (
             const IndexRowwiseMinMaxFP16* imm =
                     dynamic_cast<const IndexRowwiseMinMaxFP16*>(idx)) {
@@ -816,20 +860,20 @@ void write_index(const Index* idx, IOWriter* f) {
         uint32_t h = fourcc("IRMh");
         WRITE1(h);
         write_index_header(imm, f);
-        write_index(imm->index, f);
+        write_index(imm->index, f, io_flags);
     } else {
         FAISS_THROW_MSG("don't know how to serialize this type of index");
     }
 }
 
-void write_index(const Index* idx, FILE* f) {
+void write_index(const Index* idx, FILE* f, int io_flags) {
     FileIOWriter writer(f);
-    write_index(idx, &writer);
+    write_index(idx, &writer, io_flags);
 }
 
-void write_index(const Index* idx, const char* fname) {
+void write_index(const Index* idx, const char* fname, int io_flags) {
     FileIOWriter writer(fname);
-    write_index(idx, &writer);
+    write_index(idx, &writer, io_flags);
 }
 
 void write_VectorTransform(const VectorTransform* vt, const char* fname) {
@@ -942,7 +986,8 @@ void write_index_binary(const IndexBinary* idx, IOWriter* f) {
     } else if (
             const IndexBinaryHNSW* idxhnsw =
                     dynamic_cast<const IndexBinaryHNSW*>(idx)) {
-        uint32_t h = fourcc("IBHf");
+        uint32_t h = idxhnsw->hnsw.is_level0_compressed() ? fourcc("IBHc")
+                                                           : fourcc("IBHf");
         WRITE1(h);
         write_index_binary_header(idxhnsw, f);
         write_HNSW(&idxhnsw->hnsw, f);
@@ -0,0 +1,106 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/impl/mapped_io.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <faiss/impl/FaissAssert.h>
+
+namespace faiss {
+
+#ifndef _WIN32
+
+MmappedFileMappingOwner::MmappedFileMappingOwner(const char* fname) {
+    int fd = open(fname, O_RDONLY);
+    FAISS_THROW_IF_NOT_FMT(
+            fd >= 0,
+            "could not open %s for reading: %s",
+            fname,
+            strerror(errno));
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        int err = errno;
+        close(fd);
+        FAISS_THROW_FMT("could not stat %s: %s", fname, strerror(err));
+    }
+    size = st.st_size;
+    if (size > 0) {
+        void* p = mmap(
+                nullptr,
+                size,
+                PROT_READ | PROT_WRITE,
+                MAP_PRIVATE,
+                fd,
+                0);
+        int err = errno;
+        close(fd);
+        FAISS_THROW_IF_NOT_FMT(
+                p != MAP_FAILED,
+                "could not mmap %s: %s",
+                fname,
+                strerror(err));
+        ptr = (uint8_t*)p;
+    } else {
+        close(fd);
+    }
+}
+
+MmappedFileMappingOwner::~MmappedFileMappingOwner() {
+    if (ptr) {
+        munmap(ptr, size);
+    }
+}
+
+#else
+
+MmappedFileMappingOwner::MmappedFileMappingOwner(const char* fname) {
+    FAISS_THROW_MSG("memory-mapped files are not supported on this platform");
+}
+
+MmappedFileMappingOwner::~MmappedFileMappingOwner() {}
+
+#endif
+
+MappedFileIOReader::MappedFileIOReader(const char* fname)
+        : mmap_owner(std::make_shared<MmappedFileMappingOwner>(fname)) {
+    name = fname;
+}
+
+size_t MappedFileIOReader::operator()(void* ptr, size_t size, size_t nitems) {
+    if (size == 0) {
+        return nitems;
+    }
+    size_t nitems_avail = (mmap_owner->size - pos) / size;
+    nitems = std::min(nitems, nitems_avail);
+    memcpy(ptr, mmap_owner->ptr + pos, size * nitems);
+    pos += size * nitems;
+    return nitems;
+}
+
+uint8_t* MappedFileIOReader::map(size_t size, size_t nitems) {
+    FAISS_THROW_IF_NOT_FMT(
+            nitems <= (mmap_owner->size - pos) / std::max(size, size_t(1)),
+            "read error in %s: not enough data in the file",
+            name.c_str());
+    uint8_t* ptr = mmap_owner->ptr + pos;
+    pos += size * nitems;
+    return ptr;
+}
+
+} // namespace faiss
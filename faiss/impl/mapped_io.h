@@ -0,0 +1,54 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+
+#include <faiss/impl/io.h>
+#include <faiss/impl/maybe_owned_vector.h>
+
+namespace faiss {
+
+/** Private mapping of a whole file. The pages are shared with the page cache
+ * and the other processes that map the file, until they are written to
+ * (copy-on-write, the file is never modified).
+ */
+struct MmappedFileMappingOwner : MaybeOwnedVectorOwner {
+    uint8_t* ptr = nullptr;
+    size_t size = 0;
+
+    explicit MmappedFileMappingOwner(const char* fname);
+
+    ~MmappedFileMappingOwner() override;
+};
+
+/** Reader on a memory-mapped file. The large arrays of the indexes that
+ * support it (IndexFlatCodes, HNSW, NSG) are not copied when read from this
+ * reader: they become views of the mapping, that is kept alive as long as
+ * they exist.
+ */
+struct MappedFileIOReader : IOReader {
+    std::shared_ptr<MmappedFileMappingOwner> mmap_owner;
+
+    /// current read position in the file
+    size_t pos = 0;
+
+    explicit MappedFileIOReader(const char* fname);
+
+    size_t operator()(void* ptr, size_t size, size_t nitems) override;
+
+    /** Skip the next nitems elements of the given size and return a pointer
+     * to them in the mapping.
+     */
+    uint8_t* map(size_t size, size_t nitems);
+};
+
+} // namespace faiss
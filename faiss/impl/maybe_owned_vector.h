@@ -0,0 +1,212 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace faiss {
+
+/// Keeps alive the memory viewed by MaybeOwnedVector objects (eg. a file
+/// mapping)
+struct MaybeOwnedVectorOwner {
+    virtual ~MaybeOwnedVectorOwner() {}
+};
+
+/** Array that either owns its elements in a std::vector or is a view of
+ * memory owned by a MaybeOwnedVectorOwner, typically a memory-mapped file.
+ *
+ * It provides the subset of the std::vector interface used by the index
+ * structures. A view can be read and modified in place; operations that
+ * change its size first copy the elements to an owned buffer.
+ */
+template <typename T>
+struct MaybeOwnedVector {
+    using value_type = T;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    MaybeOwnedVector() {}
+
+    explicit MaybeOwnedVector(size_t n) : owned_data(n) {}
+
+    MaybeOwnedVector(size_t n, const T& value) : owned_data(n, value) {}
+
+    MaybeOwnedVector(const std::vector<T>& v) : owned_data(v) {}
+
+    MaybeOwnedVector(std::vector<T>&& v) : owned_data(std::move(v)) {}
+
+    MaybeOwnedVector(const MaybeOwnedVector& other) {
+        *this = other;
+    }
+
+    MaybeOwnedVector(MaybeOwnedVector&& other) {
+        *this = std::move(other);
+    }
+
+    /// copies are always owned
+    MaybeOwnedVector& operator=(const MaybeOwnedVector& other) {
+        if (this != &other) {
+            release_view();
+            owned_data.assign(other.begin(), other.end());
+        }
+        return *this;
+    }
+
+    MaybeOwnedVector& operator=(MaybeOwnedVector&& other) {
+        owned_data = std::move(other.owned_data);
+        view_data = other.view_data;
+        view_size = other.view_size;
+        owner = std::move(other.owner);
+        other.owned_data.clear();
+        other.view_data = nullptr;
+        other.view_size = 0;
+        return *this;
+    }
+
+    /// view of n elements at ptr, kept alive by owner
+    static MaybeOwnedVector create_view(
+            T* ptr,
+            size_t n,
+            std::shared_ptr<MaybeOwnedVectorOwner> owner) {
+        MaybeOwnedVector v;
+        if (n == 0) {
+            return v;
+        }
+        v.view_data = ptr;
+        v.view_size = n;
+        v.owner = std::move(owner);
+        return v;
+    }
+
+    bool is_owned() const {
+        return view_data == nullptr;
+    }
+
+    T* data() {
+        return is_owned() ? owned_data.data() : view_data;
+    }
+
+    const T* data() const {
+        return is_owned() ? owned_data.data() : view_data;
+    }
+
+    size_t size() const {
+        return is_owned() ? owned_data.size() : view_size;
+    }
+
+    bool empty() const {
+        return size() == 0;
+    }
+
+    size_t capacity() const {
+        return is_owned() ? owned_data.capacity() : view_size;
+    }
+
+    T& operator[](size_t i) {
+        return data()[i];
+    }
+
+    const T& operator[](size_t i) const {
+        return data()[i];
+    }
+
+    T* begin() {
+        return data();
+    }
+
+    T* end() {
+        return data() + size();
+    }
+
+    const T* begin() const {
+        return data();
+    }
+
+    const T* end() const {
+        return data() + size();
+    }
+
+    T& back() {
+        return data()[size() - 1];
+    }
+
+    const T& back() const {
+        return data()[size() - 1];
+    }
+
+    void resize(size_t n) {
+        make_owned();
+        owned_data.resize(n);
+    }
+
+    void resize(size_t n, const T& value) {
+        make_owned();
+        owned_data.resize(n, value);
+    }
+
+    void reserve(size_t n) {
+        make_owned();
+        owned_data.reserve(n);
+    }
+
+    void push_back(const T& value) {
+        make_owned();
+        owned_data.push_back(value);
+    }
+
+    template <class InputIt>
+    void insert(T* pos, InputIt first, InputIt last) {
+        size_t i = pos - data();
+        make_owned();
+        owned_data.insert(owned_data.begin() + i, first, last);
+    }
+
+    void clear() {
+        release_view();
+        owned_data.clear();
+    }
+
+    void shrink_to_fit() {
+        if (is_owned()) {
+            owned_data.shrink_to_fit();
+        }
+    }
+
+    void swap(MaybeOwnedVector& other) {
+        std::swap(*this, other);
+    }
+
+   private:
+    /// used when the vector is owned
+    std::vector<T> owned_data;
+
+    /// used when the vector is a view
+    T* view_data = nullptr;
+    size_t view_size = 0;
+    std::shared_ptr<MaybeOwnedVectorOwner> owner;
+
+    void release_view() {
+        view_data = nullptr;
+        view_size = 0;
+        owner.reset();
+    }
+
+    void make_owned() {
+        if (!is_owned()) {
+            owned_data.assign(view_data, view_data + view_size);
+            release_view();
+        }
+    }
+};
+
+} // namespace faiss
@@ -10,17 +10,102 @@
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/LookupTableScaler.h>
 #include <faiss/impl/simd_result_handlers.h>
+#include <faiss/utils/simd_levels.h>
 
 namespace faiss {
 
 using namespace simd_result_handlers;
 
+using DS = DummyScaler;
+using NS = NormTableScaler;
+
+using Csi = CMax<uint16_t, int>;
+using CsiMin = CMin<uint16_t, int>;
+using Csl = CMax<uint16_t, int64_t>;
+using CslMin = CMin<uint16_t, int64_t>;
+
+FAISS_SIMD_NS_BEGIN
+
 /***************************************************************
  * accumulation functions
  ***************************************************************/
 
 namespace {
 
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+
+/*
+ * 512-bit version of the inner loop of kernel_accumulate_block, that handles
+ * 4 sub-quantizers per iteration: lanes 0 and 1 of the registers hold a pair
+ * of sub-quantizers and lanes 2 and 3 the next pair. The accumulators of the
+ * two pairs are summed into the 256-bit ones at the end. nsq4 should be a
+ * multiple of 4, the codes and LUT pointers are advanced accordingly.
+ */
+template <int NQ, int BB>
+void kernel_accumulate_4sq(
+        int nsq4,
+        const uint8_t*& codes,
+        const uint8_t*& LUT,
+        simd16uint16 accu[NQ][BB][4]) {
+    simd32uint16 accu4[NQ][BB][4];
+
+    for (int q = 0; q < NQ; q++) {
+        for (int b = 0; b < BB; b++) {
+            for (int i = 0; i < 4; i++) {
+                accu4[q][b][i].clear();
+            }
+        }
+    }
+
+    for (int sq = 0; sq < nsq4; sq += 4) {
+        // the data of the second pair is NQ * 32 (LUT) and BB * 32 (codes)
+        // bytes further
+        simd64uint8 lut_cache[NQ];
+        for (int q = 0; q < NQ; q++) {
+            lut_cache[q] = NQ == 1 ? simd64uint8(LUT)
+                                   : simd64uint8(
+                                             simd32uint8(LUT),
+                                             simd32uint8(LUT + NQ * 32));
+            LUT += 32;
+        }
+        LUT += NQ * 32;
+
+        for (int b = 0; b < BB; b++) {
+            simd64uint8 c = BB == 1 ? simd64uint8(codes)
+                                    : simd64uint8(
+                                              simd32uint8(codes),
+                                              simd32uint8(codes + BB * 32));
+            codes += 32;
+            simd64uint8 mask(15);
+            simd64uint8 chi = simd64uint8(simd32uint16(c) >> 4) & mask;
+            simd64uint8 clo = c & mask;
+
+            for (int q = 0; q < NQ; q++) {
+                simd64uint8 lut = lut_cache[q];
+                simd64uint8 res0 = lut.lookup_4_lanes(clo);
+                simd64uint8 res1 = lut.lookup_4_lanes(chi);
+
+                accu4[q][b][0] += simd32uint16(res0);
+                accu4[q][b][1] += simd32uint16(res0) >> 8;
+
+                accu4[q][b][2] += simd32uint16(res1);
+                accu4[q][b][3] += simd32uint16(res1) >> 8;
+            }
+        }
+        codes += BB * 32;
+    }
+
+    for (int q = 0; q < NQ; q++) {
+        for (int b = 0; b < BB; b++) {
+            for (int i = 0; i < 4; i++) {
+                accu[q][b][i] += accu4[q][b][i].low() + accu4[q][b][i].high();
+            }
+        }
+    }
+}
+
+#endif
+
 /*
  * The computation kernel
  * It accumulates results for NQ queries and BB * 32 database elements
@@ -46,7 +131,13 @@ void kernel_accumulate_block(
         }
     }
 
-    for (int sq = 0; sq < nsq - scaler.nscale; sq += 2) {
+    int sq0 = 0;
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+    sq0 = (nsq - scaler.nscale) & ~3;
+    kernel_accumulate_4sq<NQ, BB>(sq0, codes, LUT, accu);
+#endif
+
+    for (int sq = sq0; sq < nsq - scaler.nscale; sq += 2) {
         simd32uint8 lut_cache[NQ];
         for (int q = 0; q < NQ; q++) {
             lut_cache[q] = simd32uint8(LUT);
@@ -185,9 +276,6 @@ void pq4_accumulate_loop(
             TH<C, with_id_map>&,                              \
             const S&);
 
-using DS = DummyScaler;
-using NS = NormTableScaler;
-
 #define INSTANTIATE_3(C, with_id_map)                               \
     INSTANTIATE_ACCUMULATE(SingleResultHandler, C, with_id_map, DS) \
     INSTANTIATE_ACCUMULATE(HeapHandler, C, with_id_map, DS)         \
@@ -197,14 +285,52 @@ using NS = NormTableScaler;
     INSTANTIATE_ACCUMULATE(HeapHandler, C, with_id_map, NS)         \
     INSTANTIATE_ACCUMULATE(ReservoirHandler, C, with_id_map, NS)
 
-using Csi = CMax<uint16_t, int>;
 INSTANTIATE_3(Csi, false);
-using CsiMin = CMin<uint16_t, int>;
 INSTANTIATE_3(CsiMin, false);
+INSTANTIATE_3(Csl, true);
+INSTANTIATE_3(CslMin, true);
 
-using Csl = CMax<uint16_t, int64_t>;
+FAISS_SIMD_NS_END
+
+#ifdef FAISS_SIMD_DISPATCH
+
+#define DECLARE_ACCUMULATE(level)                \
+    namespace level {                            \
+    template <class ResultHandler, class Scaler> \
+    void pq4_accumulate_loop(                    \
+            int nq,                              \
+            size_t nb,                           \
+            int bbs,                             \
+            int nsq,                             \
+            const uint8_t* codes,                \
+            const uint8_t* LUT,                  \
+            ResultHandler& res,                  \
+            const Scaler& scaler);               \
+    }
+
+DECLARE_ACCUMULATE(avx2)
+DECLARE_ACCUMULATE(avx512)
+
+template <class ResultHandler, class Scaler>
+void pq4_accumulate_loop(
+        int nq,
+        size_t nb,
+        int bbs,
+        int nsq,
+        const uint8_t* codes,
+        const uint8_t* LUT,
+        ResultHandler& res,
+        const Scaler& scaler) {
+    FAISS_SIMD_DISPATCH_CALL(
+            pq4_accumulate_loop,
+            (nq, nb, bbs, nsq, codes, LUT, res, scaler));
+}
+
+INSTANTIATE_3(Csi, false);
+INSTANTIATE_3(CsiMin, false);
 INSTANTIATE_3(Csl, true);
-using CslMin = CMin<uint16_t, int64_t>;
 INSTANTIATE_3(CslMin, true);
 
+#endif
+
 } // namespace faiss
@@ -10,18 +10,97 @@
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/LookupTableScaler.h>
 #include <faiss/impl/simd_result_handlers.h>
+#include <faiss/utils/simd_levels.h>
 #include <faiss/utils/simdlib.h>
 
 namespace faiss {
 
 using namespace simd_result_handlers;
 
+using Csi = CMax<uint16_t, int>;
+using Csi2 = CMin<uint16_t, int>;
+
+using Cfl = CMax<uint16_t, int64_t>;
+using HHCsl = HeapHandler<Cfl, true>;
+using RHCsl = ReservoirHandler<Cfl, true>;
+using SHCsl = SingleResultHandler<Cfl, true>;
+using Cfl2 = CMin<uint16_t, int64_t>;
+using HHCsl2 = HeapHandler<Cfl2, true>;
+using RHCsl2 = ReservoirHandler<Cfl2, true>;
+using SHCsl2 = SingleResultHandler<Cfl2, true>;
+
+FAISS_SIMD_NS_BEGIN
+
 /************************************************************
  * Accumulation functions
  ************************************************************/
 
 namespace {
 
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+
+/*
+ * 512-bit version of the inner loop of kernel_accumulate_block: it handles
+ * 4 sub-quantizers per iteration instead of 2. The 128-bit lanes 0 and 1 of
+ * the registers hold a pair of sub-quantizers, as in the 256-bit version,
+ * and the lanes 2 and 3 hold the next pair. The accumulators of the two
+ * pairs are summed into the 256-bit accumulators at the end, so the results
+ * are the same as with the 256-bit loop.
+ * Processes nsq4 sub-quantizers, nsq4 should be a multiple of 4. The codes
+ * and LUT pointers are advanced accordingly.
+ */
+template <int NQ, int NQA>
+void kernel_accumulate_4sq(
+        int nsq4,
+        const uint8_t*& codes,
+        const uint8_t*& LUT,
+        simd16uint16 accu[NQA][4]) {
+    simd32uint16 accu4[NQA][4];
+
+    for (int q = 0; q < NQ; q++) {
+        for (int b = 0; b < 4; b++) {
+            accu4[q][b].clear();
+        }
+    }
+
+    for (int sq = 0; sq < nsq4; sq += 4) {
+        // codes of 2 consecutive pairs of sub-quantizers
+        simd64uint8 c(codes);
+        codes += 64;
+
+        simd64uint8 mask(0xf);
+        simd64uint8 chi = simd64uint8(simd32uint16(c) >> 4) & mask;
+        simd64uint8 clo = c & mask;
+
+        for (int q = 0; q < NQ; q++) {
+            // the LUTs of the second pair are NQ * 32 bytes further
+            simd64uint8 lut = NQ == 1
+                    ? simd64uint8(LUT)
+                    : simd64uint8(
+                              simd32uint8(LUT), simd32uint8(LUT + NQ * 32));
+            LUT += 32;
+
+            simd64uint8 res0 = lut.lookup_4_lanes(clo);
+            simd64uint8 res1 = lut.lookup_4_lanes(chi);
+
+            accu4[q][0] += simd32uint16(res0);
+            accu4[q][1] += simd32uint16(res0) >> 8;
+
+            accu4[q][2] += simd32uint16(res1);
+            accu4[q][3] += simd32uint16(res1) >> 8;
+        }
+        LUT += NQ * 32;
+    }
+
+    for (int q = 0; q < NQ; q++) {
+        for (int b = 0; b < 4; b++) {
+            accu[q][b] += accu4[q][b].low() + accu4[q][b].high();
+        }
+    }
+}
+
+#endif
+
 /*
  * The computation kernel
  * It accumulates results for NQ queries and 2 * 16 database elements
@@ -47,8 +126,14 @@ void kernel_accumulate_block(
         }
     }
 
+    int sq0 = 0;
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+    sq0 = (nsq - scaler.nscale) & ~3;
+    kernel_accumulate_4sq<NQ, NQA>(sq0, codes, LUT, accu);
+#endif
+
     // _mm_prefetch(codes + 768, 0);
-    for (int sq = 0; sq < nsq - scaler.nscale; sq += 2) {
+    for (int sq = sq0; sq < nsq - scaler.nscale; sq += 2) {
         // prefetch
         simd32uint8 c(codes);
         codes += 32;
@@ -292,29 +377,92 @@ void pq4_accumulate_loop_qbs(
             RH&,                                                \
             const NormTableScaler&);
 
-using Csi = CMax<uint16_t, int>;
-INSTANTIATE_ACCUMULATE_Q(SingleResultHandler<Csi>)
-INSTANTIATE_ACCUMULATE_Q(HeapHandler<Csi>)
-INSTANTIATE_ACCUMULATE_Q(ReservoirHandler<Csi>)
-using Csi2 = CMin<uint16_t, int>;
-INSTANTIATE_ACCUMULATE_Q(SingleResultHandler<Csi2>)
-INSTANTIATE_ACCUMULATE_Q(HeapHandler<Csi2>)
-INSTANTIATE_ACCUMULATE_Q(ReservoirHandler<Csi2>)
+#define INSTANTIATE_ALL_ACCUMULATE_Q                    \
+    INSTANTIATE_ACCUMULATE_Q(SingleResultHandler<Csi>)  \
+    INSTANTIATE_ACCUMULATE_Q(HeapHandler<Csi>)          \
+    INSTANTIATE_ACCUMULATE_Q(ReservoirHandler<Csi>)     \
+    INSTANTIATE_ACCUMULATE_Q(SingleResultHandler<Csi2>) \
+    INSTANTIATE_ACCUMULATE_Q(HeapHandler<Csi2>)         \
+    INSTANTIATE_ACCUMULATE_Q(ReservoirHandler<Csi2>)    \
+    INSTANTIATE_ACCUMULATE_Q(HHCsl)                     \
+    INSTANTIATE_ACCUMULATE_Q(RHCsl)                     \
+    INSTANTIATE_ACCUMULATE_Q(SHCsl)                     \
+    INSTANTIATE_ACCUMULATE_Q(HHCsl2)                    \
+    INSTANTIATE_ACCUMULATE_Q(RHCsl2)                    \
+    INSTANTIATE_ACCUMULATE_Q(SHCsl2)
+
+INSTANTIATE_ALL_ACCUMULATE_Q
 
-using Cfl = CMax<uint16_t, int64_t>;
-using HHCsl = HeapHandler<Cfl, true>;
-using RHCsl = ReservoirHandler<Cfl, true>;
-using SHCsl = SingleResultHandler<Cfl, true>;
-INSTANTIATE_ACCUMULATE_Q(HHCsl)
-INSTANTIATE_ACCUMULATE_Q(RHCsl)
-INSTANTIATE_ACCUMULATE_Q(SHCsl)
-using Cfl2 = CMin<uint16_t, int64_t>;
-using HHCsl2 = HeapHandler<Cfl2, true>;
-using RHCsl2 = ReservoirHandler<Cfl2, true>;
-using SHCsl2 = SingleResultHandler<Cfl2, true>;
-INSTANTIATE_ACCUMULATE_Q(HHCsl2)
-INSTANTIATE_ACCUMULATE_Q(RHCsl2)
-INSTANTIATE_ACCUMULATE_Q(SHCsl2)
+void accumulate_to_mem(
+        int nq,
+        size_t ntotal2,
+        int nsq,
+        const uint8_t* codes,
+        const uint8_t* LUT,
+        uint16_t* accu) {
+    FAISS_THROW_IF_NOT(ntotal2 % 32 == 0);
+    StoreResultHandler handler(accu, ntotal2);
+    DummyScaler scaler;
+    accumulate(nq, ntotal2, nsq, codes, LUT, handler, scaler);
+}
+
+FAISS_SIMD_NS_END
+
+#ifdef FAISS_SIMD_DISPATCH
+
+#define DECLARE_ACCUMULATE(level)                \
+    namespace level {                            \
+    template <class ResultHandler, class Scaler> \
+    void pq4_accumulate_loop_qbs(                \
+            int qbs,                             \
+            size_t ntotal2,                      \
+            int nsq,                             \
+            const uint8_t* codes,                \
+            const uint8_t* LUT0,                 \
+            ResultHandler& res,                  \
+            const Scaler& scaler);               \
+    void accumulate_to_mem(                      \
+            int nq,                              \
+            size_t ntotal2,                      \
+            int nsq,                             \
+            const uint8_t* codes,                \
+            const uint8_t* LUT,                  \
+            uint16_t* accu);                     \
+    }
+
+DECLARE_ACCUMULATE(avx2)
+DECLARE_ACCUMULATE(avx512)
+
+template <class ResultHandler, class Scaler>
+void pq4_accumulate_loop_qbs(
+        int qbs,
+        size_t ntotal2,
+        int nsq,
+        const uint8_t* codes,
+        const uint8_t* LUT0,
+        ResultHandler& res,
+        const Scaler& scaler) {
+    FAISS_SIMD_DISPATCH_CALL(
+            pq4_accumulate_loop_qbs,
+            (qbs, ntotal2, nsq, codes, LUT0, res, scaler));
+}
+
+INSTANTIATE_ALL_ACCUMULATE_Q
+
+void accumulate_to_mem(
+        int nq,
+        size_t ntotal2,
+        int nsq,
+        const uint8_t* codes,
+        const uint8_t* LUT,
+        uint16_t* accu) {
+    FAISS_SIMD_DISPATCH_CALL(
+            accumulate_to_mem, (nq, ntotal2, nsq, codes, LUT, accu));
+}
+
+#endif
+
+#ifdef FAISS_SIMD_MAIN
 
 /***************************************************************
  * Packing functions
@@ -331,19 +479,6 @@ int pq4_qbs_to_nq(int qbs) {
     return i0;
 }
 
-void accumulate_to_mem(
-        int nq,
-        size_t ntotal2,
-        int nsq,
-        const uint8_t* codes,
-        const uint8_t* LUT,
-        uint16_t* accu) {
-    FAISS_THROW_IF_NOT(ntotal2 % 32 == 0);
-    StoreResultHandler handler(accu, ntotal2);
-    DummyScaler scaler;
-    accumulate(nq, ntotal2, nsq, codes, LUT, handler, scaler);
-}
-
 int pq4_preferred_qbs(int n) {
     // from timmings in P141901742, P141902828
     static int map[12] = {
@@ -362,4 +497,6 @@ int pq4_preferred_qbs(int n) {
     }
 }
 
+#endif
+
 } // namespace faiss
@@ -148,15 +148,27 @@ struct SIMDResultHandler {
             size_t b,
             simd16uint16 d0,
             simd16uint16 d1) {
-        simd16uint16 thr16(thr);
         uint32_t lt_mask;
 
         constexpr bool keep_min = C::is_max;
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+        // a single comparison on the 32 elements, that directly yields the
+        // bit mask
+        simd32uint16 d(d0, d1);
+        simd32uint16 thr32(thr);
+        if (keep_min) {
+            lt_mask = ~cmp_ge32(d, thr32);
+        } else {
+            lt_mask = ~cmp_le32(d, thr32);
+        }
+#else
+        simd16uint16 thr16(thr);
         if (keep_min) {
             lt_mask = ~cmp_ge32(d0, d1, thr16);
         } else {
             lt_mask = ~cmp_le32(d0, d1, thr16);
         }
+#endif
 
         if (lt_mask == 0) {
             return 0;
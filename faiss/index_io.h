@@ -35,9 +35,9 @@ struct IOReader;
 struct IOWriter;
 struct InvertedLists;
 
-void write_index(const Index* idx, const char* fname);
-void write_index(const Index* idx, FILE* f);
-void write_index(const Index* idx, IOWriter* writer);
+void write_index(const Index* idx, const char* fname, int io_flags = 0);
+void write_index(const Index* idx, FILE* f, int io_flags = 0);
+void write_index(const Index* idx, IOWriter* writer, int io_flags = 0);
 
 void write_index_binary(const IndexBinary* idx, const char* fname);
 void write_index_binary(const IndexBinary* idx, FILE* f);
@@ -55,6 +55,19 @@ const int IO_FLAG_SKIP_PRECOMPUTE_TABLE = 16;
 // try to memmap data (useful to load an ArrayInvertedLists as an
 // OnDiskInvertedLists)
 const int IO_FLAG_MMAP = IO_FLAG_SKIP_IVF_DATA | 0x646f0000;
+// memory-map the file and make the codes of IndexFlatCodes and the graphs of
+// HNSW and NSG views of the mapping instead of copies (see
+// MappedFileIOReader). Only for read_index from a file name
+const int IO_FLAG_MMAP_IFC = 1 << 9;
+// read the lists of an OnDiskInvertedLists with pread from a pool of I/O
+// threads instead of mmapping them (see AsyncOnDiskInvertedLists)
+const int IO_FLAG_ONDISK_ASYNC_READ = 1 << 10;
+// same, with the file opened with O_DIRECT
+const int IO_FLAG_ONDISK_DIRECT_IO = IO_FLAG_ONDISK_ASYNC_READ | 1 << 11;
+// write_index: store the NSG graphs as dense matrices (INGx fourccs), that
+// IO_FLAG_MMAP_IFC can map, instead of -1 terminated lists (INSx). The
+// files are larger for sparse graphs and cannot be read by older versions
+const int IO_FLAG_WRITE_DENSE_NSG = 1 << 12;
 
 Index* read_index(const char* fname, int io_flags = 0);
 Index* read_index(FILE* f, int io_flags = 0);
@@ -0,0 +1,294 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/invlists/CompressedIdsInvertedLists.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <memory>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/io_macros.h>
+
+namespace faiss {
+
+namespace {
+
+typedef CompressedIdsInvertedLists::List List;
+const size_t B = CompressedIdsInvertedLists::ids_per_block;
+
+uint64_t get_bits(const uint64_t* words, size_t pos, int nbits) {
+    if (nbits == 0) {
+        return 0;
+    }
+    size_t i = pos >> 6;
+    int s = pos & 63;
+    uint64_t v = words[i] >> s;
+    if (s + nbits > 64) {
+        v |= words[i + 1] << (64 - s);
+    }
+    return nbits == 64 ? v : v & ((uint64_t(1) << nbits) - 1);
+}
+
+void set_bits(uint64_t* words, size_t pos, int nbits, uint64_t v) {
+    if (nbits == 0) {
+        return;
+    }
+    uint64_t mask = nbits == 64 ? ~uint64_t(0) : (uint64_t(1) << nbits) - 1;
+    size_t i = pos >> 6;
+    int s = pos & 63;
+    words[i] = (words[i] & ~(mask << s)) | (v << s);
+    if (s + nbits > 64) {
+        int r = 64 - s;
+        words[i + 1] = (words[i + 1] & ~(mask >> r)) | (v >> r);
+    }
+}
+
+int nbits_for(uint64_t v) {
+    int nbits = 0;
+    while (nbits < 64 && (v >> nbits) != 0) {
+        nbits++;
+    }
+    return nbits;
+}
+
+size_t nwords(size_t size, int nbits) {
+    return (size * nbits + 63) / 64;
+}
+
+idx_t decode_id(const List& l, size_t j) {
+    return idx_t(
+            uint64_t(l.bases[j / B]) +
+            get_bits(l.packed.data(), j * l.nbits, l.nbits));
+}
+
+void decode_ids(const List& l, size_t j0, size_t j1, idx_t* ids) {
+    for (size_t j = j0; j < j1; j++) {
+        ids[j - j0] = decode_id(l, j);
+    }
+}
+
+/// re-encode a list with more bits per id
+void repack(List& l, int nbits) {
+    std::vector<idx_t> ids(l.size);
+    decode_ids(l, 0, l.size, ids.data());
+    l.nbits = nbits;
+    l.packed.assign(nwords(l.size, nbits), 0);
+    for (size_t j = 0; j < l.size; j++) {
+        set_bits(
+                l.packed.data(),
+                j * nbits,
+                nbits,
+                uint64_t(ids[j]) - uint64_t(l.bases[j / B]));
+    }
+}
+
+/** encode the ids of the entries offset to offset + n - 1 of a list. The
+ * other entries of the blocks that are touched are re-encoded as well. */
+void set_ids(List& l, size_t offset, size_t n, const idx_t* ids) {
+    std::vector<idx_t> block;
+    for (size_t b = offset / B; b * B < offset + n; b++) {
+        size_t j0 = b * B, j1 = std::min(j0 + B, l.size);
+        block.resize(j1 - j0);
+        for (size_t j = j0; j < j1; j++) {
+            block[j - j0] = j >= offset && j < offset + n ? ids[j - offset]
+                                                          : decode_id(l, j);
+        }
+        idx_t base = *std::min_element(block.begin(), block.end());
+        uint64_t maxdiff = 0;
+        for (idx_t id : block) {
+            maxdiff = std::max(maxdiff, uint64_t(id) - uint64_t(base));
+        }
+        int nbits = nbits_for(maxdiff);
+        if (nbits > l.nbits) {
+            repack(l, nbits);
+        }
+        l.bases[b] = base;
+        for (size_t j = j0; j < j1; j++) {
+            set_bits(
+                    l.packed.data(),
+                    j * l.nbits,
+                    l.nbits,
+                    uint64_t(block[j - j0]) - uint64_t(base));
+        }
+    }
+}
+
+} // namespace
+
+/*******************************************************
+ * CompressedIdsInvertedLists
+ *******************************************************/
+
+CompressedIdsInvertedLists::CompressedIdsInvertedLists(
+        size_t nlist,
+        size_t code_size)
+        : InvertedLists(nlist, code_size), lists(nlist) {}
+
+CompressedIdsInvertedLists::CompressedIdsInvertedLists(const InvertedLists& il)
+        : InvertedLists(il.nlist, il.code_size), lists(il.nlist) {
+    FAISS_THROW_IF_NOT(code_size != INVALID_CODE_SIZE);
+    for (size_t i = 0; i < nlist; i++) {
+        size_t ls = il.list_size(i);
+        if (ls > 0) {
+            add_entries(
+                    i,
+                    ls,
+                    ScopedIds(&il, i).get(),
+                    ScopedCodes(&il, i).get());
+        }
+    }
+}
+
+size_t CompressedIdsInvertedLists::list_size(size_t list_no) const {
+    assert(list_no < nlist);
+    return lists[list_no].size;
+}
+
+const uint8_t* CompressedIdsInvertedLists::get_codes(size_t list_no) const {
+    assert(list_no < nlist);
+    return lists[list_no].codes.data();
+}
+
+const idx_t* CompressedIdsInvertedLists::get_ids(size_t list_no) const {
+    assert(list_no < nlist);
+    const List& l = lists[list_no];
+    if (l.size == 0) {
+        return nullptr;
+    }
+    idx_t* ids = new idx_t[l.size];
+    decode_ids(l, 0, l.size, ids);
+    return ids;
+}
+
+void CompressedIdsInvertedLists::release_ids(size_t, const idx_t* ids) const {
+    delete[] ids;
+}
+
+idx_t CompressedIdsInvertedLists::get_single_id(size_t list_no, size_t offset)
+        const {
+    assert(list_no < nlist);
+    assert(offset < lists[list_no].size);
+    return decode_id(lists[list_no], offset);
+}
+
+size_t CompressedIdsInvertedLists::add_entries(
+        size_t list_no,
+        size_t n_entry,
+        const idx_t* ids_in,
+        const uint8_t* code) {
+    if (n_entry == 0) {
+        return 0;
+    }
+    assert(list_no < nlist);
+    List& l = lists[list_no];
+    size_t o = l.size;
+    l.size += n_entry;
+    l.codes.resize(l.size * code_size);
+    memcpy(&l.codes[o * code_size], code, code_size * n_entry);
+    l.bases.resize((l.size + B - 1) / B);
+    l.packed.resize(nwords(l.size, l.nbits));
+    set_ids(l, o, n_entry, ids_in);
+    return o;
+}
+
+void CompressedIdsInvertedLists::update_entries(
+        size_t list_no,
+        size_t offset,
+        size_t n_entry,
+        const idx_t* ids_in,
+        const uint8_t* codes_in) {
+    assert(list_no < nlist);
+    List& l = lists[list_no];
+    assert(n_entry + offset <= l.size);
+    memcpy(&l.codes[offset * code_size], codes_in, code_size * n_entry);
+    set_ids(l, offset, n_entry, ids_in);
+}
+
+void CompressedIdsInvertedLists::resize(size_t list_no, size_t new_size) {
+    List& l = lists[list_no];
+    size_t o = l.size;
+    l.size = new_size;
+    l.codes.resize(new_size * code_size);
+    l.bases.resize((new_size + B - 1) / B);
+    l.packed.resize(nwords(new_size, l.nbits));
+    if (new_size == 0) {
+        l.nbits = 0;
+    } else if (new_size > o) {
+        // the new entries get id 0
+        std::vector<idx_t> zeros(new_size - o);
+        set_ids(l, o, new_size - o, zeros.data());
+    }
+}
+
+size_t CompressedIdsInvertedLists::ids_nbytes() const {
+    size_t nbytes = 0;
+    for (const List& l : lists) {
+        nbytes += l.bases.size() * sizeof(idx_t) +
+                l.packed.size() * sizeof(uint64_t);
+    }
+    return nbytes;
+}
+
+CompressedIdsInvertedLists::~CompressedIdsInvertedLists() {}
+
+/**************************************************
+ * IO hook implementation
+ **************************************************/
+
+CompressedIdsInvertedListsIOHook::CompressedIdsInvertedListsIOHook()
+        : InvertedListsIOHook(
+                  "ilci",
+                  typeid(CompressedIdsInvertedLists).name()) {}
+
+void CompressedIdsInvertedListsIOHook::write(
+        const InvertedLists* ils_in,
+        IOWriter* f) const {
+    uint32_t h = fourcc("ilci");
+    WRITE1(h);
+    const CompressedIdsInvertedLists* il =
+            dynamic_cast<const CompressedIdsInvertedLists*>(ils_in);
+    WRITE1(il->nlist);
+    WRITE1(il->code_size);
+    for (size_t i = 0; i < il->nlist; i++) {
+        const CompressedIdsInvertedLists::List& l = il->lists[i];
+        WRITE1(l.size);
+        WRITE1(l.nbits);
+        WRITEVECTOR(l.codes);
+        WRITEVECTOR(l.bases);
+        WRITEVECTOR(l.packed);
+    }
+}
+
+InvertedLists* CompressedIdsInvertedListsIOHook::read(
+        IOReader* f,
+        int /* io_flags */) const {
+    size_t nlist, code_size;
+    READ1(nlist);
+    READ1(code_size);
+    std::unique_ptr<CompressedIdsInvertedLists> il(
+            new CompressedIdsInvertedLists(nlist, code_size));
+    for (size_t i = 0; i < il->nlist; i++) {
+        CompressedIdsInvertedLists::List& l = il->lists[i];
+        READ1(l.size);
+        READ1(l.nbits);
+        READVECTOR(l.codes);
+        READVECTOR(l.bases);
+        READVECTOR(l.packed);
+        FAISS_THROW_IF_NOT(l.nbits >= 0 && l.nbits <= 64);
+        FAISS_THROW_IF_NOT(l.codes.size() == l.size * code_size);
+        FAISS_THROW_IF_NOT(l.bases.size() == (l.size + B - 1) / B);
+        FAISS_THROW_IF_NOT(l.packed.size() == nwords(l.size, l.nbits));
+    }
+    return il.release();
+}
+
+} // namespace faiss
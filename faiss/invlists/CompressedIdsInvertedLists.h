@@ -0,0 +1,91 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <faiss/invlists/InvertedLists.h>
+#include <faiss/invlists/InvertedListsIOHook.h>
+
+namespace faiss {
+
+/** Inverted lists where the ids are stored compressed, the codes are stored
+ * as in ArrayInvertedLists.
+ *
+ * The ids of a list are cut in blocks of ids_per_block entries. A block
+ * stores its smallest id and the differences of the ids to it, on a number
+ * of bits that is common to all the blocks of the list (frame-of-reference
+ * coding). When the ids are added in increasing order, which is the case
+ * for the sequential ids of IndexIVF::add, an id takes about
+ * log2(ids_per_block * ntotal / list_size) bits instead of 64. The
+ * entries keep their insertion order, so that the offsets stored in a
+ * DirectMap remain valid.
+ *
+ * get_single_id decodes an id in constant time, get_ids decodes the whole
+ * list to a temporary buffer that is freed by release_ids.
+ * IndexIVF::search_preassigned scans these lists without the ids and
+ * decodes only the ids of the final results.
+ */
+struct CompressedIdsInvertedLists : InvertedLists {
+    static const size_t ids_per_block = 32;
+
+    struct List {
+        size_t size = 0;
+        int nbits = 0; ///< nb of bits per id
+        std::vector<uint8_t> codes;
+        std::vector<idx_t> bases;     ///< smallest id of each block
+        std::vector<uint64_t> packed; ///< id - base of the block
+    };
+
+    std::vector<List> lists;
+
+    CompressedIdsInvertedLists(size_t nlist, size_t code_size);
+
+    /// copy of the entries of another inverted lists
+    explicit CompressedIdsInvertedLists(const InvertedLists& il);
+
+    size_t list_size(size_t list_no) const override;
+    const uint8_t* get_codes(size_t list_no) const override;
+
+    /// decodes the ids of the list, that must be released with release_ids
+    const idx_t* get_ids(size_t list_no) const override;
+    void release_ids(size_t list_no, const idx_t* ids) const override;
+
+    idx_t get_single_id(size_t list_no, size_t offset) const override;
+
+    size_t add_entries(
+            size_t list_no,
+            size_t n_entry,
+            const idx_t* ids,
+            const uint8_t* code) override;
+
+    void update_entries(
+            size_t list_no,
+            size_t offset,
+            size_t n_entry,
+            const idx_t* ids,
+            const uint8_t* code) override;
+
+    void resize(size_t list_no, size_t new_size) override;
+
+    /// nb of bytes used to store the ids
+    size_t ids_nbytes() const;
+
+    ~CompressedIdsInvertedLists() override;
+};
+
+struct CompressedIdsInvertedListsIOHook : InvertedListsIOHook {
+    CompressedIdsInvertedListsIOHook();
+    void write(const InvertedLists* ils, IOWriter* f) const override;
+    InvertedLists* read(IOReader* f, int io_flags) const override;
+};
+
+} // namespace faiss
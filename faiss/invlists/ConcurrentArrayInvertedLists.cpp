@@ -0,0 +1,231 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/invlists/ConcurrentArrayInvertedLists.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/impl/io.h>
+#include <faiss/impl/io_macros.h>
+
+namespace faiss {
+
+namespace {
+
+typedef ConcurrentArrayInvertedLists::List List;
+typedef ConcurrentArrayInvertedLists::Segment Segment;
+
+/// make room for needed entries in the list, the list mutex must be held
+void grow(List& l, size_t needed, size_t min_capacity, size_t code_size) {
+    Segment* seg = l.live.get();
+    size_t capacity = seg ? seg->capacity : 0;
+    if (needed <= capacity) {
+        return;
+    }
+    capacity = std::max(std::max(min_capacity, 2 * capacity), needed);
+    std::unique_ptr<Segment> new_seg(new Segment(capacity, code_size));
+    size_t size = l.size.load(std::memory_order_relaxed);
+    if (size > 0) {
+        memcpy(new_seg->codes.data(), seg->codes.data(), size * code_size);
+        memcpy(new_seg->ids.data(), seg->ids.data(), size * sizeof(idx_t));
+    }
+    // the readers may still be using the former segment
+    l.segment.store(new_seg.get(), std::memory_order_release);
+    if (seg) {
+        l.retired.push_back(std::move(l.live));
+    }
+    l.live = std::move(new_seg);
+}
+
+} // namespace
+
+/*******************************************************
+ * ConcurrentArrayInvertedLists
+ *******************************************************/
+
+ConcurrentArrayInvertedLists::Segment::Segment(
+        size_t capacity,
+        size_t code_size)
+        : capacity(capacity), codes(capacity * code_size), ids(capacity) {}
+
+ConcurrentArrayInvertedLists::List::List() : segment(nullptr), size(0) {}
+
+ConcurrentArrayInvertedLists::ConcurrentArrayInvertedLists(
+        size_t nlist,
+        size_t code_size)
+        : InvertedLists(nlist, code_size), lists(new List[nlist]) {
+    FAISS_THROW_IF_NOT(code_size != INVALID_CODE_SIZE);
+}
+
+ConcurrentArrayInvertedLists::ConcurrentArrayInvertedLists(
+        const InvertedLists& il)
+        : ConcurrentArrayInvertedLists(il.nlist, il.code_size) {
+    for (size_t i = 0; i < nlist; i++) {
+        size_t ls = il.list_size(i);
+        if (ls > 0) {
+            add_entries(
+                    i,
+                    ls,
+                    ScopedIds(&il, i).get(),
+                    ScopedCodes(&il, i).get());
+        }
+    }
+}
+
+size_t ConcurrentArrayInvertedLists::list_size(size_t list_no) const {
+    assert(list_no < nlist);
+    return lists[list_no].size.load(std::memory_order_acquire);
+}
+
+const uint8_t* ConcurrentArrayInvertedLists::get_codes(size_t list_no) const {
+    assert(list_no < nlist);
+    // the segment is at least as recent as the size read before
+    Segment* seg = lists[list_no].segment.load(std::memory_order_acquire);
+    return seg ? seg->codes.data() : nullptr;
+}
+
+const idx_t* ConcurrentArrayInvertedLists::get_ids(size_t list_no) const {
+    assert(list_no < nlist);
+    Segment* seg = lists[list_no].segment.load(std::memory_order_acquire);
+    return seg ? seg->ids.data() : nullptr;
+}
+
+size_t ConcurrentArrayInvertedLists::add_entries(
+        size_t list_no,
+        size_t n_entry,
+        const idx_t* ids_in,
+        const uint8_t* code) {
+    if (n_entry == 0) {
+        return 0;
+    }
+    assert(list_no < nlist);
+    List& l = lists[list_no];
+    std::lock_guard<std::mutex> lock(l.mutex);
+    size_t o = l.size.load(std::memory_order_relaxed);
+    grow(l, o + n_entry, min_capacity, code_size);
+    Segment* seg = l.live.get();
+    memcpy(&seg->ids[o], ids_in, sizeof(ids_in[0]) * n_entry);
+    memcpy(&seg->codes[o * code_size], code, code_size * n_entry);
+    // publish the new entries
+    l.size.store(o + n_entry, std::memory_order_release);
+    return o;
+}
+
+void ConcurrentArrayInvertedLists::update_entries(
+        size_t list_no,
+        size_t offset,
+        size_t n_entry,
+        const idx_t* ids_in,
+        const uint8_t* codes_in) {
+    assert(list_no < nlist);
+    List& l = lists[list_no];
+    std::lock_guard<std::mutex> lock(l.mutex);
+    assert(n_entry + offset <= l.size.load(std::memory_order_relaxed));
+    Segment* seg = l.live.get();
+    memcpy(&seg->ids[offset], ids_in, sizeof(ids_in[0]) * n_entry);
+    memcpy(&seg->codes[offset * code_size], codes_in, code_size * n_entry);
+}
+
+void ConcurrentArrayInvertedLists::resize(size_t list_no, size_t new_size) {
+    assert(list_no < nlist);
+    List& l = lists[list_no];
+    std::lock_guard<std::mutex> lock(l.mutex);
+    size_t o = l.size.load(std::memory_order_relaxed);
+    if (new_size > o) {
+        // the new entries are zeroed, as with ArrayInvertedLists
+        grow(l, new_size, min_capacity, code_size);
+        Segment* seg = l.live.get();
+        memset(&seg->ids[o], 0, sizeof(idx_t) * (new_size - o));
+        memset(&seg->codes[o * code_size], 0, code_size * (new_size - o));
+    }
+    l.size.store(new_size, std::memory_order_release);
+}
+
+size_t ConcurrentArrayInvertedLists::retired_nbytes() const {
+    size_t nbytes = 0;
+    for (size_t i = 0; i < nlist; i++) {
+        std::lock_guard<std::mutex> lock(lists[i].mutex);
+        for (const auto& seg : lists[i].retired) {
+            nbytes += seg->capacity * (code_size + sizeof(idx_t));
+        }
+    }
+    return nbytes;
+}
+
+size_t ConcurrentArrayInvertedLists::reclaim_memory() {
+    size_t nbytes = 0;
+    for (size_t i = 0; i < nlist; i++) {
+        std::lock_guard<std::mutex> lock(lists[i].mutex);
+        for (const auto& seg : lists[i].retired) {
+            nbytes += seg->capacity * (code_size + sizeof(idx_t));
+        }
+        lists[i].retired.clear();
+    }
+    return nbytes;
+}
+
+ConcurrentArrayInvertedLists::~ConcurrentArrayInvertedLists() {}
+
+/**************************************************
+ * IO hook implementation
+ **************************************************/
+
+ConcurrentArrayInvertedListsIOHook::ConcurrentArrayInvertedListsIOHook()
+        : InvertedListsIOHook(
+                  "ilcc",
+                  typeid(ConcurrentArrayInvertedLists).name()) {}
+
+void ConcurrentArrayInvertedListsIOHook::write(
+        const InvertedLists* ils_in,
+        IOWriter* f) const {
+    uint32_t h = fourcc("ilcc");
+    WRITE1(h);
+    const ConcurrentArrayInvertedLists* il =
+            dynamic_cast<const ConcurrentArrayInvertedLists*>(ils_in);
+    WRITE1(il->nlist);
+    WRITE1(il->code_size);
+    for (size_t i = 0; i < il->nlist; i++) {
+        // the size is read first, the entries up to it are stable
+        size_t size = il->list_size(i);
+        WRITE1(size);
+        if (size > 0) {
+            WRITEANDCHECK(il->get_codes(i), size * il->code_size);
+            WRITEANDCHECK(il->get_ids(i), size);
+        }
+    }
+}
+
+InvertedLists* ConcurrentArrayInvertedListsIOHook::read(
+        IOReader* f,
+        int /* io_flags */) const {
+    size_t nlist, code_size;
+    READ1(nlist);
+    READ1(code_size);
+    std::unique_ptr<ConcurrentArrayInvertedLists> il(
+            new ConcurrentArrayInvertedLists(nlist, code_size));
+    std::vector<uint8_t> codes;
+    std::vector<idx_t> ids;
+    for (size_t i = 0; i < il->nlist; i++) {
+        size_t size;
+        READ1(size);
+        if (size > 0) {
+            codes.resize(size * code_size);
+            ids.resize(size);
+            READANDCHECK(codes.data(), size * code_size);
+            READANDCHECK(ids.data(), size);
+            il->add_entries(i, size, ids.data(), codes.data());
+        }
+    }
+    return il.release();
+}
+
+} // namespace faiss
@@ -0,0 +1,114 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <faiss/invlists/InvertedLists.h>
+#include <faiss/invlists/InvertedListsIOHook.h>
+
+namespace faiss {
+
+/** Inverted lists in RAM that can be searched while entries are appended.
+ *
+ * ArrayInvertedLists stores each list in a std::vector, so an add_entries
+ * may reallocate the list while a search is scanning it. Here the entries of
+ * a list are stored in a segment of fixed capacity that is never written
+ * below the published size. When a segment is full, the entries are copied
+ * to a new segment with twice the capacity and the former one is retired
+ * but kept in memory, so that the pointers returned to the readers remain
+ * valid. The list size is published atomically after the entries are
+ * written, so a reader that calls list_size and then get_codes / get_ids
+ * sees a consistent prefix of the list.
+ *
+ * Concurrency rules:
+ * - the read functions are lock-free and can be called by any number of
+ *   threads, concurrently with add_entries
+ * - the writers of a list are serialized by a per-list mutex
+ * - update_entries and resize are not safe with concurrent searches on the
+ *   same list, since they modify entries that may be visible to a reader
+ *
+ * IndexIVF::add can thus run in one thread while other threads call
+ * IndexIVF::search, provided the index has no direct map. The retired
+ * segments take at most as much memory as the live ones; they are freed by
+ * reclaim_memory when no search is running.
+ */
+struct ConcurrentArrayInvertedLists : InvertedLists {
+    struct Segment {
+        size_t capacity;
+        std::vector<uint8_t> codes;
+        std::vector<idx_t> ids;
+
+        Segment(size_t capacity, size_t code_size);
+    };
+
+    struct List {
+        std::atomic<Segment*> segment;
+        std::atomic<size_t> size;
+
+        // serializes the writers, protects the ownership of the segments
+        std::mutex mutex;
+        std::unique_ptr<Segment> live;
+        std::vector<std::unique_ptr<Segment>> retired;
+
+        List();
+    };
+
+    std::unique_ptr<List[]> lists;
+
+    /// capacity of the first segment of a list
+    size_t min_capacity = 16;
+
+    ConcurrentArrayInvertedLists(size_t nlist, size_t code_size);
+
+    /// copy of the entries of another inverted lists
+    explicit ConcurrentArrayInvertedLists(const InvertedLists& il);
+
+    size_t list_size(size_t list_no) const override;
+    const uint8_t* get_codes(size_t list_no) const override;
+    const idx_t* get_ids(size_t list_no) const override;
+
+    size_t add_entries(
+            size_t list_no,
+            size_t n_entry,
+            const idx_t* ids,
+            const uint8_t* code) override;
+
+    void update_entries(
+            size_t list_no,
+            size_t offset,
+            size_t n_entry,
+            const idx_t* ids,
+            const uint8_t* code) override;
+
+    void resize(size_t list_no, size_t new_size) override;
+
+    /// nb of bytes of the retired segments
+    size_t retired_nbytes() const;
+
+    /** free the retired segments. Should not be called while a search is
+     * running.
+     * @return nb of bytes freed
+     */
+    size_t reclaim_memory();
+
+    ~ConcurrentArrayInvertedLists() override;
+};
+
+struct ConcurrentArrayInvertedListsIOHook : InvertedListsIOHook {
+    ConcurrentArrayInvertedListsIOHook();
+    void write(const InvertedLists* ils, IOWriter* f) const override;
+    InvertedLists* read(IOReader* f, int io_flags) const override;
+};
+
+} // namespace faiss
@@ -101,6 +101,15 @@ void DirectMap::add_single_id(idx_t id, idx_t list_no, size_t offset) {
     }
 }
 
+void DirectMap::update_single_id(idx_t id, idx_t list_no, size_t offset) {
+    if (type == Array) {
+        FAISS_THROW_IF_NOT(id >= 0 && id < (idx_t)array.size());
+        array[id] = lo_build(list_no, offset);
+    } else if (type == Hashtable) {
+        hashtable[id] = lo_build(list_no, offset);
+    }
+}
+
 void DirectMap::check_can_add(const idx_t* ids) {
     if (type == Array && ids) {
         FAISS_THROW_MSG("cannot have array direct map and add with ids");
@@ -154,9 +163,9 @@ size_t DirectMap::remove_ids(const IDSelector& sel, InvertedLists* invlists) {
 #pragma omp parallel for
         for (idx_t i = 0; i < nlist; i++) {
             idx_t l0 = invlists->list_size(i), l = l0, j = 0;
-            ScopedIds idsi(invlists, i);
             while (j < l) {
-                if (sel.is_member(idsi[j])) {
+                // get_ids may return a copy that is not updated in place
+                if (sel.is_member(invlists->get_single_id(i, j))) {
                     l--;
                     invlists->update_entry(
                             i,
@@ -70,6 +70,9 @@ struct DirectMap {
     /// non thread-safe version
     void add_single_id(idx_t id, idx_t list_no, size_t offset);
 
+    /// non thread-safe, change the location of an id that is in the map
+    void update_single_id(idx_t id, idx_t list_no, size_t offset);
+
     /// remove all entries
     void clear();
 
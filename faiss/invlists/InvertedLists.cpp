@@ -39,6 +39,10 @@ void InvertedLists::release_ids(size_t, const idx_t*) const {}
 
 void InvertedLists::prefetch_lists(const idx_t*, int) const {}
 
+void InvertedLists::begin_add_batch() {}
+
+void InvertedLists::end_add_batch() {}
+
 const uint8_t* InvertedLists::get_single_code(size_t list_no, size_t offset)
         const {
     assert(offset < list_size(list_no));
@@ -105,6 +105,12 @@ struct InvertedLists {
 
     virtual void reset();
 
+    /** the entries added between begin_add_batch and end_add_batch belong
+     * to a single batch, that the implementations may persist at once
+     * (default does nothing). Calls may be nested. */
+    virtual void begin_add_batch();
+    virtual void end_add_batch();
+
     /*************************
      * high level functions     */
 
@@ -12,6 +12,8 @@
 #include <faiss/impl/io_macros.h>
 
 #include <faiss/invlists/BlockInvertedLists.h>
+#include <faiss/invlists/CompressedIdsInvertedLists.h>
+#include <faiss/invlists/ConcurrentArrayInvertedLists.h>
 
 #ifndef _MSC_VER
 #include <faiss/invlists/OnDiskInvertedLists.h>
@@ -35,8 +37,12 @@ struct IOHookTable : std::vector<InvertedListsIOHook*> {
     IOHookTable() {
 #ifndef _MSC_VER
         push_back(new OnDiskInvertedListsIOHook());
+        push_back(new OnDiskInvertedListsIOHook(
+                typeid(AsyncOnDiskInvertedLists).name()));
 #endif
         push_back(new BlockInvertedListsIOHook());
+        push_back(new CompressedIdsInvertedListsIOHook());
+        push_back(new ConcurrentArrayInvertedListsIOHook());
     }
 
     ~IOHookTable() {
@@ -9,8 +9,18 @@
 
 #include <faiss/invlists/OnDiskInvertedLists.h>
 
+#include <fcntl.h>
 #include <pthread.h>
 
+#include <atomic>
+#include <cstddef>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 
 #include <sys/mman.h>
@@ -260,6 +270,539 @@ void OnDiskInvertedLists::prefetch_lists(const idx_t* list_nos, int n) const {
     pf->prefetch_lists(list_nos, n);
 }
 
+/**********************************************
+ * Journal
+ **********************************************/
+
+namespace {
+
+enum JournalOp : uint32_t {
+    JOURNAL_ADD = 1,
+    JOURNAL_UPDATE = 2,
+    JOURNAL_RESIZE = 3,
+};
+
+/// header of a log record, followed by the ids and codes for ADD / UPDATE
+struct JournalRecord {
+    uint32_t magic;
+    uint32_t op;
+    uint64_t seq;
+    uint64_t list_no;
+    uint64_t arg; // offset for UPDATE, new size for RESIZE
+    uint64_t n_entry;
+    uint64_t header_checksum; // FNV-1a of the fields above
+    uint64_t checksum; // FNV-1a of the header (with checksum = 0) + payload
+};
+
+/// start of the log file and end of the data file
+struct JournalFileHeader {
+    uint32_t magic;
+    uint32_t unused;
+    uint64_t generation;
+};
+
+uint64_t fnv1a(const void* data, size_t n, uint64_t h) {
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < n; i++) {
+        h = (h ^ p[i]) * 1099511628211ULL;
+    }
+    return h;
+}
+
+uint64_t header_checksum(const JournalRecord& rec) {
+    return fnv1a(
+            &rec,
+            offsetof(JournalRecord, header_checksum),
+            14695981039346656037ULL);
+}
+
+uint64_t record_checksum(
+        JournalRecord rec,
+        const idx_t* ids,
+        const uint8_t* codes,
+        size_t code_size) {
+    rec.checksum = 0;
+    uint64_t h = fnv1a(&rec, sizeof(rec), 14695981039346656037ULL);
+    h = fnv1a(ids, rec.n_entry * sizeof(idx_t), h);
+    return fnv1a(codes, rec.n_entry * code_size, h);
+}
+
+bool file_exists(const std::string& fname) {
+    return access(fname.c_str(), F_OK) == 0;
+}
+
+uint64_t new_generation() {
+    std::random_device rd;
+    uint64_t g = 0;
+    while (g == 0) {
+        g = (uint64_t(rd()) << 32) ^ rd() ^ uint64_t(getmillisecs() * 1000);
+    }
+    return g;
+}
+
+/** the generation of the data file is stored after its totsize bytes. It
+ * is 0 if the file does not exist or was written without a generation.
+ * file_size is the size of the data without the trailer. */
+uint64_t read_data_generation(const std::string& fname, size_t* file_size) {
+    *file_size = 0;
+    int fd = open(fname.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat buf;
+    JournalFileHeader trailer;
+    uint64_t generation = 0;
+    if (fstat(fd, &buf) == 0) {
+        *file_size = buf.st_size;
+        if (buf.st_size >= sizeof(trailer) &&
+            pread(fd,
+                  &trailer,
+                  sizeof(trailer),
+                  buf.st_size - sizeof(trailer)) == sizeof(trailer) &&
+            trailer.magic == fourcc("ilgn")) {
+            generation = trailer.generation;
+            *file_size -= sizeof(trailer);
+        }
+    }
+    close(fd);
+    return generation;
+}
+
+void write_data_generation(
+        const std::string& fname,
+        size_t totsize,
+        uint64_t generation) {
+    JournalFileHeader trailer = {fourcc("ilgn"), 0, generation};
+    int fd = open(fname.c_str(), O_WRONLY);
+    bool ok = fd >= 0 &&
+            pwrite(fd, &trailer, sizeof(trailer), totsize) == sizeof(trailer);
+    if (fd >= 0) {
+        close(fd);
+    }
+    FAISS_THROW_IF_NOT_FMT(
+            ok, "could not write %s: %s", fname.c_str(), strerror(errno));
+}
+
+} // namespace
+
+struct OnDiskInvertedLists::Journal {
+    // serializes the journaled updates, so that the log order is the order
+    // in which they are applied
+    std::mutex mutex;
+    FILE* f = nullptr;
+    uint64_t seq = 0;    // seq of the last record
+    size_t nrecord = 0;  // nb of records since the last checkpoint
+    bool replaying = false;
+    int batch_depth = 0; // > 0 while in a batch of updates
+    std::vector<Slot> pending_free; // slots to free at the next checkpoint
+
+    void log(
+            uint32_t op,
+            size_t list_no,
+            size_t arg,
+            size_t n_entry,
+            const idx_t* ids,
+            const uint8_t* codes,
+            size_t code_size,
+            bool sync) {
+        JournalRecord rec;
+        rec.magic = fourcc("ilwr");
+        rec.op = op;
+        rec.seq = seq + 1;
+        rec.list_no = list_no;
+        rec.arg = arg;
+        rec.n_entry = op == JOURNAL_RESIZE ? 0 : n_entry;
+        rec.header_checksum = header_checksum(rec);
+        rec.checksum = record_checksum(rec, ids, codes, code_size);
+        bool ok = fwrite(&rec, sizeof(rec), 1, f) == 1;
+        if (rec.n_entry > 0) {
+            ok = ok && fwrite(ids, sizeof(idx_t), n_entry, f) == n_entry &&
+                    fwrite(codes, code_size, n_entry, f) == n_entry;
+        }
+        FAISS_THROW_IF_NOT_FMT(
+                ok, "could not write journal: %s", strerror(errno));
+        seq++;
+        nrecord++;
+        if (batch_depth == 0) {
+            flush(sync);
+        }
+    }
+
+    /// write the buffered records to the log file
+    void flush(bool sync) {
+        bool ok = fflush(f) == 0;
+        if (ok && sync) {
+            ok = fsync(fileno(f)) == 0;
+        }
+        FAISS_THROW_IF_NOT_FMT(
+                ok, "could not write journal: %s", strerror(errno));
+    }
+
+    /// start an empty log
+    void write_header(uint64_t generation) {
+        JournalFileHeader header = {fourcc("ilwh"), 0, generation};
+        FAISS_THROW_IF_NOT_FMT(
+                fwrite(&header, sizeof(header), 1, f) == 1,
+                "could not write journal: %s",
+                strerror(errno));
+        flush(true);
+    }
+
+    ~Journal() {
+        if (f) {
+            fclose(f);
+        }
+    }
+};
+
+namespace {
+
+/** read the list metadata from the checkpoint file. The checkpoint should
+ * be for the data file of the given generation and size (as returned by
+ * read_data_generation). */
+uint64_t read_checkpoint(
+        OnDiskInvertedLists* od,
+        uint64_t generation,
+        size_t file_size) {
+    std::string fname = od->checkpoint_filename();
+    FileIOReader reader(fname.c_str());
+    IOReader* f = &reader;
+    uint32_t h;
+    READ1(h);
+    FAISS_THROW_IF_NOT_FMT(
+            h == fourcc("ilck"), "%s is not a checkpoint file", fname.c_str());
+    uint64_t seq, ckpt_generation;
+    size_t nlist, code_size, totsize;
+    READ1(seq);
+    READ1(ckpt_generation);
+    READ1(nlist);
+    READ1(code_size);
+    READ1(totsize);
+    FAISS_THROW_IF_NOT_FMT(
+            ckpt_generation == generation && totsize <= file_size,
+            "%s does not match the data file %s (it is stale if the data "
+            "file was rebuilt, and should be removed)",
+            fname.c_str(),
+            od->filename.c_str());
+    FAISS_THROW_IF_NOT_MSG(
+            nlist == od->nlist && code_size == od->code_size,
+            "checkpoint does not match the inverted lists");
+    std::vector<OnDiskInvertedLists::List> lists;
+    std::vector<OnDiskInvertedLists::Slot> slots;
+    READVECTOR(lists);
+    READVECTOR(slots);
+    FAISS_THROW_IF_NOT(lists.size() == nlist);
+    od->lists = lists;
+    od->slots.assign(slots.begin(), slots.end());
+    if (od->ptr && totsize != od->totsize) {
+        munmap(od->ptr, od->totsize);
+        od->ptr = nullptr;
+    }
+    od->totsize = totsize;
+    return seq;
+}
+
+/** calls fn(rec, ids, codes) for the records of the log that are more
+ * recent than seq, up to the first incomplete or corrupted one. The log
+ * should be for the data file of the given generation. */
+template <class Fn>
+void read_journal(
+        const OnDiskInvertedLists* od,
+        uint64_t generation,
+        uint64_t seq,
+        Fn fn) {
+    std::string walname = od->journal_filename();
+    FILE* wf = fopen(walname.c_str(), "rb");
+    if (!wf) {
+        return;
+    }
+    std::unique_ptr<FILE, int (*)(FILE*)> del(wf, fclose);
+    struct stat buf;
+    FAISS_THROW_IF_NOT_FMT(
+            fstat(fileno(wf), &buf) == 0,
+            "could not stat %s: %s",
+            walname.c_str(),
+            strerror(errno));
+    JournalFileHeader header;
+    if (fread(&header, sizeof(header), 1, wf) != 1) {
+        return; // empty log
+    }
+    FAISS_THROW_IF_NOT_FMT(
+            header.magic == fourcc("ilwh") && header.generation == generation,
+            "%s does not match the data file %s (it is stale if the data "
+            "file was rebuilt, and should be removed)",
+            walname.c_str(),
+            od->filename.c_str());
+
+    size_t code_size = od->code_size;
+    size_t remaining = buf.st_size - sizeof(header);
+    JournalRecord rec;
+    std::vector<idx_t> ids;
+    std::vector<uint8_t> codes;
+    while (fread(&rec, sizeof(rec), 1, wf) == 1) {
+        remaining -= sizeof(rec);
+        // check the header before allocating the payload
+        if (rec.magic != fourcc("ilwr") ||
+            rec.header_checksum != header_checksum(rec) ||
+            rec.list_no >= od->nlist || rec.op < JOURNAL_ADD ||
+            rec.op > JOURNAL_RESIZE ||
+            (rec.op == JOURNAL_RESIZE && rec.n_entry != 0) ||
+            rec.n_entry > remaining / (sizeof(idx_t) + code_size)) {
+            break;
+        }
+        ids.resize(rec.n_entry);
+        codes.resize(rec.n_entry * code_size);
+        if (rec.n_entry > 0 &&
+            (fread(ids.data(), sizeof(idx_t), rec.n_entry, wf) !=
+                     rec.n_entry ||
+             fread(codes.data(), code_size, rec.n_entry, wf) != rec.n_entry)) {
+            break;
+        }
+        remaining -= rec.n_entry * (sizeof(idx_t) + code_size);
+        if (record_checksum(rec, ids.data(), codes.data(), code_size) !=
+            rec.checksum) {
+            break;
+        }
+        if (rec.seq > seq) {
+            fn(rec, ids, codes);
+        }
+    }
+}
+
+/// should hold the journal mutex
+void do_checkpoint(OnDiskInvertedLists* od) {
+    OnDiskInvertedLists::Journal* j = od->journal;
+    j->flush(false);
+    for (const OnDiskInvertedLists::Slot& slot : j->pending_free) {
+        od->free_slot(slot.offset, slot.capacity);
+    }
+    j->pending_free.clear();
+
+    // the data must be on disk before the metadata that refers to it
+    if (od->ptr && od->totsize > 0) {
+        int err = msync(od->ptr, od->totsize, MS_SYNC);
+        FAISS_THROW_IF_NOT_FMT(err == 0, "msync error: %s", strerror(errno));
+    }
+
+    // write to a temporary file and rename it, so that there is always a
+    // complete checkpoint
+    std::string fname = od->checkpoint_filename();
+    std::string tmpname = fname + ".tmp";
+    {
+        FileIOWriter writer(tmpname.c_str());
+        IOWriter* f = &writer;
+        uint32_t h = fourcc("ilck");
+        WRITE1(h);
+        WRITE1(j->seq);
+        WRITE1(od->generation);
+        WRITE1(od->nlist);
+        WRITE1(od->code_size);
+        WRITE1(od->totsize);
+        WRITEVECTOR(od->lists);
+        std::vector<OnDiskInvertedLists::Slot> slots(
+                od->slots.begin(), od->slots.end());
+        WRITEVECTOR(slots);
+        bool ok = fflush(writer.f) == 0 && fsync(fileno(writer.f)) == 0;
+        FAISS_THROW_IF_NOT_FMT(
+                ok, "could not write %s: %s", tmpname.c_str(), strerror(errno));
+    }
+    int err = rename(tmpname.c_str(), fname.c_str());
+    FAISS_THROW_IF_NOT_FMT(
+            err == 0,
+            "could not rename %s: %s",
+            fname.c_str(),
+            strerror(errno));
+
+    // the records are covered by the checkpoint (the ones that would
+    // survive a crash here are skipped at replay, based on their seq)
+    err = ftruncate(fileno(j->f), 0);
+    FAISS_THROW_IF_NOT_FMT(
+            err == 0, "could not truncate journal: %s", strerror(errno));
+    j->write_header(od->generation);
+    j->nrecord = 0;
+}
+
+/// logs an update before it is applied and checkpoints after it if needed
+struct JournalGuard {
+    OnDiskInvertedLists* od;
+    std::unique_lock<std::mutex> lock;
+
+    JournalGuard(
+            OnDiskInvertedLists* od,
+            uint32_t op,
+            size_t list_no,
+            size_t arg,
+            size_t n_entry,
+            const idx_t* ids,
+            const uint8_t* codes)
+            : od(od) {
+        OnDiskInvertedLists::Journal* j = od->journal;
+        if (!j) {
+            return;
+        }
+        lock = std::unique_lock<std::mutex>(j->mutex);
+        if (!j->replaying) {
+            j->log(op,
+                   list_no,
+                   arg,
+                   n_entry,
+                   ids,
+                   codes,
+                   od->code_size,
+                   od->journal_sync);
+        }
+    }
+
+    /// to be called once the update is applied
+    void done() {
+        OnDiskInvertedLists::Journal* j = od->journal;
+        if (j && !j->replaying && j->batch_depth == 0 &&
+            od->checkpoint_interval > 0 &&
+            j->nrecord >= od->checkpoint_interval) {
+            do_checkpoint(od);
+        }
+    }
+};
+
+} // namespace
+
+std::string OnDiskInvertedLists::journal_filename() const {
+    return filename + ".wal";
+}
+
+std::string OnDiskInvertedLists::checkpoint_filename() const {
+    return filename + ".ckpt";
+}
+
+void OnDiskInvertedLists::enable_journal() {
+    FAISS_THROW_IF_NOT_MSG(!read_only, "cannot journal read-only invlists");
+    FAISS_THROW_IF_NOT_MSG(!journal, "journal already enabled");
+    std::string walname = journal_filename();
+
+    size_t file_size;
+    uint64_t data_generation = read_data_generation(filename, &file_size);
+    uint64_t seq = 0;
+    if (file_exists(checkpoint_filename())) {
+        seq = read_checkpoint(this, data_generation, file_size);
+        if (!ptr && totsize > 0) {
+            do_mmap();
+        }
+    }
+    if (data_generation != 0) {
+        generation = data_generation;
+    } else {
+        // the data file does not exist yet or has no generation
+        if (generation == 0) {
+            generation = new_generation();
+        }
+        if (totsize > 0) {
+            write_data_generation(filename, totsize, generation);
+        }
+    }
+
+    journal = new Journal();
+    journal->seq = seq;
+
+    // replay the records that are more recent than the checkpoint
+    journal->replaying = true;
+    read_journal(
+            this,
+            generation,
+            seq,
+            [this](const JournalRecord& rec,
+                   const std::vector<idx_t>& ids,
+                   const std::vector<uint8_t>& codes) {
+                if (rec.op == JOURNAL_ADD) {
+                    add_entries(
+                            rec.list_no,
+                            rec.n_entry,
+                            ids.data(),
+                            codes.data());
+                } else if (rec.op == JOURNAL_UPDATE) {
+                    update_entries(
+                            rec.list_no,
+                            rec.arg,
+                            rec.n_entry,
+                            ids.data(),
+                            codes.data());
+                } else {
+                    resize(rec.list_no, rec.arg);
+                }
+                journal->seq = rec.seq;
+            });
+    journal->replaying = false;
+
+    journal->f = fopen(walname.c_str(), "ab");
+    FAISS_THROW_IF_NOT_FMT(
+            journal->f,
+            "could not open %s: %s",
+            walname.c_str(),
+            strerror(errno));
+
+    // persist the recovered state and start a new log
+    std::lock_guard<std::mutex> lock(journal->mutex);
+    do_checkpoint(this);
+}
+
+namespace {
+
+/// the read-only and asynchronous invlists cannot replay the log, they can
+/// only be opened if the log has no updates after the checkpoint
+void check_no_pending_journal(OnDiskInvertedLists* od) {
+    size_t file_size;
+    uint64_t generation = read_data_generation(od->filename, &file_size);
+    uint64_t seq = 0;
+    if (file_exists(od->checkpoint_filename())) {
+        seq = read_checkpoint(od, generation, file_size);
+    }
+    size_t npending = 0;
+    read_journal(
+            od,
+            generation,
+            seq,
+            [&npending](
+                    const JournalRecord&,
+                    const std::vector<idx_t>&,
+                    const std::vector<uint8_t>&) { npending++; });
+    FAISS_THROW_IF_NOT_FMT(
+            npending == 0,
+            "%s contains %zd updates that are not checkpointed: open the "
+            "index read-write to recover them first",
+            od->journal_filename().c_str(),
+            npending);
+}
+
+} // namespace
+
+void OnDiskInvertedLists::checkpoint() {
+    FAISS_THROW_IF_NOT_MSG(journal, "journal not enabled");
+    std::lock_guard<std::mutex> lock(journal->mutex);
+    do_checkpoint(this);
+}
+
+void OnDiskInvertedLists::begin_add_batch() {
+    if (!journal) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(journal->mutex);
+    journal->batch_depth++;
+}
+
+void OnDiskInvertedLists::end_add_batch() {
+    if (!journal) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(journal->mutex);
+    FAISS_THROW_IF_NOT(journal->batch_depth > 0);
+    if (--journal->batch_depth > 0) {
+        return;
+    }
+    journal->flush(journal_sync);
+    if (checkpoint_interval > 0 && journal->nrecord >= checkpoint_interval) {
+        do_checkpoint(this);
+    }
+}
+
 /**********************************************
  * OnDiskInvertedLists: mmapping
  **********************************************/
@@ -329,6 +872,9 @@ void OnDiskInvertedLists::update_totsize(size_t new_size) {
             filename.c_str(),
             totsize,
             strerror(errno));
+    if (generation != 0) {
+        write_data_generation(filename, totsize, generation);
+    }
     do_mmap();
 }
 
@@ -354,6 +900,7 @@ OnDiskInvertedLists::OnDiskInvertedLists(
           totsize(0),
           ptr(nullptr),
           read_only(false),
+          journal(nullptr),
           locks(new LockLevels()),
           pf(new OngoingPrefetch(this)),
           prefetch_nthread(32) {
@@ -366,6 +913,7 @@ OnDiskInvertedLists::OnDiskInvertedLists() : OnDiskInvertedLists(0, 0, "") {}
 
 OnDiskInvertedLists::~OnDiskInvertedLists() {
     delete pf;
+    delete journal;
 
     // unmap all lists
     if (ptr != nullptr) {
@@ -407,6 +955,18 @@ void OnDiskInvertedLists::update_entries(
     FAISS_THROW_IF_NOT(!read_only);
     if (n_entry == 0)
         return;
+    JournalGuard guard(
+            this, JOURNAL_UPDATE, list_no, offset, n_entry, ids_in, codes_in);
+    write_entries(list_no, offset, n_entry, ids_in, codes_in);
+    guard.done();
+}
+
+void OnDiskInvertedLists::write_entries(
+        size_t list_no,
+        size_t offset,
+        size_t n_entry,
+        const idx_t* ids_in,
+        const uint8_t* codes_in) {
     const List& l = lists[list_no];
     assert(n_entry + offset <= l.size);
     idx_t* ids = const_cast<idx_t*>(get_ids(list_no));
@@ -421,19 +981,26 @@ size_t OnDiskInvertedLists::add_entries(
         const idx_t* ids,
         const uint8_t* code) {
     FAISS_THROW_IF_NOT(!read_only);
+    JournalGuard guard(this, JOURNAL_ADD, list_no, 0, n_entry, ids, code);
     locks->lock_1(list_no);
     size_t o = list_size(list_no);
     resize_locked(list_no, n_entry + o);
-    update_entries(list_no, o, n_entry, ids, code);
+    if (n_entry > 0) {
+        write_entries(list_no, o, n_entry, ids, code);
+    }
     locks->unlock_1(list_no);
+    guard.done();
     return o;
 }
 
 void OnDiskInvertedLists::resize(size_t list_no, size_t new_size) {
     FAISS_THROW_IF_NOT(!read_only);
+    JournalGuard guard(
+            this, JOURNAL_RESIZE, list_no, new_size, 0, nullptr, nullptr);
     locks->lock_1(list_no);
     resize_locked(list_no, new_size);
     locks->unlock_1(list_no);
+    guard.done();
 }
 
 void OnDiskInvertedLists::resize_locked(size_t list_no, size_t new_size) {
@@ -444,10 +1011,9 @@ void OnDiskInvertedLists::resize_locked(size_t list_no, size_t new_size) {
         return;
     }
 
-    // otherwise we release the current slot, and find a new one
+    // otherwise we find a new slot, and release the current one
 
     locks->lock_2();
-    free_slot(l.offset, l.capacity);
 
     List new_l;
 
@@ -474,6 +1040,17 @@ void OnDiskInvertedLists::resize_locked(size_t list_no, size_t new_size) {
         }
     }
 
+    // free the slot after the copy, so that the new one cannot overlap it
+    size_t slot_size = l.capacity * (sizeof(idx_t) + code_size);
+    if (journal) {
+        // the checkpointed data may still be in this slot
+        if (slot_size > 0) {
+            journal->pending_free.emplace_back(l.offset, slot_size);
+        }
+    } else {
+        free_slot(l.offset, slot_size);
+    }
+
     lists[list_no] = new_l;
     locks->unlock_2();
 }
@@ -572,6 +1149,7 @@ size_t OnDiskInvertedLists::merge_from(
         bool verbose) {
     FAISS_THROW_IF_NOT_MSG(
             totsize == 0, "works only on an empty InvertedLists");
+    FAISS_THROW_IF_NOT_MSG(!journal, "merge_from is not journaled");
 
     std::vector<size_t> sizes(nlist);
     for (int i = 0; i < n_il; i++) {
@@ -641,6 +1219,219 @@ size_t OnDiskInvertedLists::merge_from_1(
     return merge_from(&ils, 1, verbose);
 }
 
+namespace {
+
+void pread_all(int fd, void* buf, size_t n, size_t offset) {
+    uint8_t* p = (uint8_t*)buf;
+    while (n > 0) {
+        ssize_t nr = pread(fd, p, n, offset);
+        FAISS_THROW_IF_NOT_FMT(
+                nr > 0,
+                "pread of %zd bytes at offset %zd failed: %s",
+                n,
+                offset,
+                nr == 0 ? "end of file" : strerror(errno));
+        p += nr;
+        n -= nr;
+        offset += nr;
+    }
+}
+
+void pwrite_all(int fd, const void* buf, size_t n, size_t offset) {
+    const uint8_t* p = (const uint8_t*)buf;
+    while (n > 0) {
+        ssize_t nw = pwrite(fd, p, n, offset);
+        FAISS_THROW_IF_NOT_FMT(
+                nw > 0,
+                "pwrite of %zd bytes at offset %zd failed: %s",
+                n,
+                offset,
+                strerror(errno));
+        p += nw;
+        n -= nw;
+        offset += nw;
+    }
+}
+
+/// closes the file descriptors when going out of scope
+struct FileDescriptors : std::vector<int> {
+    ~FileDescriptors() {
+        for (int fd : *this) {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+    }
+};
+
+} // namespace
+
+size_t OnDiskInvertedLists::merge_from_files(
+        const InvertedLists** ils_in,
+        int n_il,
+        size_t buffer_size,
+        bool verbose) {
+    FAISS_THROW_IF_NOT_MSG(
+            totsize == 0, "works only on an empty InvertedLists");
+    FAISS_THROW_IF_NOT_MSG(!journal, "merge_from is not journaled");
+    FAISS_THROW_IF_NOT(buffer_size > 0);
+
+    std::vector<const OnDiskInvertedLists*> ils(n_il);
+    FileDescriptors fds;
+    for (int i = 0; i < n_il; i++) {
+        ils[i] = dynamic_cast<const OnDiskInvertedLists*>(ils_in[i]);
+        FAISS_THROW_IF_NOT_MSG(
+                ils[i], "merge_from_files needs OnDiskInvertedLists inputs");
+        FAISS_THROW_IF_NOT(
+                ils[i]->nlist == nlist && ils[i]->code_size == code_size);
+        const std::string& fname = ils[i]->filename;
+        int fd = open(fname.c_str(), O_RDONLY);
+        FAISS_THROW_IF_NOT_FMT(
+                fd >= 0,
+                "could not open %s: %s",
+                fname.c_str(),
+                strerror(errno));
+        fds.push_back(fd);
+    }
+
+    // compact layout, as in merge_from
+    size_t entry_size = code_size + sizeof(idx_t);
+    size_t cums = 0;
+    size_t ntotal = 0;
+    for (size_t j = 0; j < nlist; j++) {
+        size_t size = 0;
+        for (int i = 0; i < n_il; i++) {
+            size += ils[i]->lists[j].size;
+        }
+        ntotal += size;
+        lists[j].size = lists[j].capacity = size;
+        lists[j].offset = cums;
+        cums += size * entry_size;
+    }
+
+    if (cums == 0) {
+        return 0;
+    }
+    update_totsize(cums);
+
+    FileDescriptors out;
+    out.push_back(open(filename.c_str(), O_WRONLY));
+    int out_fd = out[0];
+    FAISS_THROW_IF_NOT_FMT(
+            out_fd >= 0,
+            "could not open %s: %s",
+            filename.c_str(),
+            strerror(errno));
+
+    // ranges of lists of at most buffer_size bytes (or a single list)
+    std::vector<size_t> range_begins;
+    for (size_t j = 0; j < nlist;) {
+        range_begins.push_back(j);
+        size_t nbytes = lists[j].size * entry_size;
+        for (j++; j < nlist; j++) {
+            size_t list_nbytes = lists[j].size * entry_size;
+            if (nbytes + list_nbytes > buffer_size) {
+                break;
+            }
+            nbytes += list_nbytes;
+        }
+    }
+    range_begins.push_back(nlist);
+    int64_t nrange = range_begins.size() - 1;
+
+    size_t nmerged = 0;
+    double t0 = getmillisecs(), last_t = t0;
+    bool interrupt = false;
+    std::string exception_string;
+
+#pragma omp parallel
+    {
+        std::vector<uint8_t> buf;
+
+#pragma omp for schedule(dynamic)
+        for (int64_t r = 0; r < nrange; r++) {
+            if (interrupt) {
+                continue;
+            }
+            size_t l0 = range_begins[r], l1 = range_begins[r + 1];
+            size_t o0 = lists[l0].offset;
+            size_t o1 = l1 < nlist ? lists[l1].offset : cums;
+            try {
+                buf.resize(std::min(o1 - o0, buffer_size));
+                bool buffered = o1 - o0 <= buffer_size;
+                // copies a piece of an input to the range
+                auto copy = [&](int fd,
+                                size_t in_offset,
+                                size_t out_offset,
+                                size_t n) {
+                    if (buffered) {
+                        pread_all(
+                                fd, buf.data() + out_offset - o0, n, in_offset);
+                        return;
+                    }
+                    for (size_t done = 0; done < n; done += buffer_size) {
+                        size_t nb = std::min(buffer_size, n - done);
+                        pread_all(fd, buf.data(), nb, in_offset + done);
+                        pwrite_all(out_fd, buf.data(), nb, out_offset + done);
+                    }
+                };
+                for (size_t j = l0; j < l1; j++) {
+                    const List& l = lists[j];
+                    size_t codes_offset = l.offset;
+                    size_t ids_offset = l.offset + l.capacity * code_size;
+                    for (int i = 0; i < n_il; i++) {
+                        const List& li = ils[i]->lists[j];
+                        if (li.size == 0) {
+                            continue;
+                        }
+                        copy(fds[i],
+                             li.offset,
+                             codes_offset,
+                             li.size * code_size);
+                        copy(fds[i],
+                             li.offset + li.capacity * code_size,
+                             ids_offset,
+                             li.size * sizeof(idx_t));
+                        codes_offset += li.size * code_size;
+                        ids_offset += li.size * sizeof(idx_t);
+                    }
+                }
+                if (buffered) {
+                    pwrite_all(out_fd, buf.data(), o1 - o0, o0);
+                }
+            } catch (const std::exception& e) {
+#pragma omp critical
+                {
+                    exception_string = e.what();
+                    interrupt = true;
+                }
+            }
+            if (verbose) {
+#pragma omp critical
+                {
+                    nmerged += l1 - l0;
+                    double t1 = getmillisecs();
+                    if (t1 - last_t > 500) {
+                        printf("merged %zd lists in %.3f s\r",
+                               nmerged,
+                               (t1 - t0) / 1000.0);
+                        fflush(stdout);
+                        last_t = t1;
+                    }
+                }
+            }
+        }
+    }
+    if (verbose) {
+        printf("\n");
+    }
+    if (interrupt) {
+        FAISS_THROW_FMT("merge failed: %s", exception_string.c_str());
+    }
+
+    return ntotal;
+}
+
 void OnDiskInvertedLists::crop_invlists(size_t l0, size_t l1) {
     FAISS_THROW_IF_NOT(0 <= l0 && l0 <= l1 && l1 <= nlist);
 
@@ -661,12 +1452,297 @@ void OnDiskInvertedLists::set_all_lists_sizes(const size_t* sizes) {
     }
 }
 
+/*******************************************************
+ * AsyncOnDiskInvertedLists
+ *******************************************************/
+
+struct AsyncOnDiskInvertedLists::ListCache {
+    enum State { QUEUED, READING, DONE };
+
+    struct Entry {
+        State state = QUEUED;
+        std::vector<uint8_t> buf;
+        const uint8_t* data = nullptr; ///< start of the list in buf
+        size_t nbytes = 0;
+        int nuser = 0; ///< nb of get_codes / get_ids not released yet
+        std::string error;
+        std::list<size_t>::iterator order_it;
+    };
+
+    const AsyncOnDiskInvertedLists* il;
+    int fd;
+    int buffered_fd = -1; ///< without O_DIRECT, for the unaligned reads
+
+    std::mutex mutex;
+    std::condition_variable list_done;
+    std::condition_variable queue_cv;
+
+    std::unordered_map<size_t, std::unique_ptr<Entry>> entries;
+    std::list<size_t> order; ///< lists in insertion order, for eviction
+    size_t cached_bytes = 0;
+
+    std::list<size_t> queue; ///< lists to read by the I/O threads
+    bool stop = false;
+    std::vector<std::thread> threads;
+
+    std::atomic<size_t> nbytes_read;
+
+    static const size_t alignment = 4096;
+
+    ListCache(const AsyncOnDiskInvertedLists* il, int nthread)
+            : il(il), nbytes_read(0) {
+        int flags = O_RDONLY;
+#ifdef O_DIRECT
+        if (il->direct_io) {
+            flags |= O_DIRECT;
+        }
+#else
+        FAISS_THROW_IF_NOT_MSG(!il->direct_io, "O_DIRECT not supported");
+#endif
+        fd = open(il->filename.c_str(), flags);
+        FAISS_THROW_IF_NOT_FMT(
+                fd >= 0,
+                "could not open %s: %s",
+                il->filename.c_str(),
+                strerror(errno));
+        if (il->direct_io) {
+            buffered_fd = open(il->filename.c_str(), O_RDONLY);
+            FAISS_THROW_IF_NOT_FMT(
+                    buffered_fd >= 0,
+                    "could not open %s: %s",
+                    il->filename.c_str(),
+                    strerror(errno));
+        }
+        for (int i = 0; i < nthread; i++) {
+            threads.emplace_back([this]() { io_loop(); });
+        }
+    }
+
+    /// read the codes and ids of a list, without holding the mutex
+    void read_list(size_t list_no, Entry& e) {
+        const List& l = il->lists[list_no];
+        size_t nbytes = l.capacity * (il->code_size + sizeof(idx_t));
+        size_t begin = l.offset, end = l.offset + nbytes;
+        if (il->direct_io) {
+            begin = begin / alignment * alignment;
+            end = (end + alignment - 1) / alignment * alignment;
+        }
+        e.buf.resize(end - begin + alignment);
+        uint8_t* dest = e.buf.data();
+        if (il->direct_io) {
+            dest += (alignment - uintptr_t(dest) % alignment) % alignment;
+        }
+        size_t nread = 0;
+        int rfd = fd;
+        while (begin + nread < l.offset + nbytes) {
+            ssize_t ret = pread(
+                    rfd, dest + nread, end - begin - nread, begin + nread);
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ret <= 0) {
+                e.error = ret < 0 ? strerror(errno) : "unexpected end of file";
+                return;
+            }
+            nread += ret;
+            if (il->direct_io && nread % alignment != 0) {
+                // short read: O_DIRECT needs an aligned offset and length,
+                // the rest is read through the page cache
+                rfd = buffered_fd;
+            }
+        }
+        nbytes_read += nread;
+        e.data = dest + (l.offset - begin);
+        e.nbytes = e.buf.size();
+    }
+
+    void io_loop() {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            queue_cv.wait(lock, [this]() { return stop || !queue.empty(); });
+            if (stop) {
+                return;
+            }
+            size_t list_no = queue.front();
+            queue.pop_front();
+            auto it = entries.find(list_no);
+            if (it == entries.end() || it->second->state != QUEUED) {
+                // already read by a searching thread
+                continue;
+            }
+            Entry& e = *it->second;
+            e.state = READING;
+            lock.unlock();
+            read_list(list_no, e);
+            lock.lock();
+            finish(e);
+        }
+    }
+
+    // called with the mutex held
+    Entry& insert(size_t list_no) {
+        Entry* e = new Entry();
+        entries[list_no].reset(e);
+        e->order_it = order.insert(order.end(), list_no);
+        return *e;
+    }
+
+    // called with the mutex held
+    void finish(Entry& e) {
+        e.state = DONE;
+        cached_bytes += e.nbytes;
+        list_done.notify_all();
+        evict();
+    }
+
+    // called with the mutex held
+    void erase(size_t list_no) {
+        auto it = entries.find(list_no);
+        cached_bytes -= it->second->nbytes;
+        order.erase(it->second->order_it);
+        entries.erase(it);
+    }
+
+    // called with the mutex held
+    void evict() {
+        auto it = order.begin();
+        while (cached_bytes > il->cache_size && it != order.end()) {
+            size_t list_no = *it++;
+            const Entry& e = *entries[list_no];
+            if (e.state == DONE && e.nuser == 0) {
+                erase(list_no);
+            }
+        }
+    }
+
+    void prefetch(const idx_t* list_nos, int n) {
+        std::unique_lock<std::mutex> lock(mutex);
+        for (int i = 0; i < n; i++) {
+            idx_t list_no = list_nos[i];
+            if (list_no < 0 || il->list_size(list_no) == 0 ||
+                entries.count(list_no)) {
+                continue;
+            }
+            insert(list_no);
+            queue.push_back(list_no);
+        }
+        evict();
+        queue_cv.notify_all();
+    }
+
+    const uint8_t* get(size_t list_no) {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = entries.find(list_no);
+        Entry* e = it == entries.end() ? &insert(list_no) : it->second.get();
+        e->nuser++;
+        if (e->state == QUEUED) {
+            // read it now rather than waiting for the I/O threads
+            e->state = READING;
+            lock.unlock();
+            read_list(list_no, *e);
+            lock.lock();
+            finish(*e);
+        } else {
+            list_done.wait(lock, [e]() { return e->state == DONE; });
+        }
+        if (!e->error.empty()) {
+            std::string error = e->error;
+            if (--e->nuser == 0) {
+                erase(list_no);
+            }
+            FAISS_THROW_FMT(
+                    "could not read list %zd from %s: %s",
+                    list_no,
+                    il->filename.c_str(),
+                    error.c_str());
+        }
+        return e->data;
+    }
+
+    void release(size_t list_no) {
+        std::unique_lock<std::mutex> lock(mutex);
+        auto it = entries.find(list_no);
+        if (it != entries.end() && --it->second->nuser == 0) {
+            evict();
+        }
+    }
+
+    ~ListCache() {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            stop = true;
+        }
+        queue_cv.notify_all();
+        for (auto& th : threads) {
+            th.join();
+        }
+        close(fd);
+        if (buffered_fd >= 0) {
+            close(buffered_fd);
+        }
+    }
+};
+
+AsyncOnDiskInvertedLists::AsyncOnDiskInvertedLists(
+        const OnDiskInvertedLists& od,
+        bool direct_io,
+        int nthread)
+        : direct_io(direct_io), cache(nullptr) {
+    nlist = od.nlist;
+    code_size = od.code_size;
+    lists = od.lists;
+    slots = od.slots;
+    filename = od.filename;
+    totsize = od.totsize;
+    read_only = true;
+    cache = new ListCache(this, nthread);
+}
+
+const uint8_t* AsyncOnDiskInvertedLists::get_codes(size_t list_no) const {
+    if (lists[list_no].offset == INVALID_OFFSET) {
+        return nullptr;
+    }
+    return cache->get(list_no);
+}
+
+const idx_t* AsyncOnDiskInvertedLists::get_ids(size_t list_no) const {
+    if (lists[list_no].offset == INVALID_OFFSET) {
+        return nullptr;
+    }
+    return (const idx_t*)(cache->get(list_no) +
+                          code_size * lists[list_no].capacity);
+}
+
+void AsyncOnDiskInvertedLists::release_codes(size_t list_no, const uint8_t*)
+        const {
+    cache->release(list_no);
+}
+
+void AsyncOnDiskInvertedLists::release_ids(size_t list_no, const idx_t*)
+        const {
+    cache->release(list_no);
+}
+
+void AsyncOnDiskInvertedLists::prefetch_lists(const idx_t* list_nos, int n)
+        const {
+    cache->prefetch(list_nos, n);
+}
+
+size_t AsyncOnDiskInvertedLists::get_nbytes_read() const {
+    return cache->nbytes_read;
+}
+
+AsyncOnDiskInvertedLists::~AsyncOnDiskInvertedLists() {
+    delete cache;
+}
+
 /*******************************************************
  * I/O support via callbacks
  *******************************************************/
 
-OnDiskInvertedListsIOHook::OnDiskInvertedListsIOHook()
-        : InvertedListsIOHook("ilod", typeid(OnDiskInvertedLists).name()) {}
+OnDiskInvertedListsIOHook::OnDiskInvertedListsIOHook(
+        const std::string& classname)
+        : InvertedListsIOHook("ilod", classname) {}
 
 void OnDiskInvertedListsIOHook::write(const InvertedLists* ils, IOWriter* f)
         const {
@@ -735,8 +1811,32 @@ InvertedLists* OnDiskInvertedListsIOHook::read(IOReader* f, int io_flags)
         }
     }
     READ1(od->totsize);
-    if (!(io_flags & IO_FLAG_SKIP_IVF_DATA)) {
-        od->do_mmap();
+    bool skip_data = io_flags & IO_FLAG_SKIP_IVF_DATA;
+    bool async = io_flags & IO_FLAG_ONDISK_ASYNC_READ;
+    bool journaled = !skip_data &&
+            (file_exists(od->checkpoint_filename()) ||
+             file_exists(od->journal_filename()));
+    if (journaled && (od->read_only || async)) {
+        // the checkpoint is more recent than the index file
+        check_no_pending_journal(od);
+    }
+    if (async) {
+        std::unique_ptr<OnDiskInvertedLists> del(od);
+        return new AsyncOnDiskInvertedLists(
+                *od,
+                (io_flags & IO_FLAG_ONDISK_DIRECT_IO) ==
+                        IO_FLAG_ONDISK_DIRECT_IO);
+    }
+    if (!skip_data) {
+        size_t file_size;
+        od->generation = read_data_generation(od->filename, &file_size);
+        if (od->totsize > 0) {
+            od->do_mmap();
+        }
+        if (journaled && !od->read_only) {
+            // recovers from the checkpoint and the log
+            od->enable_journal();
+        }
     }
     return od;
 }
@@ -757,6 +1857,8 @@ InvertedLists* OnDiskInvertedListsIOHook::read_ArrayInvertedLists(
     FileIOReader* reader = dynamic_cast<FileIOReader*>(f);
     FAISS_THROW_IF_NOT_MSG(reader, "mmap only supported for File objects");
     FILE* fdesc = reader->f;
+    // the lists can be read from the index file (see merge_from_files)
+    ails->filename = reader->name;
     size_t o0 = ftell(fdesc);
     size_t o = o0;
     { // do the mmap
@@ -11,6 +11,7 @@
 #define FAISS_ON_DISK_INVERTED_LISTS_H
 
 #include <list>
+#include <string>
 #include <typeinfo>
 #include <vector>
 
@@ -56,6 +57,28 @@ struct OnDiskOneList {
  * When it is known that a set of lists will be accessed, it is useful
  * to call prefetch_lists, that launches a set of threads to read the
  * lists in parallel.
+ *
+ * In journaled mode (enable_journal), each add_entries, update_entries and
+ * resize is appended to a write-ahead log (filename + ".wal") before it is
+ * applied to the mmapped file. The records of a batch (begin_add_batch /
+ * end_add_batch, eg. one IndexIVF::add call) are flushed to the log once,
+ * at the end of the batch, and fsynced if journal_sync is set. Every
+ * checkpoint_interval updates (checked outside of batches), the
+ * mmapped file is synced, the list metadata is written to filename +
+ * ".ckpt" and the log is truncated. The slots freed by the updates are
+ * reused only after the next checkpoint, so that the data of the
+ * checkpointed lists is never overwritten by the updates that follow it.
+ * After a crash, enable_journal reloads the checkpoint and replays the
+ * log, which restores the state after the last update that reached the
+ * log. Reading an index whose checkpoint or log file exists enables the
+ * journal, and thus performs the recovery. Reading it read-only or with
+ * IO_FLAG_ONDISK_ASYNC_READ uses the checkpoint, and fails if the log
+ * contains more recent updates (they can only be replayed read-write).
+ *
+ * The journaled data file ends with a random generation number (after the
+ * totsize bytes of lists), that is also stored in the checkpoint and log
+ * headers. The recovery refuses checkpoint and log files that have another
+ * generation, ie. that are stale files of a data file that was rebuilt.
  */
 struct OnDiskInvertedLists : InvertedLists {
     using List = OnDiskOneList;
@@ -109,15 +132,58 @@ struct OnDiskInvertedLists : InvertedLists {
     /// same as merge_from for a single invlist
     size_t merge_from_1(const InvertedLists* il, bool verbose = false);
 
+    /** same as merge_from for OnDiskInvertedLists inputs (eg. read with
+     * IO_FLAG_MMAP), that are read from their files with pread instead of
+     * through mmap. The lists are processed by ranges of consecutive lists
+     * of at most buffer_size bytes: each thread reads the pieces of a range
+     * from all the inputs, in file order, and writes the range to the
+     * output with a single pwrite. Lists larger than buffer_size are copied
+     * through the buffer piece by piece. The memory used is about
+     * buffer_size per thread.
+     */
+    size_t merge_from_files(
+            const InvertedLists** ils,
+            int n_il,
+            size_t buffer_size = size_t(1) << 26,
+            bool verbose = false);
+
     /// restrict the inverted lists to l0:l1 without touching the mmapped region
     void crop_invlists(size_t l0, size_t l1);
 
+    /// nb of journaled updates between two checkpoints (0 = manual only)
+    size_t checkpoint_interval = 1024;
+
+    /// identifies the content of the data file, 0 = none (not journaled)
+    uint64_t generation = 0;
+
+    /// fsync the log after each update or batch of updates (otherwise the
+    /// log is only flushed to the OS, which survives a crash of the process
+    /// but not of the machine)
+    bool journal_sync = false;
+
+    /// switch to journaled mode, recover from the checkpoint and log files
+    /// if they exist
+    void enable_journal();
+
+    /// sync the data, write the list metadata and truncate the log
+    void checkpoint();
+
+    std::string journal_filename() const;
+    std::string checkpoint_filename() const;
+
     void prefetch_lists(const idx_t* list_nos, int nlist) const override;
 
+    void begin_add_batch() override;
+    void end_add_batch() override;
+
     ~OnDiskInvertedLists() override;
 
     // private
 
+    // the log file and the slots waiting for the next checkpoint
+    struct Journal;
+    Journal* journal;
+
     LockLevels* locks;
 
     // encapsulates the threads that are busy prefeteching
@@ -131,6 +197,14 @@ struct OnDiskInvertedLists : InvertedLists {
     size_t allocate_slot(size_t capacity);
     void free_slot(size_t offset, size_t capacity);
 
+    /// copy entries to the mmapped list, without journaling
+    void write_entries(
+            size_t list_no,
+            size_t offset,
+            size_t n_entry,
+            const idx_t* ids,
+            const uint8_t* code);
+
     /// override all list sizes and make a packed storage
     void set_all_lists_sizes(const size_t* sizes);
 
@@ -138,8 +212,59 @@ struct OnDiskInvertedLists : InvertedLists {
     OnDiskInvertedLists();
 };
 
+/** Read-only OnDiskInvertedLists that reads the lists from the file with
+ * pread instead of mmapping it, so that the queries do not stall on serial
+ * page faults when the file is not in the page cache.
+ *
+ * prefetch_lists, that IndexIVF::search calls with all the lists of a
+ * batch of queries, submits the reads to a pool of I/O threads. The scan
+ * of a list then overlaps with the reads of the following ones. get_codes
+ * and get_ids wait for a list that is being read, and read it in the
+ * calling thread if it was not prefetched yet.
+ *
+ * With direct_io the file is opened with O_DIRECT, which bypasses the page
+ * cache (the reads are aligned on 4 kiB, after a short read the rest of
+ * the list is read through the page cache). The lists that were read are
+ * kept in a cache of about cache_size bytes, trimmed when lists are read
+ * or released; the lists that are being read or used are never evicted.
+ *
+ * It is obtained with read_index and IO_FLAG_ONDISK_ASYNC_READ, and is
+ * written like an OnDiskInvertedLists.
+ */
+struct AsyncOnDiskInvertedLists : OnDiskInvertedLists {
+    bool direct_io;
+
+    /// max size of the lists kept in memory (bytes)
+    size_t cache_size = size_t(1) << 28;
+
+    /// copies the list layout of od, that does not need to be mmapped
+    explicit AsyncOnDiskInvertedLists(
+            const OnDiskInvertedLists& od,
+            bool direct_io = false,
+            int nthread = 8);
+
+    const uint8_t* get_codes(size_t list_no) const override;
+    const idx_t* get_ids(size_t list_no) const override;
+
+    void release_codes(size_t list_no, const uint8_t* codes) const override;
+    void release_ids(size_t list_no, const idx_t* ids) const override;
+
+    void prefetch_lists(const idx_t* list_nos, int nlist) const override;
+
+    /// nb of bytes read from the file so far
+    size_t get_nbytes_read() const;
+
+    ~AsyncOnDiskInvertedLists() override;
+
+    // the I/O threads and the cache of lists
+    struct ListCache;
+    ListCache* cache;
+};
+
 struct OnDiskInvertedListsIOHook : InvertedListsIOHook {
-    OnDiskInvertedListsIOHook();
+    /// the same hook writes the subclasses of OnDiskInvertedLists
+    explicit OnDiskInvertedListsIOHook(
+            const std::string& classname = typeid(OnDiskInvertedLists).name());
     void write(const InvertedLists* ils, IOWriter* f) const override;
     InvertedLists* read(IOReader* f, int io_flags) const override;
     InvertedLists* read_ArrayInvertedLists(
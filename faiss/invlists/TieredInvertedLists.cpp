@@ -0,0 +1,386 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/invlists/TieredInvertedLists.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <faiss/impl/FaissAssert.h>
+
+namespace faiss {
+
+/*******************************************************
+ * TieredInvertedLists
+ *******************************************************/
+
+struct TieredInvertedLists::Tiers {
+    struct HotList {
+        std::vector<uint8_t> codes;
+        std::vector<idx_t> ids;
+        /// nb of get_codes / get_ids not released yet
+        std::atomic<int> nuser{0};
+    };
+
+    TieredInvertedLists* il;
+
+    /* The searches access the hot lists without locking. A search
+     * registers in nreader[list_no] while it reads hot[list_no] and
+     * updates the nuser of the list it found. A demoted list is retired
+     * and freed once its nuser is 0 with no reader on its slot: the
+     * searches that load hot[list_no] afterwards do not see it. */
+    std::unique_ptr<std::atomic<HotList*>[]> hot;
+    std::unique_ptr<std::atomic<int>[]> nreader;
+    std::vector<std::unique_ptr<HotList>> owned; ///< used by the updater
+    /// size of the hot and retired lists
+    std::atomic<size_t> hot_bytes;
+
+    // protects retired
+    std::mutex retired_mutex;
+    std::vector<std::pair<size_t, std::unique_ptr<HotList>>> retired;
+
+    // access statistics, updated without locking
+    std::unique_ptr<std::atomic<uint64_t>[]> counts;
+    std::unique_ptr<std::atomic<uint64_t>[]> last_access;
+    std::atomic<uint64_t> clock;
+    std::atomic<size_t> naccess, nhot_access;
+
+    // serializes the calls to update_tiers
+    std::mutex update_mutex;
+
+    // background thread
+    std::mutex thread_mutex;
+    std::condition_variable thread_cv;
+    bool stop = false;
+    std::thread thread;
+
+    explicit Tiers(TieredInvertedLists* il)
+            : il(il),
+              hot(new std::atomic<HotList*>[il->nlist]),
+              nreader(new std::atomic<int>[il->nlist]),
+              owned(il->nlist),
+              hot_bytes(0),
+              counts(new std::atomic<uint64_t>[il->nlist]),
+              last_access(new std::atomic<uint64_t>[il->nlist]),
+              clock(0),
+              naccess(0),
+              nhot_access(0) {
+        for (size_t i = 0; i < il->nlist; i++) {
+            hot[i] = nullptr;
+            nreader[i] = 0;
+            counts[i] = 0;
+            last_access[i] = 0;
+        }
+    }
+
+    /// start the background thread, once the object is complete
+    void start(int update_interval_ms) {
+        if (update_interval_ms > 0) {
+            thread = std::thread(
+                    [this, update_interval_ms]() { loop(update_interval_ms); });
+        }
+    }
+
+    void loop(int update_interval_ms) {
+        std::unique_lock<std::mutex> lock(thread_mutex);
+        for (;;) {
+            thread_cv.wait_for(
+                    lock,
+                    std::chrono::milliseconds(update_interval_ms),
+                    [this]() { return stop; });
+            if (stop) {
+                return;
+            }
+            lock.unlock();
+            try {
+                il->update_tiers();
+            } catch (const std::exception& e) {
+                fprintf(stderr,
+                        "WARN: TieredInvertedLists update failed: %s\n",
+                        e.what());
+            }
+            lock.lock();
+        }
+    }
+
+    void record_access(size_t list_no) {
+        counts[list_no]++;
+        last_access[list_no] = ++clock;
+        naccess++;
+    }
+
+    size_t list_bytes(size_t list_no) const {
+        return il->cold->list_size(list_no) *
+                (il->code_size + sizeof(idx_t));
+    }
+
+    size_t hot_list_bytes(const HotList& h) const {
+        return h.ids.size() * (il->code_size + sizeof(idx_t));
+    }
+
+    /// returns nullptr if the list is not hot
+    HotList* acquire(size_t list_no) {
+        nreader[list_no]++;
+        HotList* h = hot[list_no];
+        if (h) {
+            h->nuser++;
+        }
+        nreader[list_no]--;
+        return h;
+    }
+
+    /// returns false if ptr does not come from a hot list
+    bool release(size_t list_no, const void* ptr) {
+        auto from = [ptr](const HotList* h) {
+            return h && (ptr == h->codes.data() || ptr == h->ids.data());
+        };
+        nreader[list_no]++;
+        HotList* h = hot[list_no];
+        bool found = from(h);
+        if (found) {
+            h->nuser--;
+        }
+        nreader[list_no]--;
+        if (!found) {
+            // the list may have been demoted since it was acquired
+            std::lock_guard<std::mutex> lock(retired_mutex);
+            for (const auto& r : retired) {
+                if (r.first == list_no && from(r.second.get())) {
+                    r.second->nuser--;
+                    found = true;
+                    break;
+                }
+            }
+        }
+        return found;
+    }
+
+    /// remove a list from the hot tier, called by the updater
+    void demote(size_t list_no) {
+        // retire before unpublishing, so that release finds the list
+        std::lock_guard<std::mutex> lock(retired_mutex);
+        retired.emplace_back(list_no, std::move(owned[list_no]));
+        hot[list_no] = nullptr;
+    }
+
+    /** free the retired lists that are not in use anymore. Returns the
+     * slots that still have a retired list. */
+    std::vector<bool> collect() {
+        std::lock_guard<std::mutex> lock(retired_mutex);
+        std::vector<bool> pending(il->nlist);
+        size_t j = 0;
+        for (size_t i = 0; i < retired.size(); i++) {
+            size_t list_no = retired[i].first;
+            const HotList& h = *retired[i].second;
+            // nreader first: a reader that registers afterwards does not
+            // see the list, one that registered before has updated nuser
+            if (nreader[list_no] > 0 || h.nuser > 0) {
+                pending[list_no] = true;
+                std::swap(retired[j++], retired[i]);
+            } else {
+                hot_bytes -= hot_list_bytes(h);
+            }
+        }
+        retired.resize(j);
+        return pending;
+    }
+
+    ~Tiers() {
+        {
+            std::lock_guard<std::mutex> lock(thread_mutex);
+            stop = true;
+        }
+        thread_cv.notify_all();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+};
+
+TieredInvertedLists::TieredInvertedLists(
+        const InvertedLists* cold,
+        size_t cache_size,
+        EvictionPolicy policy,
+        int update_interval_ms)
+        : ReadOnlyInvertedLists(cold->nlist, cold->code_size),
+          cold(cold),
+          cache_size(cache_size),
+          policy(policy),
+          tiers(nullptr) {
+    FAISS_THROW_IF_NOT_MSG(
+            code_size != INVALID_CODE_SIZE,
+            "the cold inverted lists should have a fixed code size");
+    tiers = new Tiers(this);
+    // last, the background thread accesses tiers
+    tiers->start(update_interval_ms);
+}
+
+size_t TieredInvertedLists::list_size(size_t list_no) const {
+    return cold->list_size(list_no);
+}
+
+const uint8_t* TieredInvertedLists::get_codes(size_t list_no) const {
+    tiers->record_access(list_no);
+    Tiers::HotList* h = tiers->acquire(list_no);
+    if (h) {
+        tiers->nhot_access++;
+        return h->codes.data();
+    }
+    return cold->get_codes(list_no);
+}
+
+const idx_t* TieredInvertedLists::get_ids(size_t list_no) const {
+    Tiers::HotList* h = tiers->acquire(list_no);
+    if (h) {
+        return h->ids.data();
+    }
+    return cold->get_ids(list_no);
+}
+
+void TieredInvertedLists::release_codes(size_t list_no, const uint8_t* codes)
+        const {
+    // the list may have been promoted since get_codes
+    if (!tiers->release(list_no, codes)) {
+        cold->release_codes(list_no, codes);
+    }
+}
+
+void TieredInvertedLists::release_ids(size_t list_no, const idx_t* ids) const {
+    if (!tiers->release(list_no, ids)) {
+        cold->release_ids(list_no, ids);
+    }
+}
+
+void TieredInvertedLists::prefetch_lists(const idx_t* list_nos, int n) const {
+    std::vector<idx_t> cold_list_nos;
+    for (int i = 0; i < n; i++) {
+        if (list_nos[i] >= 0 && !is_hot(list_nos[i])) {
+            cold_list_nos.push_back(list_nos[i]);
+        }
+    }
+    if (!cold_list_nos.empty()) {
+        cold->prefetch_lists(cold_list_nos.data(), cold_list_nos.size());
+    }
+}
+
+void TieredInvertedLists::update_tiers() {
+    std::lock_guard<std::mutex> update_lock(tiers->update_mutex);
+
+    // rank the lists that were accessed
+    typedef std::pair<uint64_t, size_t> Score;
+    std::vector<Score> scores;
+    for (size_t i = 0; i < nlist; i++) {
+        uint64_t score;
+        if (policy == LFU) {
+            // exponential decay of the counts
+            uint64_t c = tiers->counts[i];
+            tiers->counts[i] -= c - c / 2;
+            score = c;
+        } else {
+            score = tiers->last_access[i];
+        }
+        if (score > 0 && cold->list_size(i) > 0) {
+            scores.emplace_back(score, i);
+        }
+    }
+    std::sort(scores.begin(), scores.end(), [](const Score& a, const Score& b) {
+        return a.first > b.first ||
+                (a.first == b.first && a.second < b.second);
+    });
+
+    std::vector<bool> wanted(nlist);
+    size_t wanted_bytes = 0;
+    for (const Score& s : scores) {
+        size_t nbytes = tiers->list_bytes(s.second);
+        if (wanted_bytes + nbytes <= cache_size) {
+            wanted[s.second] = true;
+            wanted_bytes += nbytes;
+        }
+    }
+
+    // demote first to make room. The lists that are in use are freed
+    // at a later update, after they are released. A list is not promoted
+    // again before its previous copy is freed
+    for (size_t i = 0; i < nlist; i++) {
+        if (tiers->owned[i] && !wanted[i]) {
+            tiers->demote(i);
+        }
+    }
+    std::vector<bool> pending = tiers->collect();
+    std::vector<size_t> to_promote;
+    for (size_t i = 0; i < nlist; i++) {
+        if (!tiers->owned[i] && wanted[i] && !pending[i]) {
+            to_promote.push_back(i);
+        }
+    }
+
+    // promote, in order of decreasing score. The copies are made without
+    // blocking the searches
+    for (const Score& s : scores) {
+        size_t list_no = s.second;
+        if (!std::binary_search(
+                    to_promote.begin(), to_promote.end(), list_no)) {
+            continue;
+        }
+        size_t ls = cold->list_size(list_no);
+        // the retired lists that are still in use may take the space
+        if (tiers->hot_bytes + ls * (code_size + sizeof(idx_t)) >
+            cache_size) {
+            continue;
+        }
+        std::unique_ptr<Tiers::HotList> h(new Tiers::HotList());
+        h->codes.resize(ls * code_size);
+        h->ids.resize(ls);
+        {
+            ScopedCodes codes(cold, list_no);
+            memcpy(h->codes.data(), codes.get(), ls * code_size);
+        }
+        {
+            ScopedIds ids(cold, list_no);
+            memcpy(h->ids.data(), ids.get(), ls * sizeof(idx_t));
+        }
+        tiers->hot_bytes += ls * (code_size + sizeof(idx_t));
+        tiers->hot[list_no] = h.get();
+        tiers->owned[list_no] = std::move(h);
+    }
+}
+
+bool TieredInvertedLists::is_hot(size_t list_no) const {
+    return tiers->hot[list_no] != nullptr;
+}
+
+size_t TieredInvertedLists::get_hot_bytes() const {
+    return tiers->hot_bytes;
+}
+
+size_t TieredInvertedLists::get_naccess() const {
+    return tiers->naccess;
+}
+
+size_t TieredInvertedLists::get_nhot_access() const {
+    return tiers->nhot_access;
+}
+
+TieredInvertedLists::~TieredInvertedLists() {
+    // stop the background thread before releasing the cold lists
+    delete tiers;
+    if (own_cold) {
+        delete cold;
+    }
+}
+
+} // namespace faiss
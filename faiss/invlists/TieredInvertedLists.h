@@ -0,0 +1,90 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#pragma once
+
+#include <faiss/invlists/InvertedLists.h>
+
+namespace faiss {
+
+/** Inverted lists in two tiers: the lists that are accessed most often are
+ * copied in RAM (hot tier), the other ones are accessed in the underlying
+ * cold inverted lists, typically an OnDiskInvertedLists.
+ *
+ * The hot tier is bounded by cache_size bytes (codes + ids). Each
+ * get_codes counts as an access to the list. The hot set is recomputed by
+ * update_tiers, that promotes the best lists according to the policy and
+ * demotes the others:
+ * - LFU: the lists with the most accesses. The counters are halved at each
+ *   update so that the hot set follows the changes of the query
+ *   distribution.
+ * - LRU: the lists that were accessed most recently.
+ *
+ * update_tiers is called every update_interval_ms by a background thread,
+ * and can also be called explicitly. The copies are made outside of the
+ * search path. The searches access the tiers without locking, a list that
+ * is demoted while in use (between get_codes and release_codes) is freed
+ * at the next update after it is released. Until then it counts in the
+ * hot tier size and the list is not promoted again.
+ *
+ * The cold inverted lists should not be modified while they are wrapped.
+ */
+struct TieredInvertedLists : ReadOnlyInvertedLists {
+    enum EvictionPolicy {
+        LRU, ///< keep the most recently accessed lists
+        LFU, ///< keep the most frequently accessed lists
+    };
+
+    const InvertedLists* cold;
+    bool own_cold = false;
+
+    /// max size of the lists kept in RAM (bytes)
+    size_t cache_size;
+
+    EvictionPolicy policy;
+
+    /** @param update_interval_ms  period of the background update of the
+     *                             tiers, 0 = no background thread
+     */
+    TieredInvertedLists(
+            const InvertedLists* cold,
+            size_t cache_size,
+            EvictionPolicy policy = LFU,
+            int update_interval_ms = 1000);
+
+    size_t list_size(size_t list_no) const override;
+    const uint8_t* get_codes(size_t list_no) const override;
+    const idx_t* get_ids(size_t list_no) const override;
+
+    void release_codes(size_t list_no, const uint8_t* codes) const override;
+    void release_ids(size_t list_no, const idx_t* ids) const override;
+
+    void prefetch_lists(const idx_t* list_nos, int nlist) const override;
+
+    /// promote / demote lists according to the access statistics
+    void update_tiers();
+
+    /// whether the list is currently in RAM
+    bool is_hot(size_t list_no) const;
+
+    /// size of the lists in RAM (bytes)
+    size_t get_hot_bytes() const;
+
+    /// nb of get_codes calls, and how many of them were served from RAM
+    size_t get_naccess() const;
+    size_t get_nhot_access() const;
+
+    ~TieredInvertedLists() override;
+
+    // the hot lists, the access counters and the background thread
+    struct Tiers;
+    Tiers* tiers;
+};
+
+} // namespace faiss
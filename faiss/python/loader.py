@@ -41,14 +41,35 @@ def supported_instruction_sets():
             return {"AVX2"}
     elif platform.system() == "Linux":
         import numpy.distutils.cpuinfo
-        if "avx2" in numpy.distutils.cpuinfo.cpu.info[0].get('flags', ""):
-            return {"AVX2"}
+        result = set()
+        flags = numpy.distutils.cpuinfo.cpu.info[0].get('flags', "")
+        if "avx2" in flags:
+            result.add("AVX2")
+        if all(f in flags.split() for f in (
+                "avx512f", "avx512cd", "avx512vl", "avx512dq", "avx512bw")):
+            result.add("AVX512_SKX")
+        return result
     return set()
 
 
 logger = logging.getLogger(__name__)
 
-has_AVX2 = "AVX2" in supported_instruction_sets()
+instruction_sets = supported_instruction_sets()
+
+# AVX512_SKX is the group of the F, CD, VL, DQ and BW extensions
+has_AVX512 = "AVX512_SKX" in instruction_sets
+if has_AVX512:
+    try:
+        logger.info("Loading faiss with AVX512 support.")
+        from .swigfaiss_avx512 import *
+        logger.info("Successfully loaded faiss with AVX512 support.")
+    except ImportError as e:
+        logger.info(
+            f"Could not load library with AVX512 support due to:\n{e!r}")
+        # reset so that we load without AVX512 below
+        has_AVX512 = False
+
+has_AVX2 = not has_AVX512 and "AVX2" in instruction_sets
 if has_AVX2:
     try:
         logger.info("Loading faiss with AVX2 support.")
@@ -59,7 +80,7 @@ if has_AVX2:
         # reset so that we load without AVX2 below
         has_AVX2 = False
 
-if not has_AVX2:
+if not has_AVX512 and not has_AVX2:
     # we import * so that the symbol X can be accessed as faiss.X
     logger.info("Loading faiss.")
     from .swigfaiss import *
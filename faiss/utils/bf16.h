@@ -0,0 +1,36 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+namespace faiss {
+
+/* bfloat16 is the 16 upper bits of a float32: it has the range of float32
+ * and 8 bits of mantissa. */
+
+inline uint16_t encode_bf16(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    if ((x & 0x7fffffff) > 0x7f800000) {
+        // NaN, make sure it stays a (quiet) NaN after truncation
+        return (x >> 16) | 0x40;
+    }
+    // round to nearest even
+    return (x + 0x7fff + ((x >> 16) & 1)) >> 16;
+}
+
+inline float decode_bf16(uint16_t v) {
+    uint32_t x = uint32_t(v) << 16;
+    float f;
+    memcpy(&f, &x, sizeof(f));
+    return f;
+}
+
+} // namespace faiss
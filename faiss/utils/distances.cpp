@@ -722,6 +722,138 @@ void knn_L2sqr(
     knn_L2sqr(x, y, d, nx, ny, res->k, res->val, res->ids, y_norm2, sel);
 }
 
+/***************************************************************************
+ * int8 / uint8 vectors
+ ***************************************************************************/
+
+namespace {
+
+template <class ResultHandler>
+void exhaustive_int8(
+        const uint8_t* x,
+        const uint8_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        bool is_signed,
+        bool is_inner_product,
+        ResultHandler& res,
+        const IDSelector* sel) {
+    if (nx == 0 || ny == 0)
+        return;
+
+    /* block sizes */
+    const size_t bs_x = distance_compute_blas_query_bs;
+    const size_t bs_y = distance_compute_blas_database_bs;
+    std::unique_ptr<int32_t[]> int_block(new int32_t[bs_x * bs_y]);
+    std::unique_ptr<float[]> dis_block(new float[bs_x * bs_y]);
+    // excluded vectors get the worst possible distance
+    const float excluded = is_inner_product ? -HUGE_VALF : HUGE_VALF;
+
+    for (size_t i0 = 0; i0 < nx; i0 += bs_x) {
+        size_t i1 = std::min(i0 + bs_x, nx);
+
+        res.begin_multiple(i0, i1);
+
+        for (size_t j0 = 0; j0 < ny; j0 += bs_y) {
+            size_t j1 = std::min(j0 + bs_y, ny);
+            size_t nyi = j1 - j0;
+            // parallelize over blocks of 8 queries, the kernel shares the
+            // loads of the database vectors between the queries of a block
+            size_t nb = (i1 - i0 + 7) / 8;
+#pragma omp parallel for if (nb > 1)
+            for (int64_t b = 0; b < nb; b++) {
+                size_t i = i0 + b * 8, in = std::min(i + 8, i1);
+                int32_t* int_line = int_block.get() + (i - i0) * nyi;
+                float* dis_line = dis_block.get() + (i - i0) * nyi;
+                if (is_signed) {
+                    int8_distances_block(
+                            (const int8_t*)(x + i * d),
+                            (const int8_t*)(y + j0 * d),
+                            d,
+                            in - i,
+                            nyi,
+                            is_inner_product,
+                            int_line);
+                } else {
+                    uint8_distances_block(
+                            x + i * d,
+                            y + j0 * d,
+                            d,
+                            in - i,
+                            nyi,
+                            is_inner_product,
+                            int_line);
+                }
+                for (size_t l = 0; l < (in - i) * nyi; l++) {
+                    dis_line[l] = int_line[l];
+                }
+                if (sel) {
+                    for (size_t j = j0; j < j1; j++) {
+                        if (!sel->is_member(j)) {
+                            for (size_t l = 0; l < in - i; l++) {
+                                dis_line[l * nyi + j - j0] = excluded;
+                            }
+                        }
+                    }
+                }
+            }
+            res.add_results(j0, j1, dis_block.get());
+        }
+        res.end_multiple();
+        InterruptCallback::check();
+    }
+}
+
+template <class C>
+void knn_int8_select(
+        const uint8_t* x,
+        const uint8_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        bool is_signed,
+        bool is_inner_product,
+        size_t k,
+        float* vals,
+        int64_t* ids,
+        const IDSelector* sel) {
+    if (k < distance_compute_min_k_reservoir) {
+        HeapResultHandler<C> res(nx, vals, ids, k);
+        exhaustive_int8(
+                x, y, d, nx, ny, is_signed, is_inner_product, res, sel);
+    } else {
+        ReservoirResultHandler<C> res(nx, vals, ids, k);
+        exhaustive_int8(
+                x, y, d, nx, ny, is_signed, is_inner_product, res, sel);
+    }
+}
+
+} // anonymous namespace
+
+void knn_int8(
+        const uint8_t* x,
+        const uint8_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        bool is_signed,
+        bool is_inner_product,
+        size_t k,
+        float* vals,
+        int64_t* ids,
+        const IDSelector* sel) {
+    // the int32 accumulators of the kernels overflow above
+    FAISS_THROW_IF_NOT_MSG(d < 32768, "knn_int8 requires d < 32768");
+    if (is_inner_product) {
+        knn_int8_select<CMin<float, int64_t>>(
+                x, y, d, nx, ny, is_signed, true, k, vals, ids, sel);
+    } else {
+        knn_int8_select<CMax<float, int64_t>>(
+                x, y, d, nx, ny, is_signed, false, k, vals, ids, sel);
+    }
+}
+
 /***************************************************************************
  * Range search
  ***************************************************************************/
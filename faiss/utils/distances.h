@@ -36,6 +36,36 @@ float fvec_L1(const float* x, const float* y, size_t d);
 /// infinity distance
 float fvec_Linf(const float* x, const float* y, size_t d);
 
+/** Special version of inner product that computes 4 distances
+ * between x and yi, the loads of x are shared between the 4 vectors.
+ */
+void fvec_inner_product_batch_4(
+        const float* x,
+        const float* y0,
+        const float* y1,
+        const float* y2,
+        const float* y3,
+        const size_t d,
+        float& dis0,
+        float& dis1,
+        float& dis2,
+        float& dis3);
+
+/** Special version of L2sqr that computes 4 distances
+ * between x and yi, the loads of x are shared between the 4 vectors.
+ */
+void fvec_L2sqr_batch_4(
+        const float* x,
+        const float* y0,
+        const float* y1,
+        const float* y2,
+        const float* y3,
+        const size_t d,
+        float& dis0,
+        float& dis1,
+        float& dis2,
+        float& dis3);
+
 /** Compute pairwise distances between sets of vectors
  *
  * @param d     dimension of the vectors
@@ -341,6 +371,64 @@ void knn_L2sqr_by_idx(
         int64_t* ids,
         int64_t ld_subset = -1);
 
+/***************************************************************************
+ * int8 / uint8 vectors
+ ***************************************************************************/
+
+/** Exact distances between two sets of int8 vectors, computed with integer
+ * arithmetic (int16 products accumulated in int32, there is no overflow for
+ * d < 2^15).
+ *
+ * @param x    size nx * d
+ * @param y    size ny * d
+ * @param is_inner_product  compute inner products instead of squared L2
+ * @param dis  output distances, size nx * ny
+ */
+void int8_distances_block(
+        const int8_t* x,
+        const int8_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        bool is_inner_product,
+        int32_t* dis);
+
+/// same as int8_distances_block for uint8 components
+void uint8_distances_block(
+        const uint8_t* x,
+        const uint8_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        bool is_inner_product,
+        int32_t* dis);
+
+/** Find the k nearest neighbors of the nx int8 (or uint8) vectors x among
+ * the ny vectors y, for the L2 or inner product metric. The distances are
+ * computed by blocks of distance_compute_blas_query_bs *
+ * distance_compute_blas_database_bs, like the float BLAS search.
+ *
+ * @param x    query vectors, size nx * d bytes
+ * @param y    database vectors, size ny * d bytes
+ * @param d    dimension, d < 32768
+ * @param is_signed  the components are int8 (otherwise uint8)
+ * @param vals output distances, size nx * k
+ * @param ids  output labels, size nx * k
+ * @param sel  search in this subset of vectors
+ */
+void knn_int8(
+        const uint8_t* x,
+        const uint8_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        bool is_signed,
+        bool is_inner_product,
+        size_t k,
+        float* vals,
+        int64_t* ids,
+        const IDSelector* sel = nullptr);
+
 /***************************************************************************
  * Range search
  ***************************************************************************/
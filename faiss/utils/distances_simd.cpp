@@ -17,6 +17,7 @@
 
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/platform_macros.h>
+#include <faiss/utils/simd_levels.h>
 #include <faiss/utils/simdlib.h>
 
 #ifdef __SSE3__
@@ -33,6 +34,8 @@ namespace faiss {
 #define USE_AVX
 #endif
 
+FAISS_SIMD_NS_BEGIN
+
 /*********************************************************
  * Optimized distance computations
  *********************************************************/
@@ -1301,6 +1304,103 @@ void fvec_inner_products_ny(
 
 #endif
 
+/*********************************************************
+ * Distances from one vector to 4 vectors
+ *********************************************************/
+
+namespace {
+
+inline float horizontal_sum(simd8float32 v) {
+    float tab[8];
+    v.storeu(tab);
+    return tab[0] + tab[1] + tab[2] + tab[3] + tab[4] + tab[5] + tab[6] +
+            tab[7];
+}
+
+} // namespace
+
+void fvec_inner_product_batch_4(
+        const float* x,
+        const float* y0,
+        const float* y1,
+        const float* y2,
+        const float* y3,
+        const size_t d,
+        float& dis0,
+        float& dis1,
+        float& dis2,
+        float& dis3) {
+    simd8float32 acc0(0.0f), acc1(0.0f), acc2(0.0f), acc3(0.0f);
+    size_t i;
+    for (i = 0; i + 7 < d; i += 8) {
+        simd8float32 xi(x + i);
+        acc0 = fmadd(xi, simd8float32(y0 + i), acc0);
+        acc1 = fmadd(xi, simd8float32(y1 + i), acc1);
+        acc2 = fmadd(xi, simd8float32(y2 + i), acc2);
+        acc3 = fmadd(xi, simd8float32(y3 + i), acc3);
+    }
+    float d0 = horizontal_sum(acc0);
+    float d1 = horizontal_sum(acc1);
+    float d2 = horizontal_sum(acc2);
+    float d3 = horizontal_sum(acc3);
+    // finish non-multiple of 8 remainder
+    for (; i < d; i++) {
+        d0 += x[i] * y0[i];
+        d1 += x[i] * y1[i];
+        d2 += x[i] * y2[i];
+        d3 += x[i] * y3[i];
+    }
+    dis0 = d0;
+    dis1 = d1;
+    dis2 = d2;
+    dis3 = d3;
+}
+
+void fvec_L2sqr_batch_4(
+        const float* x,
+        const float* y0,
+        const float* y1,
+        const float* y2,
+        const float* y3,
+        const size_t d,
+        float& dis0,
+        float& dis1,
+        float& dis2,
+        float& dis3) {
+    simd8float32 acc0(0.0f), acc1(0.0f), acc2(0.0f), acc3(0.0f);
+    size_t i;
+    for (i = 0; i + 7 < d; i += 8) {
+        simd8float32 xi(x + i);
+        simd8float32 t0 = xi - simd8float32(y0 + i);
+        simd8float32 t1 = xi - simd8float32(y1 + i);
+        simd8float32 t2 = xi - simd8float32(y2 + i);
+        simd8float32 t3 = xi - simd8float32(y3 + i);
+        acc0 = fmadd(t0, t0, acc0);
+        acc1 = fmadd(t1, t1, acc1);
+        acc2 = fmadd(t2, t2, acc2);
+        acc3 = fmadd(t3, t3, acc3);
+    }
+    float d0 = horizontal_sum(acc0);
+    float d1 = horizontal_sum(acc1);
+    float d2 = horizontal_sum(acc2);
+    float d3 = horizontal_sum(acc3);
+    // finish non-multiple of 8 remainder
+    for (; i < d; i++) {
+        float t0 = x[i] - y0[i];
+        float t1 = x[i] - y1[i];
+        float t2 = x[i] - y2[i];
+        float t3 = x[i] - y3[i];
+        d0 += t0 * t0;
+        d1 += t1 * t1;
+        d2 += t2 * t2;
+        d3 += t3 * t3;
+    }
+    dis0 = d0;
+    dis1 = d1;
+    dis2 = d2;
+    dis3 = d3;
+}
+
 /***************************************************************************
  * heavily optimized table computations
  ***************************************************************************/
@@ -1743,4 +1843,374 @@ void fvec_add(size_t d, const float* a, float b, float* c) {
     }
 }
 
+/*********************************************************
+ * int8 / uint8 distances
+ *********************************************************/
+
+namespace {
+
+/* Integer SIMD operations for the int8 distance kernels. The vectors are
+ * widened to int16 and multiplied by pairs with madd, so the products are
+ * exact and accumulated in int32. */
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+
+struct Int8Simd {
+    using reg = __m512i;
+    static constexpr int width = 32;
+
+    template <bool is_signed>
+    static reg load(const uint8_t* p) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        return is_signed ? _mm512_cvtepi8_epi16(v) : _mm512_cvtepu8_epi16(v);
+    }
+    static reg zero() {
+        return _mm512_setzero_si512();
+    }
+    static reg sub(reg a, reg b) {
+        return _mm512_sub_epi16(a, b);
+    }
+    static reg madd_add(reg accu, reg a, reg b) {
+#ifdef __AVX512VNNI__
+        return _mm512_dpwssd_epi32(accu, a, b);
+#else
+        return _mm512_add_epi32(accu, _mm512_madd_epi16(a, b));
+#endif
+    }
+    static int32_t sum(reg a) {
+        return _mm512_reduce_add_epi32(a);
+    }
+};
+
+#elif defined(__AVX2__)
+
+struct Int8Simd {
+    using reg = __m256i;
+    static constexpr int width = 16;
+
+    template <bool is_signed>
+    static reg load(const uint8_t* p) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        return is_signed ? _mm256_cvtepi8_epi16(v) : _mm256_cvtepu8_epi16(v);
+    }
+    static reg zero() {
+        return _mm256_setzero_si256();
+    }
+    static reg sub(reg a, reg b) {
+        return _mm256_sub_epi16(a, b);
+    }
+    static reg madd_add(reg accu, reg a, reg b) {
+        return _mm256_add_epi32(accu, _mm256_madd_epi16(a, b));
+    }
+    static int32_t sum(reg a) {
+        __m128i s = _mm_add_epi32(
+                _mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+        s = _mm_hadd_epi32(s, s);
+        s = _mm_hadd_epi32(s, s);
+        return _mm_cvtsi128_si32(s);
+    }
+};
+
+#else
+
+// scalar fallback, the compiler may still vectorize the loops
+struct Int8Simd {
+    using reg = int32_t;
+    static constexpr int width = 1;
+
+    template <bool is_signed>
+    static reg load(const uint8_t* p) {
+        return is_signed ? int32_t(int8_t(*p)) : int32_t(*p);
+    }
+    static reg zero() {
+        return 0;
+    }
+    static reg sub(reg a, reg b) {
+        return a - b;
+    }
+    static reg madd_add(reg accu, reg a, reg b) {
+        return accu + a * b;
+    }
+    static int32_t sum(reg a) {
+        return a;
+    }
+};
+
+#endif
+
+template <bool is_signed>
+inline int32_t int8_component(const uint8_t* p) {
+    return is_signed ? int32_t(int8_t(*p)) : int32_t(*p);
+}
+
+/* Distances between NX vectors of x and NY vectors of y (a tile of the
+ * output matrix): each component of x and y is loaded once for the NX * NY
+ * accumulators. */
+template <bool is_signed, bool is_inner_product, int NX, int NY>
+void int8_distances_tile(
+        const uint8_t* x,
+        const uint8_t* y,
+        size_t d,
+        size_t ldd,
+        int32_t* dis) {
+    using S = Int8Simd;
+    typename S::reg accu[NX][NY];
+    for (int a = 0; a < NX; a++) {
+        for (int b = 0; b < NY; b++) {
+            accu[a][b] = S::zero();
+        }
+    }
+    size_t i = 0;
+    for (; i + S::width <= d; i += S::width) {
+        typename S::reg xi[NX], yi[NY];
+        for (int a = 0; a < NX; a++) {
+            xi[a] = S::template load<is_signed>(x + a * d + i);
+        }
+        for (int b = 0; b < NY; b++) {
+            yi[b] = S::template load<is_signed>(y + b * d + i);
+        }
+        for (int a = 0; a < NX; a++) {
+            for (int b = 0; b < NY; b++) {
+                if (is_inner_product) {
+                    accu[a][b] = S::madd_add(accu[a][b], xi[a], yi[b]);
+                } else {
+                    typename S::reg diff = S::sub(xi[a], yi[b]);
+                    accu[a][b] = S::madd_add(accu[a][b], diff, diff);
+                }
+            }
+        }
+    }
+    for (int a = 0; a < NX; a++) {
+        for (int b = 0; b < NY; b++) {
+            int32_t accu1 = S::sum(accu[a][b]);
+            // non-multiple of the SIMD width remainder
+            for (size_t i1 = i; i1 < d; i1++) {
+                int32_t xv = int8_component<is_signed>(x + a * d + i1);
+                int32_t yv = int8_component<is_signed>(y + b * d + i1);
+                accu1 += is_inner_product ? xv * yv : (xv - yv) * (xv - yv);
+            }
+            dis[a * ldd + b] = accu1;
+        }
+    }
+}
+
+template <bool is_signed, bool is_inner_product>
+void int8_distances_block_tmpl(
+        const uint8_t* x,
+        const uint8_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        int32_t* dis) {
+    constexpr int NX = 2, NY = 4;
+    size_t i = 0;
+    for (; i + NX <= nx; i += NX) {
+        size_t j = 0;
+        for (; j + NY <= ny; j += NY) {
+            int8_distances_tile<is_signed, is_inner_product, NX, NY>(
+                    x + i * d, y + j * d, d, ny, dis + i * ny + j);
+        }
+        for (; j < ny; j++) {
+            int8_distances_tile<is_signed, is_inner_product, NX, 1>(
+                    x + i * d, y + j * d, d, ny, dis + i * ny + j);
+        }
+    }
+    for (; i < nx; i++) {
+        size_t j = 0;
+        for (; j + NY <= ny; j += NY) {
+            int8_distances_tile<is_signed, is_inner_product, 1, NY>(
+                    x + i * d, y + j * d, d, ny, dis + i * ny + j);
+        }
+        for (; j < ny; j++) {
+            int8_distances_tile<is_signed, is_inner_product, 1, 1>(
+                    x + i * d, y + j * d, d, ny, dis + i * ny + j);
+        }
+    }
+}
+
+} // anonymous namespace
+
+void int8_distances_block(
+        const int8_t* x,
+        const int8_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        bool is_inner_product,
+        int32_t* dis) {
+    if (is_inner_product) {
+        int8_distances_block_tmpl<true, true>(
+                (const uint8_t*)x, (const uint8_t*)y, d, nx, ny, dis);
+    } else {
+        int8_distances_block_tmpl<true, false>(
+                (const uint8_t*)x, (const uint8_t*)y, d, nx, ny, dis);
+    }
+}
+
+void uint8_distances_block(
+        const uint8_t* x,
+        const uint8_t* y,
+        size_t d,
+        size_t nx,
+        size_t ny,
+        bool is_inner_product,
+        int32_t* dis) {
+    if (is_inner_product) {
+        int8_distances_block_tmpl<false, true>(x, y, d, nx, ny, dis);
+    } else {
+        int8_distances_block_tmpl<false, false>(x, y, d, nx, ny, dis);
+    }
+}
+
+FAISS_SIMD_NS_END
+
+#ifdef FAISS_SIMD_DISPATCH
+
+#define FAISS_DISTANCES_KERNELS(K)                                       \
+    K(float,                                                             \
+      fvec_L2sqr,                                                        \
+      fvec_L2sqr,                                                        \
+      (const float* x, const float* y, size_t d),                        \
+      (x, y, d))                                                         \
+    K(float,                                                             \
+      fvec_inner_product,                                                \
+      fvec_inner_product,                                                \
+      (const float* x, const float* y, size_t d),                        \
+      (x, y, d))                                                         \
+    K(float,                                                             \
+      fvec_L1,                                                           \
+      fvec_L1,                                                           \
+      (const float* x, const float* y, size_t d),                        \
+      (x, y, d))                                                         \
+    K(float,                                                             \
+      fvec_Linf,                                                         \
+      fvec_Linf,                                                         \
+      (const float* x, const float* y, size_t d),                        \
+      (x, y, d))                                                         \
+    K(float,                                                             \
+      fvec_norm_L2sqr,                                                   \
+      fvec_norm_L2sqr,                                                   \
+      (const float* x, size_t d),                                        \
+      (x, d))                                                            \
+    K(void,                                                              \
+      fvec_inner_product_batch_4,                                        \
+      fvec_inner_product_batch_4,                                        \
+      (const float* x,                                                   \
+       const float* y0,                                                  \
+       const float* y1,                                                  \
+       const float* y2,                                                  \
+       const float* y3,                                                  \
+       const size_t d,                                                   \
+       float& dis0,                                                      \
+       float& dis1,                                                      \
+       float& dis2,                                                      \
+       float& dis3),                                                     \
+      (x, y0, y1, y2, y3, d, dis0, dis1, dis2, dis3))                    \
+    K(void,                                                              \
+      fvec_L2sqr_batch_4,                                                \
+      fvec_L2sqr_batch_4,                                                \
+      (const float* x,                                                   \
+       const float* y0,                                                  \
+       const float* y1,                                                  \
+       const float* y2,                                                  \
+       const float* y3,                                                  \
+       const size_t d,                                                   \
+       float& dis0,                                                      \
+       float& dis1,                                                      \
+       float& dis2,                                                      \
+       float& dis3),                                                     \
+      (x, y0, y1, y2, y3, d, dis0, dis1, dis2, dis3))                    \
+    K(void,                                                              \
+      fvec_inner_products_ny,                                            \
+      fvec_inner_products_ny,                                            \
+      (float* ip, const float* x, const float* y, size_t d, size_t ny),  \
+      (ip, x, y, d, ny))                                                 \
+    K(void,                                                              \
+      fvec_L2sqr_ny,                                                     \
+      fvec_L2sqr_ny,                                                     \
+      (float* dis, const float* x, const float* y, size_t d, size_t ny), \
+      (dis, x, y, d, ny))                                                \
+    K(size_t,                                                            \
+      fvec_L2sqr_ny_nearest,                                             \
+      fvec_L2sqr_ny_nearest,                                             \
+      (float* distances_tmp_buffer,                                      \
+       const float* x,                                                   \
+       const float* y,                                                   \
+       size_t d,                                                         \
+       size_t ny),                                                       \
+      (distances_tmp_buffer, x, y, d, ny))                               \
+    K(size_t,                                                            \
+      fvec_L2sqr_ny_nearest_y_transposed,                                \
+      fvec_L2sqr_ny_nearest_y_transposed,                                \
+      (float* distances_tmp_buffer,                                      \
+       const float* x,                                                   \
+       const float* y,                                                   \
+       const float* y_sqlen,                                             \
+       size_t d,                                                         \
+       size_t d_offset,                                                  \
+       size_t ny),                                                       \
+      (distances_tmp_buffer, x, y, y_sqlen, d, d_offset, ny))            \
+    K(void,                                                              \
+      fvec_madd,                                                         \
+      fvec_madd,                                                         \
+      (size_t n, const float* a, float bf, const float* b, float* c),    \
+      (n, a, bf, b, c))                                                  \
+    K(int,                                                               \
+      fvec_madd_and_argmin,                                              \
+      fvec_madd_and_argmin,                                              \
+      (size_t n, const float* a, float bf, const float* b, float* c),    \
+      (n, a, bf, b, c))                                                  \
+    K(void,                                                              \
+      compute_PQ_dis_tables_dsub2,                                       \
+      compute_PQ_dis_tables_dsub2,                                       \
+      (size_t d,                                                         \
+       size_t ksub,                                                      \
+       const float* centroids,                                           \
+       size_t nx,                                                        \
+       const float* x,                                                   \
+       bool is_inner_product,                                            \
+       float* dis_tables),                                               \
+      (d, ksub, centroids, nx, x, is_inner_product, dis_tables))         \
+    K(void,                                                              \
+      fvec_sub,                                                          \
+      fvec_sub,                                                          \
+      (size_t d, const float* a, const float* b, float* c),              \
+      (d, a, b, c))                                                      \
+    K(void,                                                              \
+      fvec_add,                                                          \
+      fvec_add,                                                          \
+      (size_t d, const float* a, const float* b, float* c),              \
+      (d, a, b, c))                                                      \
+    K(void,                                                              \
+      fvec_add,                                                          \
+      fvec_add_scalar,                                                   \
+      (size_t d, const float* a, float b, float* c),                     \
+      (d, a, b, c))                                                      \
+    K(void,                                                              \
+      int8_distances_block,                                              \
+      int8_distances_block,                                              \
+      (const int8_t* x,                                                  \
+       const int8_t* y,                                                  \
+       size_t d,                                                         \
+       size_t nx,                                                        \
+       size_t ny,                                                        \
+       bool is_inner_product,                                            \
+       int32_t* dis),                                                    \
+      (x, y, d, nx, ny, is_inner_product, dis))                          \
+    K(void,                                                              \
+      uint8_distances_block,                                             \
+      uint8_distances_block,                                             \
+      (const uint8_t* x,                                                 \
+       const uint8_t* y,                                                 \
+       size_t d,                                                         \
+       size_t nx,                                                        \
+       size_t ny,                                                        \
+       bool is_inner_product,                                            \
+       int32_t* dis),                                                    \
+      (x, y, d, nx, ny, is_inner_product, dis))
+
+FAISS_SIMD_DISPATCH_TABLE(FAISS_DISTANCES_KERNELS)
+
+#endif
+
 } // namespace faiss
@@ -35,12 +35,15 @@
 #include <faiss/impl/AuxIndexStructures.h>
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/utils/Heap.h>
+#include <faiss/utils/simd_levels.h>
 #include <faiss/utils/utils.h>
 
 static const size_t BLOCKSIZE_QUERY = 8192;
 
 namespace faiss {
 
+#ifdef FAISS_SIMD_MAIN
+
 size_t hamming_batch_size = 65536;
 
 const uint8_t hamdis_tab_ham_bytes[256] = {
@@ -56,6 +59,10 @@ const uint8_t hamdis_tab_ham_bytes[256] = {
         4, 5, 5, 6, 5, 6, 6, 7, 3, 4, 4, 5, 4, 5, 5, 6, 4, 5, 5, 6, 5, 6, 6, 7,
         4, 5, 5, 6, 5, 6, 6, 7, 5, 6, 6, 7, 6, 7, 7, 8};
 
+#endif
+
+FAISS_SIMD_NS_BEGIN
+
 template <size_t nbits>
 void hammings(
         const uint64_t* bs1,
@@ -309,6 +316,11 @@ static void hammings_knn_hc_1(
     }
 }
 
+FAISS_SIMD_NS_END
+
+// the bit vector functions do not depend on the SIMD level
+#ifdef FAISS_SIMD_MAIN
+
 /* Functions to maps vectors to bits. Assume proper allocation done beforehand,
    meaning that b should be be able to receive as many bits as x may produce. */
 
@@ -400,6 +412,10 @@ void bitvec_shuffle(
     }
 }
 
+#endif
+
+FAISS_SIMD_NS_BEGIN
+
 /*----------------------------------------*/
 /* Hamming distance computation and k-nn  */
 
@@ -416,19 +432,19 @@ void hammings(
     FAISS_THROW_IF_NOT(ncodes % 8 == 0);
     switch (ncodes) {
         case 8:
-            faiss::hammings<64>(C64(a), C64(b), na, nb, dis);
+            hammings<64>(C64(a), C64(b), na, nb, dis);
             return;
         case 16:
-            faiss::hammings<128>(C64(a), C64(b), na, nb, dis);
+            hammings<128>(C64(a), C64(b), na, nb, dis);
             return;
         case 32:
-            faiss::hammings<256>(C64(a), C64(b), na, nb, dis);
+            hammings<256>(C64(a), C64(b), na, nb, dis);
             return;
         case 64:
-            faiss::hammings<512>(C64(a), C64(b), na, nb, dis);
+            hammings<512>(C64(a), C64(b), na, nb, dis);
             return;
         default:
-            faiss::hammings(C64(a), C64(b), na, nb, ncodes * 8, dis);
+            hammings(C64(a), C64(b), na, nb, ncodes * 8, dis);
             return;
     }
 }
@@ -582,20 +598,16 @@ void hamming_count_thres(
         size_t* nptr) {
     switch (ncodes) {
         case 8:
-            faiss::hamming_count_thres<64>(
-                    C64(bs1), C64(bs2), n1, n2, ht, nptr);
+            hamming_count_thres<64>(C64(bs1), C64(bs2), n1, n2, ht, nptr);
             return;
         case 16:
-            faiss::hamming_count_thres<128>(
-                    C64(bs1), C64(bs2), n1, n2, ht, nptr);
+            hamming_count_thres<128>(C64(bs1), C64(bs2), n1, n2, ht, nptr);
             return;
         case 32:
-            faiss::hamming_count_thres<256>(
-                    C64(bs1), C64(bs2), n1, n2, ht, nptr);
+            hamming_count_thres<256>(C64(bs1), C64(bs2), n1, n2, ht, nptr);
             return;
         case 64:
-            faiss::hamming_count_thres<512>(
-                    C64(bs1), C64(bs2), n1, n2, ht, nptr);
+            hamming_count_thres<512>(C64(bs1), C64(bs2), n1, n2, ht, nptr);
             return;
         default:
             FAISS_THROW_FMT("not implemented for %zu bits", ncodes);
@@ -611,16 +623,16 @@ void crosshamming_count_thres(
         size_t* nptr) {
     switch (ncodes) {
         case 8:
-            faiss::crosshamming_count_thres<64>(C64(dbs), n, ht, nptr);
+            crosshamming_count_thres<64>(C64(dbs), n, ht, nptr);
             return;
         case 16:
-            faiss::crosshamming_count_thres<128>(C64(dbs), n, ht, nptr);
+            crosshamming_count_thres<128>(C64(dbs), n, ht, nptr);
             return;
         case 32:
-            faiss::crosshamming_count_thres<256>(C64(dbs), n, ht, nptr);
+            crosshamming_count_thres<256>(C64(dbs), n, ht, nptr);
             return;
         case 64:
-            faiss::crosshamming_count_thres<512>(C64(dbs), n, ht, nptr);
+            crosshamming_count_thres<512>(C64(dbs), n, ht, nptr);
             return;
         default:
             FAISS_THROW_FMT("not implemented for %zu bits", ncodes);
@@ -639,16 +651,16 @@ size_t match_hamming_thres(
         hamdis_t* dis) {
     switch (ncodes) {
         case 8:
-            return faiss::match_hamming_thres<64>(
+            return match_hamming_thres<64>(
                     C64(bs1), C64(bs2), n1, n2, ht, idx, dis);
         case 16:
-            return faiss::match_hamming_thres<128>(
+            return match_hamming_thres<128>(
                     C64(bs1), C64(bs2), n1, n2, ht, idx, dis);
         case 32:
-            return faiss::match_hamming_thres<256>(
+            return match_hamming_thres<256>(
                     C64(bs1), C64(bs2), n1, n2, ht, idx, dis);
         case 64:
-            return faiss::match_hamming_thres<512>(
+            return match_hamming_thres<512>(
                     C64(bs1), C64(bs2), n1, n2, ht, idx, dis);
         default:
             FAISS_THROW_FMT("not implemented for %zu bits", ncodes);
@@ -727,4 +739,109 @@ void generalized_hammings_knn_hc(
         ha->reorder();
 }
 
+FAISS_SIMD_NS_END
+
+#ifdef FAISS_SIMD_DISPATCH
+
+#define FAISS_HAMMING_KERNELS(K)                    \
+    K(void,                                         \
+      hammings,                                     \
+      hammings,                                     \
+      (const uint8_t* a,                            \
+       const uint8_t* b,                            \
+       size_t na,                                   \
+       size_t nb,                                   \
+       size_t ncodes,                               \
+       hamdis_t* dis),                              \
+      (a, b, na, nb, ncodes, dis))                  \
+    K(void,                                         \
+      hammings_knn,                                 \
+      hammings_knn,                                 \
+      (int_maxheap_array_t* ha,                     \
+       const uint8_t* a,                            \
+       const uint8_t* b,                            \
+       size_t nb,                                   \
+       size_t ncodes,                               \
+       int ordered),                                \
+      (ha, a, b, nb, ncodes, ordered))              \
+    K(void,                                         \
+      hammings_knn_hc,                              \
+      hammings_knn_hc,                              \
+      (int_maxheap_array_t* ha,                     \
+       const uint8_t* a,                            \
+       const uint8_t* b,                            \
+       size_t nb,                                   \
+       size_t ncodes,                               \
+       int ordered),                                \
+      (ha, a, b, nb, ncodes, ordered))              \
+    K(void,                                         \
+      hammings_knn_mc,                              \
+      hammings_knn_mc,                              \
+      (const uint8_t* a,                            \
+       const uint8_t* b,                            \
+       size_t na,                                   \
+       size_t nb,                                   \
+       size_t k,                                    \
+       size_t ncodes,                               \
+       int32_t* distances,                          \
+       int64_t* labels),                            \
+      (a, b, na, nb, k, ncodes, distances, labels)) \
+    K(void,                                         \
+      hamming_range_search,                         \
+      hamming_range_search,                         \
+      (const uint8_t* a,                            \
+       const uint8_t* b,                            \
+       size_t na,                                   \
+       size_t nb,                                   \
+       int radius,                                  \
+       size_t ncodes,                               \
+       RangeSearchResult* result),                  \
+      (a, b, na, nb, radius, ncodes, result))       \
+    K(void,                                         \
+      hamming_count_thres,                          \
+      hamming_count_thres,                          \
+      (const uint8_t* bs1,                          \
+       const uint8_t* bs2,                          \
+       size_t n1,                                   \
+       size_t n2,                                   \
+       hamdis_t ht,                                 \
+       size_t ncodes,                               \
+       size_t* nptr),                               \
+      (bs1, bs2, n1, n2, ht, ncodes, nptr))         \
+    K(size_t,                                       \
+      match_hamming_thres,                          \
+      match_hamming_thres,                          \
+      (const uint8_t* bs1,                          \
+       const uint8_t* bs2,                          \
+       size_t n1,                                   \
+       size_t n2,                                   \
+       hamdis_t ht,                                 \
+       size_t ncodes,                               \
+       int64_t* idx,                                \
+       hamdis_t* dis),                              \
+      (bs1, bs2, n1, n2, ht, ncodes, idx, dis))     \
+    K(void,                                         \
+      crosshamming_count_thres,                     \
+      crosshamming_count_thres,                     \
+      (const uint8_t* dbs,                          \
+       size_t n,                                    \
+       hamdis_t ht,                                 \
+       size_t ncodes,                               \
+       size_t* nptr),                               \
+      (dbs, n, ht, ncodes, nptr))                   \
+    K(void,                                         \
+      generalized_hammings_knn_hc,                  \
+      generalized_hammings_knn_hc,                  \
+      (int_maxheap_array_t* ha,                     \
+       const uint8_t* a,                            \
+       const uint8_t* b,                            \
+       size_t nb,                                   \
+       size_t code_size,                            \
+       int ordered),                                \
+      (ha, a, b, nb, code_size, ordered))
+
+FAISS_SIMD_DISPATCH_TABLE(FAISS_HAMMING_KERNELS)
+
+#endif
+
 } // namespace faiss
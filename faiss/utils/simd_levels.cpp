@@ -0,0 +1,119 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#include <faiss/utils/simd_levels.h>
+
+#include <cstdlib>
+#include <string>
+
+#include <faiss/impl/FaissAssert.h>
+
+namespace faiss {
+
+SIMDLevel detect_simd_level() {
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+    // the checks include the OS support of the AVX and AVX-512 registers.
+    // All the CPUs with AVX2 also have F16C and POPCNT.
+    __builtin_cpu_init();
+    bool avx2 = __builtin_cpu_supports("avx2") &&
+            __builtin_cpu_supports("fma") && __builtin_cpu_supports("popcnt");
+    if (avx2 && __builtin_cpu_supports("avx512f") &&
+        __builtin_cpu_supports("avx512cd") &&
+        __builtin_cpu_supports("avx512vl") &&
+        __builtin_cpu_supports("avx512dq") &&
+        __builtin_cpu_supports("avx512bw")) {
+        return SIMDLevel::AVX512;
+    }
+    if (avx2) {
+        return SIMDLevel::AVX2;
+    }
+#endif
+    return SIMDLevel::NONE;
+}
+
+namespace {
+
+#ifndef FAISS_DYNAMIC_DISPATCH
+// level of the kernels compiled in the faiss:: namespace
+SIMDLevel compiled_simd_level() {
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+    return SIMDLevel::AVX512;
+#elif defined(__AVX2__)
+    return SIMDLevel::AVX2;
+#else
+    return SIMDLevel::NONE;
+#endif
+}
+#endif
+
+SIMDLevel initial_simd_level() {
+#ifdef FAISS_DYNAMIC_DISPATCH
+    SIMDLevel level = detect_simd_level();
+    const char* env = getenv("FAISS_DISABLE_CPU_FEATURES");
+    if (env) {
+        std::string features(env);
+        size_t i0 = 0;
+        while (i0 < features.size()) {
+            size_t i1 = features.find_first_of(", \t\n\r", i0);
+            if (i1 == std::string::npos) {
+                i1 = features.size();
+            }
+            std::string f = features.substr(i0, i1 - i0);
+            if (f == "AVX2") {
+                level = SIMDLevel::NONE;
+            } else if (f == "AVX512_SKX" && level == SIMDLevel::AVX512) {
+                level = SIMDLevel::AVX2;
+            }
+            i0 = i1 + 1;
+        }
+    }
+    return level;
+#else
+    return compiled_simd_level();
+#endif
+}
+
+} // namespace
+
+// zero-initialized (NONE) until the dynamic initialization
+SIMDLevel dispatched_simd_level = initial_simd_level();
+
+SIMDLevel get_simd_level() {
+    return dispatched_simd_level;
+}
+
+bool simd_level_supported(SIMDLevel level) {
+#ifdef FAISS_DYNAMIC_DISPATCH
+    return int(level) <= int(detect_simd_level());
+#else
+    return level == compiled_simd_level();
+#endif
+}
+
+void set_simd_level(SIMDLevel level) {
+    FAISS_THROW_IF_NOT_FMT(
+            simd_level_supported(level),
+            "SIMD level %s not supported",
+            simd_level_name(level));
+    dispatched_simd_level = level;
+}
+
+const char* simd_level_name(SIMDLevel level) {
+    switch (level) {
+        case SIMDLevel::NONE:
+            return "GENERIC";
+        case SIMDLevel::AVX2:
+            return "AVX2";
+        case SIMDLevel::AVX512:
+            return "AVX512";
+    }
+    FAISS_THROW_MSG("invalid SIMD level");
+}
+
+} // namespace faiss
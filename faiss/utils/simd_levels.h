@@ -0,0 +1,156 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// -*- c++ -*-
+
+#pragma once
+
+#include <faiss/impl/platform_macros.h>
+
+/** Runtime selection of the SIMD kernels
+ *
+ * With FAISS_OPT_LEVEL=dd ("dynamic dispatch"), the files that contain the
+ * SIMD kernels (distances_simd.cpp, hamming.cpp, ScalarQuantizer.cpp and the
+ * pq4 fast-scan search) are compiled once per SIMD level, with the
+ * corresponding compiler flags. Each compilation puts its kernels in a
+ * namespace faiss::generic, faiss::avx2 or faiss::avx512 (the FAISS_SIMD_NS
+ * macro). The generic compilation also defines the faiss:: entry points,
+ * that forward the calls to the kernels of the level detected when the
+ * library is loaded.
+ *
+ * With the other opt levels, FAISS_SIMD_NS is not defined, the macros below
+ * are no-ops and the kernels are the faiss:: functions themselves.
+ */
+
+namespace faiss {
+
+/// 0 (NONE) is the level used before the detection has run
+enum class SIMDLevel {
+    NONE = 0, ///< no SIMD or the SSE level of the compiler default flags
+    AVX2 = 1, ///< AVX2 + FMA + F16C + POPCNT
+    AVX512 = 2, ///< AVX2 + AVX512 F, CD, VL, DQ and BW
+};
+
+/// highest level supported by the CPU and the OS
+SIMDLevel detect_simd_level();
+
+/// level of the kernels used by the library
+SIMDLevel get_simd_level();
+
+/** set the level of the kernels used by the library. The level must be
+ * supported by the CPU and compiled in the library (any level up to the
+ * detected one with FAISS_OPT_LEVEL=dd, only the compiled level otherwise).
+ * Not thread-safe: should be called before running searches.
+ */
+void set_simd_level(SIMDLevel level);
+
+/// is it possible to set_simd_level(level)
+bool simd_level_supported(SIMDLevel level);
+
+/// "GENERIC", "AVX2" or "AVX512"
+const char* simd_level_name(SIMDLevel level);
+
+/** level used by the dispatched kernels. It is set when the library is
+ * loaded to the detected level, capped by the FAISS_DISABLE_CPU_FEATURES
+ * environment variable (same syntax as in the python loader, eg.
+ * "AVX512_SKX" to disable the AVX-512 kernels, "AVX2" to disable both).
+ */
+FAISS_API extern SIMDLevel dispatched_simd_level;
+
+} // namespace faiss
+
+#ifdef FAISS_SIMD_NS
+
+#define FAISS_SIMD_NS_BEGIN namespace FAISS_SIMD_NS {
+#define FAISS_SIMD_NS_END }
+
+// The header-only SIMD types are compiled differently at each level, they
+// get a per-level inline namespace to avoid ODR violations between the
+// compilations.
+#define FAISS_SIMD_CAT_(a, b) a##b
+#define FAISS_SIMD_CAT(a, b) FAISS_SIMD_CAT_(a, b)
+#define FAISS_SIMDLIB_NS_BEGIN \
+    inline namespace FAISS_SIMD_CAT(simdlib_, FAISS_SIMD_NS) {
+#define FAISS_SIMDLIB_NS_END }
+
+// FAISS_SIMD_MAIN is set (by the build system) for the compilation that
+// contains the code that does not depend on the SIMD level, including the
+// dispatching functions
+#ifdef FAISS_SIMD_MAIN
+#define FAISS_SIMD_DISPATCH
+#endif
+
+/// call f in the namespace of the current SIMD level (from faiss::)
+#define FAISS_SIMD_DISPATCH_CALL(f, args)     \
+    switch (::faiss::dispatched_simd_level) { \
+        case ::faiss::SIMDLevel::AVX512:      \
+            return avx512::f args;            \
+        case ::faiss::SIMDLevel::AVX2:        \
+            return avx2::f args;              \
+        default:                              \
+            return generic::f args;           \
+    }
+
+/* Dispatch table of the non-template kernels of a file. The kernels are
+ * listed with an X-macro LIST(K) that expands to
+ *
+ *     K(return_type, name, field, (parameters), (arguments))
+ *
+ * for each kernel, where field is a unique identifier (the names may be
+ * overloaded). FAISS_SIMD_DISPATCH_TABLE(LIST) declares the kernels of each
+ * level, builds the table of function pointers and defines the faiss::
+ * functions that call the entry of the current level. It must be used in
+ * namespace faiss, once per file.
+ */
+
+#define FAISS_SIMD_KERNEL_DECLARE(ret, name, field, params, args) \
+    ret name params;
+#define FAISS_SIMD_KERNEL_FIELD(ret, name, field, params, args) \
+    ret(*field) params;
+#define FAISS_SIMD_KERNEL_generic(ret, name, field, params, args) \
+    &generic::name,
+#define FAISS_SIMD_KERNEL_avx2(ret, name, field, params, args) &avx2::name,
+#define FAISS_SIMD_KERNEL_avx512(ret, name, field, params, args) \
+    &avx512::name,
+#define FAISS_SIMD_KERNEL_DISPATCH(ret, name, field, params, args)  \
+    ret name params {                                               \
+        return simd_kernels[int(dispatched_simd_level)].field args; \
+    }
+
+#define FAISS_SIMD_DISPATCH_TABLE(LIST)        \
+    namespace generic {                        \
+    LIST(FAISS_SIMD_KERNEL_DECLARE)            \
+    }                                          \
+    namespace avx2 {                           \
+    LIST(FAISS_SIMD_KERNEL_DECLARE)            \
+    }                                          \
+    namespace avx512 {                         \
+    LIST(FAISS_SIMD_KERNEL_DECLARE)            \
+    }                                          \
+    namespace {                                \
+    struct SIMDKernels {                       \
+        LIST(FAISS_SIMD_KERNEL_FIELD)          \
+    };                                         \
+    /* indexed by SIMDLevel */                 \
+    const SIMDKernels simd_kernels[3] = {      \
+            {LIST(FAISS_SIMD_KERNEL_generic)}, \
+            {LIST(FAISS_SIMD_KERNEL_avx2)},    \
+            {LIST(FAISS_SIMD_KERNEL_avx512)}}; \
+    }                                          \
+    LIST(FAISS_SIMD_KERNEL_DISPATCH)
+
+#else
+
+#define FAISS_SIMD_NS_BEGIN
+#define FAISS_SIMD_NS_END
+#define FAISS_SIMDLIB_NS_BEGIN
+#define FAISS_SIMDLIB_NS_END
+
+// there is a single compilation that contains everything
+#define FAISS_SIMD_MAIN
+
+#endif
@@ -12,9 +12,17 @@
  * The objective is to separate the different interpretations of the same
  * registers (as a vector of uint8, uint16 or uint32), to provide printing
  * functions.
+ *
+ * When compiled with AVX-512 support, the 512-bit types (simd32uint16,
+ * simd64uint8) are available in addition to the 256-bit ones.
  */
 
-#ifdef __AVX2__
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+
+#include <faiss/utils/simdlib_avx2.h>
+#include <faiss/utils/simdlib_avx512.h>
+
+#elif defined(__AVX2__)
 
 #include <faiss/utils/simdlib_avx2.h>
 
@@ -28,6 +36,5 @@
 #include <faiss/utils/simdlib_emulated.h>
 
 // FIXME: make a SSE version
-// is this ever going to happen? We will probably rather implement AVX512
 
 #endif
@@ -13,9 +13,12 @@
 #include <immintrin.h>
 
 #include <faiss/impl/platform_macros.h>
+#include <faiss/utils/simd_levels.h>
 
 namespace faiss {
 
+FAISS_SIMDLIB_NS_BEGIN
+
 /** Simple wrapper around the AVX 256-bit registers
  *
  * The objective is to separate the different interpretations of the same
@@ -562,4 +565,6 @@ inline simd8float32 gethigh128(simd8float32 a, simd8float32 b) {
 
 } // namespace
 
+FAISS_SIMDLIB_NS_END
+
 } // namespace faiss
@@ -0,0 +1,328 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include <immintrin.h>
+
+#include <faiss/impl/platform_macros.h>
+#include <faiss/utils/simd_levels.h>
+
+#include <faiss/utils/simdlib_avx2.h>
+
+namespace faiss {
+
+FAISS_SIMDLIB_NS_BEGIN
+
+/** Simple wrapper around the AVX-512 512-bit registers
+ *
+ * The types and functions follow the 256-bit ones of simdlib_avx2.h, with
+ * twice as many elements per register. They are used by the kernels that
+ * process 4 128-bit lanes at once (eg. 4 sub-quantizers of the PQ4 fast-scan
+ * codes). Only the functions that are needed are implemented. Requires
+ * AVX512F and AVX512BW.
+ */
+
+/// 512-bit representation without interpretation as a vector
+struct simd512bit {
+    union {
+        __m512i i;
+        __m512 f;
+    };
+
+    simd512bit() {}
+
+    explicit simd512bit(__m512i i) : i(i) {}
+
+    explicit simd512bit(__m512 f) : f(f) {}
+
+    explicit simd512bit(const void* x)
+            : i(_mm512_loadu_si512((__m512i const*)x)) {}
+
+    // the lower half is lo, the upper half is hi
+    explicit simd512bit(simd256bit lo, simd256bit hi)
+            : i(_mm512_inserti64x4(_mm512_castsi256_si512(lo.i), hi.i, 1)) {}
+
+    void clear() {
+        i = _mm512_setzero_si512();
+    }
+
+    void storeu(void* ptr) const {
+        _mm512_storeu_si512((__m512i*)ptr, i);
+    }
+
+    void loadu(const void* ptr) {
+        i = _mm512_loadu_si512((__m512i*)ptr);
+    }
+
+    void store(void* ptr) const {
+        _mm512_store_si512((__m512i*)ptr, i);
+    }
+
+    simd256bit lo() const {
+        return simd256bit(_mm512_castsi512_si256(i));
+    }
+
+    simd256bit hi() const {
+        return simd256bit(_mm512_extracti64x4_epi64(i, 1));
+    }
+
+    void bin(char bits[513]) const {
+        char bytes[64];
+        storeu((void*)bytes);
+        for (int i = 0; i < 512; i++) {
+            bits[i] = '0' + ((bytes[i / 8] >> (i % 8)) & 1);
+        }
+        bits[512] = 0;
+    }
+
+    std::string bin() const {
+        char bits[513];
+        bin(bits);
+        return std::string(bits);
+    }
+};
+
+/// vector of 32 elements in uint16
+struct simd32uint16 : simd512bit {
+    simd32uint16() {}
+
+    explicit simd32uint16(__m512i i) : simd512bit(i) {}
+
+    explicit simd32uint16(int x) : simd512bit(_mm512_set1_epi16(x)) {}
+
+    explicit simd32uint16(uint16_t x) : simd512bit(_mm512_set1_epi16(x)) {}
+
+    explicit simd32uint16(simd512bit x) : simd512bit(x) {}
+
+    explicit simd32uint16(const uint16_t* x) : simd512bit((const void*)x) {}
+
+    // elements 0..15 from lo and 16..31 from hi
+    explicit simd32uint16(simd16uint16 lo, simd16uint16 hi)
+            : simd512bit(lo, hi) {}
+
+    std::string elements_to_string(const char* fmt) const {
+        uint16_t bytes[32];
+        storeu((void*)bytes);
+        char res[2000];
+        char* ptr = res;
+        for (int i = 0; i < 32; i++) {
+            ptr += sprintf(ptr, fmt, bytes[i]);
+        }
+        // strip last ,
+        ptr[-1] = 0;
+        return std::string(res);
+    }
+
+    std::string hex() const {
+        return elements_to_string("%02x,");
+    }
+
+    std::string dec() const {
+        return elements_to_string("%3d,");
+    }
+
+    void set1(uint16_t x) {
+        i = _mm512_set1_epi16((short)x);
+    }
+
+    simd32uint16 operator*(const simd32uint16& other) const {
+        return simd32uint16(_mm512_mullo_epi16(i, other.i));
+    }
+
+    // shift must be known at compile time
+    simd32uint16 operator>>(const int shift) const {
+        return simd32uint16(_mm512_srli_epi16(i, shift));
+    }
+
+    // shift must be known at compile time
+    simd32uint16 operator<<(const int shift) const {
+        return simd32uint16(_mm512_slli_epi16(i, shift));
+    }
+
+    simd32uint16 operator+=(simd32uint16 other) {
+        i = _mm512_add_epi16(i, other.i);
+        return *this;
+    }
+
+    simd32uint16 operator-=(simd32uint16 other) {
+        i = _mm512_sub_epi16(i, other.i);
+        return *this;
+    }
+
+    simd32uint16 operator+(simd32uint16 other) const {
+        return simd32uint16(_mm512_add_epi16(i, other.i));
+    }
+
+    simd32uint16 operator-(simd32uint16 other) const {
+        return simd32uint16(_mm512_sub_epi16(i, other.i));
+    }
+
+    simd32uint16 operator&(simd512bit other) const {
+        return simd32uint16(_mm512_and_si512(i, other.i));
+    }
+
+    simd32uint16 operator|(simd512bit other) const {
+        return simd32uint16(_mm512_or_si512(i, other.i));
+    }
+
+    simd32uint16 operator~() const {
+        return simd32uint16(_mm512_xor_si512(i, _mm512_set1_epi32(-1)));
+    }
+
+    simd16uint16 low() const {
+        return simd16uint16(lo());
+    }
+
+    simd16uint16 high() const {
+        return simd16uint16(hi());
+    }
+
+    // get scalar at index 0
+    uint16_t get_scalar_0() const {
+        return _mm_extract_epi16(_mm512_castsi512_si128(i), 0);
+    }
+
+    // mask of elements where this >= thresh
+    // 1 bit per component: 32 * 1 = 32 bit
+    uint32_t ge_mask(simd32uint16 thresh) const {
+        return _mm512_cmpge_epu16_mask(i, thresh.i);
+    }
+
+    uint32_t le_mask(simd32uint16 thresh) const {
+        return _mm512_cmple_epu16_mask(i, thresh.i);
+    }
+
+    uint32_t gt_mask(simd32uint16 thresh) const {
+        return _mm512_cmpgt_epu16_mask(i, thresh.i);
+    }
+
+    bool all_gt(simd32uint16 thresh) const {
+        return le_mask(thresh) == 0;
+    }
+
+    // for debugging only
+    uint16_t operator[](int i) const {
+        ALIGNED(64) uint16_t tab[32];
+        store(tab);
+        return tab[i];
+    }
+
+    void accu_min(simd32uint16 incoming) {
+        i = _mm512_min_epu16(i, incoming.i);
+    }
+
+    void accu_max(simd32uint16 incoming) {
+        i = _mm512_max_epu16(i, incoming.i);
+    }
+};
+
+// not really a std::min because it returns an elementwise min
+inline simd32uint16 min(simd32uint16 a, simd32uint16 b) {
+    return simd32uint16(_mm512_min_epu16(a.i, b.i));
+}
+
+inline simd32uint16 max(simd32uint16 a, simd32uint16 b) {
+    return simd32uint16(_mm512_max_epu16(a.i, b.i));
+}
+
+// compare d to thr, return 32 bits corresponding to the elements of d, in
+// the same order as cmp_ge32(d0, d1, thr) for d = (d0, d1)
+inline uint32_t cmp_ge32(simd32uint16 d, simd32uint16 thr) {
+    return d.ge_mask(thr);
+}
+
+inline uint32_t cmp_le32(simd32uint16 d, simd32uint16 thr) {
+    return d.le_mask(thr);
+}
+
+// vector of 64 unsigned 8-bit integers
+struct simd64uint8 : simd512bit {
+    simd64uint8() {}
+
+    explicit simd64uint8(__m512i i) : simd512bit(i) {}
+
+    explicit simd64uint8(int x) : simd512bit(_mm512_set1_epi8(x)) {}
+
+    explicit simd64uint8(uint8_t x) : simd512bit(_mm512_set1_epi8(x)) {}
+
+    explicit simd64uint8(simd512bit x) : simd512bit(x) {}
+
+    explicit simd64uint8(const uint8_t* x) : simd512bit((const void*)x) {}
+
+    // bytes 0..31 from lo and 32..63 from hi
+    explicit simd64uint8(simd32uint8 lo, simd32uint8 hi)
+            : simd512bit(lo, hi) {}
+
+    std::string elements_to_string(const char* fmt) const {
+        uint8_t bytes[64];
+        storeu((void*)bytes);
+        char res[2000];
+        char* ptr = res;
+        for (int i = 0; i < 64; i++) {
+            ptr += sprintf(ptr, fmt, bytes[i]);
+        }
+        // strip last ,
+        ptr[-1] = 0;
+        return std::string(res);
+    }
+
+    std::string hex() const {
+        return elements_to_string("%02x,");
+    }
+
+    std::string dec() const {
+        return elements_to_string("%3d,");
+    }
+
+    void set1(uint8_t x) {
+        i = _mm512_set1_epi8((char)x);
+    }
+
+    simd64uint8 operator&(simd512bit other) const {
+        return simd64uint8(_mm512_and_si512(i, other.i));
+    }
+
+    simd64uint8 operator+(simd64uint8 other) const {
+        return simd64uint8(_mm512_add_epi8(i, other.i));
+    }
+
+    // 4 independent 16-entry tables, one per 128-bit lane
+    simd64uint8 lookup_4_lanes(simd64uint8 idx) const {
+        return simd64uint8(_mm512_shuffle_epi8(i, idx.i));
+    }
+
+    // extract + 0-extend the lower half
+    simd32uint16 lane0_as_uint16() const {
+        return simd32uint16(_mm512_cvtepu8_epi16(_mm512_castsi512_si256(i)));
+    }
+
+    // extract + 0-extend the upper half
+    simd32uint16 lane1_as_uint16() const {
+        return simd32uint16(
+                _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(i, 1)));
+    }
+
+    simd64uint8 operator+=(simd64uint8 other) {
+        i = _mm512_add_epi8(i, other.i);
+        return *this;
+    }
+
+    // for debugging only
+    uint8_t operator[](int i) const {
+        ALIGNED(64) uint8_t tab[64];
+        store(tab);
+        return tab[i];
+    }
+};
+
+FAISS_SIMDLIB_NS_END
+
+} // namespace faiss
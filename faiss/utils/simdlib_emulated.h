@@ -12,8 +12,12 @@
 #include <cstring>
 #include <string>
 
+#include <faiss/utils/simd_levels.h>
+
 namespace faiss {
 
+FAISS_SIMDLIB_NS_BEGIN
+
 struct simd256bit {
     union {
         uint8_t u8[32];
@@ -779,4 +783,6 @@ inline void cmplt_and_blend_inplace(
 
 } // namespace
 
+FAISS_SIMDLIB_NS_END
+
 } // namespace faiss
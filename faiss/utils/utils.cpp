@@ -34,6 +34,7 @@
 #include <faiss/impl/FaissAssert.h>
 #include <faiss/impl/platform_macros.h>
 #include <faiss/utils/random.h>
+#include <faiss/utils/simd_levels.h>
 
 #ifndef FINTEGER
 #define FINTEGER long
@@ -109,7 +110,13 @@ std::string get_compile_options() {
     options += "OPTIMIZE ";
 #endif
 
-#ifdef __AVX2__
+#ifdef FAISS_DYNAMIC_DISPATCH
+    // the SIMD kernels are selected at runtime
+    options += "DD ";
+    options += simd_level_name(get_simd_level());
+#elif defined(__AVX512F__)
+    options += "AVX512";
+#elif defined(__AVX2__)
     options += "AVX2";
 #elif defined(__aarch64__)
     options += "NEON";
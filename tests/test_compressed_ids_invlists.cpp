@@ -0,0 +1,158 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IVFlib.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/impl/io.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/invlists/CompressedIdsInvertedLists.h>
+#include <faiss/utils/random.h>
+
+#include "test_util.h"
+
+using namespace faiss;
+
+TEST(CompressedIds, add_update_resize) {
+    size_t nlist = 5, code_size = 3;
+    ArrayInvertedLists ref(nlist, code_size);
+    CompressedIdsInvertedLists cil(nlist, code_size);
+
+    std::mt19937 rng(123);
+    std::uniform_int_distribution<int> list_dist(0, nlist - 1);
+    std::vector<uint8_t> code(code_size * 100);
+    std::vector<idx_t> ids(100);
+
+    for (int iter = 0; iter < 200; iter++) {
+        size_t list_no = list_dist(rng);
+        size_t n = rng() % 100;
+        for (size_t j = 0; j < n; j++) {
+            // mostly increasing ids, with some large and negative ones
+            switch (rng() % 10) {
+                case 0:
+                    ids[j] = -1 - idx_t(rng() % 1000);
+                    break;
+                case 1:
+                    ids[j] = idx_t(rng()) << 30;
+                    break;
+                default:
+                    ids[j] = iter * 100 + j;
+            }
+        }
+        for (size_t j = 0; j < n * code_size; j++) {
+            code[j] = rng();
+        }
+        size_t ls = ref.list_size(list_no);
+        switch (iter % 4) {
+            case 0:
+            case 1:
+                EXPECT_EQ(
+                        cil.add_entries(list_no, n, ids.data(), code.data()),
+                        ref.add_entries(list_no, n, ids.data(), code.data()));
+                break;
+            case 2:
+                if (ls > 0) {
+                    size_t offset = rng() % ls;
+                    n = std::min(n, ls - offset);
+                    cil.update_entries(
+                            list_no, offset, n, ids.data(), code.data());
+                    ref.update_entries(
+                            list_no, offset, n, ids.data(), code.data());
+                }
+                break;
+            case 3:
+                ls = ls > 0 ? rng() % ls : 0;
+                cil.resize(list_no, ls);
+                ref.resize(list_no, ls);
+                break;
+        }
+    }
+    check_same_invlists(ref, cil);
+
+    // conversion
+    CompressedIdsInvertedLists cil2(ref);
+    check_same_invlists(ref, cil2);
+}
+
+TEST(CompressedIds, ivfpq_search) {
+    int d = 32, nt = 2000, nb = 5000, nq = 100, k = 10;
+    std::unique_ptr<Index> index(index_factory(d, "IVF32,PQ8x4"));
+    std::vector<float> xt(d * nt), xb(d * nb), xq(d * nq);
+    float_rand(xt.data(), xt.size(), 123);
+    float_rand(xb.data(), xb.size(), 456);
+    float_rand(xq.data(), xq.size(), 789);
+    index->train(nt, xt.data());
+    index->add(nb, xb.data());
+    IndexIVF* ivf = ivflib::extract_index_ivf(index.get());
+    ivf->nprobe = 4;
+
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<idx_t> Iref(nq * k), I(nq * k);
+    index->search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    auto cil = new CompressedIdsInvertedLists(*ivf->invlists);
+    check_same_invlists(*ivf->invlists, *cil);
+    ivf->replace_invlists(cil, true);
+
+    // the ids take much less than 8 bytes
+    EXPECT_LT(cil->ids_nbytes(), nb * sizeof(idx_t) / 4);
+
+    for (int pmode : {0, 1, 4}) {
+        ivf->parallel_mode = pmode;
+        index->search(nq, xq.data(), k, D.data(), I.data());
+        EXPECT_EQ(Iref, I);
+        for (int i = 0; i < nq * k; i++) {
+            EXPECT_NEAR(Dref[i], D[i], 1e-5);
+        }
+    }
+    ivf->parallel_mode = 0;
+
+    // with a selector, the ids are decoded with the list
+    {
+        IDSelectorRange sel(0, nb / 2);
+        SearchParametersIVF params;
+        params.nprobe = 4;
+        params.sel = &sel;
+        index->search(nq, xq.data(), k, D.data(), I.data(), &params);
+        for (idx_t id : I) {
+            EXPECT_LT(id, nb / 2);
+        }
+    }
+
+    // serialization
+    {
+        VectorIOWriter writer;
+        write_index(index.get(), &writer);
+        VectorIOReader reader;
+        reader.data = writer.data;
+        std::unique_ptr<Index> index2(read_index(&reader));
+        IndexIVF* ivf2 = ivflib::extract_index_ivf(index2.get());
+        ASSERT_TRUE(dynamic_cast<CompressedIdsInvertedLists*>(ivf2->invlists));
+        index2->search(nq, xq.data(), k, D.data(), I.data());
+        EXPECT_EQ(Iref, I);
+    }
+
+    // removal and addition
+    {
+        IDSelectorRange sel(0, nb / 2);
+        EXPECT_EQ(index->remove_ids(sel), nb / 2);
+        index->add(nb / 2, xb.data());
+        EXPECT_EQ(index->ntotal, nb);
+        index->search(nq, xq.data(), k, D.data(), I.data());
+        for (int i = 0; i < nq * k; i++) {
+            EXPECT_LT(I[i], nb);
+            EXPECT_GE(I[i], 0);
+        }
+    }
+}
@@ -0,0 +1,156 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IVFlib.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/impl/io.h>
+#include <faiss/index_factory.h>
+#include <faiss/index_io.h>
+#include <faiss/invlists/ConcurrentArrayInvertedLists.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+#include "test_util.h"
+
+using namespace faiss;
+
+TEST(ConcurrentInvlists, add_update_resize) {
+    size_t nlist = 5, code_size = 3;
+    ArrayInvertedLists ref(nlist, code_size);
+    ConcurrentArrayInvertedLists cil(nlist, code_size);
+
+    std::mt19937 rng(123);
+    std::vector<uint8_t> code(code_size * 100);
+    std::vector<idx_t> ids(100);
+
+    for (int iter = 0; iter < 200; iter++) {
+        size_t list_no = rng() % nlist;
+        size_t n = rng() % 100;
+        for (size_t j = 0; j < n; j++) {
+            ids[j] = rng();
+        }
+        for (size_t j = 0; j < n * code_size; j++) {
+            code[j] = rng();
+        }
+        size_t ls = ref.list_size(list_no);
+        switch (iter % 4) {
+            case 0:
+            case 1:
+                EXPECT_EQ(
+                        cil.add_entries(list_no, n, ids.data(), code.data()),
+                        ref.add_entries(list_no, n, ids.data(), code.data()));
+                break;
+            case 2:
+                if (ls > 0) {
+                    size_t offset = rng() % ls;
+                    n = std::min(n, ls - offset);
+                    cil.update_entries(
+                            list_no, offset, n, ids.data(), code.data());
+                    ref.update_entries(
+                            list_no, offset, n, ids.data(), code.data());
+                }
+                break;
+            case 3:
+                // shrink or grow
+                ls = rng() % (ls + 50);
+                cil.resize(list_no, ls);
+                ref.resize(list_no, ls);
+                break;
+        }
+    }
+    check_same_invlists(ref, cil);
+
+    // the lists were reallocated, the former segments can be freed
+    size_t retired = cil.retired_nbytes();
+    EXPECT_GT(retired, 0);
+    EXPECT_EQ(cil.reclaim_memory(), retired);
+    EXPECT_EQ(cil.retired_nbytes(), 0);
+    check_same_invlists(ref, cil);
+
+    // conversion
+    ConcurrentArrayInvertedLists cil2(ref);
+    check_same_invlists(ref, cil2);
+}
+
+TEST(ConcurrentInvlists, add_while_searching) {
+    int d = 16, nt = 3000, nb = 20000, nq = 50, k = 5;
+    std::unique_ptr<Index> index(index_factory(d, "IVF64,Flat"));
+    std::vector<float> xt(d * nt), xb(d * nb), xq(d * nq);
+    float_rand(xt.data(), xt.size(), 123);
+    float_rand(xb.data(), xb.size(), 456);
+    float_rand(xq.data(), xq.size(), 789);
+    index->train(nt, xt.data());
+    IndexIVF* ivf = ivflib::extract_index_ivf(index.get());
+    ivf->nprobe = 8;
+    ivf->replace_invlists(
+            new ConcurrentArrayInvertedLists(ivf->nlist, ivf->code_size),
+            true);
+
+    std::atomic<bool> done(false);
+    std::atomic<int> nerror(0), nsearch(0);
+
+    auto search_loop = [&]() {
+        std::vector<float> D(nq * k);
+        std::vector<idx_t> I(nq * k);
+        while (!done) {
+            index->search(nq, xq.data(), k, D.data(), I.data());
+            // the (id, distance) pairs must be consistent with the data
+            for (int i = 0; i < nq * k; i++) {
+                if (I[i] < 0) {
+                    continue;
+                }
+                float dis = fvec_L2sqr(
+                        xq.data() + (i / k) * d, xb.data() + I[i] * d, d);
+                if (I[i] >= nb || std::abs(dis - D[i]) > 1e-4) {
+                    nerror++;
+                }
+            }
+            nsearch++;
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; t++) {
+        threads.emplace_back(search_loop);
+    }
+    for (int i0 = 0; i0 < nb; i0 += 500) {
+        index->add(500, xb.data() + i0 * d);
+    }
+    done = true;
+    for (auto& t : threads) {
+        t.join();
+    }
+    EXPECT_EQ(nerror, 0);
+    EXPECT_GT(nsearch, 0);
+    EXPECT_EQ(index->ntotal, nb);
+
+    // same lists as with the default inverted lists
+    std::unique_ptr<Index> ref_index(index_factory(d, "IVF64,Flat"));
+    ref_index->train(nt, xt.data());
+    ref_index->add(nb, xb.data());
+    IndexIVF* ref_ivf = ivflib::extract_index_ivf(ref_index.get());
+    check_same_invlists(*ref_ivf->invlists, *ivf->invlists);
+
+    // serialization
+    VectorIOWriter writer;
+    write_index(index.get(), &writer);
+    VectorIOReader reader;
+    reader.data = writer.data;
+    std::unique_ptr<Index> index2(read_index(&reader));
+    IndexIVF* ivf2 = ivflib::extract_index_ivf(index2.get());
+    ASSERT_TRUE(dynamic_cast<ConcurrentArrayInvertedLists*>(ivf2->invlists));
+    check_same_invlists(*ivf->invlists, *ivf2->invlists);
+}
@@ -23,7 +23,8 @@ class TestCompileOptions(unittest.TestCase):
         options = faiss.get_compile_options()
         options = options.split(' ')
         for option in options:
-            assert option in ['AVX2', 'NEON', 'GENERIC', 'OPTIMIZE']
+            assert option in [
+                'AVX2', 'AVX512', 'NEON', 'GENERIC', 'OPTIMIZE', 'DD']
 
 
 class TestSearch(unittest.TestCase):
@@ -54,9 +55,10 @@ class TestSearch(unittest.TestCase):
     # not exploitable, hence the flag test on that as well.
     @unittest.skipUnless(
         ('AVX2' in faiss.get_compile_options() or
+        'AVX512' in faiss.get_compile_options() or
         'NEON' in faiss.get_compile_options()) and
         "OPTIMIZE" in faiss.get_compile_options(),
-        "only test while building with avx2 or neon")
+        "only test while building with avx2, avx512 or neon")
     def test_PQ4_speed(self):
         ds  = datasets.SyntheticDataset(32, 2000, 5000, 1000)
         xt = ds.get_train()
@@ -0,0 +1,415 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexNSG.h>
+#include <faiss/impl/FaissException.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/impl/io.h>
+#include <faiss/index_io.h>
+
+using namespace faiss;
+
+namespace {
+
+int d = 32;
+size_t nb = 2000;
+size_t nq = 100;
+int k = 10;
+
+std::vector<float> make_data(size_t n, int seed) {
+    std::mt19937 rng(seed);
+    std::vector<float> x(n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+/// fraction of the ground-truth 1-NN found in the top-k results
+double recall_at_k(
+        const std::vector<idx_t>& Iref,
+        const std::vector<idx_t>& I) {
+    size_t nfound = 0;
+    for (size_t q = 0; q < nq; q++) {
+        for (int j = 0; j < k; j++) {
+            if (I[q * k + j] == Iref[q * k]) {
+                nfound++;
+                break;
+            }
+        }
+    }
+    return nfound / double(nq);
+}
+
+} // namespace
+
+TEST(HNSW, remove_and_compact) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(nq, 456);
+
+    IndexHNSWFlat index(d, 16);
+    index.hnsw.efSearch = 64;
+    index.add(nb, xb.data());
+
+    // remove one vector out of 4
+    std::vector<idx_t> to_remove;
+    for (idx_t i = 0; i < nb; i += 4) {
+        to_remove.push_back(i);
+    }
+    IDSelectorBatch sel(to_remove.size(), to_remove.data());
+    EXPECT_EQ(index.remove_ids(sel), to_remove.size());
+    // removing twice is a no-op
+    EXPECT_EQ(index.remove_ids(sel), 0);
+    EXPECT_EQ(index.ntotal, nb);
+
+    std::vector<idx_t> I(nq * k);
+    std::vector<float> D(nq * k);
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    for (idx_t id : I) {
+        EXPECT_TRUE(id < 0 || id % 4 != 0);
+    }
+
+    // reference on the remaining vectors, in the compacted numbering
+    IndexFlatL2 ref(d);
+    for (idx_t i = 0; i < nb; i++) {
+        if (i % 4 != 0) {
+            ref.add(1, xb.data() + i * d);
+        }
+    }
+    std::vector<idx_t> Iref(nq * k);
+    ref.search(nq, xq.data(), k, D.data(), Iref.data());
+
+    EXPECT_EQ(index.compact_deleted(), to_remove.size());
+    EXPECT_EQ(index.ntotal, ref.ntotal);
+    EXPECT_EQ(index.hnsw.ndeleted, 0);
+
+    // no link should point outside of the compacted graph
+    for (idx_t v : index.hnsw.neighbors) {
+        EXPECT_LT(v, index.ntotal);
+    }
+
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_GT(recall_at_k(Iref, I), 0.9);
+
+    // the graph can still be extended after compaction
+    std::vector<float> xb2 = make_data(100, 789);
+    index.add(100, xb2.data());
+    EXPECT_EQ(index.ntotal, ref.ntotal + 100);
+}
+
+TEST(HNSW, concurrent_add_and_search) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(nq, 456);
+
+    IndexHNSWFlat index(d, 16);
+    index.hnsw.efSearch = 64;
+    index.add(nb / 4, xb.data());
+    index.reserve(nb);
+
+    std::atomic<bool> done(false);
+    std::atomic<int> nbad(0);
+
+    std::thread writer([&]() {
+        size_t batch_size = 50;
+        for (size_t i0 = nb / 4; i0 < nb; i0 += batch_size) {
+            index.add(batch_size, xb.data() + i0 * d);
+        }
+        done = true;
+    });
+
+    // search until all vectors are added
+    std::vector<idx_t> I(nq * k);
+    std::vector<float> D(nq * k);
+    int nsearch = 0;
+    while (!done || nsearch == 0) {
+        index.search(nq, xq.data(), k, D.data(), I.data());
+        for (idx_t id : I) {
+            if (id >= idx_t(nb)) {
+                nbad++;
+            }
+        }
+        nsearch++;
+    }
+    writer.join();
+    EXPECT_EQ(nbad, 0);
+    EXPECT_EQ(index.ntotal, nb);
+
+    // the final graph should be as good as a sequentially built one
+    IndexFlatL2 ref(d);
+    ref.add(nb, xb.data());
+    std::vector<idx_t> Iref(nq * k);
+    ref.search(nq, xq.data(), k, D.data(), Iref.data());
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_GT(recall_at_k(Iref, I), 0.9);
+
+    // the reserved memory is exhausted
+    EXPECT_THROW(index.add(nb, xb.data()), FaissException);
+    EXPECT_EQ(index.ntotal, nb);
+
+    // deletions need exclusive access
+    IDSelectorRange sel(0, 10);
+    EXPECT_THROW(index.remove_ids(sel), FaissException);
+}
+
+TEST(HNSW, grouped_search) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(nq, 456);
+
+    for (MetricType metric : {METRIC_L2, METRIC_INNER_PRODUCT}) {
+        IndexHNSWFlat index(d, 16, metric);
+        index.add(nb, xb.data());
+
+        std::vector<idx_t> Iref(nq * k), I(nq * k);
+        std::vector<float> Dref(nq * k), D(nq * k);
+        index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+        // grouping the queries does not change the result of each search
+        index.hnsw.search_group_queries = true;
+        index.search(nq, xq.data(), k, D.data(), I.data());
+        EXPECT_EQ(I, Iref);
+        EXPECT_EQ(D, Dref);
+    }
+}
+
+TEST(HNSW, bfs_reordering) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(nq, 456);
+
+    IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+
+    std::vector<idx_t> Iref(nq * k), I(nq * k);
+    std::vector<float> Dref(nq * k), D(nq * k);
+    index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    std::vector<idx_t> perm(nb);
+    index.hnsw.bfs_order(perm.data());
+    EXPECT_EQ(perm[0], index.hnsw.entry_point);
+    index.permute_entries(perm.data());
+    EXPECT_EQ(index.hnsw.entry_point, 0);
+
+    // same search, in the new numbering
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    for (size_t i = 0; i < nq * k; i++) {
+        EXPECT_EQ(perm[I[i]], Iref[i]);
+    }
+    EXPECT_EQ(D, Dref);
+}
+
+TEST(NSG, bfs_reordering) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(nq, 456);
+
+    IndexNSGFlat index(d, 16);
+    index.add(nb, xb.data());
+
+    IndexFlatL2 ref(d);
+    ref.add(nb, xb.data());
+    std::vector<idx_t> Igt(nq * k), Iref(nq * k), I(nq * k);
+    std::vector<float> D(nq * k);
+    ref.search(nq, xq.data(), k, D.data(), Igt.data());
+    index.search(nq, xq.data(), k, D.data(), Iref.data());
+
+    std::vector<idx_t> perm(nb);
+    index.nsg.bfs_order(perm.data());
+    index.permute_entries(perm.data());
+
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    for (size_t i = 0; i < nq * k; i++) {
+        I[i] = perm[I[i]];
+    }
+    EXPECT_GE(recall_at_k(Igt, I), recall_at_k(Igt, Iref) - 0.05);
+}
+
+TEST(NSG, build_memory_budget) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(nq, 456);
+
+    IndexFlatL2 ref(d);
+    ref.add(nb, xb.data());
+    std::vector<idx_t> Igt(nq * k), Iref(nq * k), I(nq * k);
+    std::vector<float> D(nq * k);
+    ref.search(nq, xq.data(), k, D.data(), Igt.data());
+
+    IndexNSGFlat index_ref(d, 16);
+    index_ref.add(nb, xb.data());
+    index_ref.search(nq, xq.data(), k, D.data(), Iref.data());
+
+    // kNN graph computed by blocks of 100 queries
+    IndexNSGFlat index(d, 16);
+    index.nsg.build_memory_budget =
+            100 * (index.GK + 1) * (sizeof(idx_t) + sizeof(float));
+    index.add(nb, xb.data());
+    index.search(nq, xq.data(), k, D.data(), I.data());
+
+    EXPECT_GE(recall_at_k(Igt, I), recall_at_k(Igt, Iref) - 0.05);
+}
+
+TEST(HNSW, compressed_level_0) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(nq, 456);
+
+    IndexHNSWFlat index(d, 16);
+    index.hnsw.efSearch = 64;
+    index.add(nb, xb.data());
+
+    std::vector<idx_t> Iref(nq * k), I(nq * k);
+    std::vector<float> Dref(nq * k), D(nq * k);
+    index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    std::vector<HNSW::storage_idx_t> neighbors_ref(
+            index.hnsw.neighbors.begin(), index.hnsw.neighbors.end());
+
+    size_t size_ref = index.hnsw.neighbors.size() * sizeof(HNSW::storage_idx_t);
+    index.hnsw.compress_level_0();
+    EXPECT_TRUE(index.hnsw.is_level0_compressed());
+    size_t size_compressed =
+            index.hnsw.neighbors.size() * sizeof(HNSW::storage_idx_t) +
+            index.hnsw.level0_codes.size() +
+            index.hnsw.level0_offsets.size() * sizeof(size_t);
+    EXPECT_LT(size_compressed, size_ref / 2);
+
+    // the neighbor lists are visited in a different order
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    EXPECT_GE(recall_at_k(Iref, I), 0.95);
+
+    std::vector<uint8_t> buf;
+    {
+        VectorIOWriter writer;
+        write_index(&index, &writer);
+        buf = writer.data;
+    }
+    VectorIOReader reader;
+    reader.data = buf;
+    std::unique_ptr<IndexHNSWFlat> index2(
+            dynamic_cast<IndexHNSWFlat*>(read_index(&reader)));
+    ASSERT_TRUE(index2);
+    EXPECT_TRUE(index2->hnsw.is_level0_compressed());
+    std::vector<idx_t> I2(nq * k);
+    index2->search(nq, xq.data(), k, D.data(), I2.data());
+    EXPECT_EQ(I, I2);
+
+    // the graph must be decompressed to be modified
+    EXPECT_THROW(index.add(1, xb.data()), FaissException);
+    index.hnsw.decompress_level_0();
+    EXPECT_FALSE(index.hnsw.is_level0_compressed());
+    EXPECT_EQ(index.hnsw.neighbors.size(), neighbors_ref.size());
+    for (idx_t i = 0; i < nb; i++) {
+        // same lists, up to the order of the level 0 neighbors
+        std::vector<HNSW::storage_idx_t> l0(
+                index.hnsw.neighbors.begin() + index.hnsw.offsets[i],
+                index.hnsw.neighbors.begin() + index.hnsw.offsets[i + 1]);
+        std::vector<HNSW::storage_idx_t> l0_ref(
+                neighbors_ref.begin() + index.hnsw.offsets[i],
+                neighbors_ref.begin() + index.hnsw.offsets[i + 1]);
+        std::sort(l0.begin(), l0.begin() + index.hnsw.nb_neighbors(0));
+        std::sort(l0_ref.begin(), l0_ref.begin() + index.hnsw.nb_neighbors(0));
+        EXPECT_EQ(l0, l0_ref);
+    }
+    index.add(1, xb.data());
+}
+
+TEST(HNSW, filtered_search) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(nq, 456);
+
+    IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+    IndexFlatL2 ref(d);
+    ref.add(nb, xb.data());
+
+    std::vector<idx_t> Iref(nq * k), I(nq * k);
+    std::vector<float> Dref(nq * k), D(nq * k);
+
+    // 4% of the ids pass the filter
+    std::vector<idx_t> subset;
+    for (idx_t i = 0; i < nb; i += 25) {
+        subset.push_back(i);
+    }
+    IDSelectorBatch sel(subset.size(), subset.data());
+    SearchParameters ref_params;
+    ref_params.sel = &sel;
+    ref.search(nq, xq.data(), k, Dref.data(), Iref.data(), &ref_params);
+
+    SearchParametersHNSW params;
+    params.sel = &sel;
+    params.efSearch = 32;
+
+    // plain traversal (default)
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    for (idx_t id : I) {
+        EXPECT_TRUE(id < 0 || id % 25 == 0);
+    }
+    double recall_plain = recall_at_k(Iref, I);
+
+    // traversal through the rejected vertices
+    params.filter_two_hop_threshold = 0.5;
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    for (idx_t id : I) {
+        EXPECT_TRUE(id % 25 == 0);
+    }
+    double recall_two_hop = recall_at_k(Iref, I);
+    EXPECT_GT(recall_two_hop, 0.9);
+    EXPECT_GE(recall_two_hop, recall_plain);
+
+    // exhaustive search below the threshold, the result is exact
+    params.filter_brute_force_threshold = 0.05;
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    EXPECT_EQ(I, Iref);
+}
+
+TEST(HNSW, early_termination) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(nq, 456);
+
+    IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+    IndexFlatL2 ref(d);
+    ref.add(nb, xb.data());
+
+    std::vector<idx_t> Igt(nq * k), Iref(nq * k), I(nq * k);
+    std::vector<float> D(nq * k);
+    ref.search(nq, xq.data(), k, D.data(), Igt.data());
+
+    SearchParametersHNSW params;
+    params.efSearch = 256;
+    hnsw_stats.reset();
+    index.search(nq, xq.data(), k, D.data(), Iref.data(), &params);
+    size_t ndis_ref = hnsw_stats.n3;
+    EXPECT_EQ(hnsw_stats.nquery(), nq);
+    EXPECT_LE(hnsw_stats.ndis_quantile(0.5), hnsw_stats.ndis_quantile(0.99));
+    EXPECT_GE(hnsw_stats.ndis_quantile(1.0), ndis_ref / nq);
+
+    // stop when the results are stable
+    params.early_stop_patience = 16;
+    hnsw_stats.reset();
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    EXPECT_LT(hnsw_stats.n3, ndis_ref / 2);
+    EXPECT_GE(recall_at_k(Igt, I), recall_at_k(Igt, Iref) - 0.05);
+
+    // hard budget on the nb of distances
+    params.early_stop_patience = 0;
+    params.max_ndis = 100;
+    hnsw_stats.reset();
+    index.search(nq, xq.data(), k, D.data(), I.data(), &params);
+    // the last expansion can exceed the budget by one neighbor list
+    EXPECT_LE(hnsw_stats.n3, nq * (100 + index.hnsw.nb_neighbors(0)));
+}
@@ -0,0 +1,253 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlatInt8.h>
+#include <faiss/clone_index.h>
+#include <faiss/impl/DistanceComputer.h>
+#include <faiss/impl/FaissException.h>
+#include <faiss/impl/IDSelector.h>
+#include <faiss/impl/io.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/distances.h>
+
+using namespace faiss;
+
+namespace {
+
+std::vector<uint8_t> random_bytes(size_t n, int seed) {
+    std::mt19937 rng(seed);
+    std::vector<uint8_t> x(n);
+    for (auto& v : x) {
+        v = rng();
+    }
+    return x;
+}
+
+int64_t component(uint8_t v, bool is_signed) {
+    return is_signed ? int64_t(int8_t(v)) : int64_t(v);
+}
+
+// reference distances computed with int64 arithmetic
+std::vector<int64_t> reference_distances(
+        const std::vector<uint8_t>& xq,
+        const std::vector<uint8_t>& xb,
+        size_t d,
+        bool is_signed,
+        bool is_inner_product) {
+    size_t nq = xq.size() / d, nb = xb.size() / d;
+    std::vector<int64_t> dis(nq * nb);
+    for (size_t i = 0; i < nq; i++) {
+        for (size_t j = 0; j < nb; j++) {
+            int64_t accu = 0;
+            for (size_t l = 0; l < d; l++) {
+                int64_t a = component(xq[i * d + l], is_signed);
+                int64_t b = component(xb[j * d + l], is_signed);
+                accu += is_inner_product ? a * b : (a - b) * (a - b);
+            }
+            dis[i * nb + j] = accu;
+        }
+    }
+    return dis;
+}
+
+// the results are the exact k nearest neighbors, up to the order of ties
+void check_results(
+        const std::vector<int64_t>& ref,
+        size_t nb,
+        size_t k,
+        bool is_inner_product,
+        const std::vector<float>& D,
+        const std::vector<idx_t>& I,
+        const IDSelector* sel = nullptr) {
+    size_t nq = ref.size() / nb;
+    for (size_t i = 0; i < nq; i++) {
+        std::vector<int64_t> sorted;
+        for (size_t j = 0; j < nb; j++) {
+            if (!sel || sel->is_member(j)) {
+                sorted.push_back(ref[i * nb + j]);
+            }
+        }
+        std::sort(sorted.begin(), sorted.end());
+        if (is_inner_product) {
+            std::reverse(sorted.begin(), sorted.end());
+        }
+        for (size_t j = 0; j < k; j++) {
+            idx_t id = I[i * k + j];
+            ASSERT_GE(id, 0);
+            ASSERT_TRUE(!sel || sel->is_member(id));
+            ASSERT_EQ(D[i * k + j], float(sorted[j])) << i << " " << j;
+            ASSERT_EQ(D[i * k + j], float(ref[i * nb + id]));
+        }
+    }
+}
+
+} // namespace
+
+// the blocked kernels compute the same distances as the int64 reference,
+// including the tiles at the edges and the components after the SIMD width
+TEST(IndexFlatInt8, distances_block) {
+    for (size_t d : {1, 7, 16, 37, 64, 100, 256}) {
+        size_t nx = 7, ny = 13;
+        std::vector<uint8_t> x = random_bytes(nx * d, 123);
+        std::vector<uint8_t> y = random_bytes(ny * d, 456);
+        // extreme values to check that the int16 products do not overflow
+        std::fill(x.begin(), x.begin() + d, 0x80);
+        std::fill(y.begin(), y.begin() + d, 0x7f);
+        std::fill(y.begin() + d, y.begin() + 2 * d, 0xff);
+        for (bool is_signed : {true, false}) {
+            for (bool ip : {false, true}) {
+                std::vector<int64_t> ref =
+                        reference_distances(x, y, d, is_signed, ip);
+                std::vector<int32_t> dis(nx * ny);
+                if (is_signed) {
+                    int8_distances_block(
+                            (const int8_t*)x.data(),
+                            (const int8_t*)y.data(),
+                            d,
+                            nx,
+                            ny,
+                            ip,
+                            dis.data());
+                } else {
+                    uint8_distances_block(
+                            x.data(), y.data(), d, nx, ny, ip, dis.data());
+                }
+                for (size_t i = 0; i < nx * ny; i++) {
+                    ASSERT_EQ(dis[i], ref[i]) << "d=" << d << " i=" << i
+                                              << " signed=" << is_signed
+                                              << " ip=" << ip;
+                }
+            }
+        }
+    }
+}
+
+TEST(IndexFlatInt8, search) {
+    int old_query_bs = distance_compute_blas_query_bs;
+    int old_database_bs = distance_compute_blas_database_bs;
+    // small blocks so that the search spans several of them
+    distance_compute_blas_query_bs = 16;
+    distance_compute_blas_database_bs = 100;
+
+    size_t d = 37, nb = 1000, nq = 50;
+    std::vector<uint8_t> xb = random_bytes(nb * d, 123);
+    std::vector<uint8_t> xq = random_bytes(nq * d, 456);
+    IDSelectorRange sel(100, 400);
+    SearchParameters params;
+    params.sel = &sel;
+
+    for (bool is_signed : {true, false}) {
+        for (MetricType metric : {METRIC_L2, METRIC_INNER_PRODUCT}) {
+            bool ip = metric == METRIC_INNER_PRODUCT;
+            IndexFlatInt8 index(d, metric, is_signed);
+            index.add_int8(nb, xb.data());
+            std::vector<int64_t> ref =
+                    reference_distances(xq, xb, d, is_signed, ip);
+
+            // the reservoir handler is used from k = 100
+            for (size_t k : {1, 10, 120}) {
+                std::vector<float> D(nq * k);
+                std::vector<idx_t> I(nq * k);
+                index.search_int8(nq, xq.data(), k, D.data(), I.data());
+                check_results(ref, nb, k, ip, D, I);
+                index.search_int8(
+                        nq, xq.data(), k, D.data(), I.data(), &params);
+                check_results(ref, nb, k, ip, D, I, &sel);
+            }
+
+            // float interface
+            size_t k = 10;
+            std::vector<float> xqf(nq * d);
+            index.sa_decode(nq, xq.data(), xqf.data());
+            std::vector<float> D(nq * k), Dref(nq * k);
+            std::vector<idx_t> I(nq * k), Iref(nq * k);
+            index.search(nq, xqf.data(), k, D.data(), I.data());
+            index.search_int8(nq, xq.data(), k, Dref.data(), Iref.data());
+            EXPECT_EQ(D, Dref);
+            EXPECT_EQ(I, Iref);
+
+            std::unique_ptr<FlatCodesDistanceComputer> dc(
+                    index.get_FlatCodesDistanceComputer());
+            dc->set_query(xqf.data());
+            for (size_t j = 0; j < 20; j++) {
+                EXPECT_EQ((*dc)(j), float(ref[j]));
+            }
+        }
+    }
+    distance_compute_blas_query_bs = old_query_bs;
+    distance_compute_blas_database_bs = old_database_bs;
+}
+
+TEST(IndexFlatInt8, encode_and_io) {
+    size_t d = 16, nb = 100, nq = 10, k = 5;
+    IndexFlatInt8 index(d, METRIC_L2, false);
+    // rounded and clamped to [0, 255]
+    std::vector<float> x = {-3.f, 0.4f, 1.6f, 254.6f, 300.f};
+    x.resize(d, 7.f);
+    index.add(1, x.data());
+    std::vector<float> recons(d);
+    index.reconstruct(0, recons.data());
+    EXPECT_EQ(recons[0], 0.f);
+    EXPECT_EQ(recons[1], 0.f);
+    EXPECT_EQ(recons[2], 2.f);
+    EXPECT_EQ(recons[3], 255.f);
+    EXPECT_EQ(recons[4], 255.f);
+    EXPECT_EQ(recons[5], 7.f);
+
+    std::vector<uint8_t> xb = random_bytes(nb * d, 123);
+    std::vector<uint8_t> xq = random_bytes(nq * d, 456);
+    index.add_int8(nb, xb.data());
+    std::vector<float> D(nq * k), D2(nq * k);
+    std::vector<idx_t> I(nq * k), I2(nq * k);
+    index.search_int8(nq, xq.data(), k, D.data(), I.data());
+
+    VectorIOWriter writer;
+    write_index(&index, &writer);
+    VectorIOReader reader;
+    reader.data = writer.data;
+    std::unique_ptr<Index> index2(read_index(&reader));
+    auto* index_i8 = dynamic_cast<IndexFlatInt8*>(index2.get());
+    ASSERT_TRUE(index_i8);
+    EXPECT_FALSE(index_i8->is_signed);
+    EXPECT_EQ(index_i8->ntotal, nb + 1);
+    index_i8->search_int8(nq, xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ(D, D2);
+    EXPECT_EQ(I, I2);
+
+    std::unique_ptr<Index> index3(clone_index(&index));
+    index_i8 = dynamic_cast<IndexFlatInt8*>(index3.get());
+    ASSERT_TRUE(index_i8);
+    index_i8->search_int8(nq, xq.data(), k, D2.data(), I2.data());
+    EXPECT_EQ(D, D2);
+    EXPECT_EQ(I, I2);
+}
+
+// the int32 accumulators limit the dimension
+TEST(IndexFlatInt8, max_dimension) {
+    EXPECT_THROW(IndexFlatInt8(32768), FaissException);
+    std::vector<float> D(1);
+    std::vector<idx_t> I(1);
+    EXPECT_THROW(
+            knn_int8(nullptr,
+                     nullptr,
+                     32768,
+                     0,
+                     0,
+                     true,
+                     false,
+                     1,
+                     D.data(),
+                     I.data()),
+            FaissException);
+}
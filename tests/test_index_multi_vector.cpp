@@ -0,0 +1,212 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <algorithm>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFPQ.h>
+#include <faiss/IndexMultiVector.h>
+#include <faiss/impl/io.h>
+#include <faiss/index_io.h>
+#include <faiss/utils/distances.h>
+
+using namespace faiss;
+
+namespace {
+
+int d = 32;
+size_t ndoc = 500;
+size_t nq = 20;
+int k = 10;
+
+/// documents made of vectors around a per-document center
+struct MultiVectorData {
+    std::vector<idx_t> doc_lengths;
+    std::vector<float> xb;
+    std::vector<idx_t> query_lengths;
+    std::vector<float> xq;
+    std::vector<idx_t> query_doc; ///< document the query is drawn from
+
+    MultiVectorData() {
+        std::mt19937 rng(1234);
+        std::normal_distribution<float> gauss;
+        std::uniform_int_distribution<int> length(1, 8);
+        std::vector<float> centers(ndoc * d);
+        for (size_t i = 0; i < centers.size(); i++) {
+            centers[i] = gauss(rng);
+        }
+        for (size_t i = 0; i < ndoc; i++) {
+            doc_lengths.push_back(length(rng));
+            for (int t = 0; t < doc_lengths.back(); t++) {
+                for (int j = 0; j < d; j++) {
+                    xb.push_back(centers[i * d + j] + 0.5 * gauss(rng));
+                }
+            }
+        }
+        for (size_t q = 0; q < nq; q++) {
+            query_doc.push_back(q * 7 % ndoc);
+            query_lengths.push_back(4);
+            for (int t = 0; t < 4; t++) {
+                for (int j = 0; j < d; j++) {
+                    xq.push_back(
+                            centers[query_doc.back() * d + j] +
+                            0.5 * gauss(rng));
+                }
+            }
+        }
+    }
+};
+
+/// brute-force MaxSim scores with inner products
+std::vector<float> maxsim_ref(const MultiVectorData& data, size_t q) {
+    std::vector<float> scores(ndoc, 0);
+    const float* xq = data.xq.data() + q * 4 * d;
+    size_t offset = 0;
+    for (size_t i = 0; i < ndoc; i++) {
+        for (int qt = 0; qt < 4; qt++) {
+            float best = -1e30;
+            for (int t = 0; t < data.doc_lengths[i]; t++) {
+                best = std::max(
+                        best,
+                        fvec_inner_product(
+                                xq + qt * d,
+                                data.xb.data() + (offset + t) * d,
+                                d));
+            }
+            scores[i] += best;
+        }
+        offset += data.doc_lengths[i];
+    }
+    return scores;
+}
+
+} // namespace
+
+TEST(IndexMultiVector, exact_maxsim) {
+    MultiVectorData data;
+    IndexMultiVector index(new IndexFlatIP(d));
+    index.own_fields = true;
+    index.add_documents(ndoc, data.doc_lengths.data(), data.xb.data());
+    EXPECT_EQ(index.ntotal, ndoc);
+    EXPECT_EQ(index.token_index->ntotal, data.xb.size() / d);
+
+    // all vectors are candidates: the search is exhaustive
+    index.k_token = index.token_index->ntotal;
+    std::vector<idx_t> I(nq * k), I2(nq * k);
+    std::vector<float> D(nq * k), D2(nq * k);
+    index.search_documents(
+            nq,
+            data.query_lengths.data(),
+            data.xq.data(),
+            k,
+            D.data(),
+            I.data());
+
+    for (size_t q = 0; q < nq; q++) {
+        std::vector<float> scores = maxsim_ref(data, q);
+        std::vector<idx_t> order(ndoc);
+        for (size_t i = 0; i < ndoc; i++) {
+            order[i] = i;
+        }
+        std::partial_sort(
+                order.begin(),
+                order.begin() + k,
+                order.end(),
+                [&](idx_t a, idx_t b) { return scores[a] > scores[b]; });
+        for (int j = 0; j < k; j++) {
+            EXPECT_EQ(I[q * k + j], order[j]);
+            EXPECT_NEAR(D[q * k + j], scores[order[j]], 1e-3);
+        }
+    }
+
+    // with all the vectors retrieved, the approximate scores are exact
+    index.exact_maxsim = false;
+    index.search_documents(
+            nq,
+            data.query_lengths.data(),
+            data.xq.data(),
+            k,
+            D2.data(),
+            I2.data());
+    EXPECT_EQ(I, I2);
+}
+
+TEST(IndexMultiVector, ivfpq) {
+    MultiVectorData data;
+    IndexFlatIP quantizer(d);
+    IndexIVFPQ ivfpq(&quantizer, d, 16, 8, 4, METRIC_INNER_PRODUCT);
+    IndexMultiVector index(&ivfpq);
+    index.train(data.xb.size() / d, data.xb.data());
+    index.add_documents(ndoc, data.doc_lengths.data(), data.xb.data());
+    ivfpq.nprobe = 4;
+    index.k_token = 32;
+
+    std::vector<idx_t> I(nq * k);
+    std::vector<float> D(nq * k);
+    for (bool exact : {true, false}) {
+        index.exact_maxsim = exact;
+        index.search_documents(
+                nq,
+                data.query_lengths.data(),
+                data.xq.data(),
+                k,
+                D.data(),
+                I.data());
+        size_t nfound = 0;
+        for (size_t q = 0; q < nq; q++) {
+            if (I[q * k] == data.query_doc[q]) {
+                nfound++;
+            }
+        }
+        EXPECT_GE(nfound, nq * 9 / 10);
+    }
+
+    // serialization
+    VectorIOWriter writer;
+    write_index(&index, &writer);
+    VectorIOReader reader;
+    reader.data = writer.data;
+    std::unique_ptr<Index> index2(read_index(&reader));
+    IndexMultiVector* index_mv =
+            dynamic_cast<IndexMultiVector*>(index2.get());
+    ASSERT_TRUE(index_mv);
+    EXPECT_EQ(index_mv->doc_offsets, index.doc_offsets);
+    EXPECT_EQ(index_mv->k_token, index.k_token);
+
+    std::vector<idx_t> I2(nq * k);
+    std::vector<float> D2(nq * k);
+    index_mv->search_documents(
+            nq,
+            data.query_lengths.data(),
+            data.xq.data(),
+            k,
+            D2.data(),
+            I2.data());
+    EXPECT_EQ(I, I2);
+}
+
+TEST(IndexMultiVector, single_vector_queries) {
+    MultiVectorData data;
+    IndexFlatL2 flat(d);
+    IndexMultiVector index(&flat);
+    index.add_documents(ndoc, data.doc_lengths.data(), data.xb.data());
+
+    // a query of one vector returns the document of its nearest vector
+    std::vector<idx_t> I(nq), Iref(nq);
+    std::vector<float> D(nq), Dref(nq);
+    index.search(nq, data.xq.data(), 1, D.data(), I.data());
+    flat.search(nq, data.xq.data(), 1, Dref.data(), Iref.data());
+    for (size_t q = 0; q < nq; q++) {
+        EXPECT_EQ(I[q], index.token_to_doc(Iref[q]));
+        EXPECT_NEAR(D[q], Dref[q], 1e-4);
+    }
+}
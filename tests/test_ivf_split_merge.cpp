@@ -0,0 +1,166 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexIVFFlat.h>
+#include <faiss/IndexIVFPQ.h>
+
+using namespace faiss;
+
+namespace {
+
+int d = 16;
+size_t nlist = 16;
+size_t nt = 2000, nb = 4000, nq = 50;
+int k = 5;
+
+/// 3/4 of the vectors are concentrated in a small region of the space
+std::vector<float> make_skewed_data(size_t n, int seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> gauss;
+    std::vector<float> x(n * d);
+    for (size_t i = 0; i < n; i++) {
+        bool dense = i % 4 != 0;
+        for (int j = 0; j < d; j++) {
+            x[i * d + j] = dense ? 0.1 * gauss(rng) + (j == 0 ? 1.5 : 0)
+                                 : gauss(rng);
+        }
+    }
+    return x;
+}
+
+std::vector<float> make_gaussian_data(size_t n, int seed) {
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> gauss;
+    std::vector<float> x(n * d);
+    for (auto& v : x) {
+        v = gauss(rng);
+    }
+    return x;
+}
+
+size_t max_list_size(const IndexIVF& index) {
+    size_t m = 0;
+    for (size_t i = 0; i < index.nlist; i++) {
+        m = std::max(m, index.get_list_size(i));
+    }
+    return m;
+}
+
+/// check the lists, the direct map and the search results
+void check_index(
+        IndexIVFFlat& index,
+        const std::vector<float>& xb,
+        const std::vector<idx_t>& ids) {
+    EXPECT_EQ(index.quantizer->ntotal, index.nlist);
+    EXPECT_EQ(index.invlists->nlist, index.nlist);
+    EXPECT_EQ(index.invlists->compute_ntotal(), nb);
+
+    std::vector<float> recons(d);
+    for (size_t i = 0; i < nb; i += 7) {
+        index.reconstruct(ids[i], recons.data());
+        for (int j = 0; j < d; j++) {
+            EXPECT_EQ(recons[j], xb[i * d + j]);
+        }
+    }
+
+    // exhaustive search
+    IndexFlatL2 flat(d);
+    flat.add(nb, xb.data());
+    auto xq = make_skewed_data(nq, 789);
+    std::vector<float> D(nq * k), Dref(nq * k);
+    std::vector<idx_t> I(nq * k), Iref(nq * k);
+    flat.search(nq, xq.data(), k, Dref.data(), Iref.data());
+    index.nprobe = index.nlist;
+    index.search(nq, xq.data(), k, D.data(), I.data());
+    for (size_t i = 0; i < nq * k; i++) {
+        EXPECT_EQ(I[i], ids[Iref[i]]);
+    }
+}
+
+} // namespace
+
+TEST(IVFSplitMerge, IVFFlat) {
+    IndexFlatL2 quantizer(d);
+    IndexIVFFlat index(&quantizer, d, nlist);
+    auto xt = make_gaussian_data(nt, 123);
+    index.train(nt, xt.data());
+    index.set_direct_map_type(DirectMap::Hashtable);
+
+    auto xb = make_skewed_data(nb, 456);
+    std::vector<idx_t> ids(nb);
+    for (size_t i = 0; i < nb; i++) {
+        ids[i] = 1000 + 3 * i;
+    }
+    index.add_with_ids(nb, xb.data(), ids.data());
+    size_t max0 = max_list_size(index);
+    EXPECT_GT(max0, 4 * nb / nlist);
+
+    // split until the lists are below 2x the mean size of the original lists
+    size_t max_size = 2 * nb / nlist;
+    for (int iter = 0; iter < 10; iter++) {
+        if (index.split_lists(max_size) == 0) {
+            break;
+        }
+    }
+    EXPECT_GT(index.nlist, nlist);
+    EXPECT_LE(max_list_size(index), max_size);
+    check_index(index, xb, ids);
+
+    // merge the small lists
+    size_t nlist1 = index.nlist;
+    size_t min_size = nb / nlist / 4;
+    size_t nremove = index.merge_lists(min_size);
+    EXPECT_GT(nremove, 0);
+    EXPECT_EQ(index.nlist, nlist1 - nremove);
+    check_index(index, xb, ids);
+}
+
+TEST(IVFSplitMerge, IVFPQ) {
+    IndexFlatL2 quantizer(d);
+    IndexIVFPQ index(&quantizer, d, nlist, 8, 4);
+    auto xt = make_gaussian_data(nt, 123);
+    index.train(nt, xt.data());
+    auto xb = make_skewed_data(nb, 456);
+    index.add(nb, xb.data());
+    index.make_direct_map();
+    index.nprobe = 4;
+
+    // nb of vectors that are found as their own nearest neighbor
+    auto count_found = [&]() {
+        std::vector<float> D(nb);
+        std::vector<idx_t> I(nb);
+        index.search(nb, xb.data(), 1, D.data(), I.data());
+        size_t nfound = 0;
+        for (size_t i = 0; i < nb; i++) {
+            nfound += I[i] == i;
+        }
+        return nfound;
+    };
+    size_t nfound0 = count_found();
+
+    EXPECT_GT(index.split_lists(nb / nlist), 0);
+    EXPECT_GT(index.merge_lists(nb / nlist / 4), 0);
+    EXPECT_EQ(index.invlists->compute_ntotal(), nb);
+
+    // the precomputed tables follow the centroids
+    EXPECT_EQ(index.use_precomputed_table, 1);
+    EXPECT_EQ(
+            index.precomputed_table.size(),
+            index.nlist * index.pq.M * index.pq.ksub);
+
+    // the vectors are re-encoded from their lossy reconstruction
+    EXPECT_GE(count_found(), nfound0 * 3 / 4);
+    std::vector<float> recons(d);
+    index.reconstruct(0, recons.data());
+}
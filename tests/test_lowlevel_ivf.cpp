@@ -14,6 +14,8 @@
 #include <thread>
 #include <vector>
 
+#include <omp.h>
+
 #include <gtest/gtest.h>
 
 #include <faiss/AutoTune.h>
@@ -22,6 +24,8 @@
 #include <faiss/IndexIVF.h>
 #include <faiss/IndexPreTransform.h>
 #include <faiss/VectorTransform.h>
+#include <faiss/impl/AuxIndexStructures.h>
+#include <faiss/impl/IDSelector.h>
 #include <faiss/index_factory.h>
 #include <faiss/index_io.h>
 
@@ -562,3 +566,182 @@ void test_threaded_search(const char* index_key, MetricType metric) {
 TEST(TestLowLevelIVF, ThreadedSearch) {
     test_threaded_search("IVF32,Flat", METRIC_L2);
 }
+
+/*************************************************************
+ * Test list-major search (parallel_mode 4)
+ *************************************************************/
+
+namespace {
+
+void test_list_major_search(const char* index_key, MetricType metric) {
+    std::unique_ptr<Index> index = make_trained_index(index_key, metric);
+    auto xb = make_data(nb);
+    index->add(nb, xb.data());
+    auto xq = make_data(nq);
+
+    IndexIVF* index_ivf = ivflib::extract_index_ivf(index.get());
+
+    std::vector<idx_t> ref_I(k * nq), new_I(k * nq);
+    std::vector<float> ref_D(k * nq), new_D(k * nq);
+    index_ivf->parallel_mode = 0;
+    index->search(nq, xq.data(), k, ref_D.data(), ref_I.data());
+
+    index_ivf->parallel_mode = 4;
+    index->search(nq, xq.data(), k, new_D.data(), new_I.data());
+
+    for (size_t i = 0; i < nq * k; i++) {
+        EXPECT_EQ(new_I[i], ref_I[i]);
+        EXPECT_NEAR(new_D[i], ref_D[i], 1e-4);
+    }
+
+    // the range search falls back to the default mode
+    RangeSearchResult res(nq);
+    index->range_search(nq, xq.data(), ref_D[k - 1], &res);
+    EXPECT_GE(res.lims[1], 1);
+}
+
+} // namespace
+
+TEST(TestLowLevelIVF, ListMajorSearchL2) {
+    test_list_major_search("IVF32,Flat", METRIC_L2);
+}
+
+TEST(TestLowLevelIVF, ListMajorSearchIP) {
+    test_list_major_search("IVF32,PQ8", METRIC_INNER_PRODUCT);
+}
+
+/*************************************************************
+ * Test adaptive nprobe
+ *************************************************************/
+
+namespace {
+
+/// vectors around 32 cluster centers, so that most lists can be skipped
+std::vector<float> make_clustered_data(size_t n) {
+    std::vector<float> x = make_data(n);
+    std::mt19937 crng(1234);
+    std::uniform_real_distribution<> distrib;
+    std::vector<float> centers(32 * d);
+    for (float& c : centers) {
+        c = distrib(crng) * 10;
+    }
+    for (size_t i = 0; i < n; i++) {
+        const float* c = centers.data() + (rng() % 32) * d;
+        for (int j = 0; j < d; j++) {
+            x[i * d + j] = c[j] + x[i * d + j] * 0.5;
+        }
+    }
+    return x;
+}
+
+} // namespace
+
+TEST(TestLowLevelIVF, AdaptiveNprobe) {
+    std::unique_ptr<Index> index(index_factory(d, "IVF32,Flat"));
+    auto xt = make_clustered_data(nt);
+    index->train(nt, xt.data());
+    auto xb = make_clustered_data(nb);
+    index->add(nb, xb.data());
+    auto xq = make_clustered_data(nq);
+    std::vector<idx_t> ref_I(k * nq), new_I(k * nq);
+    std::vector<float> ref_D(k * nq), new_D(k * nq);
+
+    // exhaustive search
+    SearchParametersIVF params;
+    params.nprobe = 32;
+    indexIVF_stats.reset();
+    index->search(nq, xq.data(), k, ref_D.data(), ref_I.data(), &params);
+    size_t ref_ndis = indexIVF_stats.ndis;
+    EXPECT_EQ(indexIVF_stats.nprobe_skipped, 0);
+
+    // the bound is exact for IVFFlat, so the results do not change
+    params.adaptive_nprobe = true;
+    indexIVF_stats.reset();
+    index->search(nq, xq.data(), k, new_D.data(), new_I.data(), &params);
+    EXPECT_EQ(new_I, ref_I);
+    EXPECT_LT(indexIVF_stats.ndis, ref_ndis);
+    EXPECT_GT(indexIVF_stats.nprobe_skipped, 0);
+    size_t nskip = indexIVF_stats.nprobe_skipped;
+
+    // a larger factor does not visit more lists
+    params.adaptive_lb_factor = 4;
+    indexIVF_stats.reset();
+    index->search(nq, xq.data(), k, new_D.data(), new_I.data(), &params);
+    EXPECT_GE(indexIVF_stats.nprobe_skipped, nskip);
+
+    // parallel_mode 3 is supported, the other modes throw
+    IndexIVF* index_ivf = ivflib::extract_index_ivf(index.get());
+    index_ivf->parallel_mode = 3;
+    index->search(nq, xq.data(), k, new_D.data(), new_I.data(), &params);
+    for (int pmode : {1, 2, 4}) {
+        index_ivf->parallel_mode = pmode;
+        EXPECT_THROW(
+                index->search(
+                        nq, xq.data(), k, new_D.data(), new_I.data(), &params),
+                FaissException);
+    }
+    index_ivf->parallel_mode = 0;
+
+    // only supported for L2
+    std::unique_ptr<Index> index_ip =
+            make_trained_index("IVF32,Flat", METRIC_INNER_PRODUCT);
+    EXPECT_THROW(
+            index_ip->search(
+                    nq, xq.data(), k, new_D.data(), new_I.data(), &params),
+            FaissException);
+}
+
+/*************************************************************
+ * Test intra-list parallelism (parallel_mode 1 with chunks)
+ *************************************************************/
+
+namespace {
+
+void test_chunked_search(const char* index_key) {
+    std::unique_ptr<Index> index = make_trained_index(index_key, METRIC_L2);
+    auto xb = make_data(nb);
+    index->add(nb, xb.data());
+    auto xq = make_data(nq);
+
+    IndexIVF* index_ivf = ivflib::extract_index_ivf(index.get());
+
+    std::vector<idx_t> ref_I(k * nq), new_I(k * nq);
+    std::vector<float> ref_D(k * nq), new_D(k * nq);
+
+    IDSelectorRange sel(nb / 4, nb / 2, true);
+    SearchParametersIVF params;
+    params.nprobe = 4;
+
+    int nt0 = omp_get_max_threads();
+    for (IDSelector* s : {(IDSelector*)nullptr, (IDSelector*)&sel}) {
+        params.sel = s;
+        index_ivf->parallel_mode = 0;
+        index_ivf->parallel_chunk_size = 0;
+        index->search(nq, xq.data(), k, ref_D.data(), ref_I.data(), &params);
+
+        // the lists have about 30 entries
+        index_ivf->parallel_mode = 1;
+        index_ivf->parallel_chunk_size = 7;
+        for (int nt : {1, 4}) {
+            omp_set_num_threads(nt);
+            index->search(
+                    nq, xq.data(), k, new_D.data(), new_I.data(), &params);
+            EXPECT_EQ(new_I, ref_I);
+            for (size_t i = 0; i < nq * k; i++) {
+                EXPECT_NEAR(new_D[i], ref_D[i], 1e-4);
+            }
+        }
+        omp_set_num_threads(nt0);
+    }
+    index_ivf->parallel_mode = 0;
+}
+
+} // namespace
+
+TEST(TestLowLevelIVF, ChunkedSearchFlat) {
+    test_chunked_search("IVF32,Flat");
+}
+
+TEST(TestLowLevelIVF, ChunkedSearchPQ) {
+    test_chunked_search("IVF32,PQ8");
+}
@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexNSG.h>
+#include <faiss/index_io.h>
+
+using namespace faiss;
+
+namespace {
+
+struct Tempfilename {
+    static pthread_mutex_t mutex;
+
+    std::string filename = "/tmp/faiss_tmp_XXXXXX";
+
+    Tempfilename() {
+        pthread_mutex_lock(&mutex);
+        int fd = mkstemp(&filename[0]);
+        close(fd);
+        pthread_mutex_unlock(&mutex);
+    }
+
+    ~Tempfilename() {
+        unlink(filename.c_str());
+    }
+
+    const char* c_str() {
+        return filename.c_str();
+    }
+};
+
+pthread_mutex_t Tempfilename::mutex = PTHREAD_MUTEX_INITIALIZER;
+
+int d = 32;
+size_t nb = 2000;
+size_t nq = 50;
+int k = 10;
+
+std::vector<float> make_data(size_t n, int seed) {
+    std::mt19937 rng(seed);
+    std::vector<float> x(n * d);
+    std::uniform_real_distribution<> distrib;
+    for (size_t i = 0; i < x.size(); i++) {
+        x[i] = distrib(rng);
+    }
+    return x;
+}
+
+/// search results of the index written to and read back from a file
+void search_mmapped(
+        const Index& index,
+        const float* xq,
+        std::vector<idx_t>& I,
+        std::unique_ptr<Index>& index2,
+        int write_flags = 0) {
+    Tempfilename fname;
+    write_index(&index, fname.c_str(), write_flags);
+    index2.reset(read_index(fname.c_str(), IO_FLAG_MMAP_IFC));
+    // the mapping outlives the file name
+    unlink(fname.c_str());
+    std::vector<float> D(nq * k);
+    I.resize(nq * k);
+    index2->search(nq, xq, k, D.data(), I.data());
+}
+
+} // namespace
+
+TEST(MMAP, hnsw) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(nq, 456);
+
+    IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+    std::vector<idx_t> Iref(nq * k), I;
+    std::vector<float> D(nq * k);
+    index.search(nq, xq.data(), k, D.data(), Iref.data());
+
+    std::unique_ptr<Index> index2;
+    search_mmapped(index, xq.data(), I, index2);
+    EXPECT_EQ(I, Iref);
+
+    IndexHNSWFlat* index_hnsw = dynamic_cast<IndexHNSWFlat*>(index2.get());
+    ASSERT_TRUE(index_hnsw);
+    auto storage = dynamic_cast<IndexFlatCodes*>(index_hnsw->storage);
+    EXPECT_FALSE(storage->codes.is_owned());
+    EXPECT_FALSE(index_hnsw->hnsw.neighbors.is_owned());
+    EXPECT_FALSE(index_hnsw->hnsw.offsets.is_owned());
+    EXPECT_FALSE(index_hnsw->hnsw.levels.is_owned());
+
+    // adding copies the mapped arrays
+    std::vector<float> xb2 = make_data(10, 789);
+    index_hnsw->add(10, xb2.data());
+    EXPECT_TRUE(storage->codes.is_owned());
+    EXPECT_TRUE(index_hnsw->hnsw.neighbors.is_owned());
+    EXPECT_EQ(index_hnsw->ntotal, nb + 10);
+}
+
+TEST(MMAP, hnsw_compressed_level_0) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(nq, 456);
+
+    IndexHNSWFlat index(d, 16);
+    index.add(nb, xb.data());
+    index.hnsw.compress_level_0();
+    std::vector<idx_t> Iref(nq * k), I;
+    std::vector<float> D(nq * k);
+    index.search(nq, xq.data(), k, D.data(), Iref.data());
+
+    std::unique_ptr<Index> index2;
+    search_mmapped(index, xq.data(), I, index2);
+    EXPECT_EQ(I, Iref);
+    IndexHNSWFlat* index_hnsw = dynamic_cast<IndexHNSWFlat*>(index2.get());
+    EXPECT_FALSE(index_hnsw->hnsw.level0_codes.is_owned());
+}
+
+TEST(MMAP, nsg) {
+    std::vector<float> xb = make_data(nb, 123);
+    std::vector<float> xq = make_data(nq, 456);
+
+    IndexNSGFlat index(d, 16);
+    index.add(nb, xb.data());
+    std::vector<idx_t> Iref(nq * k), I;
+    std::vector<float> D(nq * k);
+    index.search(nq, xq.data(), k, D.data(), Iref.data());
+
+    // the default format is read into memory
+    std::unique_ptr<Index> index2;
+    search_mmapped(index, xq.data(), I, index2);
+    EXPECT_EQ(I, Iref);
+    IndexNSGFlat* index_nsg = dynamic_cast<IndexNSGFlat*>(index2.get());
+    ASSERT_TRUE(index_nsg);
+    EXPECT_TRUE(index_nsg->nsg.final_graph->own_fields);
+
+    search_mmapped(index, xq.data(), I, index2, IO_FLAG_WRITE_DENSE_NSG);
+    EXPECT_EQ(I, Iref);
+    index_nsg = dynamic_cast<IndexNSGFlat*>(index2.get());
+    ASSERT_TRUE(index_nsg);
+    EXPECT_FALSE(index_nsg->nsg.final_graph->own_fields);
+    auto storage = dynamic_cast<IndexFlatCodes*>(index_nsg->storage);
+    EXPECT_FALSE(storage->codes.is_owned());
+}
+
+TEST(MMAP, copy_is_owned) {
+    std::vector<float> xb = make_data(nb, 123);
+    IndexFlatL2 index(d);
+    index.add(nb, xb.data());
+
+    Tempfilename fname;
+    write_index(&index, fname.c_str());
+    std::unique_ptr<IndexFlatL2> index2(dynamic_cast<IndexFlatL2*>(
+            read_index(fname.c_str(), IO_FLAG_MMAP_IFC)));
+    ASSERT_TRUE(index2);
+    EXPECT_FALSE(index2->codes.is_owned());
+
+    // modifying a copy must not change the mapped index
+    IndexFlatL2 index3(*index2);
+    EXPECT_TRUE(index3.codes.is_owned());
+    index3.get_xb()[0] = -1;
+    EXPECT_EQ(index2->get_xb()[0], xb[0]);
+}
@@ -5,11 +5,16 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <atomic>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
+#include <memory>
 #include <random>
+#include <thread>
 
 #include <omp.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <pthread.h>
@@ -19,10 +24,14 @@
 
 #include <faiss/IndexFlat.h>
 #include <faiss/IndexIVFFlat.h>
+#include <faiss/impl/FaissException.h>
 #include <faiss/index_io.h>
 #include <faiss/invlists/OnDiskInvertedLists.h>
+#include <faiss/invlists/TieredInvertedLists.h>
 #include <faiss/utils/random.h>
 
+#include "test_util.h"
+
 namespace {
 
 struct Tempfilename {
@@ -155,8 +164,146 @@ TEST(ONDISK, test_add) {
 
         delete index3;
     }
+
+    // test reading the lists with pread
+    for (int io_flags :
+         {faiss::IO_FLAG_ONDISK_ASYNC_READ, faiss::IO_FLAG_ONDISK_DIRECT_IO}) {
+        std::unique_ptr<faiss::Index> index3(
+                faiss::read_index(filename2.c_str(), io_flags));
+        auto ivf3 = dynamic_cast<faiss::IndexIVF*>(index3.get());
+        auto invlists = dynamic_cast<faiss::AsyncOnDiskInvertedLists*>(
+                ivf3->invlists);
+        ASSERT_TRUE(invlists);
+        EXPECT_EQ(invlists->direct_io,
+                  io_flags == faiss::IO_FLAG_ONDISK_DIRECT_IO);
+        // small cache: the lists are evicted and read again
+        invlists->cache_size = 4096;
+
+        std::vector<float> new_D(nq * k);
+        std::vector<faiss::idx_t> new_I(nq * k);
+
+        index3->search(nq, xq.data(), k, new_D.data(), new_I.data());
+
+        EXPECT_EQ(ref_D, new_D);
+        EXPECT_EQ(ref_I, new_I);
+        EXPECT_GE(invlists->get_nbytes_read(), nb * index.code_size);
+
+        // the index can be written back
+        Tempfilename filename3;
+        write_index(index3.get(), filename3.c_str());
+        std::unique_ptr<faiss::Index> index4(
+                faiss::read_index(filename3.c_str()));
+        index4->search(nq, xq.data(), k, new_D.data(), new_I.data());
+        EXPECT_EQ(ref_I, new_I);
+    }
 };
 
+TEST(ONDISK, tiered_invlists) {
+    int d = 8;
+    int nlist = 30, nq = 200, nb = 3000, k = 10;
+    faiss::IndexFlatL2 quantizer(d);
+    {
+        std::vector<float> x(d * nlist);
+        faiss::float_rand(x.data(), d * nlist, 12345);
+        quantizer.add(nlist, x.data());
+    }
+    std::vector<float> xb(d * nb);
+    faiss::float_rand(xb.data(), d * nb, 23456);
+    std::vector<float> xq(d * nq);
+    faiss::float_rand(xq.data(), d * nq, 34567);
+
+    Tempfilename filename;
+    faiss::IndexIVFFlat index(&quantizer, d, nlist);
+    faiss::OnDiskInvertedLists ivf(
+            index.nlist, index.code_size, filename.c_str());
+    index.replace_invlists(&ivf);
+    index.add(nb, xb.data());
+    index.nprobe = 2;
+
+    std::vector<float> ref_D(nq * k), new_D(nq * k);
+    std::vector<faiss::idx_t> ref_I(nq * k), new_I(nq * k);
+    index.search(nq, xq.data(), k, ref_D.data(), ref_I.data());
+
+    size_t entry_size = index.code_size + sizeof(faiss::idx_t);
+    size_t cache_size = nb / 2 * entry_size;
+
+    for (auto policy :
+         {faiss::TieredInvertedLists::LFU, faiss::TieredInvertedLists::LRU}) {
+        faiss::TieredInvertedLists tiered(&ivf, cache_size, policy, 0);
+        index.replace_invlists(&tiered);
+
+        // everything is cold
+        index.search(nq, xq.data(), k, new_D.data(), new_I.data());
+        EXPECT_EQ(ref_I, new_I);
+        EXPECT_EQ(tiered.get_nhot_access(), 0);
+        EXPECT_EQ(tiered.get_naccess(), nq * index.nprobe);
+
+        // queries on a few lists only
+        for (int i = 0; i < 10; i++) {
+            index.search(3, xq.data(), k, new_D.data(), new_I.data());
+        }
+        tiered.update_tiers();
+        EXPECT_GT(tiered.get_hot_bytes(), 0);
+        EXPECT_LE(tiered.get_hot_bytes(), cache_size);
+        std::vector<faiss::idx_t> keys(3 * index.nprobe);
+        std::vector<float> coarse_dis(3 * index.nprobe);
+        quantizer.search(
+                3, xq.data(), index.nprobe, coarse_dis.data(), keys.data());
+        size_t nhot = 0;
+        for (faiss::idx_t key : keys) {
+            nhot += tiered.is_hot(key);
+        }
+        EXPECT_GE(nhot, keys.size() / 2);
+
+        // same results with a part of the lists in RAM
+        size_t nhot_access = tiered.get_nhot_access();
+        index.search(nq, xq.data(), k, new_D.data(), new_I.data());
+        EXPECT_EQ(ref_I, new_I);
+        EXPECT_EQ(ref_D, new_D);
+        EXPECT_GT(tiered.get_nhot_access(), nhot_access);
+    }
+
+    // promotion and demotion in the background during the searches
+    {
+        faiss::TieredInvertedLists tiered(
+                &ivf, cache_size, faiss::TieredInvertedLists::LFU, 1);
+        index.replace_invlists(&tiered);
+        for (int i = 0; i < 20; i++) {
+            index.search(nq, xq.data(), k, new_D.data(), new_I.data());
+            EXPECT_EQ(ref_I, new_I);
+        }
+        EXPECT_LE(tiered.get_hot_bytes(), cache_size);
+    }
+
+    // the same lists promoted and demoted repeatedly during the searches
+    {
+        faiss::TieredInvertedLists tiered(
+                &ivf, cache_size, faiss::TieredInvertedLists::LRU, 0);
+        index.replace_invlists(&tiered);
+        std::atomic<bool> stop(false);
+        std::atomic<size_t> max_hot_bytes(0);
+        std::thread updater([&]() {
+            for (int i = 0; !stop; i++) {
+                tiered.cache_size = i % 2 == 0 ? cache_size : 0;
+                tiered.update_tiers();
+                size_t hot_bytes = tiered.get_hot_bytes();
+                if (hot_bytes > max_hot_bytes) {
+                    max_hot_bytes = hot_bytes;
+                }
+            }
+        });
+        for (int i = 0; i < 50; i++) {
+            index.search(nq, xq.data(), k, new_D.data(), new_I.data());
+            EXPECT_EQ(ref_I, new_I);
+        }
+        stop = true;
+        updater.join();
+        EXPECT_GT(max_hot_bytes, 0);
+        EXPECT_LE(max_hot_bytes, cache_size);
+    }
+    index.replace_invlists(&ivf);
+}
+
 // WARN this thest will run multithreaded only in opt mode
 TEST(ONDISK, make_invlists_threaded) {
     int nlist = 100;
@@ -205,3 +352,287 @@ TEST(ONDISK, make_invlists_threaded) {
     }
     EXPECT_EQ(ntot, nadd);
 };
+
+namespace {
+
+/// random updates applied to both inverted lists
+void random_updates(
+        faiss::InvertedLists& ref,
+        faiss::InvertedLists& il,
+        int nupdate,
+        std::mt19937& rng) {
+    size_t code_size = ref.code_size;
+    std::vector<uint8_t> codes(code_size * 50);
+    std::vector<faiss::idx_t> ids(50);
+    for (int iter = 0; iter < nupdate; iter++) {
+        size_t list_no = rng() % ref.nlist;
+        size_t n = rng() % 50;
+        for (size_t j = 0; j < n; j++) {
+            ids[j] = rng();
+        }
+        for (size_t j = 0; j < n * code_size; j++) {
+            codes[j] = rng();
+        }
+        size_t ls = ref.list_size(list_no);
+        switch (rng() % 4) {
+            case 0:
+            case 1:
+                ref.add_entries(list_no, n, ids.data(), codes.data());
+                il.add_entries(list_no, n, ids.data(), codes.data());
+                break;
+            case 2:
+                if (ls > 0) {
+                    size_t offset = rng() % ls;
+                    n = std::min(n, ls - offset);
+                    ref.update_entries(
+                            list_no, offset, n, ids.data(), codes.data());
+                    il.update_entries(
+                            list_no, offset, n, ids.data(), codes.data());
+                }
+                break;
+            case 3:
+                ls = ls > 0 ? rng() % ls : 0;
+                ref.resize(list_no, ls);
+                il.resize(list_no, ls);
+                break;
+        }
+    }
+}
+
+} // namespace
+
+TEST(ONDISK, journal_recovery) {
+    size_t nlist = 20, code_size = 12;
+    Tempfilename filename;
+    faiss::ArrayInvertedLists ref(nlist, code_size);
+    std::mt19937 rng(123);
+
+    {
+        faiss::OnDiskInvertedLists ivf(nlist, code_size, filename.c_str());
+        ivf.checkpoint_interval = 50;
+        ivf.enable_journal();
+        random_updates(ref, ivf, 320, rng);
+        faiss::check_same_invlists(ref, ivf);
+        // the object is destroyed without a checkpoint, as in a crash:
+        // the last 20 updates are only in the log
+    }
+
+    // a torn record at the end of the log is ignored
+    {
+        std::string walname = filename.filename + ".wal";
+        FILE* f = fopen(walname.c_str(), "ab");
+        ASSERT_TRUE(f);
+        uint32_t garbage[5] = {1, 2, 3, 4, 5};
+        fwrite(garbage, sizeof(garbage), 1, f);
+        fclose(f);
+    }
+
+    {
+        faiss::OnDiskInvertedLists ivf(nlist, code_size, filename.c_str());
+        ivf.enable_journal();
+        faiss::check_same_invlists(ref, ivf);
+
+        // continue updating after the recovery
+        random_updates(ref, ivf, 30, rng);
+        faiss::check_same_invlists(ref, ivf);
+    }
+
+    // recovery when reading an index that refers to the lists
+    Tempfilename index_filename;
+    {
+        // code_size = 3 * sizeof(float)
+        faiss::IndexFlatL2 quantizer(3);
+        faiss::IndexIVFFlat index(&quantizer, 3, nlist);
+        index.is_trained = true;
+        faiss::OnDiskInvertedLists* ivf = new faiss::OnDiskInvertedLists(
+                nlist, code_size, filename.c_str());
+        ivf->enable_journal();
+        index.replace_invlists(ivf, true);
+        faiss::write_index(&index, index_filename.c_str());
+        // the metadata of the index file is stale after these
+        random_updates(ref, *ivf, 30, rng);
+    }
+    {
+        std::unique_ptr<faiss::Index> index(
+                faiss::read_index(index_filename.c_str()));
+        auto ivf = dynamic_cast<faiss::OnDiskInvertedLists*>(
+                dynamic_cast<faiss::IndexIVF*>(index.get())->invlists);
+        ASSERT_TRUE(ivf);
+        faiss::check_same_invlists(ref, *ivf);
+    }
+    {
+        // read-only readers see the last checkpoint
+        std::unique_ptr<faiss::Index> index(faiss::read_index(
+                index_filename.c_str(), faiss::IO_FLAG_READ_ONLY));
+        auto ivf = dynamic_cast<faiss::OnDiskInvertedLists*>(
+                dynamic_cast<faiss::IndexIVF*>(index.get())->invlists);
+        faiss::check_same_invlists(ref, *ivf);
+    }
+    unlink(index_filename.c_str());
+
+    unlink((filename.filename + ".wal").c_str());
+    unlink((filename.filename + ".ckpt").c_str());
+}
+
+namespace {
+
+size_t total_size(const faiss::Index* index) {
+    const faiss::InvertedLists* il =
+            dynamic_cast<const faiss::IndexIVF*>(index)->invlists;
+    size_t tot = 0;
+    for (size_t i = 0; i < il->nlist; i++) {
+        tot += il->list_size(i);
+    }
+    return tot;
+}
+
+} // namespace
+
+// the adds of an IndexIVF are journaled by batch, the read-only readers
+// refuse a log with updates that are not checkpointed and the journal
+// files of a data file that was rebuilt are refused
+TEST(ONDISK, journal_batches) {
+    int d = 8, nlist = 10, nb = 500;
+    faiss::IndexFlatL2 quantizer(d);
+    {
+        std::vector<float> x(d * nlist);
+        faiss::float_rand(x.data(), d * nlist, 12345);
+        quantizer.add(nlist, x.data());
+    }
+    std::vector<float> xb(d * nb);
+    faiss::float_rand(xb.data(), d * nb, 23456);
+    Tempfilename filename, index_filename;
+    std::string walname = filename.filename + ".wal";
+    std::string ckptname = filename.filename + ".ckpt";
+
+    {
+        faiss::IndexIVFFlat index(&quantizer, d, nlist);
+        auto ivf = new faiss::OnDiskInvertedLists(
+                nlist, index.code_size, filename.c_str());
+        ivf->checkpoint_interval = 100;
+        ivf->enable_journal();
+        index.replace_invlists(ivf, true);
+        faiss::write_index(&index, index_filename.c_str());
+
+        // checkpointed at the end of the batch: the log is empty
+        index.add(nb, xb.data());
+        struct stat buf;
+        ASSERT_EQ(stat(walname.c_str(), &buf), 0);
+        EXPECT_LE(buf.st_size, 16);
+        // these are only in the log
+        index.add(10, xb.data());
+    }
+
+    EXPECT_THROW(
+            faiss::read_index(
+                    index_filename.c_str(), faiss::IO_FLAG_READ_ONLY),
+            faiss::FaissException);
+    EXPECT_THROW(
+            faiss::read_index(
+                    index_filename.c_str(), faiss::IO_FLAG_ONDISK_ASYNC_READ),
+            faiss::FaissException);
+    {
+        std::unique_ptr<faiss::Index> index(
+                faiss::read_index(index_filename.c_str()));
+        EXPECT_EQ(total_size(index.get()), nb + 10);
+    }
+    {
+        std::unique_ptr<faiss::Index> index(faiss::read_index(
+                index_filename.c_str(), faiss::IO_FLAG_READ_ONLY));
+        EXPECT_EQ(total_size(index.get()), nb + 10);
+    }
+
+    // rebuild the data file
+    {
+        faiss::OnDiskInvertedLists ivf(
+                nlist, d * sizeof(float), filename.c_str());
+        std::vector<faiss::idx_t> ids(20);
+        ivf.add_entries(0, 20, ids.data(), (const uint8_t*)xb.data());
+    }
+    EXPECT_THROW(
+            faiss::read_index(index_filename.c_str()), faiss::FaissException);
+    {
+        faiss::OnDiskInvertedLists ivf(
+                nlist, d * sizeof(float), filename.c_str());
+        EXPECT_THROW(ivf.enable_journal(), faiss::FaissException);
+    }
+
+    unlink(index_filename.c_str());
+    unlink(walname.c_str());
+    unlink(ckptname.c_str());
+}
+
+TEST(ONDISK, merge_from_files) {
+    int d = 8, nlist = 30, nb = 1000, nshard = 4;
+    faiss::IndexFlatL2 quantizer(d);
+    {
+        std::vector<float> x(d * nlist);
+        faiss::float_rand(x.data(), d * nlist, 12345);
+        quantizer.add(nlist, x.data());
+    }
+    std::vector<float> xb(d * nb);
+    faiss::float_rand(xb.data(), d * nb, 23456);
+
+    std::vector<Tempfilename> index_fnames(nshard);
+    Tempfilename shard_data_fname, merged_fname;
+    faiss::ArrayInvertedLists ref(nlist, d * sizeof(float));
+
+    for (int s = 0; s < nshard; s++) {
+        faiss::IndexIVFFlat index(&quantizer, d, nlist);
+        if (s == nshard - 1) {
+            // an OnDiskInvertedLists shard, with capacity > size
+            index.replace_invlists(
+                    new faiss::OnDiskInvertedLists(
+                            nlist, index.code_size, shard_data_fname.c_str()),
+                    true);
+        }
+        int i0 = s * nb / nshard, i1 = (s + 1) * nb / nshard;
+        for (int i = i0; i < i1; i += 50) {
+            std::vector<faiss::idx_t> ids(50);
+            for (int j = 0; j < 50; j++) {
+                ids[j] = i + j;
+            }
+            index.add_with_ids(50, xb.data() + i * d, ids.data());
+        }
+        for (int j = 0; j < nlist; j++) {
+            size_t ls = index.invlists->list_size(j);
+            if (ls > 0) {
+                ref.add_entries(
+                        j,
+                        ls,
+                        faiss::InvertedLists::ScopedIds(index.invlists, j)
+                                .get(),
+                        faiss::InvertedLists::ScopedCodes(index.invlists, j)
+                                .get());
+            }
+        }
+        faiss::write_index(&index, index_fnames[s].c_str());
+    }
+
+    // the shards are read without loading their data
+    std::vector<std::unique_ptr<faiss::Index>> shards;
+    std::vector<const faiss::InvertedLists*> ils;
+    for (int s = 0; s < nshard; s++) {
+        shards.emplace_back(faiss::read_index(
+                index_fnames[s].c_str(), faiss::IO_FLAG_MMAP));
+        ils.push_back(
+                dynamic_cast<faiss::IndexIVF*>(shards.back().get())->invlists);
+    }
+
+    // small buffers: the lists are copied piece by piece, large buffers:
+    // several lists are written at once
+    for (size_t buffer_size : {100, 5000, 1 << 20}) {
+        faiss::OnDiskInvertedLists merged(
+                nlist, d * sizeof(float), merged_fname.c_str());
+        EXPECT_EQ(
+                merged.merge_from_files(ils.data(), nshard, buffer_size),
+                nb);
+        faiss::check_same_invlists(ref, merged);
+        unlink(merged_fname.c_str());
+    }
+
+    for (int s = 0; s < nshard; s++) {
+        unlink(index_fnames[s].c_str());
+    }
+    unlink(shard_data_fname.c_str());
+}
@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexPQ.h>
+#include <faiss/IndexPQFastScan.h>
+#include <faiss/utils/AlignedTable.h>
+#include <faiss/impl/pq4_fast_scan.h>
+#include <faiss/utils/random.h>
+
+namespace faiss {
+
+// defined in pq4_fast_scan_search_qbs.cpp
+void accumulate_to_mem(
+        int nq,
+        size_t ntotal2,
+        int nsq,
+        const uint8_t* codes,
+        const uint8_t* LUT,
+        uint16_t* accu);
+
+} // namespace faiss
+
+using namespace faiss;
+
+// the SIMD kernels should give exactly the sums of the LUT entries. The
+// numbers of sub-quantizers exercise the 4-by-4 loop of the AVX-512 kernel
+// and its remainder.
+TEST(PQ4FastScan, accumulate_to_mem) {
+    std::mt19937 rng(123);
+    size_t ntotal = 80, bbs = 32, nb = 96;
+
+    for (int nsq : {2, 4, 6, 8, 10, 16}) {
+        std::vector<uint8_t> codes(ntotal * nsq / 2);
+        for (auto& c : codes) {
+            c = rng();
+        }
+        AlignedTable<uint8_t> packed(nb * nsq / 2);
+        pq4_pack_codes(
+                codes.data(), ntotal, nsq, nb, bbs, nsq, packed.get());
+
+        for (int nq = 1; nq <= 4; nq++) {
+            std::vector<uint8_t> LUT(nq * nsq * 16);
+            for (auto& v : LUT) {
+                v = rng();
+            }
+            AlignedTable<uint8_t> LUT_packed(nq * nsq * 16);
+            pq4_pack_LUT(nq, nsq, LUT.data(), LUT_packed.get());
+
+            AlignedTable<uint16_t> accu(nq * nb);
+            accumulate_to_mem(
+                    nq, nb, nsq, packed.get(), LUT_packed.get(), accu.get());
+
+            for (int q = 0; q < nq; q++) {
+                for (size_t j = 0; j < ntotal; j++) {
+                    int ref = 0;
+                    for (int sq = 0; sq < nsq; sq++) {
+                        int c = pq4_get_packed_element(
+                                packed.get(), bbs, nsq, j, sq);
+                        ref += LUT[(q * nsq + sq) * 16 + c];
+                    }
+                    ASSERT_EQ(ref, accu[q * nb + j])
+                            << "nsq=" << nsq << " nq=" << nq << " j=" << j;
+                }
+            }
+        }
+    }
+}
+
+// the qbs kernels (implem 12, 13) and the kernels with larger database
+// blocks (implem 14, 15) compute the same distances
+TEST(PQ4FastScan, search_implems) {
+    int d = 24, nt = 2000, nb = 1000, nq = 30, k = 10;
+    std::vector<float> xt(d * nt), xb(d * nb), xq(d * nq);
+    float_rand(xt.data(), xt.size(), 123);
+    float_rand(xb.data(), xb.size(), 456);
+    float_rand(xq.data(), xq.size(), 789);
+
+    for (int M : {6, 8, 12}) {
+        IndexPQ index_pq(d, M, 4);
+        index_pq.train(nt, xt.data());
+        index_pq.add(nb, xb.data());
+
+        IndexPQFastScan index(index_pq, 32);
+        std::vector<float> Dref(nq * k), D(nq * k);
+        std::vector<idx_t> Iref(nq * k), I(nq * k);
+        index.implem = 12;
+        index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+        for (int bbs : {32, 64, 96}) {
+            IndexPQFastScan index2(index_pq, bbs);
+            for (int implem : {12, 13, 14, 15}) {
+                if (implem < 14 && bbs != 32) {
+                    continue;
+                }
+                index2.implem = implem;
+                if (bbs == 32) {
+                    index2.search(nq, xq.data(), k, D.data(), I.data());
+                } else {
+                    // larger blocks are instantiated only for 1 query
+                    for (int q = 0; q < nq; q++) {
+                        index2.search(
+                                1,
+                                xq.data() + q * d,
+                                k,
+                                D.data() + q * k,
+                                I.data() + q * k);
+                    }
+                }
+                EXPECT_EQ(Dref, D)
+                        << "M=" << M << " bbs=" << bbs << " implem=" << implem;
+                EXPECT_EQ(Iref, I)
+                        << "M=" << M << " bbs=" << bbs << " implem=" << implem;
+            }
+        }
+    }
+}
@@ -0,0 +1,222 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexFlat.h>
+#include <faiss/IndexHNSW.h>
+#include <faiss/IndexIVF.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/index_factory.h>
+#include <faiss/impl/FaissException.h>
+#include <faiss/impl/ScalarQuantizer.h>
+#include <faiss/utils/bf16.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/random.h>
+
+using namespace faiss;
+
+namespace {
+
+typedef ScalarQuantizer::QuantizerType QuantizerType;
+
+// distances between the queries and the decoded database vectors
+std::vector<float> reference_distances(
+        const ScalarQuantizer& sq,
+        MetricType metric,
+        const std::vector<float>& xq,
+        const std::vector<uint8_t>& codes) {
+    size_t d = sq.d, nq = xq.size() / d, nb = codes.size() / sq.code_size;
+    std::vector<float> xb(nb * d);
+    sq.decode(codes.data(), xb.data(), nb);
+    std::vector<float> dis(nq * nb);
+    for (size_t i = 0; i < nq; i++) {
+        for (size_t j = 0; j < nb; j++) {
+            const float* x = xq.data() + i * d;
+            const float* y = xb.data() + j * d;
+            dis[i * nb + j] = metric == METRIC_L2 ? fvec_L2sqr(x, y, d)
+                                                  : fvec_inner_product(x, y, d);
+        }
+    }
+    return dis;
+}
+
+} // namespace
+
+// the distance computers of all the SIMD widths (d % 16, d % 8 and other
+// dimensions) compute the distances to the decoded vectors
+TEST(ScalarQuantizer, distance_computers) {
+    size_t nt = 1000, nb = 50, nq = 5;
+    for (size_t d : {12, 24, 32, 48, 80}) {
+        std::vector<float> xt(d * nt), xb(d * nb), xq(d * nq);
+        float_rand(xt.data(), xt.size(), 123);
+        float_rand(xb.data(), xb.size(), 456);
+        float_rand(xq.data(), xq.size(), 789);
+        for (QuantizerType qtype :
+             {ScalarQuantizer::QT_8bit,
+              ScalarQuantizer::QT_4bit,
+              ScalarQuantizer::QT_8bit_uniform,
+              ScalarQuantizer::QT_4bit_uniform,
+              ScalarQuantizer::QT_fp16,
+              ScalarQuantizer::QT_8bit_direct,
+              ScalarQuantizer::QT_6bit,
+              ScalarQuantizer::QT_bf16}) {
+            std::vector<float> xt1 = xt, xb1 = xb, xq1 = xq;
+            if (qtype == ScalarQuantizer::QT_8bit_direct) {
+                // integer values in [0, 255]
+                for (auto* x : {&xt1, &xb1, &xq1}) {
+                    for (float& v : *x) {
+                        v = std::floor(v * 256);
+                    }
+                }
+            }
+            ScalarQuantizer sq(d, qtype);
+            sq.train(nt, xt1.data());
+            std::vector<uint8_t> codes(nb * sq.code_size);
+            sq.compute_codes(xb1.data(), codes.data(), nb);
+            std::vector<float> x0(d);
+            sq.decode(codes.data(), x0.data(), 1);
+
+            for (MetricType metric : {METRIC_L2, METRIC_INNER_PRODUCT}) {
+                std::vector<float> ref =
+                        reference_distances(sq, metric, xq1, codes);
+                std::vector<float> ref_sym =
+                        reference_distances(sq, metric, x0, codes);
+                std::unique_ptr<ScalarQuantizer::SQDistanceComputer> dc(
+                        sq.get_distance_computer(metric));
+                dc->codes = codes.data();
+                dc->code_size = sq.code_size;
+                for (size_t i = 0; i < nq; i++) {
+                    dc->set_query(xq1.data() + i * d);
+                    for (size_t j = 0; j < nb; j++) {
+                        float r = ref[i * nb + j];
+                        ASSERT_NEAR((*dc)(j), r, 1e-4 * (std::abs(r) + 1))
+                                << "d=" << d << " qtype=" << qtype
+                                << " metric=" << metric;
+                    }
+                }
+                for (size_t j = 0; j < nb; j++) {
+                    float r = ref_sym[j];
+                    ASSERT_NEAR(
+                            dc->symmetric_dis(0, j),
+                            r,
+                            1e-4 * (std::abs(r) + 1))
+                            << "d=" << d << " qtype=" << qtype
+                            << " metric=" << metric;
+                }
+            }
+        }
+    }
+}
+
+// with int8_query, the distances are approximate but the search results
+// are close to those of the float kernels, for all the kernel widths
+TEST(ScalarQuantizer, int8_query) {
+    int nt = 2000, nb = 2000, nq = 50, k = 10;
+
+    for (int d : {48, 24, 20}) {
+        std::vector<float> xt(d * nt), xb(d * nb), xq(d * nq);
+        float_rand(xt.data(), xt.size(), 123);
+        float_rand(xb.data(), xb.size(), 456);
+        float_rand(xq.data(), xq.size(), 789);
+
+        for (MetricType metric : {METRIC_L2, METRIC_INNER_PRODUCT}) {
+            IndexScalarQuantizer index(
+                    d, ScalarQuantizer::QT_8bit_uniform, metric);
+            index.train(nt, xt.data());
+            index.add(nb, xb.data());
+
+            std::vector<float> Dref(nq * k), D(nq * k);
+            std::vector<idx_t> Iref(nq * k), I(nq * k);
+            index.search(nq, xq.data(), k, Dref.data(), Iref.data());
+            index.sq.int8_query = true;
+            index.search(nq, xq.data(), k, D.data(), I.data());
+
+            // the error comes from the rounding of the query components,
+            // the relative error grows as 1 / sqrt(d)
+            size_t ninter = 0;
+            double err = 0, tot = 0;
+            for (int i = 0; i < nq; i++) {
+                for (int j = 0; j < k; j++) {
+                    err += std::abs(D[i * k + j] - Dref[i * k + j]);
+                    tot += std::abs(Dref[i * k + j]);
+                    for (int l = 0; l < k; l++) {
+                        ninter += I[i * k + j] == Iref[i * k + l];
+                    }
+                }
+            }
+            EXPECT_GT(err, 0) << "d=" << d << " metric=" << metric;
+            EXPECT_LT(err, tot * 0.005 * std::sqrt(48.0 / d))
+                    << "d=" << d << " metric=" << metric;
+            EXPECT_GT(ninter, nq * k * 0.9)
+                    << "d=" << d << " metric=" << metric;
+        }
+    }
+
+    // only defined for QT_8bit_uniform
+    IndexScalarQuantizer index(16, ScalarQuantizer::QT_8bit);
+    index.sq.int8_query = true;
+    EXPECT_THROW(index.sq.get_distance_computer(), FaissException);
+}
+
+TEST(ScalarQuantizer, bf16_conversion) {
+    // exactly representable values
+    for (float x : {0.f, 1.f, -2.5f, 0.15625f, 3.0e38f, -1.0e-30f}) {
+        float y = decode_bf16(encode_bf16(x));
+        EXPECT_NEAR(y, x, std::abs(x) / 128) << x;
+    }
+    EXPECT_EQ(decode_bf16(encode_bf16(1.f)), 1.f);
+    EXPECT_EQ(decode_bf16(encode_bf16(-2.5f)), -2.5f);
+    // round to nearest even: 1 + 2^-8 is halfway between 1 and 1 + 2^-7
+    EXPECT_EQ(decode_bf16(encode_bf16(1.f + 1.f / 256)), 1.f);
+    EXPECT_EQ(
+            decode_bf16(encode_bf16(1.f + 3.f / 256)), 1.f + 1.f / 64);
+    EXPECT_EQ(decode_bf16(encode_bf16(1.f + 1.5f / 256)), 1.f + 1.f / 128);
+    // the range of float32 is preserved
+    EXPECT_TRUE(std::isinf(decode_bf16(encode_bf16(INFINITY))));
+    EXPECT_TRUE(std::isnan(decode_bf16(encode_bf16(NAN))));
+}
+
+// SQbf16 from the index factory, flat, IVF and HNSW
+TEST(ScalarQuantizer, bf16_indexes) {
+    int d = 32, nt = 2000, nb = 2000, nq = 20, k = 5;
+    std::vector<float> xt(d * nt), xb(d * nb), xq(d * nq);
+    float_rand(xt.data(), xt.size(), 123);
+    float_rand(xb.data(), xb.size(), 456);
+    float_rand(xq.data(), xq.size(), 789);
+
+    IndexFlatL2 index_ref(d);
+    index_ref.add(nb, xb.data());
+    std::vector<float> Dref(nq * k), D(nq * k);
+    std::vector<idx_t> Iref(nq * k), I(nq * k);
+    index_ref.search(nq, xq.data(), k, Dref.data(), Iref.data());
+
+    for (const char* key : {"SQbf16", "IVF16,SQbf16", "HNSW16_SQbf16"}) {
+        std::unique_ptr<Index> index(index_factory(d, key));
+        index->train(nt, xt.data());
+        index->add(nb, xb.data());
+        if (auto* index_ivf = dynamic_cast<IndexIVF*>(index.get())) {
+            index_ivf->nprobe = 16;
+        }
+        if (auto* index_hnsw = dynamic_cast<IndexHNSW*>(index.get())) {
+            index_hnsw->hnsw.efSearch = 64;
+        }
+        index->search(nq, xq.data(), k, D.data(), I.data());
+        int n1 = 0;
+        for (int i = 0; i < nq; i++) {
+            if (I[i * k] == Iref[i * k]) {
+                n1++;
+                EXPECT_NEAR(D[i * k], Dref[i * k], 1e-2 * Dref[i * k]) << key;
+            }
+        }
+        EXPECT_GE(n1, nq * 0.9) << key;
+    }
+}
@@ -0,0 +1,136 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include <cmath>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include <faiss/IndexPQ.h>
+#include <faiss/IndexPQFastScan.h>
+#include <faiss/IndexScalarQuantizer.h>
+#include <faiss/impl/FaissAssert.h>
+#include <faiss/utils/distances.h>
+#include <faiss/utils/hamming.h>
+#include <faiss/utils/random.h>
+#include <faiss/utils/simd_levels.h>
+#include <faiss/utils/utils.h>
+
+using namespace faiss;
+
+namespace {
+
+/// restores the SIMD level at the end of the scope
+struct SIMDLevelGuard {
+    SIMDLevel level = get_simd_level();
+    ~SIMDLevelGuard() {
+        set_simd_level(level);
+    }
+};
+
+std::vector<SIMDLevel> supported_levels() {
+    std::vector<SIMDLevel> levels;
+    for (SIMDLevel level :
+         {SIMDLevel::NONE, SIMDLevel::AVX2, SIMDLevel::AVX512}) {
+        if (simd_level_supported(level)) {
+            levels.push_back(level);
+        }
+    }
+    return levels;
+}
+
+} // namespace
+
+TEST(SIMDLevels, get_set) {
+    SIMDLevelGuard guard;
+    EXPECT_TRUE(simd_level_supported(get_simd_level()));
+    EXPECT_LE(int(get_simd_level()), int(detect_simd_level()));
+    for (SIMDLevel level : supported_levels()) {
+        set_simd_level(level);
+        EXPECT_EQ(get_simd_level(), level);
+        // the compile options report the level in use
+        std::string options = get_compile_options();
+        EXPECT_NE(options.find(simd_level_name(level)), std::string::npos)
+                << options;
+    }
+    if (!simd_level_supported(SIMDLevel::AVX512)) {
+        EXPECT_THROW(set_simd_level(SIMDLevel::AVX512), FaissException);
+    }
+}
+
+// all the levels compute the same results, up to float rounding
+TEST(SIMDLevels, same_results) {
+    SIMDLevelGuard guard;
+    int d = 32, nt = 2000, nb = 1000, nq = 20, k = 10;
+    std::vector<float> xt(d * nt), xb(d * nb), xq(d * nq);
+    float_rand(xt.data(), xt.size(), 123);
+    float_rand(xb.data(), xb.size(), 456);
+    float_rand(xq.data(), xq.size(), 789);
+
+    std::mt19937 rng(123);
+    size_t ncodes = 16;
+    std::vector<uint8_t> codes_b(nb * ncodes), codes_q(nq * ncodes);
+    for (auto& c : codes_b) {
+        c = rng();
+    }
+    for (auto& c : codes_q) {
+        c = rng();
+    }
+
+    IndexScalarQuantizer index_sq(d, ScalarQuantizer::QT_8bit);
+    index_sq.train(nt, xt.data());
+    index_sq.add(nb, xb.data());
+
+    IndexPQ index_pq(d, 16, 4);
+    index_pq.train(nt, xt.data());
+    index_pq.add(nb, xb.data());
+    IndexPQFastScan index_fs(index_pq);
+
+    std::vector<float> dis_ref, D_sq_ref, D_fs_ref;
+    std::vector<hamdis_t> hdis_ref;
+    std::vector<idx_t> I_fs_ref;
+
+    for (SIMDLevel level : supported_levels()) {
+        set_simd_level(level);
+        const char* name = simd_level_name(level);
+
+        std::vector<float> dis(nq * nb);
+        for (int i = 0; i < nq; i++) {
+            fvec_L2sqr_ny(
+                    dis.data() + i * nb, xq.data() + i * d, xb.data(), d, nb);
+        }
+
+        std::vector<hamdis_t> hdis(nq * nb);
+        hammings(codes_q.data(), codes_b.data(), nq, nb, ncodes, hdis.data());
+
+        std::vector<float> D_sq(nq * k), D_fs(nq * k);
+        std::vector<idx_t> I_sq(nq * k), I_fs(nq * k);
+        index_sq.search(nq, xq.data(), k, D_sq.data(), I_sq.data());
+        index_fs.search(nq, xq.data(), k, D_fs.data(), I_fs.data());
+
+        if (dis_ref.empty()) {
+            dis_ref = dis;
+            hdis_ref = hdis;
+            D_sq_ref = D_sq;
+            D_fs_ref = D_fs;
+            I_fs_ref = I_fs;
+            continue;
+        }
+        for (size_t i = 0; i < dis.size(); i++) {
+            ASSERT_NEAR(dis[i], dis_ref[i], 1e-5 * dis_ref[i]) << name;
+        }
+        EXPECT_EQ(hdis, hdis_ref) << name;
+        for (size_t i = 0; i < D_sq.size(); i++) {
+            ASSERT_NEAR(D_sq[i], D_sq_ref[i], 1e-5 * D_sq_ref[i]) << name;
+        }
+        // the fast-scan distances are integers before the final scaling
+        EXPECT_EQ(D_fs, D_fs_ref) << name;
+        EXPECT_EQ(I_fs, I_fs_ref) << name;
+    }
+}
@@ -28,3 +28,39 @@ TEST(TEST_SIMDLIB, TestCmpltAndBlendInplace) {
     ASSERT_EQ(lowestValues, expectedValues);
     ASSERT_EQ(lowestIndices, expectedIndices);
 }
+
+#if defined(__AVX512F__) && defined(__AVX512BW__)
+
+// the 512-bit operations are consistent with the 256-bit ones
+TEST(TEST_SIMDLIB, Avx512ConsistentWithAvx2) {
+    ALIGNED(64) uint8_t bytes[64];
+    ALIGNED(64) uint8_t idx[64];
+    for (int i = 0; i < 64; i++) {
+        bytes[i] = i * 7 + 3;
+        idx[i] = (i * 13) & 15;
+    }
+    simd64uint8 lut(bytes), c(idx);
+    simd64uint8 res = lut.lookup_4_lanes(c);
+    simd32uint8 res_lo = simd32uint8(bytes).lookup_2_lanes(simd32uint8(idx));
+    simd32uint8 res_hi =
+            simd32uint8(bytes + 32).lookup_2_lanes(simd32uint8(idx + 32));
+    for (int i = 0; i < 32; i++) {
+        EXPECT_EQ(res[i], res_lo[i]);
+        EXPECT_EQ(res[i + 32], res_hi[i]);
+    }
+
+    simd32uint16 d(res);
+    simd16uint16 thr16(uint16_t(20000));
+    simd32uint16 thr32(uint16_t(20000));
+    EXPECT_EQ(cmp_ge32(d, thr32), cmp_ge32(d.low(), d.high(), thr16));
+    EXPECT_EQ(cmp_le32(d, thr32), cmp_le32(d.low(), d.high(), thr16));
+
+    simd32uint16 s = (d >> 8) + d;
+    simd16uint16 s_lo = (d.low() >> 8) + d.low();
+    for (int i = 0; i < 16; i++) {
+        EXPECT_EQ(s[i], s_lo[i]);
+    }
+    EXPECT_EQ(simd32uint16(d.low(), d.high()).hex(), d.hex());
+}
+
+#endif
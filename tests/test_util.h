@@ -0,0 +1,40 @@
+/**
+ * Copyright (c) Facebook, Inc. and its affiliates.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstring>
+
+#include <gtest/gtest.h>
+
+#include <faiss/invlists/InvertedLists.h>
+
+namespace faiss {
+
+/// compare all the entries of two inverted lists
+inline void check_same_invlists(
+        const InvertedLists& a,
+        const InvertedLists& b) {
+    ASSERT_EQ(a.nlist, b.nlist);
+    ASSERT_EQ(a.code_size, b.code_size);
+    for (size_t i = 0; i < a.nlist; i++) {
+        size_t ls = a.list_size(i);
+        ASSERT_EQ(ls, b.list_size(i));
+        if (ls == 0) {
+            continue;
+        }
+        InvertedLists::ScopedIds ida(&a, i), idb(&b, i);
+        InvertedLists::ScopedCodes codea(&a, i), codeb(&b, i);
+        EXPECT_EQ(memcmp(ida.get(), idb.get(), ls * sizeof(idx_t)), 0);
+        EXPECT_EQ(memcmp(codea.get(), codeb.get(), ls * a.code_size), 0);
+        for (size_t j = 0; j < ls; j++) {
+            EXPECT_EQ(b.get_single_id(i, j), ida[j]);
+        }
+    }
+}
+
+} // namespace faiss